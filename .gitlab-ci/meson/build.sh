@@ -87,7 +87,8 @@ meson compile -j ${FDO_CI_CONCURRENT:-4} || {
 meson install
 
 if [ -n "${TEST_SUITE}" ]; then
-    VRENDTEST_USE_EGL_SURFACELESS=1 meson test --num-processes ${FDO_CI_CONCURRENT:-4} || RET=$?
+    VRENDTEST_USE_EGL_SURFACELESS=1 meson test --num-processes ${FDO_CI_CONCURRENT:-4} \
+        ${MESON_TEST_SUITE:+--suite ${MESON_TEST_SUITE}} || RET=$?
     mkdir -p ${RESULTS_DIR}
     mv -f meson-logs/testlog.txt ${RESULTS_DIR}/
 fi
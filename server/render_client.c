@@ -27,6 +27,18 @@ struct render_context_record {
    struct list_head head;
 };
 
+/* There is a render_pooled_worker for each idle pooled worker.  The worker
+ * has forked, jailed and initialized itself, and is blocked on pool_fd.  A
+ * context is assigned to it by sending the context args and ctx_fd over
+ * pool_fd, after which it becomes a regular context worker.
+ */
+struct render_pooled_worker {
+   struct render_worker *worker;
+   int pool_fd;
+
+   struct list_head head;
+};
+
 static struct render_context_record *
 render_client_find_record(struct render_client *client, uint32_t ctx_id)
 {
@@ -50,6 +62,14 @@ render_client_detach_all_records(struct render_client *client)
                              head)
       free(rec);
    list_inithead(&client->context_records);
+
+   list_for_each_entry_safe (struct render_pooled_worker, pooled, &client->pooled_workers,
+                             head) {
+      close(pooled->pool_fd);
+      free(pooled);
+   }
+   list_inithead(&client->pooled_workers);
+   client->pooled_worker_count = 0;
 }
 
 static void
@@ -72,6 +92,123 @@ render_client_clear_records(struct render_client *client)
       render_client_remove_record(client, rec);
 }
 
+static void
+render_client_clear_pooled_workers(struct render_client *client)
+{
+   struct render_server *srv = client->server;
+
+   list_for_each_entry_safe (struct render_pooled_worker, pooled, &client->pooled_workers,
+                             head) {
+      render_worker_destroy(srv->worker_jail, pooled->worker);
+      close(pooled->pool_fd);
+      free(pooled);
+   }
+   list_inithead(&client->pooled_workers);
+   client->pooled_worker_count = 0;
+}
+
+static bool
+render_client_create_pooled_worker(struct render_client *client)
+{
+   struct render_server *srv = client->server;
+
+   struct render_pooled_worker *pooled = calloc(1, sizeof(*pooled));
+   if (!pooled)
+      return false;
+
+   int socket_fds[2];
+   if (!render_socket_pair(socket_fds)) {
+      free(pooled);
+      return false;
+   }
+
+   struct render_context_args pool_args = {
+      .valid = true,
+      .init_flags = client->init_flags,
+      .ctx_fd = -1,
+      .pool_fd = socket_fds[0],
+   };
+   pooled->worker =
+      render_worker_create(srv->worker_jail, NULL, &pool_args, sizeof(pool_args));
+   if (!pooled->worker) {
+      close(socket_fds[0]);
+      close(socket_fds[1]);
+      free(pooled);
+      return false;
+   }
+
+   if (!render_worker_is_record(pooled->worker)) {
+      /* this is the child process */
+      srv->state = RENDER_SERVER_STATE_SUBPROCESS;
+      *srv->context_args = pool_args;
+
+      free(pooled);
+      render_client_detach_all_records(client);
+
+      close(socket_fds[1]);
+
+      return true;
+   }
+
+   /* this is the parent process */
+   close(socket_fds[0]);
+   pooled->pool_fd = socket_fds[1];
+   list_addtail(&pooled->head, &client->pooled_workers);
+   client->pooled_worker_count++;
+
+   return true;
+}
+
+/* Forks pooled workers until there are worker_pool_size of them.  Workers
+ * initialize themselves in parallel with the server.
+ */
+static void
+render_client_fill_worker_pool(struct render_client *client)
+{
+   struct render_server *srv = client->server;
+
+   while (client->pooled_worker_count < srv->worker_pool_size) {
+      if (!render_client_create_pooled_worker(client)) {
+         render_log("failed to create a pooled worker");
+         break;
+      }
+      if (srv->state == RENDER_SERVER_STATE_SUBPROCESS)
+         break;
+   }
+}
+
+/* Returns a pooled worker that now owns ctx_args, or NULL if there is none. */
+static struct render_worker *
+render_client_assign_pooled_worker(struct render_client *client,
+                                   const struct render_context_args *ctx_args)
+{
+   struct render_server *srv = client->server;
+
+   while (!list_is_empty(&client->pooled_workers)) {
+      struct render_pooled_worker *pooled =
+         list_first_entry(&client->pooled_workers, struct render_pooled_worker, head);
+      list_del(&pooled->head);
+      client->pooled_worker_count--;
+
+      struct render_worker *worker = pooled->worker;
+      struct render_socket socket;
+      render_socket_init(&socket, pooled->pool_fd);
+      const bool ok = render_socket_send_reply_with_fds(&socket, ctx_args,
+                                                        sizeof(*ctx_args),
+                                                        &ctx_args->ctx_fd, 1);
+      render_socket_fini(&socket);
+      free(pooled);
+
+      if (ok)
+         return worker;
+
+      /* the worker died while idle */
+      render_worker_destroy(srv->worker_jail, worker);
+   }
+
+   return NULL;
+}
+
 static void
 init_context_args(struct render_context_args *ctx_args,
                   uint32_t init_flags,
@@ -83,6 +220,7 @@ init_context_args(struct render_context_args *ctx_args,
       .init_flags = init_flags,
       .ctx_id = req->ctx_id,
       .ctx_fd = ctx_fd,
+      .pool_fd = -1,
    };
 
    static_assert(sizeof(ctx_args->ctx_name) == sizeof(req->ctx_name), "");
@@ -125,14 +263,19 @@ render_client_create_context(struct render_client *client,
    struct render_context_args ctx_args;
    init_context_args(&ctx_args, client->init_flags, req, ctx_fd);
 
+   rec->worker = render_client_assign_pooled_worker(client, &ctx_args);
 #ifdef ENABLE_RENDER_SERVER_WORKER_THREAD
-   rec->worker = render_worker_create(srv->worker_jail, render_client_worker_thread,
-                                      &ctx_args, sizeof(ctx_args));
-   if (rec->worker)
-      ctx_fd = -1; /* ownership transferred */
+   if (!rec->worker) {
+      rec->worker = render_worker_create(srv->worker_jail, render_client_worker_thread,
+                                         &ctx_args, sizeof(ctx_args));
+      if (rec->worker)
+         ctx_fd = -1; /* ownership transferred */
+   }
 #else
-   rec->worker = render_worker_create(srv->worker_jail, NULL,
-                                      &ctx_args, sizeof(ctx_args));
+   if (!rec->worker) {
+      rec->worker = render_worker_create(srv->worker_jail, NULL,
+                                         &ctx_args, sizeof(ctx_args));
+   }
 #endif
    if (!rec->worker) {
       render_log("failed to create a context worker");
@@ -208,6 +351,9 @@ render_client_dispatch_create_context(struct render_client *client,
                                           &remote_fd, 1);
    close(remote_fd);
 
+   /* replace the pooled worker, if any, after replying */
+   render_client_fill_worker_pool(client);
+
    return ok;
 }
 
@@ -223,8 +369,14 @@ static bool
 render_client_dispatch_init(struct render_client *client,
                             const union render_client_op_request *req)
 {
+   /* pooled workers were initialized with the old flags */
+   render_client_clear_pooled_workers(client);
+
    client->init_flags = req->init.flags;
    vkr_library_preload_icd();
+
+   render_client_fill_worker_pool(client);
+
    return true;
 }
 
@@ -288,8 +440,10 @@ render_client_destroy(struct render_client *client)
 
    if (srv->state == RENDER_SERVER_STATE_SUBPROCESS) {
       assert(list_is_empty(&client->context_records));
+      assert(list_is_empty(&client->pooled_workers));
    } else {
       render_client_clear_records(client);
+      render_client_clear_pooled_workers(client);
    }
 
    render_socket_fini(&client->socket);
@@ -308,6 +462,7 @@ render_client_create(struct render_server *srv, int client_fd)
    render_socket_init(&client->socket, client_fd);
 
    list_inithead(&client->context_records);
+   list_inithead(&client->pooled_workers);
 
    return client;
 }
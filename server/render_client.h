@@ -15,6 +15,10 @@ struct render_client {
    uint32_t init_flags;
 
    struct list_head context_records;
+
+   /* idle workers waiting for a context, see render_server::worker_pool_size */
+   struct list_head pooled_workers;
+   int pooled_worker_count;
 };
 
 struct render_client *
@@ -5,12 +5,14 @@
 
 #include "render_context.h"
 
+#include <stdalign.h>
 #include <sys/mman.h>
 
 #include "util/u_thread.h"
 #include "virgl_util.h"
 
 #include "render_state.h"
+#include "vkr_library.h"
 
 void
 render_context_update_timeline(struct render_context *ctx,
@@ -132,7 +134,15 @@ render_context_dispatch_init(struct render_context *ctx,
       return false;
 
    const struct render_context_op_init_request *req = &request->init;
-   const int timeline_count = req->shmem_size / sizeof(*ctx->shmem_timelines);
+   const size_t stats_offset = req->stats_offset;
+   const size_t timelines_size = stats_offset ? stats_offset : req->shmem_size;
+   if (timelines_size < sizeof(*ctx->shmem_timelines) || timelines_size > req->shmem_size)
+      return false;
+   if (stats_offset && (stats_offset % alignof(struct virgl_context_stats) ||
+                        req->shmem_size - stats_offset < sizeof(struct virgl_context_stats)))
+      return false;
+
+   const int timeline_count = timelines_size / sizeof(*ctx->shmem_timelines);
    const int shmem_fd = fds[0];
    const int fence_eventfd = fd_count == 2 ? fds[1] : -1;
 
@@ -140,7 +150,16 @@ render_context_dispatch_init(struct render_context *ctx,
    if (shmem_ptr == MAP_FAILED)
       return false;
 
+   /* the context updates them from its creation, and keeps them to itself
+    * when the proxy does not read them
+    */
+   if (stats_offset)
+      ctx->shmem_stats = (struct virgl_context_stats *)((char *)shmem_ptr + stats_offset);
+   else
+      ctx->shmem_stats = &ctx->private_stats;
+
    if (!render_state_create_context(ctx, req->flags, ctx->name_len, ctx->name)) {
+      ctx->shmem_stats = NULL;
       munmap(shmem_ptr, req->shmem_size);
       return false;
    }
@@ -350,11 +369,68 @@ render_context_init(struct render_context *ctx, const struct render_context_args
    return true;
 }
 
+static bool
+render_context_receive_args(int pool_fd, struct render_context_args *out_args)
+{
+   struct render_socket socket;
+   render_socket_init(&socket, pool_fd);
+
+   size_t size;
+   int fd_count;
+   int ctx_fd = -1;
+   bool ok = render_socket_receive_request_with_fds(&socket, out_args, sizeof(*out_args),
+                                                    &size, &ctx_fd, 1, &fd_count);
+   render_socket_fini(&socket);
+
+   if (!ok || size != sizeof(*out_args) || fd_count != 1) {
+      if (ok && fd_count)
+         close(ctx_fd);
+      return false;
+   }
+
+   out_args->ctx_fd = ctx_fd;
+   out_args->pool_fd = -1;
+
+   return out_args->valid && out_args->ctx_id;
+}
+
+/* A pooled worker does everything that does not depend on the context while
+ * it waits: taking the render_state reference, loading the Vulkan loader and
+ * letting it scan the ICDs.  The loader stays resident, so that
+ * vkr_context_create only has to take another reference.
+ */
+static bool
+render_context_main_pooled(const struct render_context_args *pool_args)
+{
+   if (!render_state_init(pool_args->init_flags)) {
+      close(pool_args->pool_fd);
+      return false;
+   }
+
+   struct vulkan_library lib = { 0 };
+   const bool lib_loaded = vkr_library_load(&lib);
+   vkr_library_preload_icd();
+
+   struct render_context_args args;
+   bool ok = render_context_receive_args(pool_args->pool_fd, &args);
+   if (ok)
+      ok = render_context_main(&args);
+
+   if (lib_loaded)
+      vkr_library_unload(&lib);
+   render_state_fini();
+
+   return ok;
+}
+
 bool
 render_context_main(const struct render_context_args *args)
 {
    struct render_context ctx;
 
+   if (args->pool_fd >= 0)
+      return render_context_main_pooled(args);
+
    assert(args->valid && args->ctx_id && args->ctx_fd >= 0);
 
    if (!render_state_init(args->init_flags)) {
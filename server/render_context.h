@@ -22,6 +22,9 @@ struct render_context {
    size_t shmem_size;
    void *shmem_ptr;
    atomic_uint *shmem_timelines;
+   /* in the shmem, or private_stats */
+   struct virgl_context_stats *shmem_stats;
+   struct virgl_context_stats private_stats;
 
    int timeline_count;
 
@@ -39,6 +42,12 @@ struct render_context_args {
 
    /* render_context_main always takes ownership even on errors */
    int ctx_fd;
+
+   /* When valid, the worker is pooled: it initializes itself ahead of time
+    * and receives the actual args, with ctx_fd, from this socket once a
+    * context is assigned to it.  Ownership is the same as for ctx_fd.
+    */
+   int pool_fd;
 };
 
 bool
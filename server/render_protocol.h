@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 
+#include "virgl_context.h"
 #include "virgl_resource.h"
 
 /* this covers the command line options and the socket type */
@@ -113,9 +114,11 @@ struct render_context_op_nop_request {
 
 /* Initialize the context.
  *
- * The shmem is required and currently holds an array of atomic_uint.  Each
+ * The shmem is required and starts with an array of atomic_uint.  Each
  * atomic_uint represents the current sequence number of a ring (as defined by
- * the virtio-gpu spec).
+ * the virtio-gpu spec).  When stats_offset is not 0, the array ends there and
+ * is followed by a struct virgl_context_stats whose counters the context
+ * updates.  Otherwise the array fills the shmem.
  *
  * The eventfd is optional.  When given, it will be written to when there are
  * changes to any of the sequence numbers.
@@ -126,6 +129,7 @@ struct render_context_op_init_request {
    struct render_context_op_header header;
    uint32_t flags; /* VIRGL_RENDERER_CONTEXT_FLAG_*/
    size_t shmem_size;
+   size_t stats_offset;
    /* followed by 1 shmem fd and optionally 1 eventfd */
 };
 
@@ -113,6 +113,7 @@ render_server_parse_options(struct render_server *srv, int argc, char **argv)
       OPT_WORKER_CONTEXT_ID,
       OPT_WORKER_CONTEXT_NAME,
       OPT_WORKER_CONTEXT_FD,
+      OPT_WORKER_POOL_SIZE,
       OPT_COUNT,
    };
    static const struct option options[] = {
@@ -127,6 +128,7 @@ render_server_parse_options(struct render_server *srv, int argc, char **argv)
       { "worker-context-id", required_argument, NULL, OPT_WORKER_CONTEXT_ID },
       { "worker-context-name", required_argument, NULL, OPT_WORKER_CONTEXT_NAME },
       { "worker-context-fd", required_argument, NULL, OPT_WORKER_CONTEXT_FD },
+      { "worker-pool-size", required_argument, NULL, OPT_WORKER_POOL_SIZE },
       { NULL, 0, NULL, 0 }
    };
    static_assert(OPT_COUNT <= 'z', "");
@@ -162,6 +164,9 @@ render_server_parse_options(struct render_server *srv, int argc, char **argv)
       case OPT_WORKER_CONTEXT_FD:
          srv->context_args->ctx_fd = atoi(optarg);
          break;
+      case OPT_WORKER_POOL_SIZE:
+         srv->worker_pool_size = atoi(optarg);
+         break;
       default:
          render_log("unknown option specified");
          return false;
@@ -174,6 +179,19 @@ render_server_parse_options(struct render_server *srv, int argc, char **argv)
       return false;
    }
 
+   if (srv->worker_pool_size < 0 ||
+       srv->worker_pool_size > RENDER_SERVER_MAX_WORKER_COUNT / 2) {
+      render_log("invalid worker pool size %d", srv->worker_pool_size);
+      return false;
+   }
+#if defined(ENABLE_RENDER_SERVER_WORKER_THREAD) || defined(__APPLE__)
+   /* pooled workers inherit their pool socket through fork() */
+   if (srv->worker_pool_size) {
+      render_log("worker pool is not supported by this worker type");
+      srv->worker_pool_size = 0;
+   }
+#endif
+
    if (srv->client_fd < 0 && srv->context_args->ctx_fd < 0) {
       render_log("no socket fd specified");
       return false;
@@ -213,12 +231,18 @@ render_server_init(struct render_server *srv,
 {
    memset(ctx_args, 0, sizeof(*ctx_args));
    ctx_args->ctx_fd = -1;
+   ctx_args->pool_fd = -1;
 
    memset(srv, 0, sizeof(*srv));
    srv->state = RENDER_SERVER_STATE_RUN;
    srv->context_args = ctx_args;
    srv->client_fd = -1;
 
+   /* the server may be started by a VMM that does not know about the option */
+   const char *pool_size = getenv("RENDER_SERVER_WORKER_POOL_SIZE");
+   if (pool_size)
+      srv->worker_pool_size = atoi(pool_size);
+
    if (!render_server_parse_options(srv, argc, argv))
       return false;
 
@@ -24,6 +24,8 @@ struct render_server {
    const char *worker_seccomp_bpf;
    const char *worker_seccomp_minijail_policy;
    bool worker_seccomp_minijail_log;
+   /* number of idle, pre-initialized workers to keep around */
+   int worker_pool_size;
 
    struct render_worker_jail *worker_jail;
 
@@ -0,0 +1,265 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Measures the context creation latency of virgl_render_server, from
+ * RENDER_CLIENT_OP_CREATE_CONTEXT until the new worker has created its venus
+ * context and replied to its first resource creation, which is what a guest
+ * waits for at VM boot or application launch.
+ *
+ * The server is started with the given extra arguments, e.g.
+ * --worker-pool-size=2, to compare cold and pooled workers.
+ */
+
+#include "render_common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "virglrenderer.h"
+#include "virtgpu_drm.h"
+
+#define BENCH_SHMEM_SIZE 4096
+
+static uint64_t
+bench_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static pid_t
+bench_start_server(const char *server_path, char **extra_args, int extra_arg_count,
+                   int *out_fd)
+{
+   int socket_fds[2];
+   if (!render_socket_pair(socket_fds))
+      return -1;
+
+   const pid_t pid = fork();
+   if (pid < 0) {
+      close(socket_fds[0]);
+      close(socket_fds[1]);
+      return -1;
+   }
+
+   if (!pid) {
+      char fd_str[16];
+      snprintf(fd_str, sizeof(fd_str), "%d", socket_fds[1]);
+
+      char **argv = calloc(extra_arg_count + 4, sizeof(*argv));
+      if (!argv)
+         _exit(1);
+      argv[0] = (char *)server_path;
+      argv[1] = "--socket-fd";
+      argv[2] = fd_str;
+      for (int i = 0; i < extra_arg_count; i++)
+         argv[3 + i] = extra_args[i];
+
+      /* the server fd must survive exec */
+      const int flags = fcntl(socket_fds[1], F_GETFD);
+      fcntl(socket_fds[1], F_SETFD, flags & ~FD_CLOEXEC);
+
+      execv(server_path, argv);
+      fprintf(stderr, "failed to exec %s: %s\n", server_path, strerror(errno));
+      _exit(1);
+   }
+
+   close(socket_fds[1]);
+   *out_fd = socket_fds[0];
+
+   return pid;
+}
+
+static bool
+bench_create_context(struct render_socket *server, uint32_t ctx_id, int *out_ctx_fd)
+{
+   const struct render_client_op_create_context_request req = {
+      .header.op = RENDER_CLIENT_OP_CREATE_CONTEXT,
+      .ctx_id = ctx_id,
+      .ctx_name = "render_server_bench",
+   };
+   if (!render_socket_send_reply(server, &req, sizeof(req)))
+      return false;
+
+   struct render_client_op_create_context_reply reply;
+   size_t reply_size;
+   int fd_count;
+   if (!render_socket_receive_request_with_fds(server, &reply, sizeof(reply), &reply_size,
+                                               out_ctx_fd, 1, &fd_count))
+      return false;
+
+   if (!reply.ok || fd_count != 1) {
+      if (fd_count)
+         close(*out_ctx_fd);
+      return false;
+   }
+
+   return true;
+}
+
+/* Initializes the context and waits for the worker to reply to the creation
+ * of the shm blob the guest driver always starts with.
+ */
+static bool
+bench_init_context(struct render_socket *ctx, int shmem_fd)
+{
+   const struct render_context_op_init_request init = {
+      .header.op = RENDER_CONTEXT_OP_INIT,
+      .flags = VIRTGPU_DRM_CAPSET_VENUS,
+      .shmem_size = BENCH_SHMEM_SIZE,
+   };
+   if (!render_socket_send_reply_with_fds(ctx, &init, sizeof(init), &shmem_fd, 1))
+      return false;
+
+   const struct render_context_op_create_resource_request create = {
+      .header.op = RENDER_CONTEXT_OP_CREATE_RESOURCE,
+      .res_id = 1,
+      .blob_size = 4096,
+      .blob_flags = VIRGL_RENDERER_BLOB_FLAG_USE_MAPPABLE,
+   };
+   if (!render_socket_send_reply(ctx, &create, sizeof(create)))
+      return false;
+
+   struct render_context_op_create_resource_reply reply;
+   size_t reply_size;
+   int res_fd;
+   int fd_count;
+   if (!render_socket_receive_request_with_fds(ctx, &reply, sizeof(reply), &reply_size,
+                                               &res_fd, 1, &fd_count))
+      return false;
+   if (fd_count)
+      close(res_fd);
+
+   return reply.fd_type != VIRGL_RESOURCE_FD_INVALID;
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+   const uint64_t va = *(const uint64_t *)a;
+   const uint64_t vb = *(const uint64_t *)b;
+   return va < vb ? -1 : va > vb;
+}
+
+static void
+usage(const char *name)
+{
+   fprintf(stderr,
+           "usage: %s [-n iterations] [-d delay_ms] server_path [server args...]\n",
+           name);
+}
+
+int
+main(int argc, char **argv)
+{
+   uint32_t iterations = 50;
+   uint32_t delay_ms = 100;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "+n:d:")) != -1) {
+      switch (opt) {
+      case 'n':
+         iterations = atoi(optarg);
+         break;
+      case 'd':
+         delay_ms = atoi(optarg);
+         break;
+      default:
+         usage(argv[0]);
+         return 1;
+      }
+   }
+
+   if (optind >= argc || !iterations) {
+      usage(argv[0]);
+      return 1;
+   }
+
+   render_log_init();
+
+   int server_fd;
+   const pid_t server_pid =
+      bench_start_server(argv[optind], &argv[optind + 1], argc - optind - 1, &server_fd);
+   if (server_pid < 0)
+      return 1;
+
+   struct render_socket server;
+   render_socket_init(&server, server_fd);
+
+   const struct render_client_op_init_request init = {
+      .header.op = RENDER_CLIENT_OP_INIT,
+      .flags = VIRGL_RENDERER_VENUS | VIRGL_RENDERER_NO_VIRGL,
+   };
+   if (!render_socket_send_reply(&server, &init, sizeof(init)))
+      return 1;
+
+   const int shmem_fd = memfd_create("render_server_bench", MFD_CLOEXEC);
+   if (shmem_fd < 0 || ftruncate(shmem_fd, BENCH_SHMEM_SIZE))
+      return 1;
+
+   uint64_t *latencies = calloc(iterations, sizeof(*latencies));
+   if (!latencies)
+      return 1;
+
+   bool ok = true;
+   for (uint32_t i = 0; i < iterations && ok; i++) {
+      /* give pooled workers, if any, the time to be replaced */
+      usleep(delay_ms * 1000);
+
+      const uint64_t start = bench_now_ns();
+
+      const uint32_t ctx_id = i + 1;
+      int ctx_fd;
+      ok = bench_create_context(&server, ctx_id, &ctx_fd);
+      if (!ok)
+         break;
+
+      struct render_socket ctx;
+      render_socket_init(&ctx, ctx_fd);
+      ok = bench_init_context(&ctx, shmem_fd);
+
+      latencies[i] = bench_now_ns() - start;
+
+      render_socket_fini(&ctx);
+
+      const struct render_client_op_destroy_context_request destroy = {
+         .header.op = RENDER_CLIENT_OP_DESTROY_CONTEXT,
+         .ctx_id = ctx_id,
+      };
+      ok = render_socket_send_reply(&server, &destroy, sizeof(destroy)) && ok;
+   }
+
+   render_socket_fini(&server);
+   waitpid(server_pid, NULL, 0);
+   close(shmem_fd);
+
+   if (!ok) {
+      fprintf(stderr, "context creation failed\n");
+      free(latencies);
+      return 1;
+   }
+
+   qsort(latencies, iterations, sizeof(*latencies), compare_u64);
+
+   uint64_t total = 0;
+   for (uint32_t i = 0; i < iterations; i++)
+      total += latencies[i];
+
+   printf("context creation latency over %u contexts: "
+          "mean %.1f us, min %.1f us, p50 %.1f us, p99 %.1f us\n",
+          iterations, total / 1000.0 / iterations, latencies[0] / 1000.0,
+          latencies[iterations / 2] / 1000.0, latencies[iterations * 99 / 100] / 1000.0);
+
+   free(latencies);
+
+   return 0;
+}
@@ -172,7 +172,7 @@ render_state_create_context(struct render_context *ctx,
 {
    {
       SCOPE_LOCK_RENDERER();
-      if (!vkr_renderer_create_context(ctx->ctx_id, flags, name_len, name))
+      if (!vkr_renderer_create_context(ctx->ctx_id, flags, name_len, name, ctx->shmem_stats))
          return false;
    }
 
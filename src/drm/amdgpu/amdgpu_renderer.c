@@ -88,6 +88,17 @@ struct amdgpu_context {
 
    struct hash_table_u64 *id_to_ctx;
 
+   /* Persistent BO lists created with AMDGPU_CCMD_BO_LIST, indexed by list_id. */
+   struct hash_table_u64 *bo_lists;
+   /* Incremented each time an object is freed, so that BO lists can tell
+    * whether their translated GEM handles may have gone stale.
+    */
+   uint64_t bo_generation;
+
+   /* Scratch storage for BO lists passed inline with CS_SUBMIT. */
+   struct drm_amdgpu_bo_list_entry *bo_list_scratch;
+   uint32_t bo_list_scratch_count;
+
    uint32_t timeline_count;
    struct drm_timeline timelines[];
 };
@@ -119,6 +130,7 @@ amdgpu_renderer_probe(int fd, struct virgl_renderer_capset_drm *capset)
            amdgpu_get_marketing_name(dev),
            sizeof(capset->u.amdgpu.marketing_name) - 1);
    capset->u.amdgpu.has_vm_always_valid = 1;
+   capset->u.amdgpu.has_bo_list = 1;
 
    amdgpu_device_deinitialize(dev);
 
@@ -139,11 +151,35 @@ struct amdgpu_object {
 };
 DEFINE_CAST(drm_object, amdgpu_object)
 
+/* Persistent BO list, see AMDGPU_CCMD_BO_LIST. */
+struct amdgpu_bo_list {
+   /* Entries as sent by the guest, bo_handle is the res_id. */
+   struct drm_amdgpu_bo_list_entry *guest;
+   /* Same entries with bo_handle translated to the GEM handle. */
+   struct drm_amdgpu_bo_list_entry *host;
+   uint32_t count;
+   /* amdgpu_context::bo_generation at the time host was translated. */
+   uint64_t generation;
+};
+
 static void free_id_to_ctx(struct hash_entry *entry)
 {
    amdgpu_cs_ctx_free(entry->data);
 }
 
+static void
+amdgpu_bo_list_destroy(struct amdgpu_bo_list *list)
+{
+   free(list->guest);
+   free(list->host);
+   free(list);
+}
+
+static void free_bo_list(struct hash_entry *entry)
+{
+   amdgpu_bo_list_destroy(entry->data);
+}
+
 static void
 amdgpu_renderer_destroy(struct virgl_context *vctx)
 {
@@ -160,6 +196,10 @@ amdgpu_renderer_destroy(struct virgl_context *vctx)
    if (ctx->id_to_ctx)
       _mesa_hash_table_u64_destroy(ctx->id_to_ctx, free_id_to_ctx);
 
+   if (ctx->bo_lists)
+      _mesa_hash_table_u64_destroy(ctx->bo_lists, free_bo_list);
+   free(ctx->bo_list_scratch);
+
    amdgpu_device_deinitialize(ctx->dev);
 
    free((void*)ctx->debug_name);
@@ -277,6 +317,9 @@ amdgpu_renderer_free_object(struct drm_context *dctx, struct drm_object *dobj)
 
    print(2, "free obj res_id: %d", dobj->res_id);
 
+   /* The GEM handle may be reused by a later allocation. */
+   ctx->bo_generation++;
+
    amdgpu_bo_free(obj->bo);
    free(obj);
 }
@@ -804,6 +847,217 @@ static bool validate_chunk_inputs(size_t offset, size_t len, struct amdgpu_conte
    return true;
 }
 
+static bool
+amdgpu_bo_list_translate_entry(struct amdgpu_context *ctx,
+                               const struct drm_amdgpu_bo_list_entry *in,
+                               struct drm_amdgpu_bo_list_entry *out)
+{
+   struct amdgpu_object *obj =
+      amdgpu_get_object_from_res_id(ctx, in->bo_handle, __FUNCTION__);
+   if (!obj) {
+      print(0, "Couldn't retrieve bo with res_id %d", in->bo_handle);
+      return false;
+   }
+   out->bo_handle = obj->base.handle;
+   out->bo_priority = in->bo_priority;
+   return true;
+}
+
+static bool
+amdgpu_bo_list_translate(struct amdgpu_context *ctx, struct amdgpu_bo_list *list)
+{
+   for (uint32_t i = 0; i < list->count; i++) {
+      if (!amdgpu_bo_list_translate_entry(ctx, &list->guest[i], &list->host[i]))
+         return false;
+   }
+   list->generation = ctx->bo_generation;
+   return true;
+}
+
+static int
+amdgpu_bo_list_find(const struct drm_amdgpu_bo_list_entry *guest, uint32_t count,
+                    uint32_t res_id)
+{
+   for (uint32_t i = 0; i < count; i++) {
+      if (guest[i].bo_handle == res_id)
+         return i;
+   }
+   return -1;
+}
+
+static int
+amdgpu_ccmd_bo_list(struct drm_context *dctx, struct vdrm_ccmd_req *hdr)
+{
+   const struct amdgpu_ccmd_bo_list_req *req = to_amdgpu_ccmd_bo_list_req(hdr);
+   struct amdgpu_context *ctx = to_amdgpu_context(dctx);
+   struct amdgpu_ccmd_rsp *rsp;
+   rsp = drm_context_rsp(dctx, hdr, sizeof(struct amdgpu_ccmd_rsp));
+   if (!rsp) {
+      print(0, "Cannot alloc response buffer");
+      return -ENOMEM;
+   }
+
+   if (req->list_id == 0) {
+      print(0, "Invalid list_id 0");
+      rsp->ret = -EINVAL;
+      return -1;
+   }
+
+   struct amdgpu_bo_list *list = _mesa_hash_table_u64_search(ctx->bo_lists, req->list_id);
+
+   if (req->op == AMDGPU_CCMD_BO_LIST_OP_DESTROY) {
+      if (!list) {
+         print(0, "Failed to find bo list %u", req->list_id);
+         rsp->ret = -EINVAL;
+         return -1;
+      }
+      _mesa_hash_table_u64_remove(ctx->bo_lists, req->list_id);
+      amdgpu_bo_list_destroy(list);
+      rsp->ret = 0;
+      return 0;
+   }
+
+   if (req->op != AMDGPU_CCMD_BO_LIST_OP_CREATE && req->op != AMDGPU_CCMD_BO_LIST_OP_UPDATE) {
+      print(0, "Invalid op %u", req->op);
+      rsp->ret = -EINVAL;
+      return -1;
+   }
+
+   if (req->num_add > AMDGPU_CCMD_BO_LIST_MAX_ENTRIES ||
+       req->num_remove > AMDGPU_CCMD_BO_LIST_MAX_ENTRIES) {
+      print(0, "Too many entries: add %u remove %u", req->num_add, req->num_remove);
+      rsp->ret = -EINVAL;
+      return -1;
+   }
+
+   size_t add_len = size_mul(req->num_add, sizeof(struct drm_amdgpu_bo_list_entry));
+   size_t remove_len = size_mul(req->num_remove, sizeof(uint32_t));
+   size_t payload_len = size_add(offsetof(struct amdgpu_ccmd_bo_list_req, payload),
+                                 size_add(add_len, remove_len));
+   if (payload_len > hdr->len) {
+      print(0, "Payload is out of bounds: %zu > %" PRIu32, payload_len, hdr->len);
+      rsp->ret = -EINVAL;
+      return -1;
+   }
+   const struct drm_amdgpu_bo_list_entry *add = (const void *)req->payload;
+   const uint32_t *remove = (const void *)&req->payload[add_len];
+
+   if (req->op == AMDGPU_CCMD_BO_LIST_OP_CREATE) {
+      if (list) {
+         print(0, "bo list %u already exists", req->list_id);
+         rsp->ret = -EINVAL;
+         return -1;
+      }
+      if (req->num_remove) {
+         print(0, "Cannot remove entries from a new bo list");
+         rsp->ret = -EINVAL;
+         return -1;
+      }
+   } else if (!list) {
+      print(0, "Failed to find bo list %u", req->list_id);
+      rsp->ret = -EINVAL;
+      return -1;
+   }
+
+   /* The changes are made to new arrays, large enough for the list without
+    * any removal, so that a failed update leaves the list as it was.
+    */
+   const uint32_t old_count = list ? list->count : 0;
+   const uint32_t max_count = MAX2(old_count + req->num_add, 1);
+   struct drm_amdgpu_bo_list_entry *guest = malloc(max_count * sizeof(*guest));
+   struct drm_amdgpu_bo_list_entry *host = malloc(max_count * sizeof(*host));
+   if (!guest || !host) {
+      free(guest);
+      free(host);
+      rsp->ret = -ENOMEM;
+      return -ENOMEM;
+   }
+
+   uint32_t count = old_count;
+   if (count) {
+      memcpy(guest, list->guest, count * sizeof(*guest));
+      memcpy(host, list->host, count * sizeof(*host));
+   }
+
+   for (uint32_t i = 0; i < req->num_remove; i++) {
+      int idx = amdgpu_bo_list_find(guest, count, remove[i]);
+      if (idx < 0) {
+         print(1, "res_id %u not in bo list %u", remove[i], req->list_id);
+         continue;
+      }
+      count--;
+      guest[idx] = guest[count];
+      host[idx] = host[count];
+   }
+
+   bool untranslated = false;
+   for (uint32_t i = 0; i < req->num_add; i++) {
+      int idx = -1;
+      if (req->op == AMDGPU_CCMD_BO_LIST_OP_UPDATE)
+         idx = amdgpu_bo_list_find(guest, count, add[i].bo_handle);
+      if (idx < 0)
+         idx = count++;
+
+      guest[idx] = add[i];
+      /* An untranslatable entry is kept, and reported again by the
+       * submit using the list, like an inline BO list would be.
+       */
+      if (!amdgpu_bo_list_translate_entry(ctx, &add[i], &host[idx])) {
+         host[idx].bo_handle = 0;
+         untranslated = true;
+      }
+   }
+
+   if (count > AMDGPU_CCMD_BO_LIST_MAX_ENTRIES) {
+      print(0, "bo list %u would have %u entries", req->list_id, count);
+      free(guest);
+      free(host);
+      rsp->ret = -EINVAL;
+      return -1;
+   }
+
+   if (!list) {
+      list = calloc(1, sizeof(*list));
+      if (!list) {
+         free(guest);
+         free(host);
+         rsp->ret = -ENOMEM;
+         return -ENOMEM;
+      }
+      list->generation = ctx->bo_generation;
+      _mesa_hash_table_u64_insert(ctx->bo_lists, req->list_id, list);
+   }
+
+   free(list->guest);
+   free(list->host);
+   list->guest = guest;
+   list->host = host;
+   list->count = count;
+   if (untranslated)
+      list->generation = ~0ull;
+
+   rsp->ret = untranslated ? -EINVAL : 0;
+
+   print(2, "bo list %u: %u entries (+%u -%u)", req->list_id, list->count,
+         req->num_add, req->num_remove);
+
+   return 0;
+}
+
+static struct drm_amdgpu_bo_list_entry *
+amdgpu_bo_list_scratch(struct amdgpu_context *ctx, uint32_t count)
+{
+   if (count > ctx->bo_list_scratch_count) {
+      struct drm_amdgpu_bo_list_entry *scratch =
+         realloc(ctx->bo_list_scratch, count * sizeof(*scratch));
+      if (!scratch)
+         return NULL;
+      ctx->bo_list_scratch = scratch;
+      ctx->bo_list_scratch_count = count;
+   }
+   return ctx->bo_list_scratch;
+}
+
 static int
 amdgpu_ccmd_cs_submit(struct drm_context *dctx, struct vdrm_ccmd_req *hdr)
 {
@@ -814,7 +1068,8 @@ amdgpu_ccmd_cs_submit(struct drm_context *dctx, struct vdrm_ccmd_req *hdr)
    struct drm_amdgpu_cs_chunk_sem syncobj_in = { 0 };
    const struct drm_amdgpu_bo_list_entry *bo_handles_in = NULL;
    struct drm_amdgpu_bo_list_entry *bo_list = NULL;
-   struct drm_amdgpu_cs_chunk *chunks;
+   struct drm_amdgpu_cs_chunk chunks[AMDGPU_CCMD_CS_SUBMIT_MAX_NUM_CHUNKS +
+                                     1 /* syncobj_in */ + 1 /* syncobj_out */];
    unsigned num_chunks = 0;
    uint64_t seqno = 0;
    int r;
@@ -839,14 +1094,6 @@ amdgpu_ccmd_cs_submit(struct drm_context *dctx, struct vdrm_ccmd_req *hdr)
       rsp->ret = -EINVAL;
       return -1;
    }
-   chunks = malloc((req->num_chunks + 1 /* syncobj_in */ + 1 /* syncobj_out */) *
-                   sizeof(*chunks));
-   if (chunks == NULL) {
-      print(0, "Failed to allocate %" PRIu32 " chunks", req->num_chunks + 2);
-      r = -EINVAL;
-      goto end;
-   }
-
    amdgpu_context_handle actx = _mesa_hash_table_u64_search(ctx->id_to_ctx,
                                                             (uintptr_t)req->ctx_id);
 
@@ -893,15 +1140,15 @@ amdgpu_ccmd_cs_submit(struct drm_context *dctx, struct vdrm_ccmd_req *hdr)
             goto end;
          }
 
-         if (bo_list != NULL) {
+         if (bo_handles_in != NULL) {
             print(0, "Refusing to allocate multiple BO lists");
             r = -EINVAL;
             goto end;
          }
 
          bo_handles_in = input;
-         bo_list = malloc(bo_count * sizeof(struct drm_amdgpu_bo_list_entry));
-         if (!bo_list) {
+         bo_list = amdgpu_bo_list_scratch(ctx, bo_count);
+         if (!bo_list && bo_count) {
             print(0, "Unable to allocate %zu bytes for bo_list",
                   bo_count * sizeof(struct drm_amdgpu_bo_list_entry));
             r = -ENOMEM;
@@ -915,17 +1162,56 @@ amdgpu_ccmd_cs_submit(struct drm_context *dctx, struct vdrm_ccmd_req *hdr)
          bo_list_in.bo_info_ptr = (uint64_t)(uintptr_t)bo_list;
 
          for (uint32_t j = 0; j < bo_count; j++) {
-            struct amdgpu_object *obj =
-               amdgpu_get_object_from_res_id(ctx, bo_handles_in[j].bo_handle, __FUNCTION__);
-            if (!obj) {
-               print(0, "Couldn't retrieve bo with res_id %d", bo_handles_in[j].bo_handle);
+            if (!amdgpu_bo_list_translate_entry(ctx, &bo_handles_in[j], &bo_list[j])) {
                r = -EINVAL;
                goto end;
             }
-            bo_list[j].bo_handle = obj->base.handle;
-            bo_list[j].bo_priority = bo_handles_in[j].bo_priority;
          }
 
+         chunks[num_chunks].length_dw = sizeof(bo_list_in) / 4;
+         chunks[num_chunks].chunk_data = (uintptr_t)&bo_list_in;
+      } else if (chunk_id == AMDGPU_CCMD_CHUNK_ID_BO_LIST) {
+         const struct amdgpu_ccmd_cs_bo_list_chunk *in;
+         if (!validate_chunk_inputs(1, typeof(*in))) {
+            r = -EINVAL;
+            goto end;
+         }
+         in = input;
+         if (in->pad != 0) {
+            print(0, "Padding not zeroed");
+            r = -EINVAL;
+            goto end;
+         }
+
+         if (bo_handles_in != NULL) {
+            print(0, "Refusing to use multiple BO lists");
+            r = -EINVAL;
+            goto end;
+         }
+
+         struct amdgpu_bo_list *list = _mesa_hash_table_u64_search(ctx->bo_lists, in->list_id);
+         if (!list) {
+            print(0, "Failed to find bo list %u", in->list_id);
+            r = -EINVAL;
+            goto end;
+         }
+
+         /* Only re-translate when an object was freed since the last time. */
+         if (list->generation != ctx->bo_generation &&
+             !amdgpu_bo_list_translate(ctx, list)) {
+            r = -EINVAL;
+            goto end;
+         }
+
+         bo_handles_in = list->guest;
+
+         bo_list_in.operation = ~0;
+         bo_list_in.list_handle = ~0;
+         bo_list_in.bo_number = list->count;
+         bo_list_in.bo_info_size = sizeof(struct drm_amdgpu_bo_list_entry);
+         bo_list_in.bo_info_ptr = (uint64_t)(uintptr_t)list->host;
+
+         chunks[num_chunks].chunk_id = AMDGPU_CHUNK_ID_BO_HANDLES;
          chunks[num_chunks].length_dw = sizeof(bo_list_in) / 4;
          chunks[num_chunks].chunk_data = (uintptr_t)&bo_list_in;
       } else if (chunk_id == AMDGPU_CHUNK_ID_FENCE) {
@@ -1046,9 +1332,6 @@ amdgpu_ccmd_cs_submit(struct drm_context *dctx, struct vdrm_ccmd_req *hdr)
    print(3, "ctx: %d -> seqno={v=%d a=%ld} r=%d", req->ctx_id, hdr->seqno, seqno, r);
 
 end:
-   if (bo_list)
-      free(bo_list);
-   free(chunks);
    rsp->ret = r;
    return r;
 }
@@ -1147,6 +1430,7 @@ static const struct drm_ccmd ccmd_dispatch[] = {
    HANDLER(RESERVE_VMID, reserve_vmid),
    HANDLER(SET_PSTATE, set_pstate),
    HANDLER(CS_QUERY_FENCE_STATUS, cs_query_fence_status),
+   HANDLER(BO_LIST, bo_list),
 };
 
 static int
@@ -1248,6 +1532,10 @@ amdgpu_renderer_create(int fd, size_t debug_len, const char *debug_name)
    if (ctx->id_to_ctx == NULL)
       goto fail_hash_table;
 
+   ctx->bo_lists = _mesa_hash_table_u64_create(NULL);
+   if (ctx->bo_lists == NULL)
+      goto fail_bo_lists;
+
    /* Ring 0 is for CPU execution. */
    /* TODO: add a setting to control which queues are exposed to the
     * guest.
@@ -1279,6 +1567,8 @@ amdgpu_renderer_create(int fd, size_t debug_len, const char *debug_name)
    return &ctx->base.base;
 
 fail_context_deinit:
+   _mesa_hash_table_u64_destroy(ctx->bo_lists, NULL);
+fail_bo_lists:
    _mesa_hash_table_u64_destroy(ctx->id_to_ctx, NULL);
 fail_hash_table:
    drm_context_deinit(&ctx->base);
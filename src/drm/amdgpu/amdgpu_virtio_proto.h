@@ -20,6 +20,7 @@ enum amdgpu_ccmd {
    AMDGPU_CCMD_RESERVE_VMID,
    AMDGPU_CCMD_SET_PSTATE,
    AMDGPU_CCMD_CS_QUERY_FENCE_STATUS,
+   AMDGPU_CCMD_BO_LIST,
 };
 
 struct amdgpu_ccmd_rsp {
@@ -135,6 +136,19 @@ DEFINE_CAST(vdrm_ccmd_req, amdgpu_ccmd_cs_submit_req)
 AMDGPU_STATIC_ASSERT_SIZE(amdgpu_ccmd_cs_submit_req)
 #define AMDGPU_CCMD_CS_SUBMIT_MAX_NUM_CHUNKS 128
 
+/* Virtual chunk id, not passed to the kernel: the chunk payload is a
+ * struct amdgpu_ccmd_cs_bo_list_chunk referencing a BO list previously
+ * created with AMDGPU_CCMD_BO_LIST.  Mutually exclusive with
+ * AMDGPU_CHUNK_ID_BO_HANDLES.
+ */
+#define AMDGPU_CCMD_CHUNK_ID_BO_LIST 0x8000
+
+struct amdgpu_ccmd_cs_bo_list_chunk {
+   uint32_t list_id;
+   uint32_t pad; /* must be zero */
+};
+AMDGPU_STATIC_ASSERT_SIZE(amdgpu_ccmd_cs_bo_list_chunk)
+
 /*
  * AMDGPU_CCMD_SET_METADATA
  */
@@ -268,6 +282,36 @@ struct amdgpu_ccmd_cs_query_fence_status_rsp {
 };
 AMDGPU_STATIC_ASSERT_SIZE(amdgpu_ccmd_cs_query_fence_status_rsp)
 
+/*
+ * AMDGPU_CCMD_BO_LIST
+ *
+ * Only supported when the capset has has_bo_list set.
+ *
+ * Maintains a persistent host-side BO list, so that the guest doesn't
+ * need to send (and the host doesn't need to translate) the full list
+ * of res_ids with every CS_SUBMIT.
+ *
+ * The payload holds num_add struct drm_amdgpu_bo_list_entry (with
+ * bo_handle being the res_id), followed by num_remove res_ids.  For
+ * AMDGPU_CCMD_BO_LIST_OP_UPDATE, removals are applied first, then
+ * additions; adding a res_id already in the list updates its priority.
+ */
+struct amdgpu_ccmd_bo_list_req {
+   struct vdrm_ccmd_req hdr;
+   uint32_t list_id; /* guest assigned, non-zero */
+   uint32_t op;      /* AMDGPU_CCMD_BO_LIST_OP_* */
+   uint32_t num_add;
+   uint32_t num_remove;
+   uint8_t payload[];
+};
+DEFINE_CAST(vdrm_ccmd_req, amdgpu_ccmd_bo_list_req)
+AMDGPU_STATIC_ASSERT_SIZE(amdgpu_ccmd_bo_list_req)
+#define AMDGPU_CCMD_BO_LIST_OP_CREATE  0
+#define AMDGPU_CCMD_BO_LIST_OP_UPDATE  1
+#define AMDGPU_CCMD_BO_LIST_OP_DESTROY 2
+/* Upper bound on the number of entries of a single list. */
+#define AMDGPU_CCMD_BO_LIST_MAX_ENTRIES (1 << 16)
+
 #ifdef __GNUC__
 # pragma GCC diagnostic pop
 #endif
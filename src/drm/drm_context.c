@@ -19,8 +19,10 @@
 #include "util/macros.h"
 #include "util/os_file.h"
 #include "util/u_atomic.h"
+#include "util/u_math.h"
 
 #include "drm_context.h"
+#include "drm_trace.h"
 #include "drm_util.h"
 
 static int
@@ -61,6 +63,26 @@ drm_context_unmap_shmem_blob(struct drm_context *dctx)
    dctx->rsp_mem_sz = 0;
 }
 
+/* Returns a buffer of at least size bytes, grown as needed and kept for the
+ * lifetime of the context.
+ */
+static void *
+drm_context_scratch(uint8_t **buf, size_t *buf_size, size_t size)
+{
+   if (likely(size <= *buf_size))
+      return *buf;
+
+   size_t new_size = MAX2(util_next_power_of_two64(size), 256);
+   uint8_t *new_buf = realloc(*buf, new_size);
+   if (!new_buf)
+      return NULL;
+
+   *buf = new_buf;
+   *buf_size = new_size;
+
+   return new_buf;
+}
+
 static int
 drm_context_submit_cmd_dispatch(struct drm_context *dctx, const struct vdrm_ccmd_req *hdr)
 {
@@ -81,22 +103,29 @@ drm_context_submit_cmd_dispatch(struct drm_context *dctx, const struct vdrm_ccmd
    drm_dbg("%s: hdr={cmd=%u, len=%u, seqno=%u, rsp_off=0x%x)", ccmd->name, hdr->cmd,
            hdr->len, hdr->seqno, hdr->rsp_off);
 
-   /* copy request to let ccmd handler patch command in-place */
-   size_t ccmd_size = MAX2(ccmd->size, hdr->len);
-   uint8_t *buf = malloc(ccmd_size);
-   if (!buf)
-      return -ENOMEM;
+   struct vdrm_ccmd_req *ccmd_hdr;
 
-   memcpy(&buf[0], hdr, hdr->len);
+   if (ccmd->read_only && hdr->len >= ccmd->size &&
+       !((uintptr_t)hdr & (dctx->ccmd_alignment - 1))) {
+      ccmd_hdr = (struct vdrm_ccmd_req *)hdr;
+   } else {
+      /* copy request to let ccmd handler patch command in-place */
+      size_t ccmd_size = MAX2(ccmd->size, hdr->len);
+      uint8_t *buf = drm_context_scratch(&dctx->req_buf, &dctx->req_buf_size, ccmd_size);
+      if (!buf)
+         return -ENOMEM;
 
-   /* Request length from the guest can be smaller than the expected
-    * size, ie. newer host and older guest, we need to zero initialize
-    * the new fields at the end.
-    */
-   if (ccmd->size > hdr->len)
-      memset(&buf[hdr->len], 0, ccmd->size - hdr->len);
+      memcpy(&buf[0], hdr, hdr->len);
+
+      /* Request length from the guest can be smaller than the expected
+       * size, ie. newer host and older guest, we need to zero initialize
+       * the new fields at the end.
+       */
+      if (ccmd->size > hdr->len)
+         memset(&buf[hdr->len], 0, ccmd->size - hdr->len);
 
-   struct vdrm_ccmd_req *ccmd_hdr = (struct vdrm_ccmd_req *)buf;
+      ccmd_hdr = (struct vdrm_ccmd_req *)buf;
+   }
 
    void *trace_scope = TRACE_SCOPE_BEGIN(ccmd->name);
 
@@ -104,10 +133,9 @@ drm_context_submit_cmd_dispatch(struct drm_context *dctx, const struct vdrm_ccmd
 
    TRACE_SCOPE_END(trace_scope);
 
-   free(buf);
-
    if (ret) {
       drm_err("%s: dispatch failed: %d (%s)", ccmd->name, ret, strerror(errno));
+      dctx->current_rsp = NULL;
       return ret;
    }
 
@@ -128,7 +156,6 @@ drm_context_submit_cmd_dispatch(struct drm_context *dctx, const struct vdrm_ccmd
       len = MIN2(len, dctx->current_rsp->len);
       memcpy(rsp, dctx->current_rsp, len);
       rsp->len = len;
-      free(dctx->current_rsp);
    }
    dctx->current_rsp = NULL;
 
@@ -138,9 +165,9 @@ drm_context_submit_cmd_dispatch(struct drm_context *dctx, const struct vdrm_ccmd
 }
 
 static int
-drm_context_submit_cmd(struct virgl_context *vctx, const void *_buffer, size_t size)
+drm_context_submit_cmds(struct drm_context *dctx, const void *_buffer, size_t size)
 {
-   struct drm_context *dctx = to_drm_context(vctx);
+   struct virgl_context *vctx = &dctx->base;
    unsigned int alignment = dctx->ccmd_alignment;
    const uint8_t *buffer = _buffer;
 
@@ -174,6 +201,7 @@ drm_context_submit_cmd(struct virgl_context *vctx, const void *_buffer, size_t s
          drm_err("dispatch failed: %d (%u)", ret, hdr->cmd);
          return ret;
       }
+      virgl_context_stats_add(&vctx->stats.commands, 1);
 
       buffer += hdr->len;
       size -= hdr->len;
@@ -187,12 +215,30 @@ drm_context_submit_cmd(struct virgl_context *vctx, const void *_buffer, size_t s
    return 0;
 }
 
+static int
+drm_context_submit_cmd(struct virgl_context *vctx, const void *buffer, size_t size)
+{
+   struct drm_context *dctx = to_drm_context(vctx);
+
+   int ret = drm_context_submit_cmds(dctx, buffer, size);
+
+   if (unlikely(dctx->trace) && size <= UINT32_MAX / 2)
+      drm_trace_submit_cmd(dctx->trace, buffer, size, ret);
+
+   return ret;
+}
+
 static void
 drm_context_remove_object(struct drm_context *dctx, struct drm_object *obj)
 {
    if (drm_context_res_id_unused(dctx, obj->res_id))
       return;
 
+   struct drm_object **slot =
+      &dctx->res_cache[obj->res_id & (DRM_CONTEXT_RES_CACHE_SIZE - 1)];
+   if (*slot == obj)
+      *slot = NULL;
+
    _mesa_hash_table_remove_key(dctx->resource_table, (void *)(uintptr_t)obj->res_id);
 }
 
@@ -219,9 +265,39 @@ drm_context_detach_resource(struct virgl_context *vctx, struct virgl_resource *r
 
    drm_dbg("obj=%p, blob_id=%u, res_id=%u", (void*)obj, obj->blob_id, obj->res_id);
 
+   if (unlikely(dctx->trace))
+      drm_trace_detach_resource(dctx->trace, res->res_id);
+
    drm_context_free_object(dctx, obj);
 }
 
+static int
+drm_context_trace_get_blob(struct virgl_context *vctx, uint32_t res_id, uint64_t blob_id,
+                           uint64_t blob_size, uint32_t blob_flags,
+                           struct virgl_context_blob *blob)
+{
+   struct drm_context *dctx = to_drm_context(vctx);
+
+   int ret = dctx->traced_get_blob(vctx, res_id, blob_id, blob_size, blob_flags, blob);
+   if (!ret)
+      drm_trace_create_blob(dctx->trace, res_id, blob_id, blob_size, blob_flags);
+
+   return ret;
+}
+
+void
+drm_context_trace_open(struct drm_context *dctx, uint32_t context_type,
+                       size_t debug_len, const char *debug_name)
+{
+   dctx->trace = drm_trace_open(context_type, debug_len, debug_name);
+   if (!dctx->trace)
+      return;
+
+   /* Blobs are created through the backend get_blob(), set up by now. */
+   dctx->traced_get_blob = dctx->base.get_blob;
+   dctx->base.get_blob = drm_context_trace_get_blob;
+}
+
 static int
 drm_context_get_device_fd(struct virgl_context *vctx)
 {
@@ -307,6 +383,11 @@ drm_context_deinit(struct drm_context *dctx)
    _mesa_hash_table_destroy(dctx->resource_table, NULL);
    _mesa_hash_table_destroy(dctx->blob_table, NULL);
 
+   free(dctx->req_buf);
+   free(dctx->rsp_buf);
+
+   drm_trace_close(dctx->trace);
+
    close(dctx->fd);
 }
 
@@ -324,13 +405,16 @@ drm_context_rsp(struct drm_context *dctx, const struct vdrm_ccmd_req *hdr,
    }
 
    /* The shared buffer might be writable by the guest.  To avoid TOCTOU,
-    * data races, and other security problems, always allocate a shadow buffer.
+    * data races, and other security problems, always use a shadow buffer.
     *
-    * Zero it to ensure that uninitialized heap memory cannot be exposed to guests.
+    * Zero it to ensure that stale or uninitialized memory cannot be exposed
+    * to guests.
     */
-   struct vdrm_ccmd_rsp *rsp = calloc(len, 1);
+   struct vdrm_ccmd_rsp *rsp =
+      drm_context_scratch(&dctx->rsp_buf, &dctx->rsp_buf_size, len);
    if (!rsp)
       return NULL;
+   memset(rsp, 0, len);
    rsp->len = len;
    dctx->current_rsp = rsp;
 
@@ -461,8 +545,17 @@ drm_context_object_set_res_id(struct drm_context *dctx,
 struct drm_object *
 drm_context_get_object_from_res_id(struct drm_context *dctx, uint32_t res_id)
 {
+   struct drm_object **slot = &dctx->res_cache[res_id & (DRM_CONTEXT_RES_CACHE_SIZE - 1)];
+
+   if (likely(*slot && (*slot)->res_id == res_id))
+      return *slot;
+
    const struct hash_entry *entry = hash_table_search(dctx->resource_table, res_id);
-   return likely(entry) ? entry->data : NULL;
+   if (unlikely(!entry))
+      return NULL;
+
+   *slot = entry->data;
+   return entry->data;
 }
 
 bool
@@ -7,6 +7,7 @@
 #ifndef DRM_CONTEXT_H_
 #define DRM_CONTEXT_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "virgl_context.h"
@@ -22,6 +23,10 @@ struct drm_ccmd {
    const char *name;
    int (*handler)(struct drm_context *ctx, struct vdrm_ccmd_req *hdr);
    size_t size;
+   /* The handler never writes to the request, so it can be dispatched
+    * straight from the submit buffer when it is large enough.
+    */
+   bool read_only;
 };
 
 struct drm_object {
@@ -37,6 +42,9 @@ struct drm_object {
    uint64_t size;
 };
 
+/* Must be a power of two. */
+#define DRM_CONTEXT_RES_CACHE_SIZE 256
+
 struct drm_context {
    struct virgl_context base;
 
@@ -46,9 +54,23 @@ struct drm_context {
 
    struct vdrm_ccmd_rsp *current_rsp;
 
+   /* Reused across ccmds so that the dispatch loop does not allocate in
+    * the steady state.
+    */
+   uint8_t *req_buf;
+   size_t req_buf_size;
+   uint8_t *rsp_buf;
+   size_t rsp_buf_size;
+
    struct hash_table *blob_table;
    struct hash_table *resource_table;
 
+   /* Direct-mapped cache in front of resource_table, indexed by the low
+    * bits of the res_id.  Submits keep referencing the same set of
+    * objects, so most res_id lookups never reach the hash table.
+    */
+   struct drm_object *res_cache[DRM_CONTEXT_RES_CACHE_SIZE];
+
    int fd;
 
    const struct drm_ccmd *ccmd_dispatch;
@@ -56,6 +78,14 @@ struct drm_context {
    unsigned int ccmd_alignment;
 
    void (*free_object)(struct drm_context *dctx, struct drm_object *dobj);
+
+   /* Set when VIRGL_DRM_TRACE is, see drm_trace.h.  get_blob() is then
+    * wrapped to record the blobs, the backend one being traced_get_blob.
+    */
+   struct drm_trace *trace;
+   int (*traced_get_blob)(struct virgl_context *vctx, uint32_t res_id, uint64_t blob_id,
+                          uint64_t blob_size, uint32_t blob_flags,
+                          struct virgl_context_blob *blob);
 };
 DEFINE_CAST(virgl_context, drm_context)
 
@@ -64,6 +94,9 @@ bool drm_context_init(struct drm_context *dctx, int fd,
 
 void drm_context_deinit(struct drm_context *dctx);
 
+void drm_context_trace_open(struct drm_context *dctx, uint32_t context_type,
+                            size_t debug_len, const char *debug_name);
+
 void drm_context_fence_retire(struct virgl_context *vctx,
                               uint32_t ring_idx, uint64_t fence_id);
 
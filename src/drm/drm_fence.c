@@ -3,13 +3,20 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <assert.h>
+#include <errno.h>
 #include <poll.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include "virgl_context.h"
 #include "virgl_fence.h"
 #include "virgl_util.h"
 
+#include "util/macros.h"
 #include "util/os_file.h"
 #include "util/u_atomic.h"
 #include "util/u_thread.h"
@@ -56,42 +63,321 @@ drm_fence_create(int fd, uint32_t flags, uint64_t fence_id)
    return fence;
 }
 
-static int
-thread_sync(void *arg)
+/**
+ * A waiter thread and its epoll set.  The thread owns its fds and frees
+ * itself once it has stopped, so that it can be stopped from one of its own
+ * retire callbacks.
+ */
+struct drm_fence_waiter {
+   thrd_t thread;
+   int epoll_fd;
+   int wake_fd;
+
+   /* Protected by waiter.lock. */
+   bool stop;
+   /* Bumped each time the thread is done with a batch of events. */
+   uint64_t epoch;
+
+   /* Batch being processed, only accessed by the thread itself. */
+   struct epoll_event events[32];
+   int event_count;
+
+   /* Timeline whose fences are being retired, and whether it was torn
+    * down by one of their callbacks.
+    */
+   struct drm_timeline *processing;
+   bool processing_removed;
+};
+
+/**
+ * Process-wide waiter, one epoll set across the timelines of every context.
+ */
+static struct {
+   mtx_t lock;
+   cnd_t cond;
+
+   unsigned refcount;
+   struct drm_fence_waiter *current;
+} waiter = {
+   .lock = _MTX_INITIALIZER_NP,
+};
+
+static once_flag waiter_once = ONCE_FLAG_INIT;
+
+/* The waiter running on this thread, if any. */
+static __THREAD_INITIAL_EXEC struct drm_fence_waiter *thread_waiter;
+
+/* Replaces the events of a timeline torn down in the middle of a batch. */
+static char removed_timeline;
+
+static void
+waiter_init_once(void)
 {
-   struct drm_timeline *timeline = arg;
+   cnd_init(&waiter.cond);
+}
 
-   u_thread_setname(timeline->name);
+static uint64_t
+now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
-   mtx_lock(&timeline->fence_mutex);
-   while (!timeline->stop_sync_thread) {
-      if (list_is_empty(&timeline->pending_fences)) {
-         if (cnd_wait(&timeline->fence_cond, &timeline->fence_mutex))
-            drm_err("error waiting on fence condition");
-         continue;
-      }
+static bool
+fence_signaled(struct drm_fence *fence)
+{
+   return poll(&(struct pollfd){fence->fd, POLLIN}, 1, 0) == 1;
+}
+
+/* Called with the timeline fence_mutex held. */
+static bool
+timeline_arm(struct drm_timeline *timeline)
+{
+   if (timeline->closing || timeline->armed || list_is_empty(&timeline->pending_fences))
+      return true;
+
+   struct drm_fence *fence =
+      list_first_entry(&timeline->pending_fences, struct drm_fence, node);
+   struct epoll_event ev = {
+      .events = EPOLLIN | EPOLLONESHOT,
+      .data.ptr = timeline,
+   };
+
+   if (epoll_ctl(timeline->waiter->epoll_fd, EPOLL_CTL_ADD, fence->fd, &ev)) {
+      drm_err("epoll_ctl failed: %s", strerror(errno));
+      return false;
+   }
+
+   timeline->armed = true;
+   return true;
+}
 
-      struct drm_fence *fence =
-         list_first_entry(&timeline->pending_fences, struct drm_fence, node);
-      int ret;
+/* Called with the timeline fence_mutex held. */
+static void
+timeline_disarm(struct drm_timeline *timeline)
+{
+   if (!timeline->armed)
+      return;
+
+   struct drm_fence *fence =
+      list_first_entry(&timeline->pending_fences, struct drm_fence, node);
+
+   epoll_ctl(timeline->waiter->epoll_fd, EPOLL_CTL_DEL, fence->fd, NULL);
+   timeline->armed = false;
+}
+
+static void
+timeline_process(struct drm_fence_waiter *w, struct drm_timeline *timeline, uint64_t wakeup_ns)
+{
+   struct list_head signaled;
 
+   list_inithead(&signaled);
+
+   mtx_lock(&timeline->fence_mutex);
+
+   /* Stale event for a timeline that has been torn down since. */
+   if (!timeline->armed) {
       mtx_unlock(&timeline->fence_mutex);
-      ret = poll(&(struct pollfd){fence->fd, POLLIN}, 1, -1); /* wait forever */
-      mtx_lock(&timeline->fence_mutex);
+      return;
+   }
 
-      if (ret == 1) {
+   timeline_disarm(timeline);
+
+   /* Fences complete in order, so retire everything that is already
+    * signaled before going back to sleep.
+    */
+   list_for_each_entry_safe (struct drm_fence, fence, &timeline->pending_fences, node) {
+      if (!fence_signaled(fence))
+         break;
+      list_del(&fence->node);
+      list_addtail(&fence->node, &signaled);
+   }
+
+   mtx_unlock(&timeline->fence_mutex);
+
+   /* The callbacks run unlocked, as they may tear down the timeline. */
+   w->processing = timeline;
+   w->processing_removed = false;
+
+   list_for_each_entry_safe (struct drm_fence, fence, &signaled, node) {
+      if (!w->processing_removed) {
          drm_dbg("fence signaled: %p (%" PRIu64 ")", (void*)fence, fence->fence_id);
          timeline->fence_retire(timeline->vctx, timeline->ring_idx, fence->fence_id);
-         drm_fence_destroy(fence);
-      } else if (ret != 0) {
-         drm_err("poll failed: %s", strerror(errno));
+      }
+      drm_fence_destroy(fence);
+
+      if (!w->processing_removed) {
+         uint64_t latency = now_ns() - wakeup_ns;
+         timeline->retired_count++;
+         timeline->retire_latency_total_ns += latency;
+         timeline->retire_latency_max_ns = MAX2(timeline->retire_latency_max_ns, latency);
       }
    }
+
+   w->processing = NULL;
+   if (w->processing_removed)
+      return;
+
+   mtx_lock(&timeline->fence_mutex);
+   timeline_arm(timeline);
    mtx_unlock(&timeline->fence_mutex);
+}
+
+static int
+thread_sync(void *arg)
+{
+   struct drm_fence_waiter *w = arg;
+
+   u_thread_setname("drm-sync");
+   thread_waiter = w;
+
+   while (true) {
+      int n = epoll_wait(w->epoll_fd, w->events, ARRAY_SIZE(w->events), -1);
+      if (n < 0 && errno != EINTR)
+         drm_err("epoll_wait failed: %s", strerror(errno));
+
+      uint64_t wakeup_ns = now_ns();
+
+      w->event_count = MAX2(n, 0);
+      for (int i = 0; i < w->event_count; i++) {
+         void *ptr = w->events[i].data.ptr;
+
+         if (!ptr) {
+            uint64_t val;
+            if (read(w->wake_fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+               drm_err("wake_fd read failed: %s", strerror(errno));
+            continue;
+         }
+
+         if (ptr != &removed_timeline)
+            timeline_process(w, ptr, wakeup_ns);
+      }
+      w->event_count = 0;
+
+      mtx_lock(&waiter.lock);
+      w->epoch++;
+      cnd_broadcast(&waiter.cond);
+      bool stop = w->stop;
+      mtx_unlock(&waiter.lock);
+
+      if (stop)
+         break;
+   }
+
+   close(w->epoll_fd);
+   close(w->wake_fd);
+   free(w);
 
    return 0;
 }
 
+static void
+waiter_wake(struct drm_fence_waiter *w)
+{
+   uint64_t val = 1;
+   if (write(w->wake_fd, &val, sizeof(val)) < 0)
+      drm_err("wake_fd write failed: %s", strerror(errno));
+}
+
+static struct drm_fence_waiter *
+waiter_start(void)
+{
+   struct drm_fence_waiter *w = calloc(1, sizeof(*w));
+   if (!w)
+      return NULL;
+
+   w->wake_fd = -1;
+   w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   if (w->epoll_fd < 0)
+      goto fail;
+
+   w->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if (w->wake_fd < 0)
+      goto fail;
+
+   struct epoll_event ev = {
+      .events = EPOLLIN,
+      .data.ptr = NULL,
+   };
+   if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->wake_fd, &ev))
+      goto fail;
+
+   w->thread = u_thread_create(thread_sync, w);
+   if (!w->thread)
+      goto fail;
+
+   return w;
+
+fail:
+   drm_err("failed to start fence waiter: %s", strerror(errno));
+   if (w->wake_fd >= 0)
+      close(w->wake_fd);
+   if (w->epoll_fd >= 0)
+      close(w->epoll_fd);
+   free(w);
+   return NULL;
+}
+
+/* Returns the running waiter, starting it if needed, or NULL. */
+static struct drm_fence_waiter *
+waiter_ref(void)
+{
+   call_once(&waiter_once, waiter_init_once);
+
+   mtx_lock(&waiter.lock);
+   if (!waiter.current)
+      waiter.current = waiter_start();
+   if (waiter.current)
+      waiter.refcount++;
+   struct drm_fence_waiter *w = waiter.current;
+   mtx_unlock(&waiter.lock);
+
+   return w;
+}
+
+static void
+waiter_unref(struct drm_fence_waiter *w)
+{
+   /* From a retire callback, the batch being processed is the caller's own,
+    * and its events for the timeline were removed instead.
+    */
+   const bool on_thread = thread_waiter == w;
+
+   mtx_lock(&waiter.lock);
+
+   assert(waiter.current == w && waiter.refcount);
+
+   /* Wait for the thread to finish the batch of events it is working on,
+    * which could still reference the timeline being torn down.
+    */
+   if (!on_thread) {
+      uint64_t epoch = w->epoch;
+      waiter_wake(w);
+      while (w->epoch == epoch)
+         cnd_wait(&waiter.cond, &waiter.lock);
+   }
+
+   if (--waiter.refcount) {
+      mtx_unlock(&waiter.lock);
+      return;
+   }
+
+   /* w is freed by the thread once it sees stop. */
+   thrd_t thread = w->thread;
+   w->stop = true;
+   waiter_wake(w);
+   waiter.current = NULL;
+
+   mtx_unlock(&waiter.lock);
+
+   /* Joining would deadlock, the thread exits when the callback returns. */
+   if (on_thread)
+      thrd_detach(thread);
+   else
+      thrd_join(thread, NULL);
+}
+
 void
 drm_timeline_init(struct drm_timeline *timeline, struct virgl_context *vctx,
                   const char *name, int ring_idx,
@@ -107,22 +393,50 @@ drm_timeline_init(struct drm_timeline *timeline, struct virgl_context *vctx,
    list_inithead(&timeline->pending_fences);
 
    mtx_init(&timeline->fence_mutex, mtx_plain);
-   cnd_init(&timeline->fence_cond);
+   timeline->armed = false;
+   timeline->closing = false;
 
-   timeline->sync_thread = u_thread_create(thread_sync, timeline);
+   timeline->retired_count = 0;
+   timeline->retire_latency_total_ns = 0;
+   timeline->retire_latency_max_ns = 0;
+
+   /* Retried by drm_timeline_submit_fence() on failure. */
+   timeline->waiter = waiter_ref();
 }
 
+/* May be called from a retire callback, including the timeline's own. */
 void
 drm_timeline_fini(struct drm_timeline *timeline)
 {
-   /* signal thread_sync to shutdown: */
-   mtx_lock(&timeline->fence_mutex);
-   timeline->stop_sync_thread = true;
-   cnd_signal(&timeline->fence_cond);
-   mtx_unlock(&timeline->fence_mutex);
+   struct drm_fence_waiter *w = timeline->waiter;
 
-   /* wait for thread_sync to exit: */
-   thrd_join(timeline->sync_thread, NULL);
+   if (w) {
+      /* Not to be armed again by the waiter retiring its fences. */
+      mtx_lock(&timeline->fence_mutex);
+      timeline->closing = true;
+      timeline_disarm(timeline);
+      mtx_unlock(&timeline->fence_mutex);
+
+      /* Drop the events of the timeline still in the current batch. */
+      if (thread_waiter == w) {
+         for (int i = 0; i < w->event_count; i++) {
+            if (w->events[i].data.ptr == timeline)
+               w->events[i].data.ptr = &removed_timeline;
+         }
+         if (w->processing == timeline)
+            w->processing_removed = true;
+      }
+
+      waiter_unref(w);
+      timeline->waiter = NULL;
+   }
+
+   if (timeline->retired_count) {
+      drm_dbg("%s-%d: %" PRIu64 " fences, retire latency avg %" PRIu64 "ns max %" PRIu64 "ns",
+              timeline->name, timeline->ring_idx, timeline->retired_count,
+              timeline->retire_latency_total_ns / timeline->retired_count,
+              timeline->retire_latency_max_ns);
+   }
 
    if (timeline->last_fence_fd != -1)
       close(timeline->last_fence_fd);
@@ -132,7 +446,6 @@ drm_timeline_fini(struct drm_timeline *timeline)
       drm_fence_destroy(fence);
    }
 
-   cnd_destroy(&timeline->fence_cond);
    mtx_destroy(&timeline->fence_mutex);
 }
 
@@ -143,6 +456,13 @@ drm_timeline_submit_fence(struct drm_timeline *timeline, uint32_t flags,
    if (timeline->last_fence_fd == -1)
       return -EINVAL;
 
+   /* A fence nobody waits for would never be retired. */
+   if (!timeline->waiter) {
+      timeline->waiter = waiter_ref();
+      if (!timeline->waiter)
+         return -EIO;
+   }
+
    struct drm_fence *fence =
       drm_fence_create(timeline->last_fence_fd, flags, fence_id);
 
@@ -155,7 +475,11 @@ drm_timeline_submit_fence(struct drm_timeline *timeline, uint32_t flags,
 
    mtx_lock(&timeline->fence_mutex);
    list_addtail(&fence->node, &timeline->pending_fences);
-   cnd_signal(&timeline->fence_cond);
+   if (!timeline_arm(timeline)) {
+      drm_fence_destroy(fence);
+      mtx_unlock(&timeline->fence_mutex);
+      return -EIO;
+   }
    mtx_unlock(&timeline->fence_mutex);
 
    close(timeline->last_fence_fd);
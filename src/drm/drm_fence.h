@@ -18,11 +18,15 @@
  */
 
 struct drm_fence;
+struct drm_fence_waiter;
 struct virgl_context;
 
 /**
  * Represents a single timeline of fence-fd's.  Fences on a timeline are
  * signaled in FIFO order.
+ *
+ * All timelines share a single waiter thread, which only watches the
+ * oldest pending fence of each timeline.
  */
 struct drm_timeline {
    struct virgl_context *vctx;
@@ -33,10 +37,19 @@ struct drm_timeline {
    int last_fence_fd;
    struct list_head pending_fences;
 
+   /* Held reference, NULL if the waiter could not be started. */
+   struct drm_fence_waiter *waiter;
+
    mtx_t fence_mutex;
-   cnd_t fence_cond;
-   thrd_t sync_thread;
-   bool stop_sync_thread;
+   /* The head of pending_fences is registered with the waiter. */
+   bool armed;
+   /* Being torn down, must not be armed again. */
+   bool closing;
+
+   /* Time from the waiter waking up to the fence being retired. */
+   uint64_t retired_count;
+   uint64_t retire_latency_total_ns;
+   uint64_t retire_latency_max_ns;
 };
 
 void drm_timeline_init(struct drm_timeline *timeline, struct virgl_context *vctx,
@@ -14,6 +14,7 @@
 
 #include <xf86drm.h>
 
+#include "drm_context.h"
 #include "drm_hw.h"
 #include "drm_renderer.h"
 #include "drm_util.h"
@@ -187,7 +188,11 @@ drm_renderer_create(size_t debug_len, const char *debug_name, int drm_fd)
          drmIoctl(fd, DRM_IOCTL_SET_CLIENT_NAME, &n);
       }
 
-      return b->create(fd, debug_len, debug_name);
+      struct virgl_context *vctx = b->create(fd, debug_len, debug_name);
+      if (vctx)
+         drm_context_trace_open(to_drm_context(vctx), b->context_type, debug_len, debug_name);
+
+      return vctx;
    }
 
    return NULL;
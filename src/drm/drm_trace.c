@@ -0,0 +1,123 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/macros.h"
+#include "util/u_atomic.h"
+
+#include "drm_trace.h"
+#include "drm_util.h"
+
+struct drm_trace {
+   FILE *fp;
+};
+
+static uint32_t drm_trace_count;
+
+struct drm_trace *
+drm_trace_open(uint32_t context_type, size_t debug_len, const char *debug_name)
+{
+   const char *prefix = getenv("VIRGL_DRM_TRACE");
+   if (!prefix || !*prefix)
+      return NULL;
+
+   char path[PATH_MAX];
+   uint32_t n = p_atomic_inc_return(&drm_trace_count) - 1;
+   snprintf(path, sizeof(path), "%s.%d.%u", prefix, (int)getpid(), n);
+
+   struct drm_trace *trace = calloc(1, sizeof(*trace));
+   if (!trace)
+      return NULL;
+
+   trace->fp = fopen(path, "wb");
+   if (!trace->fp) {
+      drm_err("failed to open trace %s: %s", path, strerror(errno));
+      free(trace);
+      return NULL;
+   }
+
+   struct drm_trace_header header = {
+      .magic = DRM_TRACE_MAGIC,
+      .version = DRM_TRACE_VERSION,
+      .context_type = context_type,
+   };
+   if (debug_name)
+      memcpy(header.name, debug_name, MIN2(debug_len, sizeof(header.name) - 1));
+   fwrite(&header, sizeof(header), 1, trace->fp);
+
+   drm_log("recording to %s", path);
+
+   return trace;
+}
+
+void
+drm_trace_close(struct drm_trace *trace)
+{
+   if (!trace)
+      return;
+
+   fclose(trace->fp);
+   free(trace);
+}
+
+static void
+drm_trace_record(struct drm_trace *trace, uint32_t type, const void *header,
+                 uint32_t header_len, const void *data, uint32_t len)
+{
+   static const uint8_t zeroes[8];
+   const struct drm_trace_record record = {
+      .type = type,
+      .len = header_len + len,
+   };
+
+   fwrite(&record, sizeof(record), 1, trace->fp);
+   fwrite(header, header_len, 1, trace->fp);
+   if (len)
+      fwrite(data, len, 1, trace->fp);
+   if (record.len % 8)
+      fwrite(zeroes, 8 - record.len % 8, 1, trace->fp);
+}
+
+void
+drm_trace_create_blob(struct drm_trace *trace, uint32_t res_id, uint64_t blob_id,
+                      uint64_t size, uint32_t blob_flags)
+{
+   const struct drm_trace_create_blob blob = {
+      .blob_id = blob_id,
+      .size = size,
+      .res_id = res_id,
+      .blob_flags = blob_flags,
+   };
+
+   drm_trace_record(trace, DRM_TRACE_CREATE_BLOB, &blob, sizeof(blob), NULL, 0);
+}
+
+void
+drm_trace_submit_cmd(struct drm_trace *trace, const void *buf, size_t size, int ret)
+{
+   const struct drm_trace_submit_cmd submit = {
+      .ret = ret,
+   };
+
+   drm_trace_record(trace, DRM_TRACE_SUBMIT_CMD, &submit, sizeof(submit), buf, size);
+}
+
+void
+drm_trace_detach_resource(struct drm_trace *trace, uint32_t res_id)
+{
+   const struct drm_trace_detach_resource detach = {
+      .res_id = res_id,
+   };
+
+   drm_trace_record(trace, DRM_TRACE_DETACH_RESOURCE, &detach, sizeof(detach), NULL, 0);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DRM_TRACE_H_
+#define DRM_TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Recorded ccmd stream of a single drm native context.  When
+ * VIRGL_DRM_TRACE is set, every drm context records the blobs it hands out
+ * and the ccmd buffers it is submitted to <VIRGL_DRM_TRACE>.<pid>.<n>,
+ * n counting the contexts created by the process.  The traces can be
+ * replayed on the mock drm device by drm_replay.
+ *
+ * The file is a drm_trace_header followed by records.  Each record is a
+ * drm_trace_record followed by its payload, padded to 8 bytes.  Resources
+ * are identified by the res_id the guest created them with, the shmem blob
+ * included.  Resources imported rather than created from a blob are not
+ * recorded.
+ */
+
+#define DRM_TRACE_MAGIC   "VDRMTRC1"
+#define DRM_TRACE_VERSION 2
+
+enum drm_trace_record_type {
+   /* Payload is a drm_trace_create_blob. */
+   DRM_TRACE_CREATE_BLOB = 1,
+   /* Payload is a drm_trace_submit_cmd followed by the ccmd buffer. */
+   DRM_TRACE_SUBMIT_CMD = 2,
+   /* Payload is a drm_trace_detach_resource. */
+   DRM_TRACE_DETACH_RESOURCE = 3,
+};
+
+struct drm_trace_header {
+   char magic[8];
+   uint32_t version;
+   /* VIRTGPU_DRM_CONTEXT_* of the recording context. */
+   uint32_t context_type;
+   /* Debug name the recording context was created with. */
+   char name[32];
+};
+
+struct drm_trace_record {
+   uint32_t type;
+   /* Payload length, excluding padding. */
+   uint32_t len;
+};
+
+struct drm_trace_create_blob {
+   uint64_t blob_id;
+   uint64_t size;
+   uint32_t res_id;
+   uint32_t blob_flags;
+};
+
+struct drm_trace_submit_cmd {
+   /* What the context returned for the submit, a replay is expected to
+    * fail the same submits.
+    */
+   int32_t ret;
+   uint32_t pad;
+};
+
+struct drm_trace_detach_resource {
+   uint32_t res_id;
+   uint32_t pad;
+};
+
+#ifdef ENABLE_DRM
+
+struct drm_trace;
+
+/* Returns NULL when VIRGL_DRM_TRACE is not set or the file cannot be
+ * created.
+ */
+struct drm_trace *
+drm_trace_open(uint32_t context_type, size_t debug_len, const char *debug_name);
+
+void
+drm_trace_close(struct drm_trace *trace);
+
+void
+drm_trace_create_blob(struct drm_trace *trace, uint32_t res_id, uint64_t blob_id,
+                      uint64_t size, uint32_t blob_flags);
+
+void
+drm_trace_submit_cmd(struct drm_trace *trace, const void *buf, size_t size, int ret);
+
+void
+drm_trace_detach_resource(struct drm_trace *trace, uint32_t res_id);
+
+#endif /* ENABLE_DRM */
+
+#endif /* DRM_TRACE_H_ */
@@ -987,8 +987,9 @@ msm_ccmd_set_debuginfo(struct drm_context *dctx, struct vdrm_ccmd_req *hdr)
 }
 
 static const struct drm_ccmd ccmd_dispatch[] = {
+/* None of the msm handlers patch the request in place. */
 #define HANDLER(N, n)                                                                    \
-   [MSM_CCMD_##N] = {#N, msm_ccmd_##n, sizeof(struct msm_ccmd_##n##_req)}
+   [MSM_CCMD_##N] = {#N, msm_ccmd_##n, sizeof(struct msm_ccmd_##n##_req), true}
    HANDLER(NOP, nop),
    HANDLER(IOCTL_SIMPLE, ioctl_simple),
    HANDLER(GEM_NEW, gem_new),
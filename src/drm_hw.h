@@ -56,7 +56,9 @@ struct virgl_renderer_capset_drm {
       struct {
          uint32_t address32_hi;
          uint32_t has_vm_always_valid : 1;
-         uint32_t __pad : 31;
+         /* AMDGPU_CCMD_BO_LIST and AMDGPU_CCMD_CHUNK_ID_BO_LIST */
+         uint32_t has_bo_list : 1;
+         uint32_t __pad : 30;
 #ifdef ENABLE_DRM_AMDGPU
          struct amdgpu_buffer_size_alignments alignments;
          struct amdgpu_gpu_info gpu_info;
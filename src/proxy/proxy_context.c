@@ -7,6 +7,7 @@
 
 #include <fcntl.h>
 #include <poll.h>
+#include <stdalign.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -545,6 +546,16 @@ proxy_context_destroy(struct virgl_context *base)
    free(ctx);
 }
 
+static void
+proxy_context_get_stats(struct virgl_context *base,
+                        struct virgl_renderer_context_stats *stats)
+{
+   struct proxy_context *ctx = (struct proxy_context *)base;
+
+   if (ctx->worker_stats)
+      virgl_context_stats_accumulate(ctx->worker_stats, stats);
+}
+
 static void
 proxy_context_init_base(struct proxy_context *ctx)
 {
@@ -558,6 +569,7 @@ proxy_context_init_base(struct proxy_context *ctx)
    ctx->base.get_fencing_fd = proxy_context_get_fencing_fd;
    ctx->base.retire_fences = proxy_context_retire_fences;
    ctx->base.submit_fence = proxy_context_submit_fence;
+   ctx->base.get_stats = proxy_context_get_stats;
 }
 
 static bool
@@ -636,16 +648,30 @@ fail:
    return -1;
 }
 
+/* the worker stats follow the timeline seqnos in the shmem */
+static inline size_t
+proxy_context_stats_offset(void)
+{
+   return sizeof(atomic_uint) * PROXY_CONTEXT_TIMELINE_COUNT;
+}
+
 static bool
 proxy_context_init_shmem(struct proxy_context *ctx)
 {
-   const size_t shmem_size = sizeof(*ctx->timeline_seqnos) * PROXY_CONTEXT_TIMELINE_COUNT;
+   const size_t shmem_size = proxy_context_stats_offset() + sizeof(struct virgl_context_stats);
    ctx->shmem.fd = alloc_memfd("proxy-ctx", shmem_size, &ctx->shmem.ptr);
    if (ctx->shmem.fd < 0)
       return false;
 
    ctx->shmem.size = shmem_size;
 
+   /* the memfd is zeroed, and so are the counters */
+   static_assert(sizeof(atomic_uint) * PROXY_CONTEXT_TIMELINE_COUNT %
+                    alignof(struct virgl_context_stats) == 0,
+                 "misaligned worker stats");
+   ctx->worker_stats = (const struct virgl_context_stats *)((char *)ctx->shmem.ptr +
+                                                            proxy_context_stats_offset());
+
    return true;
 }
 
@@ -662,6 +688,7 @@ proxy_context_init(struct proxy_context *ctx, uint32_t ctx_flags)
       .header.op = RENDER_CONTEXT_OP_INIT,
       .flags = ctx_flags,
       .shmem_size = ctx->shmem.size,
+      .stats_offset = proxy_context_stats_offset(),
    };
    const int req_fds[2] = { ctx->shmem.fd, ctx->sync_thread.fence_eventfd };
    const int req_fd_count = req_fds[1] >= 0 ? 2 : 1;
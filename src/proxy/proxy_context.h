@@ -15,6 +15,7 @@
 #define PROXY_CONTEXT_TIMELINE_COUNT 64
 
 static_assert(ATOMIC_INT_LOCK_FREE == 2, "proxy renderer requires lock-free atomic_uint");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "proxy renderer requires lock-free 64-bit atomics");
 
 struct proxy_timeline {
    uint32_t cur_seqno;
@@ -46,6 +47,8 @@ struct proxy_context {
    uint64_t timeline_busy_mask;
    /* this points a region of shmem updated by the render worker */
    const volatile atomic_uint *timeline_seqnos;
+   /* and so does this, with the counters of the work done in the worker */
+   const struct virgl_context_stats *worker_stats;
 
    mtx_t free_fences_mutex;
    struct list_head free_fences;
@@ -27,12 +27,14 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-#include "util/list.h"
+#include "util/hash_table.h"
 #include "util/macros.h"
 #include "venus-protocol/vulkan.h"
 #include "virgl_resource.h"
+#include "virgl_util.h"
 
 #include "vkr_library.h"
 
@@ -69,8 +71,6 @@ struct vkr_opaque_fd_mem_info {
    VkDeviceMemory device_memory;
    uint32_t res_id;
    uint64_t size;
-
-   struct list_head head;
 };
 
 static struct vkr_allocator {
@@ -83,17 +83,26 @@ static struct vkr_allocator {
    uint8_t device_uuids[VKR_ALLOCATOR_MAX_DEVICE_COUNT][VK_UUID_SIZE];
    uint32_t device_count;
 
-   struct list_head memories;
+   /* mapped memories indexed by res_id */
+   struct hash_table *memories;
    struct vulkan_library vulkan_library;
 } vkr_allocator;
 
 static bool vkr_allocator_initialized;
 
+static uint64_t
+vkr_allocator_now_us(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 static void
 vkr_allocator_free_memory(struct vkr_opaque_fd_mem_info *mem_info)
 {
    mem_info->vk->FreeMemory(mem_info->device, mem_info->device_memory, NULL);
-   list_del(&mem_info->head);
+   _mesa_hash_table_remove_key(vkr_allocator.memories, (void *)(uintptr_t)mem_info->res_id);
    free(mem_info);
 }
 
@@ -109,9 +118,24 @@ vkr_allocator_get_dev_idx(struct virgl_resource *res)
    return VKR_ALLOCATOR_MAX_DEVICE_COUNT;
 }
 
+static struct vkr_opaque_fd_mem_info *
+vkr_allocator_get_mem_info(struct virgl_resource *res)
+{
+   struct hash_entry *entry =
+      _mesa_hash_table_search(vkr_allocator.memories, (void *)(uintptr_t)res->res_id);
+
+   return entry ? entry->data : NULL;
+}
+
 static struct vkr_opaque_fd_mem_info *
 vkr_allocator_allocate_memory(struct virgl_resource *res)
 {
+   /* the memory is keyed by res_id, so a mapped resource cannot be mapped
+    * again without leaking the first import
+    */
+   if (vkr_allocator_get_mem_info(res))
+      return NULL;
+
    const uint32_t idx = vkr_allocator_get_dev_idx(res);
    if (idx == VKR_ALLOCATOR_MAX_DEVICE_COUNT)
       return NULL;
@@ -158,7 +182,12 @@ vkr_allocator_allocate_memory(struct virgl_resource *res)
    mem_info->res_id = res->res_id;
    mem_info->size = res->vulkan_info.allocation_size;
 
-   list_addtail(&mem_info->head, &vkr_allocator.memories);
+   if (!_mesa_hash_table_insert(vkr_allocator.memories,
+                                (void *)(uintptr_t)mem_info->res_id, mem_info)) {
+      vk->FreeMemory(dev_handle, mem_handle, NULL);
+      free(mem_info);
+      return NULL;
+   }
 
    return mem_info;
 }
@@ -169,8 +198,12 @@ vkr_allocator_fini(void)
    if (!vkr_allocator_initialized)
       return;
 
-   list_for_each_entry_safe (struct vkr_opaque_fd_mem_info, mem_info, &vkr_allocator.memories, head)
-      vkr_allocator_free_memory(mem_info);
+   hash_table_foreach (vkr_allocator.memories, entry) {
+      struct vkr_opaque_fd_mem_info *mem_info = entry->data;
+      mem_info->vk->FreeMemory(mem_info->device, mem_info->device_memory, NULL);
+      free(mem_info);
+   }
+   _mesa_hash_table_destroy(vkr_allocator.memories, NULL);
 
    for (uint32_t i = 0; i < vkr_allocator.device_count; i++) {
       struct vkr_dev_proc_table *vk = &vkr_allocator.proc_tables[i];
@@ -224,8 +257,19 @@ vkr_allocator_init(void)
    struct vkr_inst_proc_table *vk = &vkr_allocator.proc_table;
    VkResult res;
 
+   if (vkr_allocator_initialized)
+      return 0;
+
+   TRACE_FUNC();
+
+   vkr_allocator.memories = _mesa_hash_table_create_u32_keys(NULL);
+   if (!vkr_allocator.memories)
+      return -1;
+
    bool ret = vkr_library_load(&vkr_allocator.vulkan_library);
    if (!ret) {
+      _mesa_hash_table_destroy(vkr_allocator.memories, NULL);
+      vkr_allocator.memories = NULL;
       return -1;
    }
 
@@ -301,7 +345,7 @@ vkr_allocator_init(void)
                                         &vkr_allocator.proc_tables[i]);
    }
 
-   list_inithead(&vkr_allocator.memories);
+   vkr_allocator_initialized = true;
 
    return 0;
 
@@ -312,23 +356,24 @@ fail:
    }
    vk->DestroyInstance(vkr_allocator.instance, NULL);
 
-   memset(&vkr_allocator, 0, sizeof(vkr_allocator));
-
+   _mesa_hash_table_destroy(vkr_allocator.memories, NULL);
    vkr_library_unload(&vkr_allocator.vulkan_library);
 
+   memset(&vkr_allocator, 0, sizeof(vkr_allocator));
+
    return -1;
 }
 
 int
 vkr_allocator_resource_map(struct virgl_resource *res, void **map, uint64_t *out_size)
 {
-   if (!vkr_allocator_initialized) {
-      if (vkr_allocator_init())
-         return -EINVAL;
-      vkr_allocator_initialized = true;
-   }
+   TRACE_FUNC();
 
-   assert(vkr_allocator_initialized);
+   /* without VIRGL_RENDERER_INIT_VK_ALLOCATOR, the first map initializes */
+   if (vkr_allocator_init())
+      return -EINVAL;
+
+   const uint64_t start = vkr_allocator_now_us();
 
    struct vkr_opaque_fd_mem_info *mem_info = vkr_allocator_allocate_memory(res);
    if (!mem_info)
@@ -344,24 +389,20 @@ vkr_allocator_resource_map(struct virgl_resource *res, void **map, uint64_t *out
    *map = ptr;
    *out_size = mem_info->size;
 
-   return 0;
-}
-
-static struct vkr_opaque_fd_mem_info *
-vkr_allocator_get_mem_info(struct virgl_resource *res)
-{
-   list_for_each_entry_safe (struct vkr_opaque_fd_mem_info, mem_info, &vkr_allocator.memories, head)
-      if (mem_info->res_id == res->res_id)
-         return mem_info;
+   TRACE_COUNTER_VALUE(vk_allocator_map_us, vkr_allocator_now_us() - start);
 
-   return NULL;
+   return 0;
 }
 
 int
 vkr_allocator_resource_unmap(struct virgl_resource *res)
 {
+   TRACE_FUNC();
+
    assert(vkr_allocator_initialized);
 
+   const uint64_t start = vkr_allocator_now_us();
+
    struct vkr_opaque_fd_mem_info *mem_info = vkr_allocator_get_mem_info(res);
    if (!mem_info)
       return -EINVAL;
@@ -370,5 +411,7 @@ vkr_allocator_resource_unmap(struct virgl_resource *res)
 
    vkr_allocator_free_memory(mem_info);
 
+   TRACE_COUNTER_VALUE(vk_allocator_unmap_us, vkr_allocator_now_us() - start);
+
    return 0;
 }
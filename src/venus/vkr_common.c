@@ -217,6 +217,7 @@ static const struct debug_named_value vkr_debug_options[] = {
    { "validate", VKR_DEBUG_VALIDATE, "Force enabling the validation layer" },
    { "udmabuf", VKR_DEBUG_UDMABUF, "Force udmabuf for host visible memory" },
    { "gbm", VKR_DEBUG_GBM, "Force gbm for host visible memory" },
+   { "prewarm", VKR_DEBUG_PREWARM, "Fill the query cache with all core formats" },
    DEBUG_NAMED_VALUE_END
 };
 
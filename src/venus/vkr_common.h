@@ -117,6 +117,7 @@ enum vkr_debug_flags {
    VKR_DEBUG_VALIDATE = 1 << 0,
    VKR_DEBUG_UDMABUF = 1 << 1,
    VKR_DEBUG_GBM = 1 << 2,
+   VKR_DEBUG_PREWARM = 1 << 3,
 };
 
 /* base class for all objects */
@@ -173,6 +173,7 @@ vkr_context_submit_cmd(struct vkr_context *ctx, const void *buffer, size_t size)
 
    while (vkr_cs_decoder_has_command(&ctx->decoder)) {
       vn_dispatch_command(&ctx->dispatch);
+      virgl_context_stats_add(&ctx->stats->commands, 1);
       if (vkr_context_get_fatal(ctx)) {
          vkr_log("submit_cmd: vn_dispatch_command failed");
 
@@ -193,6 +194,8 @@ vkr_context_free_resource(struct hash_entry *entry)
       munmap(res->u.data, res->size);
    else if (res->u.fd >= 0)
       close(res->u.fd);
+   if (res->udmabuf_range)
+      vkr_udmabuf_range_unref(res->udmabuf_range);
    free(res);
 }
 
@@ -237,6 +240,7 @@ vkr_context_import_resource_internal(struct vkr_context *ctx,
    res->res_id = res_id;
    res->fd_type = fd_type;
    res->size = blob_size;
+   res->udmabuf_range = NULL;
 
    /* fd and mmap_ptr cannot be valid at the same time, but allowed to be -1 and NULL */
    assert(fd < 0 || !mmap_ptr);
@@ -347,6 +351,11 @@ vkr_context_create_resource_from_device_memory(struct vkr_context *ctx,
       return false;
    }
 
+   if (mem->udmabuf_range) {
+      struct vkr_resource *res = vkr_context_get_resource(ctx, res_id);
+      res->udmabuf_range = vkr_udmabuf_range_ref(mem->udmabuf_range);
+   }
+
    *out_blob = blob;
 
    return true;
@@ -668,7 +677,8 @@ struct vkr_context *
 vkr_context_create(uint32_t ctx_id,
                    vkr_renderer_retire_fence_callback_type cb,
                    size_t debug_len,
-                   const char *debug_name)
+                   const char *debug_name,
+                   struct virgl_context_stats *stats)
 {
    struct vkr_context *ctx = calloc(1, sizeof(*ctx));
    if (!ctx)
@@ -682,6 +692,7 @@ vkr_context_create(uint32_t ctx_id,
 
    ctx->ctx_id = ctx_id;
    ctx->retire_fence = cb;
+   ctx->stats = stats;
    ctx->debug_name = malloc(debug_len + 1);
    if (!ctx->debug_name)
       goto err_debug_name;
@@ -32,6 +32,11 @@ struct vkr_resource {
    } u;
 
    size_t size;
+
+   /* the pooled udmabuf range of the exported memory, which must not be
+    * recycled while the resource exists
+    */
+   struct vkr_udmabuf_range *udmabuf_range;
 };
 
 enum vkr_context_validate_level {
@@ -47,6 +52,9 @@ struct vkr_context {
    uint32_t ctx_id;
    vkr_renderer_retire_fence_callback_type retire_fence;
 
+   /* updated by the context and its rings, and read by the proxy context */
+   struct virgl_context_stats *stats;
+
    char *debug_name;
    enum vkr_context_validate_level validate_level;
    bool validate_fatal;
@@ -109,7 +117,8 @@ struct vkr_context *
 vkr_context_create(uint32_t ctx_id,
                    vkr_renderer_retire_fence_callback_type cb,
                    size_t debug_len,
-                   const char *debug_name);
+                   const char *debug_name,
+                   struct virgl_context_stats *stats);
 
 void
 vkr_context_destroy(struct vkr_context *ctx);
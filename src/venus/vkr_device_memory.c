@@ -59,12 +59,20 @@ static VkResult
 vkr_udmabuf_get_fd_info_from_allocation_info(struct vkr_physical_device *physical_dev,
                                              const VkMemoryAllocateInfo *alloc_info,
                                              int *out_udmabuf_fd,
+                                             struct vkr_udmabuf_range **out_range,
                                              VkImportMemoryFdInfoKHR *out_fd_info)
 {
    int memfd = -1;
    int udmabuf_fd = -1;
    int fd = -1;
 
+   if (physical_dev->udmabuf_pool) {
+      udmabuf_fd = vkr_udmabuf_pool_alloc(physical_dev->udmabuf_pool,
+                                          alloc_info->allocationSize, out_range);
+      if (udmabuf_fd >= 0)
+         goto dup_fd;
+   }
+
    memfd = memfd_create("vkr-udmabuf", MFD_CLOEXEC | MFD_ALLOW_SEALING);
    if (memfd < 0) {
       vkr_log("memfd_create failed (%s)", strerror(errno));
@@ -95,14 +103,16 @@ vkr_udmabuf_get_fd_info_from_allocation_info(struct vkr_physical_device *physica
       goto fail;
    }
 
+   close(memfd);
+   memfd = -1;
+
+dup_fd:
    fd = os_dupfd_cloexec(udmabuf_fd);
    if (fd < 0) {
       vkr_log("os_dupfd_cloexec failed (%s)", strerror(errno));
       goto fail;
    }
 
-   close(memfd);
-
    *out_udmabuf_fd = udmabuf_fd;
    *out_fd_info = (VkImportMemoryFdInfoKHR){
       .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
@@ -118,6 +128,10 @@ fail:
       close(udmabuf_fd);
    if (memfd >= 0)
       close(memfd);
+   if (*out_range) {
+      vkr_udmabuf_range_unref(*out_range);
+      *out_range = NULL;
+   }
    return VK_ERROR_OUT_OF_DEVICE_MEMORY;
 }
 
@@ -128,6 +142,7 @@ vkr_udmabuf_get_fd_info_from_allocation_info(
    UNUSED struct vkr_physical_device *physical_dev,
    UNUSED const VkMemoryAllocateInfo *alloc_info,
    UNUSED int *out_udmabuf_fd,
+   UNUSED struct vkr_udmabuf_range **out_range,
    UNUSED VkImportMemoryFdInfoKHR *out_fd_info)
 {
    vkr_log("udmabuf_allocation is not enabled");
@@ -295,6 +310,7 @@ vkr_dispatch_vkAllocateMemory(struct vn_dispatch_context *dispatch,
       physical_dev->memory_properties.memoryTypes[mem_type_index].propertyFlags;
    uint32_t valid_fd_types = 0;
    int udmabuf_fd = -1;
+   struct vkr_udmabuf_range *udmabuf_range = NULL;
    void *gbm_bo = NULL;
    VkExportMemoryAllocateInfo local_export_info;
    if ((property_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !res_info) {
@@ -362,7 +378,7 @@ vkr_dispatch_vkAllocateMemory(struct vn_dispatch_context *dispatch,
              * - size_limit_mb: Max size of a dmabuf, in megabytes. Default is 64.
              */
             args->ret = vkr_udmabuf_get_fd_info_from_allocation_info(
-               physical_dev, alloc_info, &udmabuf_fd, &local_import_info);
+               physical_dev, alloc_info, &udmabuf_fd, &udmabuf_range, &local_import_info);
          } else {
             args->ret = vkr_gbm_get_fd_info_from_allocation_info(
                physical_dev, alloc_info, &gbm_bo, &local_import_info);
@@ -388,6 +404,10 @@ vkr_dispatch_vkAllocateMemory(struct vn_dispatch_context *dispatch,
          close(local_import_info.fd);
       if (gbm_bo)
          vkr_gbm_bo_destroy(gbm_bo);
+      if (udmabuf_fd >= 0)
+         close(udmabuf_fd);
+      if (udmabuf_range)
+         vkr_udmabuf_range_unref(udmabuf_range);
       return;
    }
 
@@ -396,6 +416,7 @@ vkr_dispatch_vkAllocateMemory(struct vn_dispatch_context *dispatch,
    mem->property_flags = property_flags;
    mem->valid_fd_types = valid_fd_types;
    mem->udmabuf_fd = udmabuf_fd;
+   mem->udmabuf_range = udmabuf_range;
    mem->gbm_bo = gbm_bo;
    mem->allocation_size = alloc_info->allocationSize;
    mem->memory_type_index = mem_type_index;
@@ -509,6 +530,8 @@ vkr_device_memory_release(struct vkr_device_memory *mem)
       vkr_gbm_bo_destroy(mem->gbm_bo);
    if (mem->udmabuf_fd >= 0)
       close(mem->udmabuf_fd);
+   if (mem->udmabuf_range)
+      vkr_udmabuf_range_unref(mem->udmabuf_range);
 }
 
 bool
@@ -8,6 +8,8 @@
 
 #include "vkr_common.h"
 
+#include "vkr_udmabuf_pool.h"
+
 struct gbm_bo;
 
 struct vkr_device_memory {
@@ -25,6 +27,8 @@ struct vkr_device_memory {
 
    /* udmabuf backing non-external mappable memory */
    int udmabuf_fd;
+   /* set when the udmabuf was carved from the udmabuf pool */
+   struct vkr_udmabuf_range *udmabuf_range;
 
    uint64_t allocation_size;
    uint32_t memory_type_index;
@@ -10,6 +10,8 @@
 #include "vkr_context.h"
 #include "vkr_device.h"
 #include "vkr_instance.h"
+#include "vkr_query_cache.h"
+#include "vkr_udmabuf_pool.h"
 
 #ifdef HAVE_LINUX_UDMABUF_H
 #include <fcntl.h>
@@ -94,6 +96,9 @@ vkr_physical_device_destroy(struct vkr_context *ctx,
    list_for_each_entry_safe (struct vkr_device, dev, &physical_dev->devices, base.track_head)
       vkr_device_destroy(ctx, dev, false);
 
+   if (physical_dev->udmabuf_pool)
+      vkr_udmabuf_pool_destroy(physical_dev->udmabuf_pool);
+
    free(physical_dev->extensions);
    free(physical_dev->queue_family_properties);
 
@@ -237,9 +242,12 @@ vkr_physical_device_init_memory_properties(struct vkr_physical_device *physical_
 
    physical_dev->udmabuf_dev_fd = -1;
    if (VKR_DEBUG(UDMABUF)) {
-      if (physical_dev->EXT_external_memory_dma_buf)
+      if (physical_dev->EXT_external_memory_dma_buf) {
          physical_dev->udmabuf_dev_fd = vkr_physical_device_get_udmabuf_dev_fd();
-      else
+         if (physical_dev->udmabuf_dev_fd >= 0)
+            physical_dev->udmabuf_pool =
+               vkr_udmabuf_pool_create(physical_dev->udmabuf_dev_fd);
+      } else
          vkr_log("missing VK_EXT_external_memory_dma_buf for udmabuf import!");
    } else if (VKR_DEBUG(GBM)) {
       if (physical_dev->EXT_external_memory_dma_buf)
@@ -416,6 +424,10 @@ vkr_dispatch_vkEnumeratePhysicalDevices(struct vn_dispatch_context *dispatch,
       vkr_physical_device_init_id_properties(physical_dev);
       vkr_physical_device_init_queue_family_properties(physical_dev);
 
+      vkr_query_cache_load(physical_dev);
+      if (VKR_DEBUG(PREWARM))
+         vkr_query_cache_prewarm(physical_dev);
+
       list_inithead(&physical_dev->devices);
 
       instance->physical_devices[i] = physical_dev;
@@ -597,11 +609,13 @@ vkr_dispatch_vkGetPhysicalDeviceFormatProperties(
 {
    struct vkr_physical_device *physical_dev =
       vkr_physical_device_from_handle(args->physicalDevice);
-   struct vn_physical_device_proc_table *vk = &physical_dev->proc_table;
+   VkFormatProperties2 props = {
+      .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
+   };
 
    vn_replace_vkGetPhysicalDeviceFormatProperties_args_handle(args);
-   vk->GetPhysicalDeviceFormatProperties(args->physicalDevice, args->format,
-                                         args->pFormatProperties);
+   vkr_query_cache_get_format_properties(physical_dev, args->format, &props);
+   *args->pFormatProperties = props.formatProperties;
 }
 
 static void
@@ -611,12 +625,21 @@ vkr_dispatch_vkGetPhysicalDeviceImageFormatProperties(
 {
    struct vkr_physical_device *physical_dev =
       vkr_physical_device_from_handle(args->physicalDevice);
-   struct vn_physical_device_proc_table *vk = &physical_dev->proc_table;
+   const VkPhysicalDeviceImageFormatInfo2 info = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2,
+      .format = args->format,
+      .type = args->type,
+      .tiling = args->tiling,
+      .usage = args->usage,
+      .flags = args->flags,
+   };
+   VkImageFormatProperties2 props = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2,
+   };
 
    vn_replace_vkGetPhysicalDeviceImageFormatProperties_args_handle(args);
-   args->ret = vk->GetPhysicalDeviceImageFormatProperties(
-      args->physicalDevice, args->format, args->type, args->tiling, args->usage,
-      args->flags, args->pImageFormatProperties);
+   args->ret = vkr_query_cache_get_image_format_properties(physical_dev, &info, &props);
+   *args->pImageFormatProperties = props.imageFormatProperties;
 }
 
 static void
@@ -703,11 +726,10 @@ vkr_dispatch_vkGetPhysicalDeviceFormatProperties2(
 {
    struct vkr_physical_device *physical_dev =
       vkr_physical_device_from_handle(args->physicalDevice);
-   struct vn_physical_device_proc_table *vk = &physical_dev->proc_table;
 
    vn_replace_vkGetPhysicalDeviceFormatProperties2_args_handle(args);
-   vk->GetPhysicalDeviceFormatProperties2(args->physicalDevice, args->format,
-                                          args->pFormatProperties);
+   vkr_query_cache_get_format_properties(physical_dev, args->format,
+                                         args->pFormatProperties);
 }
 
 static void
@@ -717,11 +739,10 @@ vkr_dispatch_vkGetPhysicalDeviceImageFormatProperties2(
 {
    struct vkr_physical_device *physical_dev =
       vkr_physical_device_from_handle(args->physicalDevice);
-   struct vn_physical_device_proc_table *vk = &physical_dev->proc_table;
 
    vn_replace_vkGetPhysicalDeviceImageFormatProperties2_args_handle(args);
-   args->ret = vk->GetPhysicalDeviceImageFormatProperties2(
-      args->physicalDevice, args->pImageFormatInfo, args->pImageFormatProperties);
+   args->ret = vkr_query_cache_get_image_format_properties(
+      physical_dev, args->pImageFormatInfo, args->pImageFormatProperties);
 }
 
 static void
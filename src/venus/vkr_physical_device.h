@@ -33,6 +33,7 @@ struct vkr_physical_device {
    bool is_opaque_fd_export_supported;
    void *gbm_device;
    int udmabuf_dev_fd;
+   struct vkr_udmabuf_pool *udmabuf_pool;
 
    VkQueueFamilyProperties *queue_family_properties;
    uint32_t queue_family_property_count;
@@ -0,0 +1,735 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vkr_query_cache.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "util/hash_table.h"
+#define XXH_INLINE_ALL
+#include "util/xxhash.h"
+
+#include "vkr_physical_device.h"
+
+#define VKR_QUERY_KEY_MAX_SIZE 1024
+/* the device and driver UUIDs, the driver version and the api version */
+#define VKR_QUERY_KEY_DEVICE_SIZE (2 * VK_UUID_SIZE + 2 * sizeof(uint32_t))
+
+#define VKR_QUERY_CACHE_FILE_MAGIC "VKRQRY01"
+#define VKR_QUERY_CACHE_FILE_MAX_SIZE (16u << 20)
+
+enum vkr_query_kind {
+   VKR_QUERY_FORMAT_PROPERTIES,
+   VKR_QUERY_IMAGE_FORMAT_PROPERTIES,
+};
+
+struct vkr_query_buffer {
+   uint32_t size;
+   bool overflow;
+   uint8_t data[VKR_QUERY_KEY_MAX_SIZE];
+};
+
+struct vkr_query_cache_entry {
+   const uint8_t *key;
+   uint32_t key_size;
+   uint32_t value_size;
+   VkResult result;
+   uint8_t data[];
+};
+
+/* A saved cache is the header followed by records, each record followed by
+ * its key and value.
+ */
+struct vkr_query_cache_file_header {
+   char magic[8];
+   /* of the virglrenderer version, which the value layout depends on */
+   uint64_t version;
+   uint64_t size;
+   /* of the records following the header */
+   uint64_t checksum;
+};
+
+struct vkr_query_cache_file_record {
+   uint32_t key_size;
+   uint32_t value_size;
+   int32_t result;
+   uint32_t pad;
+};
+
+/* Output structs without pointers besides pNext.  Everything after the
+ * VkBaseOutStructure header is the cached value.
+ */
+static const struct {
+   VkStructureType sType;
+   size_t size;
+} vkr_query_output_structs[] = {
+   { VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3, sizeof(VkFormatProperties3) },
+   { VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES,
+     sizeof(VkExternalImageFormatProperties) },
+   { VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_IMAGE_FORMAT_PROPERTIES,
+     sizeof(VkSamplerYcbcrConversionImageFormatProperties) },
+};
+
+static struct {
+   mtx_t mutex;
+   struct hash_table *entries;
+   struct vkr_query_cache_stats stats;
+} vkr_query_cache;
+
+static uint32_t
+vkr_query_cache_entry_hash(const void *key)
+{
+   const struct vkr_query_cache_entry *entry = key;
+   return XXH32(entry->key, entry->key_size, 0);
+}
+
+static bool
+vkr_query_cache_entry_equal(const void *a, const void *b)
+{
+   const struct vkr_query_cache_entry *entry_a = a;
+   const struct vkr_query_cache_entry *entry_b = b;
+   return entry_a->key_size == entry_b->key_size &&
+          !memcmp(entry_a->key, entry_b->key, entry_a->key_size);
+}
+
+static void
+vkr_query_cache_entry_free(struct hash_entry *entry)
+{
+   free((void *)entry->key);
+}
+
+bool
+vkr_query_cache_init(void)
+{
+   if (mtx_init(&vkr_query_cache.mutex, mtx_plain) != thrd_success)
+      return false;
+
+   vkr_query_cache.entries = _mesa_hash_table_create(NULL, vkr_query_cache_entry_hash,
+                                                     vkr_query_cache_entry_equal);
+   if (!vkr_query_cache.entries) {
+      mtx_destroy(&vkr_query_cache.mutex);
+      return false;
+   }
+
+   memset(&vkr_query_cache.stats, 0, sizeof(vkr_query_cache.stats));
+
+   return true;
+}
+
+void
+vkr_query_cache_fini(void)
+{
+   struct vkr_query_cache_stats stats;
+   vkr_query_cache_get_stats(&stats);
+   if (stats.hits + stats.misses) {
+      vkr_log("query cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64
+              " uncached, %u entries",
+              stats.hits, stats.misses, stats.uncached, stats.entries);
+   }
+
+   _mesa_hash_table_destroy(vkr_query_cache.entries, vkr_query_cache_entry_free);
+   vkr_query_cache.entries = NULL;
+   mtx_destroy(&vkr_query_cache.mutex);
+}
+
+void
+vkr_query_cache_get_stats(struct vkr_query_cache_stats *stats)
+{
+   mtx_lock(&vkr_query_cache.mutex);
+   *stats = vkr_query_cache.stats;
+   stats->entries = _mesa_hash_table_num_entries(vkr_query_cache.entries);
+   mtx_unlock(&vkr_query_cache.mutex);
+}
+
+static void
+vkr_query_buffer_append(struct vkr_query_buffer *buf, const void *data, size_t size)
+{
+   if (buf->overflow || size > sizeof(buf->data) - buf->size) {
+      buf->overflow = true;
+      return;
+   }
+
+   memcpy(buf->data + buf->size, data, size);
+   buf->size += size;
+}
+
+static void
+vkr_query_buffer_append_u32(struct vkr_query_buffer *buf, uint32_t val)
+{
+   vkr_query_buffer_append(buf, &val, sizeof(val));
+}
+
+static void
+vkr_query_key_init_device(struct vkr_query_buffer *key,
+                          const struct vkr_physical_device *physical_dev)
+{
+   key->size = 0;
+   key->overflow = false;
+
+   vkr_query_buffer_append(key, physical_dev->id_properties.deviceUUID, VK_UUID_SIZE);
+   vkr_query_buffer_append(key, physical_dev->id_properties.driverUUID, VK_UUID_SIZE);
+   vkr_query_buffer_append_u32(key, physical_dev->properties.driverVersion);
+   vkr_query_buffer_append_u32(key, physical_dev->api_version);
+   assert(key->size == VKR_QUERY_KEY_DEVICE_SIZE);
+}
+
+static void
+vkr_query_key_init(struct vkr_query_buffer *key,
+                   const struct vkr_physical_device *physical_dev,
+                   enum vkr_query_kind kind)
+{
+   vkr_query_key_init_device(key, physical_dev);
+   vkr_query_buffer_append_u32(key, kind);
+}
+
+static int
+vkr_query_output_struct_index(VkStructureType sType)
+{
+   for (uint32_t i = 0; i < ARRAY_SIZE(vkr_query_output_structs); i++) {
+      if (vkr_query_output_structs[i].sType == sType)
+         return i;
+   }
+   return -1;
+}
+
+/* Adds the sTypes of the output chain to the key, or marks it overflowed if
+ * the chain has a struct that cannot be cached.
+ */
+static void
+vkr_query_key_append_output_chain(struct vkr_query_buffer *key, const void *chain)
+{
+   for (const VkBaseInStructure *out = chain; out; out = out->pNext) {
+      if (vkr_query_output_struct_index(out->sType) < 0) {
+         key->overflow = true;
+         return;
+      }
+      vkr_query_buffer_append_u32(key, out->sType);
+   }
+}
+
+static void
+vkr_query_value_pack(struct vkr_query_buffer *value, const void *base, size_t base_size,
+                     const void *chain)
+{
+   value->size = 0;
+   value->overflow = false;
+
+   vkr_query_buffer_append(value, base, base_size);
+   for (const VkBaseInStructure *out = chain; out; out = out->pNext) {
+      const size_t size =
+         vkr_query_output_structs[vkr_query_output_struct_index(out->sType)].size;
+      vkr_query_buffer_append(value, (const uint8_t *)out + sizeof(VkBaseOutStructure),
+                              size - sizeof(VkBaseOutStructure));
+   }
+}
+
+static size_t
+vkr_query_value_size(size_t base_size, const void *chain)
+{
+   size_t size = base_size;
+
+   for (const VkBaseInStructure *out = chain; out; out = out->pNext) {
+      size += vkr_query_output_structs[vkr_query_output_struct_index(out->sType)].size -
+              sizeof(VkBaseOutStructure);
+   }
+
+   return size;
+}
+
+static void
+vkr_query_value_unpack(const uint8_t *value, void *base, size_t base_size, void *chain)
+{
+   memcpy(base, value, base_size);
+   value += base_size;
+
+   for (VkBaseOutStructure *out = chain; out; out = out->pNext) {
+      const size_t size =
+         vkr_query_output_structs[vkr_query_output_struct_index(out->sType)].size -
+         sizeof(VkBaseOutStructure);
+      memcpy((uint8_t *)out + sizeof(VkBaseOutStructure), value, size);
+      value += size;
+   }
+}
+
+/* Copies the cached value to base and chain and returns true on hits. */
+static bool
+vkr_query_cache_lookup(const struct vkr_query_buffer *key,
+                       void *base,
+                       size_t base_size,
+                       void *chain,
+                       VkResult *out_result)
+{
+   const struct vkr_query_cache_entry search = {
+      .key = key->data,
+      .key_size = key->size,
+   };
+   bool hit = false;
+
+   mtx_lock(&vkr_query_cache.mutex);
+
+   const struct hash_entry *he = _mesa_hash_table_search(vkr_query_cache.entries, &search);
+   /* a loaded entry is not trusted to have the expected size */
+   if (he && ((const struct vkr_query_cache_entry *)he->data)->value_size ==
+                vkr_query_value_size(base_size, chain)) {
+      const struct vkr_query_cache_entry *entry = he->data;
+      vkr_query_value_unpack(entry->data + entry->key_size, base, base_size, chain);
+      *out_result = entry->result;
+      vkr_query_cache.stats.hits++;
+      hit = true;
+   } else {
+      vkr_query_cache.stats.misses++;
+   }
+
+   mtx_unlock(&vkr_query_cache.mutex);
+
+   return hit;
+}
+
+static struct vkr_query_cache_entry *
+vkr_query_cache_entry_create(const void *key,
+                             uint32_t key_size,
+                             const void *value,
+                             uint32_t value_size,
+                             VkResult result)
+{
+   struct vkr_query_cache_entry *entry = malloc(sizeof(*entry) + key_size + value_size);
+   if (!entry)
+      return NULL;
+
+   memcpy(entry->data, key, key_size);
+   memcpy(entry->data + key_size, value, value_size);
+   entry->key = entry->data;
+   entry->key_size = key_size;
+   entry->value_size = value_size;
+   entry->result = result;
+
+   return entry;
+}
+
+/* Takes ownership of entry. */
+static bool
+vkr_query_cache_insert_locked(struct vkr_query_cache_entry *entry)
+{
+   if (_mesa_hash_table_search(vkr_query_cache.entries, entry) ||
+       !_mesa_hash_table_insert(vkr_query_cache.entries, entry, entry)) {
+      free(entry);
+      return false;
+   }
+
+   return true;
+}
+
+static void
+vkr_query_cache_store(const struct vkr_query_buffer *key,
+                      const void *base,
+                      size_t base_size,
+                      const void *chain,
+                      VkResult result)
+{
+   struct vkr_query_buffer value;
+   vkr_query_value_pack(&value, base, base_size, chain);
+   if (value.overflow)
+      return;
+
+   struct vkr_query_cache_entry *entry =
+      vkr_query_cache_entry_create(key->data, key->size, value.data, value.size, result);
+   if (!entry)
+      return;
+
+   mtx_lock(&vkr_query_cache.mutex);
+
+   /* another context may have stored the same query meanwhile */
+   vkr_query_cache_insert_locked(entry);
+
+   mtx_unlock(&vkr_query_cache.mutex);
+}
+
+static void
+vkr_query_cache_count_uncached(void)
+{
+   mtx_lock(&vkr_query_cache.mutex);
+   vkr_query_cache.stats.uncached++;
+   mtx_unlock(&vkr_query_cache.mutex);
+}
+
+void
+vkr_query_cache_get_format_properties(struct vkr_physical_device *physical_dev,
+                                      VkFormat format,
+                                      VkFormatProperties2 *props)
+{
+   struct vn_physical_device_proc_table *vk = &physical_dev->proc_table;
+   VkPhysicalDevice handle = physical_dev->base.handle.physical_device;
+   struct vkr_query_buffer key;
+   VkResult result;
+
+   vkr_query_key_init(&key, physical_dev, VKR_QUERY_FORMAT_PROPERTIES);
+   vkr_query_buffer_append_u32(&key, format);
+   vkr_query_key_append_output_chain(&key, props->pNext);
+
+   if (key.overflow) {
+      vkr_query_cache_count_uncached();
+      vk->GetPhysicalDeviceFormatProperties2(handle, format, props);
+      return;
+   }
+
+   if (vkr_query_cache_lookup(&key, &props->formatProperties,
+                              sizeof(props->formatProperties), props->pNext, &result))
+      return;
+
+   vk->GetPhysicalDeviceFormatProperties2(handle, format, props);
+   vkr_query_cache_store(&key, &props->formatProperties, sizeof(props->formatProperties),
+                         props->pNext, VK_SUCCESS);
+}
+
+/* Adds the input chain of the image format query to the key. */
+static void
+vkr_query_key_append_image_format_info(struct vkr_query_buffer *key,
+                                       const VkPhysicalDeviceImageFormatInfo2 *info)
+{
+   vkr_query_buffer_append_u32(key, info->format);
+   vkr_query_buffer_append_u32(key, info->type);
+   vkr_query_buffer_append_u32(key, info->tiling);
+   vkr_query_buffer_append_u32(key, info->usage);
+   vkr_query_buffer_append_u32(key, info->flags);
+
+   for (const VkBaseInStructure *in = info->pNext; in; in = in->pNext) {
+      vkr_query_buffer_append_u32(key, in->sType);
+
+      switch (in->sType) {
+      case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO: {
+         const VkPhysicalDeviceExternalImageFormatInfo *ext = (const void *)in;
+         vkr_query_buffer_append_u32(key, ext->handleType);
+         break;
+      }
+      case VK_STRUCTURE_TYPE_IMAGE_STENCIL_USAGE_CREATE_INFO: {
+         const VkImageStencilUsageCreateInfo *stencil = (const void *)in;
+         vkr_query_buffer_append_u32(key, stencil->stencilUsage);
+         break;
+      }
+      case VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO: {
+         const VkImageFormatListCreateInfo *list = (const void *)in;
+         vkr_query_buffer_append_u32(key, list->viewFormatCount);
+         vkr_query_buffer_append(key, list->pViewFormats,
+                                 sizeof(*list->pViewFormats) * list->viewFormatCount);
+         break;
+      }
+      case VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_DRM_FORMAT_MODIFIER_INFO_EXT: {
+         const VkPhysicalDeviceImageDrmFormatModifierInfoEXT *mod = (const void *)in;
+         vkr_query_buffer_append(key, &mod->drmFormatModifier,
+                                 sizeof(mod->drmFormatModifier));
+         vkr_query_buffer_append_u32(key, mod->sharingMode);
+         if (mod->sharingMode == VK_SHARING_MODE_CONCURRENT) {
+            vkr_query_buffer_append_u32(key, mod->queueFamilyIndexCount);
+            vkr_query_buffer_append(key, mod->pQueueFamilyIndices,
+                                    sizeof(*mod->pQueueFamilyIndices) *
+                                       mod->queueFamilyIndexCount);
+         }
+         break;
+      }
+      default:
+         key->overflow = true;
+         return;
+      }
+   }
+}
+
+VkResult
+vkr_query_cache_get_image_format_properties(struct vkr_physical_device *physical_dev,
+                                            const VkPhysicalDeviceImageFormatInfo2 *info,
+                                            VkImageFormatProperties2 *props)
+{
+   struct vn_physical_device_proc_table *vk = &physical_dev->proc_table;
+   VkPhysicalDevice handle = physical_dev->base.handle.physical_device;
+   struct vkr_query_buffer key;
+   VkResult result;
+
+   vkr_query_key_init(&key, physical_dev, VKR_QUERY_IMAGE_FORMAT_PROPERTIES);
+   vkr_query_key_append_image_format_info(&key, info);
+   vkr_query_key_append_output_chain(&key, props->pNext);
+
+   if (key.overflow) {
+      vkr_query_cache_count_uncached();
+      return vk->GetPhysicalDeviceImageFormatProperties2(handle, info, props);
+   }
+
+   if (vkr_query_cache_lookup(&key, &props->imageFormatProperties,
+                              sizeof(props->imageFormatProperties), props->pNext, &result))
+      return result;
+
+   result = vk->GetPhysicalDeviceImageFormatProperties2(handle, info, props);
+
+   /* out of memory errors are transient */
+   if (result == VK_SUCCESS || result == VK_ERROR_FORMAT_NOT_SUPPORTED) {
+      vkr_query_cache_store(&key, &props->imageFormatProperties,
+                            sizeof(props->imageFormatProperties), props->pNext, result);
+   }
+
+   return result;
+}
+
+void
+vkr_query_cache_prewarm(struct vkr_physical_device *physical_dev)
+{
+   for (VkFormat format = VK_FORMAT_R4G4_UNORM_PACK8;
+        format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK; format++) {
+      VkFormatProperties2 props = {
+         .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
+      };
+      vkr_query_cache_get_format_properties(physical_dev, format, &props);
+   }
+}
+
+static bool
+vkr_query_cache_path(const struct vkr_query_buffer *device_key, char *path, size_t size)
+{
+   const char *dir = getenv("VIRGL_PROBE_CACHE_DIR");
+   if (!dir || !dir[0])
+      return false;
+
+   const int len = snprintf(path, size, "%s/vkr-query-%016" PRIx64, dir,
+                            XXH64(device_key->data, device_key->size, 0));
+   return len > 0 && (size_t)len < size;
+}
+
+/* Creates the cache directory and the missing parents. */
+static bool
+vkr_query_cache_make_dir(void)
+{
+   char dir[PATH_MAX];
+
+   const int len = snprintf(dir, sizeof(dir), "%s", getenv("VIRGL_PROBE_CACHE_DIR"));
+   if (len <= 0 || (size_t)len >= sizeof(dir))
+      return false;
+
+   for (char *p = dir + 1; *p; p++) {
+      if (*p != '/')
+         continue;
+      *p = '\0';
+      if (mkdir(dir, 0755) && errno != EEXIST)
+         return false;
+      *p = '/';
+   }
+
+   return !mkdir(dir, 0755) || errno == EEXIST;
+}
+
+static uint64_t
+vkr_query_cache_file_version(void)
+{
+   return XXH64(VERSION, strlen(VERSION), 0);
+}
+
+/* Reads the records of a saved cache, if it is intact.  missing is set
+ * when there is no saved cache.
+ */
+static uint8_t *
+vkr_query_cache_read_file(const char *path, uint64_t *out_size, bool *missing)
+{
+   struct vkr_query_cache_file_header header;
+   uint8_t *records = NULL;
+   struct stat st;
+
+   FILE *fp = fopen(path, "rb");
+   *missing = !fp && errno == ENOENT;
+   if (!fp)
+      return NULL;
+
+   bool ok = !fstat(fileno(fp), &st) && fread(&header, sizeof(header), 1, fp) == 1 &&
+             !memcmp(header.magic, VKR_QUERY_CACHE_FILE_MAGIC, sizeof(header.magic)) &&
+             header.version == vkr_query_cache_file_version() &&
+             header.size <= VKR_QUERY_CACHE_FILE_MAX_SIZE &&
+             (uint64_t)st.st_size == sizeof(header) + header.size;
+   if (ok) {
+      records = malloc(MAX2(header.size, 1));
+      ok = records && fread(records, header.size, 1, fp) == (header.size ? 1 : 0) &&
+           header.checksum == XXH64(records, header.size, 0);
+   }
+   fclose(fp);
+
+   if (!ok) {
+      free(records);
+      return NULL;
+   }
+
+   *out_size = header.size;
+   return records;
+}
+
+/* Whether the entry is one vkr_query_cache_prewarm() would look up for the
+ * device: format properties without an output chain.
+ */
+static bool
+vkr_query_cache_entry_is_probed(const struct vkr_query_cache_entry *entry,
+                                const struct vkr_query_buffer *device_key)
+{
+   uint32_t kind;
+
+   if (entry->key_size != VKR_QUERY_KEY_DEVICE_SIZE + 2 * sizeof(uint32_t) ||
+       memcmp(entry->key, device_key->data, VKR_QUERY_KEY_DEVICE_SIZE))
+      return false;
+
+   memcpy(&kind, entry->key + VKR_QUERY_KEY_DEVICE_SIZE, sizeof(kind));
+   return kind == VKR_QUERY_FORMAT_PROPERTIES;
+}
+
+/* Serializes the probed entries of the device, the caller holds the mutex. */
+static uint8_t *
+vkr_query_cache_pack_device_locked(const struct vkr_query_buffer *device_key,
+                                   uint64_t *out_size)
+{
+   uint64_t size = 0;
+
+   hash_table_foreach (vkr_query_cache.entries, he) {
+      const struct vkr_query_cache_entry *entry = he->data;
+      if (vkr_query_cache_entry_is_probed(entry, device_key)) {
+         size += sizeof(struct vkr_query_cache_file_record) + entry->key_size +
+                 entry->value_size;
+      }
+   }
+
+   if (!size || size > VKR_QUERY_CACHE_FILE_MAX_SIZE)
+      return NULL;
+
+   uint8_t *records = malloc(size);
+   if (!records)
+      return NULL;
+
+   uint64_t offset = 0;
+   hash_table_foreach (vkr_query_cache.entries, he) {
+      const struct vkr_query_cache_entry *entry = he->data;
+      if (!vkr_query_cache_entry_is_probed(entry, device_key))
+         continue;
+
+      const struct vkr_query_cache_file_record record = {
+         .key_size = entry->key_size,
+         .value_size = entry->value_size,
+         .result = entry->result,
+      };
+      memcpy(records + offset, &record, sizeof(record));
+      offset += sizeof(record);
+      memcpy(records + offset, entry->data, entry->key_size + entry->value_size);
+      offset += entry->key_size + entry->value_size;
+   }
+
+   *out_size = size;
+   return records;
+}
+
+/* Writes the probed entries of the device to path, unless another worker
+ * wrote it first.
+ */
+static void
+vkr_query_cache_save(const struct vkr_query_buffer *device_key, const char *path)
+{
+   char tmp_path[PATH_MAX + 16];
+   uint64_t size = 0;
+
+   mtx_lock(&vkr_query_cache.mutex);
+   uint8_t *records = vkr_query_cache_pack_device_locked(device_key, &size);
+   mtx_unlock(&vkr_query_cache.mutex);
+
+   if (!records)
+      return;
+
+   struct vkr_query_cache_file_header header = {
+      .version = vkr_query_cache_file_version(),
+      .size = size,
+      .checksum = XXH64(records, size, 0),
+   };
+   memcpy(header.magic, VKR_QUERY_CACHE_FILE_MAGIC, sizeof(header.magic));
+
+   if (!vkr_query_cache_make_dir()) {
+      free(records);
+      return;
+   }
+
+   /* the file is linked into place once complete, and only if missing */
+   snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+   const int fd = mkstemp(tmp_path);
+   FILE *fp = fd >= 0 && !fchmod(fd, 0644) ? fdopen(fd, "wb") : NULL;
+   if (!fp) {
+      vkr_log("query cache: failed to create %s (%s)", tmp_path, strerror(errno));
+      if (fd >= 0) {
+         close(fd);
+         unlink(tmp_path);
+      }
+      free(records);
+      return;
+   }
+
+   bool ok =
+      fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(records, size, 1, fp) == 1;
+   ok = !fclose(fp) && ok;
+   free(records);
+
+   if (!ok || (link(tmp_path, path) && errno != EEXIST))
+      vkr_log("query cache: failed to write %s", path);
+   unlink(tmp_path);
+}
+
+void
+vkr_query_cache_load(struct vkr_physical_device *physical_dev)
+{
+   struct vkr_query_buffer device_key;
+   char path[PATH_MAX];
+   uint64_t size;
+   bool missing;
+
+   vkr_query_key_init_device(&device_key, physical_dev);
+   if (!vkr_query_cache_path(&device_key, path, sizeof(path)))
+      return;
+
+   uint8_t *records = vkr_query_cache_read_file(path, &size, &missing);
+   if (!records) {
+      if (missing) {
+         vkr_query_cache_prewarm(physical_dev);
+         vkr_query_cache_save(&device_key, path);
+      } else {
+         vkr_log("query cache: cannot load %s", path);
+      }
+      return;
+   }
+
+   uint32_t loaded = 0;
+   uint64_t offset = 0;
+
+   mtx_lock(&vkr_query_cache.mutex);
+
+   while (offset < size) {
+      struct vkr_query_cache_file_record record;
+      if (size - offset < sizeof(record))
+         break;
+      memcpy(&record, records + offset, sizeof(record));
+      offset += sizeof(record);
+
+      /* every key is for this device */
+      if (record.key_size < VKR_QUERY_KEY_DEVICE_SIZE ||
+          record.key_size > VKR_QUERY_KEY_MAX_SIZE ||
+          record.value_size > VKR_QUERY_KEY_MAX_SIZE ||
+          size - offset < (uint64_t)record.key_size + record.value_size ||
+          memcmp(records + offset, device_key.data, VKR_QUERY_KEY_DEVICE_SIZE))
+         break;
+
+      struct vkr_query_cache_entry *entry = vkr_query_cache_entry_create(
+         records + offset, record.key_size, records + offset + record.key_size,
+         record.value_size, record.result);
+      offset += record.key_size + record.value_size;
+
+      if (entry && vkr_query_cache_insert_locked(entry))
+         loaded++;
+   }
+
+   mtx_unlock(&vkr_query_cache.mutex);
+
+   free(records);
+
+   if (offset != size)
+      vkr_log("query cache: ignoring the rest of malformed %s", path);
+   else if (VKR_DEBUG(PREWARM))
+      vkr_log("query cache: loaded %u entries from %s", loaded, path);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef VKR_QUERY_CACHE_H
+#define VKR_QUERY_CACHE_H
+
+#include "vkr_common.h"
+
+/*
+ * Renderer-wide memoization of the format queries guest drivers make at
+ * startup.  Results are keyed by the device and driver UUIDs and by the
+ * serialized query, so they are shared by all contexts of the process using
+ * the same host driver.
+ *
+ * The render server runs every context in its own worker process.  To share
+ * the results across workers and VMs, the entries of a physical device are
+ * loaded from VIRGL_PROBE_CACHE_DIR, when set.  Without it, each worker
+ * starts with an empty cache.
+ *
+ * Every worker trusts what it loads, while workers run guest commands, so
+ * they never write what the guest queried.  The file of a device is only
+ * written once, by the first worker that finds it missing, with the
+ * properties of all core formats it probes before loading anything, and an
+ * existing file is never replaced.  A corrupt file is ignored until it is
+ * removed.  The directory must not be writable by anything less trusted
+ * than the workers; where a worker compromised by its guest is a concern,
+ * fill it with a trusted client first and make it read-only for the
+ * workers.
+ *
+ * Only chains made of structs the cache knows how to serialize are cached,
+ * other queries go to the host driver every time.
+ */
+
+struct vkr_query_cache_stats {
+   uint64_t hits;
+   uint64_t misses;
+   /* queries with a chain the cache cannot serialize */
+   uint64_t uncached;
+   uint32_t entries;
+};
+
+bool
+vkr_query_cache_init(void);
+
+void
+vkr_query_cache_fini(void);
+
+void
+vkr_query_cache_get_stats(struct vkr_query_cache_stats *stats);
+
+void
+vkr_query_cache_get_format_properties(struct vkr_physical_device *physical_dev,
+                                      VkFormat format,
+                                      VkFormatProperties2 *props);
+
+VkResult
+vkr_query_cache_get_image_format_properties(struct vkr_physical_device *physical_dev,
+                                            const VkPhysicalDeviceImageFormatInfo2 *info,
+                                            VkImageFormatProperties2 *props);
+
+/* Adds the saved entries of physical_dev the cache does not have yet, or
+ * probes and saves them when none were saved.
+ */
+void
+vkr_query_cache_load(struct vkr_physical_device *physical_dev);
+
+/* Fills the cache with the properties of all core formats. */
+void
+vkr_query_cache_prewarm(struct vkr_physical_device *physical_dev);
+
+#endif /* VKR_QUERY_CACHE_H */
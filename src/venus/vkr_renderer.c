@@ -10,6 +10,7 @@
 #include "venus_hw.h"
 
 #include "vkr_context.h"
+#include "vkr_query_cache.h"
 
 struct vkr_renderer_state {
    const struct vkr_renderer_callbacks *cbs;
@@ -71,6 +72,9 @@ vkr_renderer_init(uint32_t flags, const struct vkr_renderer_callbacks *cbs)
    vkr_debug_init();
    virgl_log_set_handler(cbs->debug_logger, NULL, NULL);
 
+   if (!vkr_query_cache_init())
+      return false;
+
    vkr_state.cbs = cbs;
    list_inithead(&vkr_state.contexts);
 
@@ -85,6 +89,8 @@ vkr_renderer_fini(void)
 
    list_inithead(&vkr_state.contexts);
 
+   vkr_query_cache_fini();
+
    vkr_state.cbs = NULL;
 }
 
@@ -103,7 +109,8 @@ bool
 vkr_renderer_create_context(uint32_t ctx_id,
                             uint32_t ctx_flags,
                             uint32_t nlen,
-                            const char *name)
+                            const char *name,
+                            struct virgl_context_stats *stats)
 {
    TRACE_FUNC();
 
@@ -119,7 +126,7 @@ vkr_renderer_create_context(uint32_t ctx_id,
    if (ctx)
       return false;
 
-   ctx = vkr_context_create(ctx_id, vkr_state.cbs->retire_fence, nlen, name);
+   ctx = vkr_context_create(ctx_id, vkr_state.cbs->retire_fence, nlen, name, stats);
    if (!ctx)
       return false;
 
@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "virgl_context.h"
 #include "virgl_resource.h"
 #include "virglrenderer.h"
 
@@ -35,11 +36,13 @@ vkr_renderer_init(uint32_t flags, const struct vkr_renderer_callbacks *cbs);
 void
 vkr_renderer_fini(void);
 
+/* stats must outlive the context */
 bool
 vkr_renderer_create_context(uint32_t ctx_id,
                             uint32_t ctx_flags,
                             uint32_t nlen,
-                            const char *name);
+                            const char *name,
+                            struct virgl_context_stats *stats);
 
 void
 vkr_renderer_destroy_context(uint32_t ctx_id);
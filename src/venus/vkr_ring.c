@@ -226,8 +226,10 @@ vkr_ring_submit_cmd(struct vkr_ring *ring,
 
    vkr_cs_decoder_set_buffer_stream(dec, buffer, size);
 
+   struct vkr_context *ctx = ring->dispatch.data;
    while (vkr_cs_decoder_has_command(dec)) {
       vn_dispatch_command(&ring->dispatch);
+      virgl_context_stats_add(&ctx->stats->commands, 1);
       if (vkr_cs_decoder_get_fatal(dec)) {
          vkr_log("ring_submit_cmd: vn_dispatch_command failed");
 
@@ -279,6 +281,7 @@ vkr_ring_thread(void *arg)
 
       if (wait) {
          TRACE_SCOPE("ring idle");
+         const uint64_t idle_begin = vkr_ring_now();
 
          mtx_lock(&ring->mutex);
          while (ring->started && !ring->pending_notify) {
@@ -297,6 +300,7 @@ vkr_ring_thread(void *arg)
 
          last_submit = vkr_ring_now();
          relax_iter = 0;
+         virgl_context_stats_add(&ctx->stats->ring_idle_ns, last_submit - idle_begin);
       }
 
       const uint32_t cmd_size = vkr_ring_load_tail(ring) - ring->buffer.cur;
@@ -308,6 +312,7 @@ vkr_ring_thread(void *arg)
             break;
          }
 
+         const uint64_t busy_begin = vkr_ring_now();
          const uint32_t ring_head = ring->buffer.cur;
          vkr_ring_read_buffer(ring, ring->cmd, cmd_size);
 
@@ -318,6 +323,7 @@ vkr_ring_thread(void *arg)
 
          last_submit = vkr_ring_now();
          relax_iter = 0;
+         virgl_context_stats_add(&ctx->stats->ring_busy_ns, last_submit - busy_begin);
       } else {
          /* Get the active wait_ring seqno first to ensure ordering. */
          uint32_t wait_ring_seqno = 0;
@@ -81,6 +81,7 @@ vkr_dispatch_vkExecuteCommandStreamsMESA(
 
       while (vkr_cs_decoder_has_command(dec)) {
          vn_dispatch_command(dispatch);
+         virgl_context_stats_add(&ctx->stats->commands, 1);
          if (vkr_context_get_fatal(ctx))
             break;
       }
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vkr_udmabuf_extents.h"
+
+#include <stdlib.h>
+
+#include "util/macros.h"
+
+struct vkr_udmabuf_extent {
+   struct list_head head;
+   uint32_t offset;
+   uint32_t size;
+};
+
+bool
+vkr_udmabuf_extents_init(struct vkr_udmabuf_extents *extents, uint32_t size)
+{
+   struct vkr_udmabuf_extent *extent = malloc(sizeof(*extent));
+   if (!extent)
+      return false;
+
+   extent->offset = 0;
+   extent->size = size;
+   list_inithead(&extents->free_list);
+   list_addtail(&extent->head, &extents->free_list);
+   extents->size = size;
+   extents->free_size = size;
+
+   return true;
+}
+
+void
+vkr_udmabuf_extents_fini(struct vkr_udmabuf_extents *extents)
+{
+   list_for_each_entry_safe (struct vkr_udmabuf_extent, extent, &extents->free_list, head)
+      free(extent);
+}
+
+bool
+vkr_udmabuf_extents_take(struct vkr_udmabuf_extents *extents,
+                         uint32_t size,
+                         uint32_t *out_offset)
+{
+   if (!size || extents->free_size < size)
+      return false;
+
+   list_for_each_entry (struct vkr_udmabuf_extent, extent, &extents->free_list, head) {
+      if (extent->size < size)
+         continue;
+
+      *out_offset = extent->offset;
+      extent->offset += size;
+      extent->size -= size;
+      extents->free_size -= size;
+
+      if (!extent->size) {
+         list_del(&extent->head);
+         free(extent);
+      }
+
+      return true;
+   }
+
+   return false;
+}
+
+void
+vkr_udmabuf_extents_give(struct vkr_udmabuf_extents *extents,
+                         uint32_t offset,
+                         uint32_t size)
+{
+   struct vkr_udmabuf_extent *prev = NULL;
+   struct vkr_udmabuf_extent *next = NULL;
+
+   list_for_each_entry (struct vkr_udmabuf_extent, extent, &extents->free_list, head) {
+      if (extent->offset > offset) {
+         next = extent;
+         break;
+      }
+      prev = extent;
+   }
+
+   if (prev && prev->offset + prev->size == offset) {
+      prev->size += size;
+      if (next && prev->offset + prev->size == next->offset) {
+         prev->size += next->size;
+         list_del(&next->head);
+         free(next);
+      }
+      extents->free_size += size;
+      return;
+   }
+
+   if (next && offset + size == next->offset) {
+      next->offset = offset;
+      next->size += size;
+      extents->free_size += size;
+      return;
+   }
+
+   struct vkr_udmabuf_extent *extent = malloc(sizeof(*extent));
+   if (!extent)
+      return;
+
+   extent->offset = offset;
+   extent->size = size;
+   if (next)
+      list_addtail(&extent->head, &next->head);
+   else
+      list_addtail(&extent->head, &extents->free_list);
+   extents->free_size += size;
+}
+
+uint32_t
+vkr_udmabuf_extents_largest(const struct vkr_udmabuf_extents *extents)
+{
+   uint32_t largest = 0;
+
+   list_for_each_entry (struct vkr_udmabuf_extent, extent, &extents->free_list, head)
+      largest = MAX2(largest, extent->size);
+
+   return largest;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef VKR_UDMABUF_EXTENTS_H
+#define VKR_UDMABUF_EXTENTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/list.h"
+
+/*
+ * First-fit allocator of the pages of a udmabuf pool slab.  Freed pages are
+ * merged with their free neighbours, so that the free extents never touch.
+ */
+
+struct vkr_udmabuf_extents {
+   /* free extents sorted by offset */
+   struct list_head free_list;
+   uint32_t size;
+   uint32_t free_size;
+};
+
+/* Starts with a single free extent of size pages. */
+bool
+vkr_udmabuf_extents_init(struct vkr_udmabuf_extents *extents, uint32_t size);
+
+void
+vkr_udmabuf_extents_fini(struct vkr_udmabuf_extents *extents);
+
+/* Takes size pages from the lowest free extent large enough. */
+bool
+vkr_udmabuf_extents_take(struct vkr_udmabuf_extents *extents,
+                         uint32_t size,
+                         uint32_t *out_offset);
+
+/* When the pages cannot be tracked, they are lost until fini. */
+void
+vkr_udmabuf_extents_give(struct vkr_udmabuf_extents *extents,
+                         uint32_t offset,
+                         uint32_t size);
+
+uint32_t
+vkr_udmabuf_extents_largest(const struct vkr_udmabuf_extents *extents);
+
+static inline bool
+vkr_udmabuf_extents_is_idle(const struct vkr_udmabuf_extents *extents)
+{
+   return extents->free_size == extents->size;
+}
+
+#endif /* VKR_UDMABUF_EXTENTS_H */
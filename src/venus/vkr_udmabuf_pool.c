@@ -0,0 +1,354 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vkr_udmabuf_pool.h"
+
+#if defined(HAVE_LINUX_UDMABUF_H) && defined(HAVE_MEMFD_CREATE)
+#include <fcntl.h>
+#include <linux/udmabuf.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "vkr_udmabuf_extents.h"
+
+/* the default udmabuf size_limit_mb is 64 */
+#define VKR_UDMABUF_SLAB_SIZE (32u << 20)
+/* larger allocations get their own memfd */
+#define VKR_UDMABUF_POOL_MAX_ALLOC_SIZE (VKR_UDMABUF_SLAB_SIZE / 4)
+
+struct vkr_udmabuf_slab {
+   struct list_head head;
+   int memfd;
+
+   /* in pages */
+   struct vkr_udmabuf_extents extents;
+};
+
+struct vkr_udmabuf_range {
+   struct vkr_udmabuf_pool *pool;
+   struct vkr_udmabuf_slab *slab;
+   atomic_int refcount;
+
+   /* in pages */
+   uint32_t offset;
+   uint32_t size;
+};
+
+struct vkr_udmabuf_pool {
+   int udmabuf_dev_fd;
+   uint32_t page_size;
+   uint32_t slab_pages;
+
+   mtx_t mutex;
+   struct list_head slabs;
+   uint32_t slab_count;
+   uint32_t idle_slab_count;
+
+   /* the pool is freed with its last range once destroyed */
+   uint32_t range_count;
+   bool destroyed;
+
+   struct {
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t oversized;
+      uint32_t max_slab_count;
+   } stats;
+};
+
+static struct vkr_udmabuf_slab *
+vkr_udmabuf_slab_create(struct vkr_udmabuf_pool *pool)
+{
+   struct vkr_udmabuf_slab *slab = calloc(1, sizeof(*slab));
+   if (!slab)
+      return NULL;
+
+   if (!vkr_udmabuf_extents_init(&slab->extents, pool->slab_pages))
+      goto fail;
+
+   slab->memfd = memfd_create("vkr-udmabuf-slab", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+   if (slab->memfd < 0) {
+      vkr_log("memfd_create failed (%s)", strerror(errno));
+      goto fail_extents;
+   }
+
+   if (ftruncate(slab->memfd, VKR_UDMABUF_SLAB_SIZE)) {
+      vkr_log("ftruncate failed (%s)", strerror(errno));
+      goto fail_close;
+   }
+
+   if (fcntl(slab->memfd, F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW)) {
+      vkr_log("fcntl F_ADD_SEALS failed (%s)", strerror(errno));
+      goto fail_close;
+   }
+
+   list_addtail(&slab->head, &pool->slabs);
+   pool->slab_count++;
+   pool->idle_slab_count++;
+   pool->stats.max_slab_count = MAX2(pool->stats.max_slab_count, pool->slab_count);
+
+   return slab;
+
+fail_close:
+   close(slab->memfd);
+fail_extents:
+   vkr_udmabuf_extents_fini(&slab->extents);
+fail:
+   free(slab);
+   return NULL;
+}
+
+static void
+vkr_udmabuf_slab_destroy(struct vkr_udmabuf_pool *pool, struct vkr_udmabuf_slab *slab)
+{
+   if (vkr_udmabuf_extents_is_idle(&slab->extents))
+      pool->idle_slab_count--;
+   pool->slab_count--;
+
+   vkr_udmabuf_extents_fini(&slab->extents);
+   list_del(&slab->head);
+   close(slab->memfd);
+   free(slab);
+}
+
+static bool
+vkr_udmabuf_slab_take(struct vkr_udmabuf_pool *pool,
+                      struct vkr_udmabuf_slab *slab,
+                      uint32_t pages,
+                      uint32_t *out_offset)
+{
+   const bool idle = vkr_udmabuf_extents_is_idle(&slab->extents);
+   if (!vkr_udmabuf_extents_take(&slab->extents, pages, out_offset))
+      return false;
+
+   if (idle)
+      pool->idle_slab_count--;
+
+   return true;
+}
+
+static void
+vkr_udmabuf_slab_give(struct vkr_udmabuf_pool *pool,
+                      struct vkr_udmabuf_slab *slab,
+                      uint32_t offset,
+                      uint32_t pages)
+{
+   vkr_udmabuf_extents_give(&slab->extents, offset, pages);
+
+   if (vkr_udmabuf_extents_is_idle(&slab->extents))
+      pool->idle_slab_count++;
+}
+
+/* Drops the pages of a released range from the memfd and returns the range
+ * to the slab.
+ */
+static void
+vkr_udmabuf_slab_release(struct vkr_udmabuf_pool *pool,
+                         struct vkr_udmabuf_slab *slab,
+                         uint32_t offset,
+                         uint32_t pages)
+{
+   if (fallocate(slab->memfd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                 (off_t)offset * pool->page_size, (off_t)pages * pool->page_size)) {
+      /* the pages may still be visible through an old udmabuf */
+      vkr_log("fallocate PUNCH_HOLE failed (%s)", strerror(errno));
+      return;
+   }
+
+   vkr_udmabuf_slab_give(pool, slab, offset, pages);
+
+   /* keep a single idle slab around for the next burst */
+   if (vkr_udmabuf_extents_is_idle(&slab->extents) && pool->idle_slab_count > 1)
+      vkr_udmabuf_slab_destroy(pool, slab);
+}
+
+struct vkr_udmabuf_pool *
+vkr_udmabuf_pool_create(int udmabuf_dev_fd)
+{
+   struct vkr_udmabuf_pool *pool = calloc(1, sizeof(*pool));
+   if (!pool)
+      return NULL;
+
+   if (mtx_init(&pool->mutex, mtx_plain) != thrd_success) {
+      free(pool);
+      return NULL;
+   }
+
+   pool->udmabuf_dev_fd = udmabuf_dev_fd;
+   pool->page_size = getpagesize();
+   pool->slab_pages = VKR_UDMABUF_SLAB_SIZE / pool->page_size;
+   list_inithead(&pool->slabs);
+
+   return pool;
+}
+
+static void
+vkr_udmabuf_pool_fini(struct vkr_udmabuf_pool *pool)
+{
+   const uint64_t pooled = pool->stats.hits + pool->stats.misses;
+   if (pooled) {
+      uint64_t free_pages = 0;
+      uint32_t largest_extent = 0;
+      list_for_each_entry (struct vkr_udmabuf_slab, slab, &pool->slabs, head) {
+         free_pages += slab->extents.free_size;
+         largest_extent =
+            MAX2(largest_extent, vkr_udmabuf_extents_largest(&slab->extents));
+      }
+
+      vkr_log("udmabuf pool: %" PRIu64 " allocations, %.1f%% hits, %" PRIu64
+              " oversized, %u slabs at most, %.1f%% of free pages fragmented",
+              pooled, 100.0 * pool->stats.hits / pooled, pool->stats.oversized,
+              pool->stats.max_slab_count,
+              free_pages ? 100.0 * (free_pages - largest_extent) / free_pages : 0.0);
+   }
+
+   list_for_each_entry_safe (struct vkr_udmabuf_slab, slab, &pool->slabs, head)
+      vkr_udmabuf_slab_destroy(pool, slab);
+
+   mtx_destroy(&pool->mutex);
+   free(pool);
+}
+
+void
+vkr_udmabuf_pool_destroy(struct vkr_udmabuf_pool *pool)
+{
+   mtx_lock(&pool->mutex);
+   pool->destroyed = true;
+   const bool idle = !pool->range_count;
+   mtx_unlock(&pool->mutex);
+
+   if (idle)
+      vkr_udmabuf_pool_fini(pool);
+}
+
+int
+vkr_udmabuf_pool_alloc(struct vkr_udmabuf_pool *pool,
+                       uint64_t size,
+                       struct vkr_udmabuf_range **out_range)
+{
+   if (!size || size > VKR_UDMABUF_POOL_MAX_ALLOC_SIZE) {
+      mtx_lock(&pool->mutex);
+      pool->stats.oversized++;
+      mtx_unlock(&pool->mutex);
+      return -1;
+   }
+
+   struct vkr_udmabuf_range *range = malloc(sizeof(*range));
+   if (!range)
+      return -1;
+
+   const uint32_t pages = DIV_ROUND_UP(size, pool->page_size);
+   struct vkr_udmabuf_slab *slab = NULL;
+   uint32_t offset = 0;
+
+   mtx_lock(&pool->mutex);
+
+   list_for_each_entry (struct vkr_udmabuf_slab, iter, &pool->slabs, head) {
+      if (vkr_udmabuf_slab_take(pool, iter, pages, &offset)) {
+         slab = iter;
+         pool->stats.hits++;
+         break;
+      }
+   }
+
+   if (!slab) {
+      slab = vkr_udmabuf_slab_create(pool);
+      if (!slab || !vkr_udmabuf_slab_take(pool, slab, pages, &offset)) {
+         mtx_unlock(&pool->mutex);
+         free(range);
+         return -1;
+      }
+      pool->stats.misses++;
+   }
+
+   const struct udmabuf_create create = {
+      .memfd = slab->memfd,
+      .flags = UDMABUF_FLAGS_CLOEXEC,
+      .offset = (uint64_t)offset * pool->page_size,
+      .size = (uint64_t)pages * pool->page_size,
+   };
+   const int udmabuf_fd = ioctl(pool->udmabuf_dev_fd, UDMABUF_CREATE, &create);
+   if (udmabuf_fd < 0) {
+      vkr_log("ioctl UDMABUF_CREATE failed (%s)", strerror(errno));
+      vkr_udmabuf_slab_give(pool, slab, offset, pages);
+      mtx_unlock(&pool->mutex);
+      free(range);
+      return -1;
+   }
+
+   pool->range_count++;
+
+   mtx_unlock(&pool->mutex);
+
+   range->pool = pool;
+   range->slab = slab;
+   atomic_init(&range->refcount, 1);
+   range->offset = offset;
+   range->size = pages;
+   *out_range = range;
+
+   return udmabuf_fd;
+}
+
+struct vkr_udmabuf_range *
+vkr_udmabuf_range_ref(struct vkr_udmabuf_range *range)
+{
+   atomic_fetch_add(&range->refcount, 1);
+   return range;
+}
+
+void
+vkr_udmabuf_range_unref(struct vkr_udmabuf_range *range)
+{
+   if (atomic_fetch_sub(&range->refcount, 1) != 1)
+      return;
+
+   struct vkr_udmabuf_pool *pool = range->pool;
+
+   mtx_lock(&pool->mutex);
+   vkr_udmabuf_slab_release(pool, range->slab, range->offset, range->size);
+   pool->range_count--;
+   const bool fini = pool->destroyed && !pool->range_count;
+   mtx_unlock(&pool->mutex);
+
+   free(range);
+
+   if (fini)
+      vkr_udmabuf_pool_fini(pool);
+}
+
+#else /* HAVE_LINUX_UDMABUF_H && HAVE_MEMFD_CREATE */
+
+struct vkr_udmabuf_pool *
+vkr_udmabuf_pool_create(UNUSED int udmabuf_dev_fd)
+{
+   return NULL;
+}
+
+void
+vkr_udmabuf_pool_destroy(UNUSED struct vkr_udmabuf_pool *pool)
+{
+}
+
+int
+vkr_udmabuf_pool_alloc(UNUSED struct vkr_udmabuf_pool *pool,
+                       UNUSED uint64_t size,
+                       UNUSED struct vkr_udmabuf_range **out_range)
+{
+   return -1;
+}
+
+struct vkr_udmabuf_range *
+vkr_udmabuf_range_ref(struct vkr_udmabuf_range *range)
+{
+   return range;
+}
+
+void
+vkr_udmabuf_range_unref(UNUSED struct vkr_udmabuf_range *range)
+{
+}
+
+#endif /* HAVE_LINUX_UDMABUF_H && HAVE_MEMFD_CREATE */
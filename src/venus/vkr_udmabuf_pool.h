@@ -0,0 +1,49 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef VKR_UDMABUF_POOL_H
+#define VKR_UDMABUF_POOL_H
+
+#include "vkr_common.h"
+
+/*
+ * Carves udmabufs for host visible memory out of large sealed memfds, so that
+ * an allocation does not need its own memfd_create, ftruncate and seals.
+ * Freed ranges are coalesced and handed out again.
+ *
+ * A pool belongs to a physical device of a single context, so recycled pages
+ * never move between contexts.
+ *
+ * A range is referenced by the memory it backs and by the resource the memory
+ * is exported to.  When the last reference goes, its pages are punched out of
+ * the slab before they are handed out again.  Whoever still holds a udmabuf
+ * of the range keeps the old pages, and the next allocation gets zeroed ones.
+ */
+
+struct vkr_udmabuf_pool;
+struct vkr_udmabuf_range;
+
+struct vkr_udmabuf_pool *
+vkr_udmabuf_pool_create(int udmabuf_dev_fd);
+
+/* Ranges still referenced keep the pool alive until they are released. */
+void
+vkr_udmabuf_pool_destroy(struct vkr_udmabuf_pool *pool);
+
+/* Returns a udmabuf of at least size bytes and a reference to its range, or
+ * -1 when size is too large to be pooled or on errors.
+ */
+int
+vkr_udmabuf_pool_alloc(struct vkr_udmabuf_pool *pool,
+                       uint64_t size,
+                       struct vkr_udmabuf_range **out_range);
+
+struct vkr_udmabuf_range *
+vkr_udmabuf_range_ref(struct vkr_udmabuf_range *range);
+
+void
+vkr_udmabuf_range_unref(struct vkr_udmabuf_range *range);
+
+#endif /* VKR_UDMABUF_POOL_H */
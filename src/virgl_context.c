@@ -25,17 +25,26 @@
 #include "virgl_context.h"
 
 #include <errno.h>
+#include <time.h>
 
 #ifndef WIN32
 #include "util/libsync.h"
 #endif
+#include "c11/threads.h"
 #include "util/os_misc.h"
 #include "util/u_hash_table.h"
+#include "util/u_math.h"
 #include "util/u_pointer.h"
 #include "virgl_util.h"
+#include "virglrenderer.h"
 
 static struct util_hash_table *virgl_context_table;
 
+/* Only virgl_context_get_stats may use the table from other threads.  The
+ * mutex keeps the table and its contexts alive for it.
+ */
+static mtx_t virgl_context_table_mutex;
+
 static void
 virgl_context_destroy_func(void *val)
 {
@@ -50,37 +59,56 @@ virgl_context_destroy_func(void *val)
 int
 virgl_context_table_init(void)
 {
+   if (mtx_init(&virgl_context_table_mutex, mtx_plain) != thrd_success)
+      return ENOMEM;
+
    virgl_context_table = util_hash_table_create(hash_func_u32,
                                                 equal_func,
                                                 virgl_context_destroy_func);
-   return virgl_context_table ? 0 : ENOMEM;
+   if (!virgl_context_table) {
+      mtx_destroy(&virgl_context_table_mutex);
+      return ENOMEM;
+   }
+
+   return 0;
 }
 
 void
 virgl_context_table_cleanup(void)
 {
+   mtx_lock(&virgl_context_table_mutex);
    util_hash_table_destroy(virgl_context_table);
    virgl_context_table = NULL;
+   mtx_unlock(&virgl_context_table_mutex);
+
+   mtx_destroy(&virgl_context_table_mutex);
 }
 
 void
 virgl_context_table_reset(void)
 {
+   mtx_lock(&virgl_context_table_mutex);
    util_hash_table_clear(virgl_context_table);
+   mtx_unlock(&virgl_context_table_mutex);
 }
 
 int
 virgl_context_add(struct virgl_context *ctx)
 {
+   mtx_lock(&virgl_context_table_mutex);
    const enum pipe_error err = util_hash_table_set(
          virgl_context_table, uintptr_to_pointer(ctx->ctx_id), ctx);
+   mtx_unlock(&virgl_context_table_mutex);
+
    return err == PIPE_OK ? 0 : ENOMEM;
 }
 
 void
 virgl_context_remove(uint32_t ctx_id)
 {
+   mtx_lock(&virgl_context_table_mutex);
    util_hash_table_remove(virgl_context_table, uintptr_to_pointer(ctx_id));
+   mtx_unlock(&virgl_context_table_mutex);
 }
 
 struct virgl_context *
@@ -119,3 +147,127 @@ int virgl_context_take_in_fence_fd(struct virgl_context *ctx)
 
    return ret;
 }
+
+static uint64_t
+virgl_context_stats_now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void
+virgl_context_stats_fence_created(struct virgl_context *ctx,
+                                  uint32_t ring_idx,
+                                  uint64_t fence_id)
+{
+   if (ring_idx >= VIRGL_CONTEXT_STATS_FENCE_RINGS)
+      return;
+
+   struct virgl_context_fence_times *times = &ctx->fence_times[ring_idx];
+   const unsigned tail = atomic_load_explicit(&times->tail, memory_order_relaxed);
+   const unsigned head = atomic_load_explicit(&times->head, memory_order_acquire);
+   if (tail - head >= VIRGL_CONTEXT_STATS_FENCE_DEPTH)
+      return;
+
+   const unsigned slot = tail % VIRGL_CONTEXT_STATS_FENCE_DEPTH;
+   times->fences[slot].fence_id = fence_id;
+   times->fences[slot].create_ns = virgl_context_stats_now();
+   atomic_store_explicit(&times->tail, tail + 1, memory_order_release);
+}
+
+/* A retired fence also retires the earlier fences of its ring, which might
+ * not be reported on their own when they are mergeable.
+ */
+void
+virgl_context_stats_fence_retired(struct virgl_context *ctx,
+                                  uint32_t ring_idx,
+                                  uint64_t fence_id)
+{
+   if (ring_idx >= VIRGL_CONTEXT_STATS_FENCE_RINGS)
+      return;
+
+   struct virgl_context_fence_times *times = &ctx->fence_times[ring_idx];
+   const unsigned tail = atomic_load_explicit(&times->tail, memory_order_acquire);
+   unsigned head = atomic_load_explicit(&times->head, memory_order_relaxed);
+   uint64_t count = 0, total_ns = 0, max_ns = 0;
+   uint64_t now = 0;
+
+   while (head != tail) {
+      const unsigned slot = head % VIRGL_CONTEXT_STATS_FENCE_DEPTH;
+      if (times->fences[slot].fence_id > fence_id)
+         break;
+
+      if (!now)
+         now = virgl_context_stats_now();
+      const uint64_t latency = now - times->fences[slot].create_ns;
+      count++;
+      total_ns += latency;
+      max_ns = MAX2(max_ns, latency);
+      head++;
+   }
+
+   if (!count)
+      return;
+   atomic_store_explicit(&times->head, head, memory_order_release);
+
+   virgl_context_stats_add(&ctx->stats.fences, count);
+   virgl_context_stats_add(&ctx->stats.fence_latency_ns, total_ns);
+
+   uint_fast64_t old_max = atomic_load_explicit(&ctx->stats.fence_latency_max_ns,
+                                                memory_order_relaxed);
+   while (old_max < max_ns &&
+          !atomic_compare_exchange_weak_explicit(&ctx->stats.fence_latency_max_ns,
+                                                 &old_max, max_ns,
+                                                 memory_order_relaxed,
+                                                 memory_order_relaxed))
+      ;
+}
+
+void
+virgl_context_stats_accumulate(const struct virgl_context_stats *src,
+                               struct virgl_renderer_context_stats *stats)
+{
+#define STATS_LOAD(name) atomic_load_explicit(&src->name, memory_order_relaxed)
+#define STATS_ADD(name) stats->name += STATS_LOAD(name)
+
+   STATS_ADD(commands);
+   STATS_ADD(submits);
+   STATS_ADD(submit_bytes);
+   STATS_ADD(transfers_to_host);
+   STATS_ADD(transfer_to_host_bytes);
+   STATS_ADD(transfers_from_host);
+   STATS_ADD(transfer_from_host_bytes);
+   STATS_ADD(fences);
+   STATS_ADD(fence_latency_ns);
+   stats->fence_latency_max_ns =
+      MAX2(stats->fence_latency_max_ns, STATS_LOAD(fence_latency_max_ns));
+   STATS_ADD(shader_compiles);
+   STATS_ADD(shader_compile_ns);
+   STATS_ADD(resource_bytes);
+   STATS_ADD(ring_busy_ns);
+   STATS_ADD(ring_idle_ns);
+
+#undef STATS_ADD
+#undef STATS_LOAD
+}
+
+bool
+virgl_context_get_stats(uint32_t ctx_id,
+                        struct virgl_renderer_context_stats *stats)
+{
+   mtx_lock(&virgl_context_table_mutex);
+
+   struct virgl_context *ctx = virgl_context_lookup(ctx_id);
+   if (ctx) {
+      *stats = (struct virgl_renderer_context_stats){ .version = stats->version };
+
+      virgl_context_stats_accumulate(&ctx->stats, stats);
+      if (ctx->get_stats)
+         ctx->get_stats(ctx, stats);
+   }
+
+   mtx_unlock(&virgl_context_table_mutex);
+
+   return ctx;
+}
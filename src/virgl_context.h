@@ -25,6 +25,7 @@
 #ifndef VIRGL_CONTEXT_H
 #define VIRGL_CONTEXT_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -36,6 +37,7 @@
 
 struct vrend_transfer_info;
 struct pipe_resource;
+struct virgl_renderer_context_stats;
 
 struct virgl_context_blob {
    /* valid fd or pipe resource */
@@ -51,6 +53,53 @@ struct virgl_context_blob {
    struct virgl_resource_vulkan_info vulkan_info;
 };
 
+/*
+ * The counters behind virgl_renderer_context_get_stats.  They are updated
+ * with relaxed atomics by whichever thread does the work, and read without
+ * stopping it.  For venus, the render worker updates its own copy in the
+ * memory it shares with the proxy context.
+ */
+struct virgl_context_stats {
+   atomic_uint_fast64_t commands;
+   atomic_uint_fast64_t submits;
+   atomic_uint_fast64_t submit_bytes;
+   atomic_uint_fast64_t transfers_to_host;
+   atomic_uint_fast64_t transfer_to_host_bytes;
+   atomic_uint_fast64_t transfers_from_host;
+   atomic_uint_fast64_t transfer_from_host_bytes;
+   atomic_uint_fast64_t fences;
+   atomic_uint_fast64_t fence_latency_ns;
+   atomic_uint_fast64_t fence_latency_max_ns;
+   atomic_uint_fast64_t shader_compiles;
+   atomic_uint_fast64_t shader_compile_ns;
+   atomic_uint_fast64_t resource_bytes;
+   atomic_uint_fast64_t ring_busy_ns;
+   atomic_uint_fast64_t ring_idle_ns;
+};
+
+static inline void
+virgl_context_stats_add(atomic_uint_fast64_t *counter, uint64_t val)
+{
+   atomic_fetch_add_explicit(counter, val, memory_order_relaxed);
+}
+
+/* The fences of the first rings whose creation times are being tracked.  A
+ * fence is not timed when its ring is beyond these or has too many pending.
+ * Fences are created and retired on at most one thread each, so that this
+ * is a single-producer single-consumer queue.
+ */
+#define VIRGL_CONTEXT_STATS_FENCE_RINGS 8
+#define VIRGL_CONTEXT_STATS_FENCE_DEPTH 16
+
+struct virgl_context_fence_times {
+   atomic_uint head;
+   atomic_uint tail;
+   struct {
+      uint64_t fence_id;
+      uint64_t create_ns;
+   } fences[VIRGL_CONTEXT_STATS_FENCE_DEPTH];
+};
+
 struct virgl_context;
 
 typedef void (*virgl_context_fence_retire)(struct virgl_context *ctx,
@@ -138,6 +187,13 @@ struct virgl_context {
                           void *addr,
                           int32_t prot,
                           int32_t flags);
+
+   /* add the counters kept outside of stats, optional */
+   void (*get_stats)(struct virgl_context *ctx,
+                     struct virgl_renderer_context_stats *stats);
+
+   struct virgl_context_stats stats;
+   struct virgl_context_fence_times fence_times[VIRGL_CONTEXT_STATS_FENCE_RINGS];
 };
 
 struct virgl_context_foreach_args {
@@ -168,4 +224,26 @@ virgl_context_foreach(const struct virgl_context_foreach_args *args);
 
 int virgl_context_take_in_fence_fd(struct virgl_context *ctx);
 
+void
+virgl_context_stats_fence_created(struct virgl_context *ctx,
+                                  uint32_t ring_idx,
+                                  uint64_t fence_id);
+
+void
+virgl_context_stats_fence_retired(struct virgl_context *ctx,
+                                  uint32_t ring_idx,
+                                  uint64_t fence_id);
+
+/* adds the counters of src to stats */
+void
+virgl_context_stats_accumulate(const struct virgl_context_stats *src,
+                               struct virgl_renderer_context_stats *stats);
+
+/* Unlike the other functions, this may be called from any thread.  The
+ * context is not destroyed before it returns.
+ */
+bool
+virgl_context_get_stats(uint32_t ctx_id,
+                        struct virgl_renderer_context_stats *stats);
+
 #endif /* VIRGL_CONTEXT_H */
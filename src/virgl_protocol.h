@@ -273,6 +273,9 @@ enum virgl_context_cmd {
 #define VIRGL_OBJ_SHADER_HDR_SIZE(nso) (5 + ((nso) ? (2 * nso) + 4 : 0))
 #define VIRGL_OBJ_SHADER_HANDLE 1
 #define VIRGL_OBJ_SHADER_TYPE 2
+/* with VIRGL_CAP_V2_BINARY_TGSI: the shader is NUM_TOKENS tgsi_token dwords
+ * instead of TGSI text, and OFFSET counts their bytes */
+#define VIRGL_OBJ_SHADER_TYPE_BINARY (0x1u << 31)
 #define VIRGL_OBJ_SHADER_OFFSET 3
 #define VIRGL_OBJ_SHADER_OFFSET_VAL(x) (((x) & 0x7fffffff) << 0)
 /* start contains full length in VAL - also implies continuations */
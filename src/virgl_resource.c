@@ -218,6 +218,23 @@ struct virgl_resource *virgl_resource_lookup(uint32_t res_id)
                               uintptr_to_pointer(res_id));
 }
 
+static enum pipe_error
+virgl_resource_foreach_func(UNUSED void *key, void *val, void *data)
+{
+   const struct virgl_resource_foreach_args *args = data;
+   struct virgl_resource *res = val;
+
+   return args->callback(res, args->data) ? PIPE_OK : PIPE_ERROR;
+}
+
+void
+virgl_resource_foreach(const struct virgl_resource_foreach_args *args)
+{
+   util_hash_table_foreach(virgl_resource_table,
+                           virgl_resource_foreach_func,
+                           (void *)args);
+}
+
 int
 virgl_resource_attach_iov(struct virgl_resource *res,
                           const struct iovec *iov,
@@ -103,6 +103,9 @@ struct virgl_resource {
    void *mapped;
    bool mapped_from_pipe_resource;
 
+   /* the context whose stats count map_size as its resource memory */
+   uint32_t stats_ctx_id;
+
    struct virgl_resource_vulkan_info vulkan_info;
 
    void *private_data;
@@ -124,6 +127,11 @@ struct virgl_resource_pipe_callbacks {
                                             void *data);
 };
 
+struct virgl_resource_foreach_args {
+   bool (*callback)(struct virgl_resource *res, void *data);
+   void *data;
+};
+
 int
 virgl_resource_table_init(const struct virgl_resource_pipe_callbacks *callbacks);
 
@@ -163,6 +171,9 @@ virgl_resource_remove(uint32_t res_id);
 struct virgl_resource *
 virgl_resource_lookup(uint32_t res_id);
 
+void
+virgl_resource_foreach(const struct virgl_resource_foreach_args *args);
+
 int
 virgl_resource_attach_iov(struct virgl_resource *res,
                           const struct iovec *iov,
@@ -39,6 +39,7 @@
 #include "util/u_string.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 
@@ -270,9 +271,17 @@ void virgl_prefixed_logv(const char *domain,
 #if ENABLE_TRACING == TRACE_WITH_PERCETTO
 PERCETTO_CATEGORY_DEFINE(VIRGL_PERCETTO_CATEGORIES)
 
+#define VIRGL_TRACE_COUNTER_DEFINE(NAME) PERCETTO_TRACK_DEFINE(NAME, PERCETTO_TRACK_COUNTER);
+VIRGL_TRACE_COUNTERS(VIRGL_TRACE_COUNTER_DEFINE)
+#undef VIRGL_TRACE_COUNTER_DEFINE
+
 void trace_init(void)
 {
   PERCETTO_INIT(PERCETTO_CLOCK_DONT_CARE);
+
+#define VIRGL_TRACE_COUNTER_REGISTER(NAME) PERCETTO_REGISTER_TRACK(NAME);
+  VIRGL_TRACE_COUNTERS(VIRGL_TRACE_COUNTER_REGISTER)
+#undef VIRGL_TRACE_COUNTER_REGISTER
 }
 #endif
 
@@ -304,6 +313,13 @@ void trace_end(void **dummy)
    (void)dummy;
    vperfetto_min_endTrackEvent_VMM();
 }
+
+void trace_counter(const char *name, int64_t value)
+{
+   /* vperfetto_min only supports track events */
+   (void)name;
+   (void)value;
+}
 #endif
 
 #if ENABLE_TRACING == TRACE_WITH_SYSPROF
@@ -336,6 +352,13 @@ void trace_end(void **func_name)
                           NULL);
    free(trace);
 }
+
+void trace_counter(const char *name, int64_t value)
+{
+   char message[24];
+   snprintf(message, sizeof(message), "%" PRId64, value);
+   sysprof_collector_mark(SYSPROF_CAPTURE_CURRENT_TIME, 0, "virglrenderer", name, message);
+}
 #endif
 
 #if ENABLE_TRACING == TRACE_WITH_STDERR
@@ -362,6 +385,13 @@ void trace_end(void **func_name)
       fprintf(stderr, "  ");
    fprintf(stderr, "LEAVE %s\n", (const char *) *func_name);
 }
+
+void trace_counter(const char *name, int64_t value)
+{
+   for (int i = 0; i < nesting_depth; ++i)
+      fprintf(stderr, "  ");
+   fprintf(stderr, "COUNTER %s %" PRId64 "\n", name, value);
+}
 #endif
 
 void set_dmabuf_name(int fd, const char *name)
@@ -112,6 +112,19 @@ static inline void PRINTFLIKE(1, 2) virgl_error(const char *fmt, ...)
    va_end(va);
 }
 
+/* Counter tracks, numeric values traced with TRACE_COUNTER_VALUE(). */
+#define VIRGL_TRACE_COUNTERS(C) \
+  C(copy_fallback_gpu_bytes) \
+  C(copy_fallback_cpu_bytes) \
+  C(damage_readback_bytes) \
+  C(resource_pool_bytes) \
+  C(resource_pool_hits) \
+  C(resource_pool_misses) \
+  C(gl_calls_elided) \
+  C(draws_merged) \
+  C(vk_allocator_map_us) \
+  C(vk_allocator_unmap_us)
+
 #ifdef ENABLE_TRACING
 void trace_init(void);
 
@@ -128,6 +141,10 @@ void trace_init(void);
 
 PERCETTO_CATEGORY_DECLARE(VIRGL_PERCETTO_CATEGORIES)
 
+#define VIRGL_TRACE_COUNTER_DECLARE(NAME) PERCETTO_TRACK_DECLARE(NAME);
+VIRGL_TRACE_COUNTERS(VIRGL_TRACE_COUNTER_DECLARE)
+#undef VIRGL_TRACE_COUNTER_DECLARE
+
 static inline void *
 trace_begin(const char *scope)
 {
@@ -141,10 +158,15 @@ trace_end(UNUSED void **scope)
    TRACE_EVENT_END(virgl);
 }
 
+#define TRACE_COUNTER_VALUE(NAME, VALUE) TRACE_COUNTER(virgl, NAME, VALUE)
+
 #else /* ENABLE_TRACING == TRACE_WITH_PERCETTO */
 
 void *trace_begin(const char *scope);
 void trace_end(void **scope);
+void trace_counter(const char *name, int64_t value);
+
+#define TRACE_COUNTER_VALUE(NAME, VALUE) trace_counter(#NAME, VALUE)
 
 #endif /* ENABLE_TRACING == TRACE_WITH_PERCETTO */
 
@@ -166,6 +188,7 @@ void trace_end(void **scope);
 #define TRACE_SCOPE_SLOW(SCOPE)
 #define TRACE_SCOPE_BEGIN(SCOPE) NULL
 #define TRACE_SCOPE_END(SCOPE_OBJ) (void)SCOPE_OBJ
+#define TRACE_COUNTER_VALUE(NAME, VALUE) (void)(VALUE)
 #endif /* ENABLE_TRACING */
 
 /* Utility to name a dmabuf using DMA_BUF_SET_NAME_B. */
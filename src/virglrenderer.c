@@ -76,12 +76,25 @@ struct global_state {
 
 static struct global_state state;
 
+static inline void virgl_renderer_unlock_scope(UNUSED int *dummy)
+{
+   vrend_renderer_unlock();
+}
+
+/* Serializes calls reaching vrend with its context threads, see
+ * vrend_renderer_lock.  This is a no-op unless threaded contexts are used.
+ */
+#define VIRGL_RENDERER_LOCK_SCOPE()                                                \
+   int virgl_renderer_lock_dummy __attribute__((cleanup(virgl_renderer_unlock_scope), \
+                                                unused)) = (vrend_renderer_lock(), 0)
+
 /* new API - just wrap internal API for now */
 
 static int virgl_renderer_resource_create_internal(struct virgl_renderer_resource_create_args *args,
                                                    UNUSED struct iovec *iov, UNUSED uint32_t num_iovs,
                                                    void *image)
 {
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res;
    struct pipe_resource *pipe_res;
    struct vrend_renderer_resource_create_args vrend_args =  { 0 };
@@ -162,12 +175,20 @@ static bool detach_resource(struct virgl_context *ctx, void *data)
 
 void virgl_renderer_resource_unref(uint32_t res_handle)
 {
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res = virgl_resource_lookup(res_handle);
    struct virgl_context_foreach_args args;
 
    if (!res)
       return;
 
+   if (res->stats_ctx_id) {
+      struct virgl_context *ctx = virgl_context_lookup(res->stats_ctx_id);
+      if (ctx)
+         atomic_fetch_sub_explicit(&ctx->stats.resource_bytes, res->map_size,
+                                   memory_order_relaxed);
+   }
+
    args.callback = detach_resource;
    args.data = res;
    virgl_context_foreach(&args);
@@ -178,6 +199,7 @@ void virgl_renderer_resource_unref(uint32_t res_handle)
 void virgl_renderer_fill_caps(uint32_t set, uint32_t version,
                               void *caps)
 {
+   VIRGL_RENDERER_LOCK_SCOPE();
    switch (set) {
    case VIRTGPU_DRM_CAPSET_VIRGL:
    case VIRTGPU_DRM_CAPSET_VIRGL2:
@@ -201,6 +223,7 @@ static void per_context_fence_retire(struct virgl_context *ctx,
                                      uint32_t ring_idx,
                                      uint64_t fence_id)
 {
+   virgl_context_stats_fence_retired(ctx, ring_idx, fence_id);
    state.cbs->write_context_fence(state.cookie,
                                   ctx->ctx_id,
                                   ring_idx,
@@ -217,6 +240,7 @@ int virgl_renderer_context_create_with_flags(uint32_t ctx_id,
    int ret;
 
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
 
    /* user context id must be greater than 0 */
    if (ctx_id == 0)
@@ -280,17 +304,41 @@ int virgl_renderer_context_create(uint32_t handle, uint32_t nlen, const char *na
                                                    name);
 }
 
+static bool forget_resource_stats_ctx(struct virgl_resource *res, void *data)
+{
+   const uint32_t *ctx_id = data;
+   if (res->stats_ctx_id == *ctx_id)
+      res->stats_ctx_id = 0;
+   return true;
+}
+
 void virgl_renderer_context_destroy(uint32_t handle)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
+
+   /* so that a later context with the same id is not charged for them */
+   const struct virgl_resource_foreach_args args = {
+      .callback = forget_resource_stats_ctx,
+      .data = &handle,
+   };
+   virgl_resource_foreach(&args);
+
    virgl_context_remove(handle);
 }
 
+static void account_submit(struct virgl_context *ctx, uint32_t size)
+{
+   virgl_context_stats_add(&ctx->stats.submits, 1);
+   virgl_context_stats_add(&ctx->stats.submit_bytes, size);
+}
+
 int virgl_renderer_submit_cmd(void *buffer,
                               int ctx_id,
                               int ndw)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_context *ctx = virgl_context_lookup(ctx_id);
    if (!ctx)
       return EINVAL;
@@ -301,9 +349,24 @@ int virgl_renderer_submit_cmd(void *buffer,
    if (((uintptr_t)buffer & 3) != 0)
       return EFAULT;
 
+   account_submit(ctx, (uint32_t)ndw * sizeof(uint32_t));
    return ctx->submit_cmd(ctx, buffer, (uint32_t)ndw * sizeof(uint32_t));
 }
 
+/* The bytes of the box, which are what a transfer copies unless the format
+ * is unknown to the host, as for blobs.
+ */
+static uint64_t transfer_size(const struct virgl_resource *res,
+                              const struct virgl_box *box)
+{
+   if (!res->pipe_resource)
+      return box->w;
+
+   const enum pipe_format format = res->pipe_resource->format;
+   return (uint64_t)util_format_get_nblocks(format, box->w, box->h) *
+          util_format_get_blocksize(format) * box->d;
+}
+
 int virgl_renderer_transfer_write_iov(uint32_t handle,
                                       uint32_t ctx_id,
                                       int level,
@@ -315,6 +378,7 @@ int virgl_renderer_transfer_write_iov(uint32_t handle,
                                       unsigned int iovec_cnt)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
 
    struct virgl_resource *res = virgl_resource_lookup(handle);
    struct vrend_transfer_info transfer_info;
@@ -336,12 +400,16 @@ int virgl_renderer_transfer_write_iov(uint32_t handle,
       if (!ctx)
          return EINVAL;
 
+      virgl_context_stats_add(&ctx->stats.transfers_to_host, 1);
+      virgl_context_stats_add(&ctx->stats.transfer_to_host_bytes, transfer_size(res, box));
       return ctx->transfer_3d(ctx, res, &transfer_info,
                               VIRGL_TRANSFER_TO_HOST);
    } else {
       if (!res->pipe_resource)
          return EINVAL;
 
+      /* the resource can be in use by any context */
+      vrend_renderer_flush_context_queues();
       return vrend_renderer_transfer_pipe(res->pipe_resource, &transfer_info,
                                           VIRGL_TRANSFER_TO_HOST);
    }
@@ -355,6 +423,7 @@ int virgl_renderer_transfer_read_iov(uint32_t handle, uint32_t ctx_id,
                                      int iovec_cnt)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res = virgl_resource_lookup(handle);
    struct vrend_transfer_info transfer_info;
 
@@ -375,12 +444,15 @@ int virgl_renderer_transfer_read_iov(uint32_t handle, uint32_t ctx_id,
       if (!ctx)
          return EINVAL;
 
+      virgl_context_stats_add(&ctx->stats.transfers_from_host, 1);
+      virgl_context_stats_add(&ctx->stats.transfer_from_host_bytes, transfer_size(res, box));
       return ctx->transfer_3d(ctx, res, &transfer_info,
                               VIRGL_TRANSFER_FROM_HOST);
    } else {
       if (!res->pipe_resource)
          return EINVAL;
 
+      vrend_renderer_flush_context_queues();
       return vrend_renderer_transfer_pipe(res->pipe_resource, &transfer_info,
                                           VIRGL_TRANSFER_FROM_HOST);
    }
@@ -390,6 +462,7 @@ int virgl_renderer_resource_attach_iov(int res_handle, struct iovec *iov,
                                        int num_iovs)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res = virgl_resource_lookup(res_handle);
    if (!res)
       return EINVAL;
@@ -400,6 +473,7 @@ int virgl_renderer_resource_attach_iov(int res_handle, struct iovec *iov,
 void virgl_renderer_resource_detach_iov(int res_handle, struct iovec **iov_p, int *num_iovs_p)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res = virgl_resource_lookup(res_handle);
    if (!res)
       return;
@@ -415,9 +489,10 @@ void virgl_renderer_resource_detach_iov(int res_handle, struct iovec **iov_p, in
 int virgl_renderer_create_fence(int client_fence_id, UNUSED uint32_t ctx_id)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    const uint32_t fence_id = (uint32_t)client_fence_id;
    if (state.vrend_initialized)
-      return vrend_renderer_create_ctx0_fence(fence_id);
+      return vrend_renderer_queue_ctx0_fence(fence_id);
    return EINVAL;
 }
 
@@ -427,17 +502,22 @@ int virgl_renderer_context_create_fence(uint32_t ctx_id,
                                         uint64_t fence_id)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_context *ctx = virgl_context_lookup(ctx_id);
    if (!ctx)
       return -EINVAL;
 
    assert(state.cbs->version >= 3 && state.cbs->write_context_fence);
+
+   /* before the fence can be retired */
+   virgl_context_stats_fence_created(ctx, ring_idx, fence_id);
    return ctx->submit_fence(ctx, flags, ring_idx, fence_id);
 }
 
 void virgl_renderer_context_poll(uint32_t ctx_id)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_context *ctx = virgl_context_lookup(ctx_id);
    if (!ctx)
       return;
@@ -456,6 +536,7 @@ int virgl_renderer_context_get_poll_fd(uint32_t ctx_id)
 
 void virgl_renderer_force_ctx_0(void)
 {
+   VIRGL_RENDERER_LOCK_SCOPE();
    if (state.vrend_initialized)
       vrend_renderer_force_ctx_0();
 }
@@ -463,6 +544,7 @@ void virgl_renderer_force_ctx_0(void)
 void virgl_renderer_ctx_attach_resource(int ctx_id, int res_handle)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_context *ctx = virgl_context_lookup(ctx_id);
    struct virgl_resource *res = virgl_resource_lookup(res_handle);
    if (!ctx || !res)
@@ -473,6 +555,7 @@ void virgl_renderer_ctx_attach_resource(int ctx_id, int res_handle)
 void virgl_renderer_ctx_detach_resource(int ctx_id, int res_handle)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_context *ctx = virgl_context_lookup(ctx_id);
    struct virgl_resource *res = virgl_resource_lookup(res_handle);
    if (!ctx || !res)
@@ -487,6 +570,7 @@ static int virgl_renderer_resource_get_info_common(int res_handle,
    int ret = 0;
 
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res = virgl_resource_lookup(res_handle);
 
    if (!res)
@@ -587,6 +671,7 @@ void virgl_renderer_get_rect(int resource_id, struct iovec *iov, unsigned int nu
                              uint32_t offset, int x, int y, int width, int height)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res = virgl_resource_lookup(resource_id);
    if (!res || !res->pipe_resource)
       return;
@@ -595,6 +680,20 @@ void virgl_renderer_get_rect(int resource_id, struct iovec *iov, unsigned int nu
                            width, height);
 }
 
+int virgl_renderer_get_damaged_rect(int resource_id, struct iovec *iov,
+                                    unsigned int num_iovs, uint32_t offset,
+                                    virgl_renderer_rect_cb cb, void *data)
+{
+   TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
+   struct virgl_resource *res = virgl_resource_lookup(resource_id);
+   if (!res || !res->pipe_resource)
+      return -EINVAL;
+
+   return vrend_renderer_read_damage(res->pipe_resource, iov, num_iovs, offset,
+                                     cb, data);
+}
+
 
 static void ctx0_fence_retire(uint64_t fence_id, UNUSED void *retire_data)
 {
@@ -723,6 +822,7 @@ static const struct proxy_renderer_cbs proxy_cbs = {
 
 void *virgl_renderer_get_cursor_data(uint32_t resource_id, uint32_t *width, uint32_t *height)
 {
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res = virgl_resource_lookup(resource_id);
    if (!res || !res->pipe_resource)
       return NULL;
@@ -751,6 +851,7 @@ virgl_context_foreach_retire_fences(struct virgl_context *ctx,
 void virgl_renderer_poll(void)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    if (state.vrend_initialized)
       vrend_renderer_poll();
 
@@ -762,8 +863,11 @@ void virgl_renderer_poll(void)
 void virgl_renderer_cleanup(UNUSED void *cookie)
 {
    TRACE_FUNC();
-   if (state.vrend_initialized)
+   if (state.vrend_initialized) {
+      vrend_renderer_lock();
       vrend_renderer_prepare_reset();
+      vrend_renderer_unlock();
+   }
 
    if (state.context_initialized)
       virgl_context_table_cleanup();
@@ -786,7 +890,7 @@ void virgl_renderer_cleanup(UNUSED void *cookie)
    if (state.drm_initialized)
       drm_renderer_fini();
 
-   /* vkr_allocator_init is called on-demand upon the first map */
+   /* vkr_allocator_init is called at init or upon the first map */
    vkr_allocator_fini();
 
    memset(&state, 0, sizeof(state));
@@ -919,6 +1023,24 @@ int virgl_renderer_init(void *cookie, int flags, struct virgl_renderer_callbacks
          renderer_flags |= VREND_USE_GLES;
       if (flags & VIRGL_RENDERER_VENUS)
          renderer_flags |= VREND_USE_GBM_LAYOUT;
+      if (flags & VIRGL_RENDERER_USE_BLOB_HEAP)
+         renderer_flags |= VREND_USE_BLOB_HEAP;
+      /* Context threads unbind their GL context, which needs EGL, and make
+       * GL contexts current off the caller's thread, which the GL callbacks
+       * of the VMM do not allow for.
+       */
+      if (flags & VIRGL_RENDERER_THREADED_CONTEXTS) {
+         if (state.winsys_initialized && !(flags & VIRGL_RENDERER_USE_GLX))
+            renderer_flags |= VREND_USE_THREADED_CONTEXTS;
+         else
+            virgl_warn("threaded contexts need the EGL winsys of virglrenderer\n");
+      }
+      if (flags & VIRGL_RENDERER_USE_CONST_RING)
+         renderer_flags |= VREND_USE_CONST_RING;
+      if ((flags & VIRGL_RENDERER_SPECULATIVE_SHADERS) && !(flags & VIRGL_RENDERER_USE_GLX))
+         renderer_flags |= VREND_USE_SPECULATIVE_SHADERS;
+      if (flags & VIRGL_RENDERER_USE_RESOURCE_POOL)
+         renderer_flags |= VREND_USE_RESOURCE_POOL;
 
       ret = vrend_renderer_init(&vrend_cbs, renderer_flags);
       if (ret) {
@@ -961,6 +1083,10 @@ int virgl_renderer_init(void *cookie, int flags, struct virgl_renderer_callbacks
       state.fence_initialized = true;
    }
 
+   /* a failure leaves the allocator to be initialized on the first map */
+   if ((flags & VIRGL_RENDERER_INIT_VK_ALLOCATOR) && vkr_allocator_init())
+      virgl_warn("failed to initialize the vulkan allocator\n");
+
    return 0;
 
 fail:
@@ -971,6 +1097,7 @@ fail:
 int virgl_renderer_get_fd_for_texture(uint32_t tex_id, int *fd)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    if (state.winsys_initialized)
       return vrend_winsys_get_fd_for_texture(tex_id, fd);
    return -1;
@@ -979,6 +1106,7 @@ int virgl_renderer_get_fd_for_texture(uint32_t tex_id, int *fd)
 int virgl_renderer_get_fd_for_texture2(uint32_t tex_id, int *fd, int *stride, int *offset)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    if (state.winsys_initialized)
       return vrend_winsys_get_fd_for_texture2(tex_id, fd, stride, offset);
    return -1;
@@ -987,6 +1115,7 @@ int virgl_renderer_get_fd_for_texture2(uint32_t tex_id, int *fd, int *stride, in
 void virgl_renderer_reset(void)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    if (state.vrend_initialized)
       vrend_renderer_prepare_reset();
 
@@ -1119,6 +1248,7 @@ static int virgl_renderer_supported_structures(void *execute_args, uint32_t exec
 int virgl_renderer_execute(void *execute_args, uint32_t execute_size)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_renderer_hdr *hdr = execute_args;
    if (hdr->stype_version != 0)
       return -EINVAL;
@@ -1136,6 +1266,7 @@ int virgl_renderer_execute(void *execute_args, uint32_t execute_size)
 int virgl_renderer_resource_create_blob(const struct virgl_renderer_resource_create_blob_args *args)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res;
    struct virgl_context *ctx;
    struct virgl_context_blob blob;
@@ -1224,12 +1355,16 @@ int virgl_renderer_resource_create_blob(const struct virgl_renderer_resource_cre
    res->map_info = blob.map_info;
    res->map_size = args->size;
 
+   res->stats_ctx_id = ctx->ctx_id;
+   virgl_context_stats_add(&ctx->stats.resource_bytes, args->size);
+
    return 0;
 }
 
 int virgl_renderer_resource_map(uint32_t res_handle, void **out_map, uint64_t *out_size)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    int ret = 0;
    void *map = NULL;
    uint64_t map_size = 0;
@@ -1293,8 +1428,24 @@ int virgl_renderer_resource_map(uint32_t res_handle, void **out_map, uint64_t *o
    return ret;
 }
 
+int virgl_renderer_resource_get_map_region(uint32_t res_handle, void **out_base,
+                                           uint64_t *out_size, uint64_t *out_offset)
+{
+   VIRGL_RENDERER_LOCK_SCOPE();
+   struct virgl_resource *res = virgl_resource_lookup(res_handle);
+   if (!res)
+      return -EINVAL;
+
+   if (!res->pipe_resource)
+      return -ENODATA;
+
+   return vrend_renderer_resource_get_map_region(res->pipe_resource, out_base, out_size,
+                                                 out_offset);
+}
+
 int virgl_renderer_resource_map_fixed(uint32_t res_handle, void *addr)
 {
+   VIRGL_RENDERER_LOCK_SCOPE();
    void *map = NULL;
    struct virgl_context *ctx = NULL;
    struct virgl_resource *res = virgl_resource_lookup(res_handle);
@@ -1349,6 +1500,7 @@ int virgl_renderer_resource_map_fixed(uint32_t res_handle, void *addr)
 int virgl_renderer_resource_unmap(uint32_t res_handle)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    int ret = 0;
    struct virgl_resource *res = virgl_resource_lookup(res_handle);
    if (!res || !res->mapped)
@@ -1384,6 +1536,7 @@ int virgl_renderer_resource_unmap(uint32_t res_handle)
 int virgl_renderer_resource_get_map_info(uint32_t res_handle, uint32_t *map_info)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res = virgl_resource_lookup(res_handle);
    if (!res)
       return -EINVAL;
@@ -1400,6 +1553,7 @@ int
 virgl_renderer_resource_export_blob(uint32_t res_id, uint32_t *fd_type, int *fd)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res = virgl_resource_lookup(res_id);
    if (!res)
       return -EINVAL;
@@ -1429,6 +1583,7 @@ int
 virgl_renderer_resource_import_blob(const struct virgl_renderer_resource_import_blob_args *args)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_resource *res;
 
    /* user resource id must be greater than 0 */
@@ -1486,6 +1641,11 @@ int
 virgl_renderer_export_fence(uint64_t client_fence_id, int *fd)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
+
+   /* a ctx0 fence might still wait for queued commands */
+   if (state.vrend_initialized)
+      vrend_renderer_flush_context_queues();
 
    /* transfers FD ownership to caller */
    *fd = virgl_fence_get_fd(client_fence_id);
@@ -1495,6 +1655,18 @@ virgl_renderer_export_fence(uint64_t client_fence_id, int *fd)
    return -EINVAL;
 }
 
+void
+virgl_renderer_get_resource_pool_stats(uint64_t *hits, uint64_t *misses)
+{
+   TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
+
+   *hits = 0;
+   *misses = 0;
+   if (state.vrend_initialized)
+      vrend_renderer_resource_pool_stats(hits, misses);
+}
+
 int virgl_renderer_export_signalled_fence(void)
 {
    TRACE_FUNC();
@@ -1584,6 +1756,7 @@ int virgl_renderer_submit_cmd2(void *buffer,
                                uint32_t num_in_fences)
 {
    TRACE_FUNC();
+   VIRGL_RENDERER_LOCK_SCOPE();
    struct virgl_context *ctx = virgl_context_lookup(ctx_id);
    if (!ctx)
       return EINVAL;
@@ -1600,9 +1773,44 @@ int virgl_renderer_submit_cmd2(void *buffer,
          return err;
    }
 
+   account_submit(ctx, (uint32_t)ndw * sizeof(uint32_t));
    return ctx->submit_cmd(ctx, buffer, (uint32_t)ndw * sizeof(uint32_t));
 }
 
+/* The size of each version of the stats, whose fields are only appended. */
+static size_t context_stats_size(int version)
+{
+   switch (version) {
+   case 1:
+      return offsetof(struct virgl_renderer_context_stats, ring_idle_ns) +
+             sizeof(uint64_t);
+   default:
+      return 0;
+   }
+}
+
+int virgl_renderer_context_get_stats(uint32_t ctx_id,
+                                     struct virgl_renderer_context_stats *stats)
+{
+   TRACE_FUNC();
+   const size_t size = context_stats_size(stats->version);
+   if (!size)
+      return EINVAL;
+
+   /* the counters are atomic, so the context threads are not waited for */
+   struct virgl_renderer_context_stats all = {
+      .version = VIRGL_RENDERER_CONTEXT_STATS_VERSION,
+   };
+   if (!virgl_context_get_stats(ctx_id, &all))
+      return EINVAL;
+
+   /* the struct of an older caller is smaller */
+   const size_t start = offsetof(struct virgl_renderer_context_stats, commands);
+   memcpy((char *)stats + start, (const char *)&all + start, size - start);
+
+   return 0;
+}
+
 int virgl_renderer_get_dev_fd(int ctx_id)
 {
    struct virgl_context *ctx = virgl_context_lookup(ctx_id);
@@ -169,6 +169,53 @@ struct virgl_renderer_callbacks {
 /* Blob allocations must be done by guest from dedicated heap (Host visible memory). */
 #define VIRGL_RENDERER_USE_GUEST_VRAM (1 << 14)
 
+/*
+ * Carve small host visible blobs out of a few large shared mappings instead
+ * of giving each of them a mapping of its own.  See
+ * virgl_renderer_resource_get_map_region().
+ */
+#define VIRGL_RENDERER_USE_BLOB_HEAP (1 << 15)
+
+/*
+ * Decode and render the commands of each virgl context on a thread of its
+ * own.  The threads split the command buffers concurrently, but render
+ * them one at a time.  virgl_renderer_submit_cmd() queues the commands and
+ * returns, so submission errors are only logged, and completion must be
+ * waited for with fences.  All calls must still come from the thread that
+ * called virgl_renderer_init(), which keeps ctx0 bound.  Needs
+ * VIRGL_RENDERER_USE_EGL, and is ignored with the GL callbacks of the VMM
+ * and with VIRGL_RENDERER_ASYNC_FENCE_CB.
+ */
+#define VIRGL_RENDERER_THREADED_CONTEXTS (1 << 16)
+
+/*
+ * Streams shader constants into a persistently mapped uniform buffer that is
+ * recycled with fences, instead of uploading them with glUniform on every
+ * program or constant change.  Needs GL_ARB_buffer_storage.
+ */
+#define VIRGL_RENDERER_USE_CONST_RING (1 << 17)
+
+/*
+ * Initializes the Vulkan instance and devices used to map opaque fd blobs
+ * in virgl_renderer_init(), instead of on the first such map.  Only useful
+ * with VIRGL_RENDERER_VENUS.
+ */
+#define VIRGL_RENDERER_INIT_VK_ALLOCATOR (1 << 18)
+
+/*
+ * Compiles the variant a new shader is most likely drawn with on a thread
+ * with a shared GL context, using a key predicted from the current state,
+ * so that the first draw usually finds it compiled.  Ignored with GLX.
+ */
+#define VIRGL_RENDERER_SPECULATIVE_SHADERS (1 << 19)
+
+/*
+ * Keeps the GL storage of destroyed resources for a while, to create
+ * identical resources with it.  Costs a fence and a flush per destroyed
+ * resource.  See virgl_renderer_get_resource_pool_stats().
+ */
+#define VIRGL_RENDERER_USE_RESOURCE_POOL (1 << 20)
+
 VIRGL_EXPORT int virgl_renderer_init(void *cookie, int flags, struct virgl_renderer_callbacks *cb);
 VIRGL_EXPORT void virgl_renderer_poll(void); /* force fences */
 
@@ -178,6 +225,29 @@ VIRGL_EXPORT void *virgl_renderer_get_cursor_data(uint32_t resource_id, uint32_t
 VIRGL_EXPORT void virgl_renderer_get_rect(int resource_id, struct iovec *iov, unsigned int num_iovs,
                                           uint32_t offset, int x, int y, int width, int height);
 
+/* Called when the rectangle requested by virgl_renderer_get_damaged_rect()
+ * has been written.  An empty rectangle means the readback failed.
+ */
+typedef void (*virgl_renderer_rect_cb)(void *data, int x, int y, int width, int height);
+
+/* Asynchronously reads back the rectangle of a texture resource written
+ * since the previous call, or the whole resource on the first call.  iov
+ * describes the whole image at the given offset, as for
+ * virgl_renderer_get_rect(), and must stay valid until cb is called from
+ * virgl_renderer_poll().  cb is not called if the resource is destroyed
+ * first.
+ *
+ * Only writes through virgl contexts are tracked, not writes to imported
+ * resources from outside virglrenderer.
+ *
+ * Returns 0 when a readback was started, -ENODATA when nothing was written,
+ * -EBUSY while the previous readback of the resource is in flight, or
+ * another negative errno.
+ */
+VIRGL_EXPORT int virgl_renderer_get_damaged_rect(int resource_id, struct iovec *iov,
+                                                 unsigned int num_iovs, uint32_t offset,
+                                                 virgl_renderer_rect_cb cb, void *data);
+
 VIRGL_EXPORT int virgl_renderer_get_fd_for_texture(uint32_t tex_id, int *fd);
 VIRGL_EXPORT int virgl_renderer_get_fd_for_texture2(uint32_t tex_id, int *fd, int *stride, int *offset);
 
@@ -424,6 +494,20 @@ VIRGL_EXPORT int virgl_renderer_resource_map(uint32_t res_handle, void **map, ui
 
 VIRGL_EXPORT int virgl_renderer_resource_unmap(uint32_t res_handle);
 
+/*
+ * For a blob carved out of a shared mapping (see VIRGL_RENDERER_USE_BLOB_HEAP),
+ * returns the base of that mapping, and the page aligned offset and size of
+ * the range of it that holds the blob.  Only that range belongs to the blob,
+ * the rest of the shared mapping must not be exposed with it.  Blobs of the
+ * same context that share a base can be exposed through a single mapping of
+ * the shared one, which stays valid until virgl_renderer_cleanup().
+ *
+ * Returns -ENODATA for blobs with a mapping of their own.
+ */
+VIRGL_EXPORT int
+virgl_renderer_resource_get_map_region(uint32_t res_handle, void **out_base,
+                                       uint64_t *out_size, uint64_t *out_offset);
+
 #define VIRGL_RENDERER_MAP_CACHE_MASK      0x0f
 #define VIRGL_RENDERER_MAP_CACHE_NONE      0x00
 #define VIRGL_RENDERER_MAP_CACHE_CACHED    0x01
@@ -460,6 +544,54 @@ VIRGL_EXPORT int virgl_renderer_context_create_fence(uint32_t ctx_id,
 VIRGL_EXPORT void virgl_renderer_context_poll(uint32_t ctx_id); /* force fences */
 VIRGL_EXPORT int virgl_renderer_context_get_poll_fd(uint32_t ctx_id);
 
+#define VIRGL_RENDERER_CONTEXT_STATS_VERSION 1
+
+/* Counters of the work done for a context since it was created.  Times are
+ * in nanoseconds of CLOCK_MONOTONIC.  A counter that does not apply to the
+ * context, such as ring_busy_ns for a virgl context, stays 0.
+ */
+struct virgl_renderer_context_stats {
+   int version;
+
+   /* commands decoded from the submitted command streams and rings */
+   uint64_t commands;
+   /* calls to virgl_renderer_submit_cmd{,2} and their sizes */
+   uint64_t submits;
+   uint64_t submit_bytes;
+
+   /* virgl_renderer_transfer_{write,read}_iov calls with this context */
+   uint64_t transfers_to_host;
+   uint64_t transfer_to_host_bytes;
+   uint64_t transfers_from_host;
+   uint64_t transfer_from_host_bytes;
+
+   /* fences retired, and the time from their creation to their retirement */
+   uint64_t fences;
+   uint64_t fence_latency_ns;
+   uint64_t fence_latency_max_ns;
+
+   /* shaders compiled, and the time the context waited for them */
+   uint64_t shader_compiles;
+   uint64_t shader_compile_ns;
+
+   /* host storage of the blob resources created from the context */
+   uint64_t resource_bytes;
+
+   /* time venus rings spent executing commands, and asleep waiting for them */
+   uint64_t ring_busy_ns;
+   uint64_t ring_idle_ns;
+};
+
+/* Reads the counters without waiting for the context to be idle.  They are
+ * updated as the work is done, so that counters read together may be off by
+ * the work in progress.  This may be called from any thread.
+ *
+ * stats->version must be set to the version the caller was built with, and
+ * only the fields of that version are written.
+ */
+VIRGL_EXPORT int
+virgl_renderer_context_get_stats(uint32_t ctx_id, struct virgl_renderer_context_stats *stats);
+
 /* Map a resource to an specific userspace address. If successful, the
  * mapping is owned by the caller and is its responsibility to unmap
  * the resource by its own means (i.e. overriding the map with
@@ -484,6 +616,12 @@ virgl_renderer_export_fence(uint64_t client_fence_id, int *fd);
 VIRGL_EXPORT int
 virgl_renderer_export_signalled_fence(void);
 
+/* Number of virgl resources created with the GL storage of a destroyed one,
+ * and created with new storage.
+ */
+VIRGL_EXPORT void
+virgl_renderer_get_resource_pool_stats(uint64_t *hits, uint64_t *misses);
+
 /* Submit a command buffer for execution.  ctx_id is the context ID.
  * ndw is the length of the buffer in 4-byte words.
  *
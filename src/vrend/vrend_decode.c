@@ -29,6 +29,7 @@
 #include <fcntl.h>
 
 #include "util/u_memory.h"
+#include "util/u_thread.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_state.h"
 #include "pipe/p_shader_tokens.h"
@@ -51,11 +52,102 @@
 /* decode side */
 #define DECODE_MAX_TOKENS 8000
 
+/* A command of a submit, or a run of draws merged into one. */
+struct vrend_decode_op {
+   const uint32_t *buf;
+   /* index of the first merged draw in vrend_decode_ops::draws */
+   uint32_t first_draw;
+   uint16_t len;
+   uint8_t cmd;
+   /* merged draws, or 0 */
+   uint8_t draw_count;
+};
+
+/* A submit split into commands by vrend_decode_split(), which only looks
+ * at the buffer and not at the renderer state, so that context threads
+ * can do it without the renderer lock.
+ */
+struct vrend_decode_ops {
+   struct vrend_decode_op *ops;
+   uint32_t count;
+   uint32_t capacity;
+
+   struct pipe_draw_info *draws;
+   uint32_t draw_count;
+   uint32_t draw_capacity;
+
+   /* the buffer ends in the middle of the command after the ops */
+   bool truncated;
+   /* EINVAL for an unknown command after the ops, ENOMEM without ops */
+   int ret;
+};
+
 struct vrend_decode_ctx {
    struct virgl_context base;
    struct vrend_context *grctx;
+
+   /* reused by the submits executed on the caller's thread */
+   struct vrend_decode_ops ops;
+
+   /* VREND_USE_THREADED_CONTEXTS */
+   struct vrend_decode_thread *thread;
 };
 
+enum vrend_decode_job_type {
+   VREND_DECODE_JOB_SUBMIT,
+   VREND_DECODE_JOB_FENCE,
+};
+
+/* A command buffer or fence queued to a context thread. */
+struct vrend_decode_job {
+   struct list_head head;
+   enum vrend_decode_job_type type;
+   /* order among the jobs of all contexts */
+   uint64_t seqno;
+
+   uint32_t fence_flags;
+   uint64_t fence_id;
+
+   /* VREND_DECODE_JOB_SUBMIT, split on the context thread */
+   bool split;
+   struct vrend_decode_ops ops;
+
+   size_t size;
+   uint8_t data[];
+};
+
+struct vrend_decode_thread {
+   struct vrend_decode_ctx *dctx;
+   thrd_t thread;
+   struct list_head head;
+
+   mtx_t mutex;
+   cnd_t cond;
+   struct list_head jobs;
+   /* jobs taken from the queue, which stay here until they have run */
+   struct list_head running;
+   bool quit;
+};
+
+/* ctx0 fence waiting for the jobs queued before it */
+struct vrend_decode_ctx0_fence {
+   struct list_head head;
+   uint32_t fence_id;
+   uint64_t last_seqno;
+};
+
+/* Initialized with the first context thread, and only accessed with the
+ * renderer lock held.
+ */
+static struct {
+   bool initialized;
+   struct list_head threads;
+   struct list_head ctx0_fences;
+   uint64_t last_seqno;
+   /* jobs queued to all threads and not run yet */
+   uint32_t pending_jobs;
+} vrend_decode_queues;
+
 static inline uint32_t get_buf_entry(const uint32_t *buf, uint32_t offset)
 {
    return buf[offset];
@@ -78,11 +170,14 @@ static int vrend_decode_create_shader(struct vrend_context *ctx,
    unsigned num_tokens, num_so_outputs, offlen;
    const uint8_t *shd_text;
    uint32_t type;
+   bool binary;
 
    if (length < VIRGL_OBJ_SHADER_HDR_SIZE(0))
       return EINVAL;
 
    type = get_buf_entry(buf, VIRGL_OBJ_SHADER_TYPE);
+   binary = type & VIRGL_OBJ_SHADER_TYPE_BINARY;
+   type &= ~VIRGL_OBJ_SHADER_TYPE_BINARY;
 
    if (type >= PIPE_SHADER_TYPES)
       return EINVAL;
@@ -133,7 +228,7 @@ static int vrend_decode_create_shader(struct vrend_context *ctx,
      memset(&so_info, 0, sizeof(so_info));
 
    shd_text = get_buf_ptr(buf, shader_offset);
-   ret = vrend_create_shader(ctx, handle, &so_info, req_local_mem, (const char *)shd_text, offlen, num_tokens, type, length - shader_offset + 1);
+   ret = vrend_create_shader(ctx, handle, &so_info, req_local_mem, (const char *)shd_text, offlen, num_tokens, type, binary, length - shader_offset + 1);
 
    return ret;
 }
@@ -460,47 +555,96 @@ static int vrend_decode_resource_inline_write(struct vrend_context *ctx, const u
    return vrend_transfer_inline_write(ctx, dst_handle, &info);
 }
 
-static int vrend_decode_draw_vbo(struct vrend_context *ctx, const uint32_t *buf, uint32_t length)
+static int vrend_decode_draw_info(const uint32_t *buf, uint32_t length,
+                                  struct pipe_draw_info *info, uint32_t *cso,
+                                  uint32_t *handle, uint32_t *indirect_draw_count_handle)
 {
-   struct pipe_draw_info info;
-   uint32_t cso;
-   uint32_t handle = 0, indirect_draw_count_handle = 0;
    if (length != VIRGL_DRAW_VBO_SIZE && length != VIRGL_DRAW_VBO_SIZE_TESS &&
        length != VIRGL_DRAW_VBO_SIZE_INDIRECT)
       return EINVAL;
-   memset(&info, 0, sizeof(struct pipe_draw_info));
-
-   info.start = get_buf_entry(buf, VIRGL_DRAW_VBO_START);
-   info.count = get_buf_entry(buf, VIRGL_DRAW_VBO_COUNT);
-   info.mode = get_buf_entry(buf, VIRGL_DRAW_VBO_MODE);
-   info.indexed = !!get_buf_entry(buf, VIRGL_DRAW_VBO_INDEXED);
-   info.instance_count = get_buf_entry(buf, VIRGL_DRAW_VBO_INSTANCE_COUNT);
-   info.index_bias = get_buf_entry(buf, VIRGL_DRAW_VBO_INDEX_BIAS);
-   info.start_instance = get_buf_entry(buf, VIRGL_DRAW_VBO_START_INSTANCE);
-   info.primitive_restart = !!get_buf_entry(buf, VIRGL_DRAW_VBO_PRIMITIVE_RESTART);
-   info.restart_index = get_buf_entry(buf, VIRGL_DRAW_VBO_RESTART_INDEX);
-   info.min_index = get_buf_entry(buf, VIRGL_DRAW_VBO_MIN_INDEX);
-   info.max_index = get_buf_entry(buf, VIRGL_DRAW_VBO_MAX_INDEX);
+   memset(info, 0, sizeof(struct pipe_draw_info));
+   *handle = 0;
+   *indirect_draw_count_handle = 0;
+
+   info->start = get_buf_entry(buf, VIRGL_DRAW_VBO_START);
+   info->count = get_buf_entry(buf, VIRGL_DRAW_VBO_COUNT);
+   info->mode = get_buf_entry(buf, VIRGL_DRAW_VBO_MODE);
+   info->indexed = !!get_buf_entry(buf, VIRGL_DRAW_VBO_INDEXED);
+   info->instance_count = get_buf_entry(buf, VIRGL_DRAW_VBO_INSTANCE_COUNT);
+   info->index_bias = get_buf_entry(buf, VIRGL_DRAW_VBO_INDEX_BIAS);
+   info->start_instance = get_buf_entry(buf, VIRGL_DRAW_VBO_START_INSTANCE);
+   info->primitive_restart = !!get_buf_entry(buf, VIRGL_DRAW_VBO_PRIMITIVE_RESTART);
+   info->restart_index = get_buf_entry(buf, VIRGL_DRAW_VBO_RESTART_INDEX);
+   info->min_index = get_buf_entry(buf, VIRGL_DRAW_VBO_MIN_INDEX);
+   info->max_index = get_buf_entry(buf, VIRGL_DRAW_VBO_MAX_INDEX);
 
    if (length >= VIRGL_DRAW_VBO_SIZE_TESS) {
-      info.vertices_per_patch = get_buf_entry(buf, VIRGL_DRAW_VBO_VERTICES_PER_PATCH);
-      info.drawid = get_buf_entry(buf, VIRGL_DRAW_VBO_DRAWID);
+      info->vertices_per_patch = get_buf_entry(buf, VIRGL_DRAW_VBO_VERTICES_PER_PATCH);
+      info->drawid = get_buf_entry(buf, VIRGL_DRAW_VBO_DRAWID);
    }
 
    if (length == VIRGL_DRAW_VBO_SIZE_INDIRECT) {
-      handle = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_HANDLE);
-      info.indirect.offset = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_OFFSET);
-      info.indirect.stride = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_STRIDE);
-      info.indirect.draw_count = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT);
-      info.indirect.indirect_draw_count_offset = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT_OFFSET);
-      indirect_draw_count_handle = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT_HANDLE);
+      *handle = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_HANDLE);
+      info->indirect.offset = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_OFFSET);
+      info->indirect.stride = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_STRIDE);
+      info->indirect.draw_count = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT);
+      info->indirect.indirect_draw_count_offset = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT_OFFSET);
+      *indirect_draw_count_handle = get_buf_entry(buf, VIRGL_DRAW_VBO_INDIRECT_DRAW_COUNT_HANDLE);
    }
 
-   cso = get_buf_entry(buf, VIRGL_DRAW_VBO_COUNT_FROM_SO);
+   *cso = get_buf_entry(buf, VIRGL_DRAW_VBO_COUNT_FROM_SO);
+
+   return 0;
+}
+
+static int vrend_decode_draw_vbo(struct vrend_context *ctx, const uint32_t *buf, uint32_t length)
+{
+   struct pipe_draw_info info;
+   uint32_t cso;
+   uint32_t handle, indirect_draw_count_handle;
+
+   int ret = vrend_decode_draw_info(buf, length, &info, &cso, &handle, &indirect_draw_count_handle);
+   if (ret)
+      return ret;
 
    return vrend_draw_vbo(ctx, &info, cso, handle, indirect_draw_count_handle);
 }
 
+/* Decodes the run of direct draws starting at buf that can go into a single
+ * multi-draw.  Only draws that directly follow each other are considered, so
+ * no state can change between them.  Returns the number of draws decoded into
+ * infos, or 0 to decode buf on its own, and the dwords they span in used.
+ */
+static uint32_t vrend_decode_draw_run(const uint32_t *buf, uint32_t buf_left,
+                                      struct pipe_draw_info *infos, uint32_t *used)
+{
+   uint32_t count = 0;
+   uint32_t offset = 0;
+
+   while (count < VREND_MAX_MERGED_DRAWS && offset < buf_left) {
+      const uint32_t len = buf[offset] >> 16;
+      uint32_t cso, handle, indirect_draw_count_handle;
+
+      if ((buf[offset] & 0xff) != VIRGL_CCMD_DRAW_VBO || offset + len + 1 > buf_left)
+         break;
+      if (vrend_decode_draw_info(&buf[offset], len, &infos[count], &cso, &handle,
+                                 &indirect_draw_count_handle) ||
+          cso || handle || indirect_draw_count_handle)
+         break;
+      if (!vrend_draw_vbo_can_merge(&infos[0], &infos[count]))
+         break;
+
+      offset += len + 1;
+      count++;
+   }
+
+   if (count < 2)
+      return 0;
+
+   *used = offset;
+   return count;
+}
+
 static int vrend_decode_create_blend(struct vrend_context *ctx, const uint32_t *buf, uint32_t handle, uint16_t length)
 {
    struct pipe_blend_state *blend_state;
@@ -1628,6 +1772,10 @@ static int vrend_decode_pipe_resource_set_type(struct vrend_context *ctx, const
 
 static void vrend_decode_ctx_init_base(struct vrend_decode_ctx *dctx,
                                        uint32_t ctx_id);
+static bool vrend_decode_ctx_start_thread(struct vrend_decode_ctx *dctx);
+static void vrend_decode_ctx_stop_thread(struct vrend_decode_ctx *dctx);
+static void vrend_decode_ctx_flush_jobs(struct vrend_decode_ctx *dctx);
+static void vrend_decode_ops_fini(struct vrend_decode_ops *ops);
 
 static void vrend_decode_ctx_fence_retire(uint64_t fence_id,
                                           void *retire_data)
@@ -1642,7 +1790,7 @@ struct virgl_context *vrend_renderer_context_create(uint32_t handle,
 {
    struct vrend_decode_ctx *dctx;
 
-   dctx = malloc(sizeof(struct vrend_decode_ctx));
+   dctx = calloc(1, sizeof(struct vrend_decode_ctx));
    if (!dctx)
       return NULL;
 
@@ -1657,6 +1805,13 @@ struct virgl_context *vrend_renderer_context_create(uint32_t handle,
    vrend_renderer_set_fence_retire(dctx->grctx,
                                    vrend_decode_ctx_fence_retire,
                                    dctx);
+   vrend_renderer_set_stats(dctx->grctx, &dctx->base.stats);
+
+   if (vrend_renderer_use_threaded_contexts() && !vrend_decode_ctx_start_thread(dctx)) {
+      vrend_destroy_context(dctx->grctx);
+      free(dctx);
+      return NULL;
+   }
 
    return &dctx->base;
 }
@@ -1666,8 +1821,17 @@ static void vrend_decode_ctx_destroy(struct virgl_context *ctx)
    TRACE_FUNC();
    struct vrend_decode_ctx *dctx = (struct vrend_decode_ctx *)ctx;
 
+   /* also called at cleanup, without the lock */
+   vrend_renderer_lock();
+
+   if (dctx->thread)
+      vrend_decode_ctx_stop_thread(dctx);
+
    vrend_destroy_context(dctx->grctx);
+   vrend_decode_ops_fini(&dctx->ops);
    free(dctx);
+
+   vrend_renderer_unlock();
 }
 
 static void vrend_decode_ctx_attach_resource(struct virgl_context *ctx,
@@ -1683,6 +1847,7 @@ static void vrend_decode_ctx_detach_resource(struct virgl_context *ctx,
 {
    TRACE_FUNC();
    struct vrend_decode_ctx *dctx = (struct vrend_decode_ctx *)ctx;
+   vrend_decode_ctx_flush_jobs(dctx);
    vrend_renderer_detach_res_ctx(dctx->grctx, res);
 }
 
@@ -1693,6 +1858,7 @@ static int vrend_decode_ctx_transfer_3d(struct virgl_context *ctx,
 {
    TRACE_FUNC();
    struct vrend_decode_ctx *dctx = (struct vrend_decode_ctx *)ctx;
+   vrend_decode_ctx_flush_jobs(dctx);
    int ret = vrend_renderer_transfer_iov(dctx->grctx, res->res_id, info,
                                          transfer_mode);
    return vrend_check_no_error(dctx->grctx) || ret ? ret : EINVAL;
@@ -1708,6 +1874,9 @@ static int vrend_decode_ctx_get_blob(struct virgl_context *ctx,
    TRACE_FUNC();
    struct vrend_decode_ctx *dctx = (struct vrend_decode_ctx *)ctx;
 
+   /* the blob is created by a queued command */
+   vrend_decode_ctx_flush_jobs(dctx);
+
    blob->type = VIRGL_RESOURCE_FD_INVALID;
    /* this transfers ownership and blob_id is no longer valid */
    blob->u.pipe_resource = vrend_get_blob_pipe(dctx->grctx, blob_id);
@@ -2046,66 +2215,485 @@ static void dump_command_stream_to_file(const void *buffer, size_t size)
    }
 }
 
-static int vrend_decode_ctx_submit_cmd(struct virgl_context *ctx,
-                                       const void *buffer,
-                                       size_t size)
+static struct vrend_decode_op *vrend_decode_ops_add(struct vrend_decode_ops *ops)
 {
-   TRACE_FUNC();
-   struct vrend_decode_ctx *gdctx = (struct vrend_decode_ctx *)ctx;
-   bool bret;
-   int ret;
-
-#define TRANSFER_HEADER_SIZE 4096
+   if (ops->count == ops->capacity) {
+      const uint32_t capacity = MAX2(ops->capacity * 2, 64);
+      struct vrend_decode_op *new_ops = realloc(ops->ops, capacity * sizeof(*new_ops));
+      if (!new_ops)
+         return NULL;
+      ops->ops = new_ops;
+      ops->capacity = capacity;
+   }
 
-   bret = vrend_hw_switch_context(gdctx->grctx, true);
-   if (bret == false)
-      return EINVAL;
+   return &ops->ops[ops->count++];
+}
 
-   if (VREND_DEBUG_ENABLED &&
-       vrend_debug(gdctx->grctx, dbg_dump_cmd_streams) &&
-       size > TRANSFER_HEADER_SIZE) {
-      dump_command_stream_to_file((char *)buffer + TRANSFER_HEADER_SIZE,
-                                  size - TRANSFER_HEADER_SIZE);
+/* Makes room for a run of merged draws after the ones already decoded. */
+static struct pipe_draw_info *vrend_decode_ops_reserve_draws(struct vrend_decode_ops *ops)
+{
+   if (ops->draw_count + VREND_MAX_MERGED_DRAWS > ops->draw_capacity) {
+      const uint32_t capacity = MAX2(ops->draw_capacity * 2,
+                                     ops->draw_count + VREND_MAX_MERGED_DRAWS);
+      struct pipe_draw_info *draws = realloc(ops->draws, capacity * sizeof(*draws));
+      if (!draws)
+         return NULL;
+      ops->draws = draws;
+      ops->draw_capacity = capacity;
    }
 
+   return &ops->draws[ops->draw_count];
+}
+
+static void vrend_decode_ops_fini(struct vrend_decode_ops *ops)
+{
+   free(ops->ops);
+   free(ops->draws);
+}
+
+static void vrend_decode_split(struct vrend_decode_ops *ops,
+                               const void *buffer,
+                               size_t size)
+{
    const uint32_t *typed_buf = (const uint32_t *)buffer;
    const uint32_t buf_total = (uint32_t)(size / sizeof(uint32_t));
    uint32_t buf_offset = 0;
 
+   ops->count = 0;
+   ops->draw_count = 0;
+   ops->truncated = false;
+   ops->ret = 0;
+
    while (buf_offset < buf_total) {
-      const uint32_t cur_offset = buf_offset;
       const uint32_t *buf = &typed_buf[buf_offset];
       uint32_t len = *buf >> 16;
       uint32_t cmd = *buf & 0xff;
 
-      if (cmd >= VIRGL_MAX_COMMANDS)
-         return EINVAL;
+      if (cmd >= VIRGL_MAX_COMMANDS) {
+         ops->ret = EINVAL;
+         return;
+      }
+
+      struct vrend_decode_op *op = vrend_decode_ops_add(ops);
+      if (!op)
+         goto oom;
+
+      op->buf = buf;
+      op->len = len;
+      op->cmd = cmd;
+      op->draw_count = 0;
+
+      if (cmd == VIRGL_CCMD_DRAW_VBO) {
+         struct pipe_draw_info *infos = vrend_decode_ops_reserve_draws(ops);
+         uint32_t used;
+
+         if (!infos)
+            goto oom;
+
+         uint32_t count = vrend_decode_draw_run(buf, buf_total - buf_offset, infos, &used);
+         if (count) {
+            op->first_draw = ops->draw_count;
+            op->draw_count = count;
+            ops->draw_count += count;
+            buf_offset += used;
+            continue;
+         }
+      }
 
       buf_offset += len + 1;
 
-      ret = 0;
       /* check if the guest is doing something bad */
       if (buf_offset > buf_total) {
-         vrend_report_buffer_error(gdctx->grctx, 0);
-         break;
+         ops->count--;
+         ops->truncated = true;
+         return;
+      }
+   }
+   return;
+
+oom:
+   ops->count = 0;
+   ops->ret = ENOMEM;
+}
+
+static int vrend_decode_ctx_execute(struct vrend_decode_ctx *gdctx,
+                                    const struct vrend_decode_ops *ops,
+                                    const void *buffer,
+                                    size_t size)
+{
+   TRACE_FUNC();
+   bool bret;
+   int ret;
+
+#define TRANSFER_HEADER_SIZE 4096
+
+   bret = vrend_hw_switch_context(gdctx->grctx, true);
+   if (bret == false)
+      return EINVAL;
+
+   if (VREND_DEBUG_ENABLED &&
+       vrend_debug(gdctx->grctx, dbg_dump_cmd_streams) &&
+       size > TRANSFER_HEADER_SIZE) {
+      dump_command_stream_to_file((char *)buffer + TRANSFER_HEADER_SIZE,
+                                  size - TRANSFER_HEADER_SIZE);
+   }
+
+   const uint32_t *typed_buf = (const uint32_t *)buffer;
+   uint32_t merged_draws = 0;
+   uint32_t commands = 0;
+
+   for (uint32_t i = 0; i < ops->count; i++) {
+      const struct vrend_decode_op *op = &ops->ops[i];
+      const int cur_offset = op->buf - typed_buf;
+
+      if (op->draw_count) {
+         VREND_DEBUG(dbg_cmd, gdctx->grctx, "%-4d %-20s merged:%d\n",
+                     cur_offset, vrend_get_comand_name(op->cmd), op->draw_count);
+
+         merged_draws += op->draw_count - 1;
+         commands += op->draw_count;
+         ret = vrend_draw_vbo_multi(gdctx->grctx, &ops->draws[op->first_draw],
+                                    op->draw_count);
+         if (!vrend_check_no_error(gdctx->grctx) && !ret)
+            ret = EINVAL;
+         if (ret) {
+            virgl_error("context %d failed to dispatch %u merged draws: %d\n",
+                        gdctx->base.ctx_id, op->draw_count, ret);
+            return ret;
+         }
+         continue;
       }
 
       VREND_DEBUG(dbg_cmd, gdctx->grctx, "%-4d %-20s len:%d\n",
-                  cur_offset, vrend_get_comand_name(cmd), len);
+                  cur_offset, vrend_get_comand_name(op->cmd), op->len);
 
-      TRACE_SCOPE_SLOW(vrend_get_comand_name(cmd));
+      TRACE_SCOPE_SLOW(vrend_get_comand_name(op->cmd));
 
-      ret = decode_table[cmd](gdctx->grctx, buf, len);
+      commands++;
+      ret = decode_table[op->cmd](gdctx->grctx, op->buf, op->len);
       if (!vrend_check_no_error(gdctx->grctx) && !ret)
          ret = EINVAL;
       if (ret) {
          virgl_error("context %d failed to dispatch %s: %d\n",
-               gdctx->base.ctx_id, vrend_get_comand_name(cmd), ret);
+               gdctx->base.ctx_id, vrend_get_comand_name(op->cmd), ret);
          if (ret == EINVAL)
-            vrend_report_buffer_error(gdctx->grctx, *buf);
+            vrend_report_buffer_error(gdctx->grctx, *op->buf);
          return ret;
       }
    }
+
+   if (ops->truncated)
+      vrend_report_buffer_error(gdctx->grctx, 0);
+   else if (ops->ret)
+      return ops->ret;
+
+   /* once per submit, the commands of a failed one are not counted */
+   virgl_context_stats_add(&gdctx->base.stats.commands, commands);
+
+   TRACE_COUNTER_VALUE(draws_merged, merged_draws);
+   if (merged_draws)
+      VREND_DEBUG(dbg_cmd, gdctx->grctx, "%u draws merged in this submit\n", merged_draws);
+   return 0;
+}
+
+static void vrend_decode_job_split(struct vrend_decode_job *job)
+{
+   if (job->type != VREND_DECODE_JOB_SUBMIT || job->split)
+      return;
+
+   vrend_decode_split(&job->ops, job->data, job->size);
+   job->split = true;
+}
+
+static void vrend_decode_job_free(struct vrend_decode_job *job)
+{
+   if (job->type == VREND_DECODE_JOB_SUBMIT)
+      vrend_decode_ops_fini(&job->ops);
+   free(job);
+}
+
+static void vrend_decode_ctx_run_job(struct vrend_decode_ctx *dctx,
+                                     struct vrend_decode_job *job)
+{
+   switch (job->type) {
+   case VREND_DECODE_JOB_SUBMIT:
+      /* errors are reported by vrend_decode_ctx_execute */
+      vrend_decode_job_split(job);
+      vrend_decode_ctx_execute(dctx, &job->ops, job->data, job->size);
+      break;
+   case VREND_DECODE_JOB_FENCE:
+      if (vrend_renderer_create_fence(dctx->grctx, job->fence_flags, job->fence_id))
+         virgl_error("context %d failed to create fence %" PRIu64 "\n",
+                     dctx->base.ctx_id, job->fence_id);
+      break;
+   }
+}
+
+/* Creates the ctx0 fences whose preceding jobs have all run. */
+static void vrend_decode_check_ctx0_fences(void)
+{
+   uint64_t oldest_seqno = UINT64_MAX;
+
+   list_for_each_entry(struct vrend_decode_thread, thread, &vrend_decode_queues.threads, head) {
+      mtx_lock(&thread->mutex);
+      const struct list_head *jobs =
+         list_is_empty(&thread->running) ? &thread->jobs : &thread->running;
+      if (!list_is_empty(jobs)) {
+         const struct vrend_decode_job *job =
+            list_first_entry(jobs, struct vrend_decode_job, head);
+         oldest_seqno = MIN2(oldest_seqno, job->seqno);
+      }
+      mtx_unlock(&thread->mutex);
+   }
+
+   list_for_each_entry_safe(struct vrend_decode_ctx0_fence, fence,
+                            &vrend_decode_queues.ctx0_fences, head) {
+      if (fence->last_seqno >= oldest_seqno)
+         break;
+
+      vrend_renderer_create_ctx0_fence(fence->fence_id);
+      list_del(&fence->head);
+      free(fence);
+   }
+}
+
+/* Runs the jobs taken from the queue of the context, with the renderer lock
+ * held, on the context thread or on the caller's thread to flush them.
+ */
+static void vrend_decode_ctx_run_jobs(struct vrend_decode_ctx *dctx)
+{
+   struct vrend_decode_thread *thread = dctx->thread;
+
+   while (true) {
+      struct vrend_decode_job *job = NULL;
+
+      mtx_lock(&thread->mutex);
+      if (!list_is_empty(&thread->running))
+         job = list_first_entry(&thread->running, struct vrend_decode_job, head);
+      mtx_unlock(&thread->mutex);
+
+      if (!job)
+         break;
+
+      vrend_decode_ctx_run_job(dctx, job);
+
+      mtx_lock(&thread->mutex);
+      list_del(&job->head);
+      mtx_unlock(&thread->mutex);
+      vrend_decode_job_free(job);
+      vrend_decode_queues.pending_jobs--;
+
+      if (!list_is_empty(&vrend_decode_queues.ctx0_fences))
+         vrend_decode_check_ctx0_fences();
+   }
+}
+
+/* Runs the queued jobs of the context on the caller's thread, with the
+ * renderer lock held.  The jobs the context thread already took run first,
+ * and the lock is released to wait for them.
+ */
+static void vrend_decode_ctx_flush_jobs(struct vrend_decode_ctx *dctx)
+{
+   struct vrend_decode_thread *thread = dctx->thread;
+
+   if (!thread)
+      return;
+
+   mtx_lock(&thread->mutex);
+   while (!list_is_empty(&thread->running)) {
+      mtx_unlock(&thread->mutex);
+      const unsigned depth = vrend_renderer_unlock_all();
+
+      mtx_lock(&thread->mutex);
+      while (!list_is_empty(&thread->running))
+         cnd_wait(&thread->cond, &thread->mutex);
+      mtx_unlock(&thread->mutex);
+
+      vrend_renderer_relock(depth);
+      mtx_lock(&thread->mutex);
+   }
+
+   /* nothing is queued while this thread holds the lock */
+   list_splicetail(&thread->jobs, &thread->running);
+   list_inithead(&thread->jobs);
+   mtx_unlock(&thread->mutex);
+
+   vrend_decode_ctx_run_jobs(dctx);
+}
+
+void vrend_renderer_flush_context_queues(void)
+{
+   if (!vrend_decode_queues.initialized)
+      return;
+
+   list_for_each_entry(struct vrend_decode_thread, thread, &vrend_decode_queues.threads, head)
+      vrend_decode_ctx_flush_jobs(thread->dctx);
+}
+
+bool vrend_renderer_context_queues_pending(void)
+{
+   return vrend_decode_queues.pending_jobs;
+}
+
+int vrend_renderer_queue_ctx0_fence(uint32_t fence_id)
+{
+   if (!vrend_decode_queues.initialized)
+      return vrend_renderer_create_ctx0_fence(fence_id);
+
+   struct vrend_decode_ctx0_fence *fence = malloc(sizeof(*fence));
+   if (!fence)
+      return ENOMEM;
+
+   fence->fence_id = fence_id;
+   fence->last_seqno = vrend_decode_queues.last_seqno;
+   list_addtail(&fence->head, &vrend_decode_queues.ctx0_fences);
+
+   /* it might not have to wait at all */
+   vrend_decode_check_ctx0_fences();
+
+   return 0;
+}
+
+static int vrend_decode_thread_func(void *arg)
+{
+   struct vrend_decode_ctx *dctx = arg;
+   struct vrend_decode_thread *thread = dctx->thread;
+
+   u_thread_setname("vrend-ctx");
+
+   mtx_lock(&thread->mutex);
+   while (true) {
+      while (list_is_empty(&thread->jobs) && !thread->quit)
+         cnd_wait(&thread->cond, &thread->mutex);
+      if (thread->quit)
+         break;
+
+      /* only running the jobs needs the lock, splitting them does not */
+      list_splicetail(&thread->jobs, &thread->running);
+      list_inithead(&thread->jobs);
+      mtx_unlock(&thread->mutex);
+
+      list_for_each_entry(struct vrend_decode_job, job, &thread->running, head)
+         vrend_decode_job_split(job);
+
+      vrend_renderer_lock_context(dctx->grctx);
+      vrend_decode_ctx_run_jobs(dctx);
+      vrend_renderer_unlock_context();
+
+      mtx_lock(&thread->mutex);
+      /* for vrend_decode_ctx_flush_jobs */
+      cnd_broadcast(&thread->cond);
+   }
+   mtx_unlock(&thread->mutex);
+
+   return 0;
+}
+
+static bool vrend_decode_ctx_start_thread(struct vrend_decode_ctx *dctx)
+{
+   struct vrend_decode_thread *thread = calloc(1, sizeof(*thread));
+   if (!thread)
+      return false;
+
+   thread->dctx = dctx;
+   list_inithead(&thread->jobs);
+   list_inithead(&thread->running);
+   if (mtx_init(&thread->mutex, mtx_plain) != thrd_success) {
+      free(thread);
+      return false;
+   }
+   if (cnd_init(&thread->cond) != thrd_success) {
+      mtx_destroy(&thread->mutex);
+      free(thread);
+      return false;
+   }
+
+   dctx->thread = thread;
+   thread->thread = u_thread_create(vrend_decode_thread_func, dctx);
+   if (!thread->thread) {
+      cnd_destroy(&thread->cond);
+      mtx_destroy(&thread->mutex);
+      free(thread);
+      dctx->thread = NULL;
+      return false;
+   }
+
+   if (!vrend_decode_queues.initialized) {
+      list_inithead(&vrend_decode_queues.threads);
+      list_inithead(&vrend_decode_queues.ctx0_fences);
+      vrend_decode_queues.initialized = true;
+   }
+   list_addtail(&thread->head, &vrend_decode_queues.threads);
+
+   return true;
+}
+
+static void vrend_decode_ctx_stop_thread(struct vrend_decode_ctx *dctx)
+{
+   struct vrend_decode_thread *thread = dctx->thread;
+
+   /* the thread has nothing left to run once it gets the lock */
+   vrend_decode_ctx_flush_jobs(dctx);
+   list_del(&thread->head);
+
+   mtx_lock(&thread->mutex);
+   thread->quit = true;
+   cnd_signal(&thread->cond);
+   mtx_unlock(&thread->mutex);
+
+   const unsigned depth = vrend_renderer_unlock_all();
+   thrd_join(thread->thread, NULL);
+   vrend_renderer_relock(depth);
+
+   cnd_destroy(&thread->cond);
+   mtx_destroy(&thread->mutex);
+   free(thread);
+   dctx->thread = NULL;
+
+   /* ctx0 fences do not wait for this context anymore */
+   if (!list_is_empty(&vrend_decode_queues.ctx0_fences))
+      vrend_decode_check_ctx0_fences();
+}
+
+static void vrend_decode_ctx_queue_job(struct vrend_decode_ctx *dctx,
+                                       struct vrend_decode_job *job)
+{
+   struct vrend_decode_thread *thread = dctx->thread;
+
+   job->seqno = ++vrend_decode_queues.last_seqno;
+   vrend_decode_queues.pending_jobs++;
+
+   mtx_lock(&thread->mutex);
+   list_addtail(&job->head, &thread->jobs);
+   cnd_signal(&thread->cond);
+   mtx_unlock(&thread->mutex);
+}
+
+static int vrend_decode_ctx_submit_cmd(struct virgl_context *ctx,
+                                       const void *buffer,
+                                       size_t size)
+{
+   struct vrend_decode_ctx *dctx = (struct vrend_decode_ctx *)ctx;
+
+   if (!dctx->thread) {
+      vrend_decode_split(&dctx->ops, buffer, size);
+      return vrend_decode_ctx_execute(dctx, &dctx->ops, buffer, size);
+   }
+
+   TRACE_FUNC();
+
+   /* the buffer is only valid for the duration of the call */
+   struct vrend_decode_job *job = malloc(sizeof(*job) + size);
+   if (!job)
+      return ENOMEM;
+
+   job->type = VREND_DECODE_JOB_SUBMIT;
+   job->split = false;
+   memset(&job->ops, 0, sizeof(job->ops));
+   job->size = size;
+   memcpy(job->data, buffer, size);
+   vrend_decode_ctx_queue_job(dctx, job);
+
    return 0;
 }
 
@@ -2132,7 +2720,20 @@ static int vrend_decode_ctx_submit_fence(struct virgl_context *ctx,
    if (!dctx->grctx)
       return EINVAL;
 
-   return vrend_renderer_create_fence(dctx->grctx, flags, fence_id);
+   if (!dctx->thread)
+      return vrend_renderer_create_fence(dctx->grctx, flags, fence_id);
+
+   struct vrend_decode_job *job = malloc(sizeof(*job));
+   if (!job)
+      return ENOMEM;
+
+   job->type = VREND_DECODE_JOB_FENCE;
+   job->fence_flags = flags;
+   job->fence_id = fence_id;
+   job->size = 0;
+   vrend_decode_ctx_queue_job(dctx, job);
+
+   return 0;
 }
 
 static void vrend_decode_ctx_init_base(struct vrend_decode_ctx *dctx,
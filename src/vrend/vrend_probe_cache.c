@@ -0,0 +1,166 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vrend_probe_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <epoxy/gl.h>
+
+#include "virgl_util.h"
+
+#define XXH_INLINE_ALL
+#include "util/xxhash.h"
+
+#define VREND_PROBE_CACHE_MAGIC "VRPROBE2"
+
+struct vrend_probe_cache_header {
+   char magic[8];
+   uint64_t key;
+   uint64_t size;
+   /* of the data following the header */
+   uint64_t checksum;
+};
+
+static bool
+vrend_probe_cache_dir(char *dir, size_t size)
+{
+   const char *env = getenv("VIRGL_PROBE_CACHE_DIR");
+
+   if (!env || !env[0])
+      return false;
+
+   const int len = snprintf(dir, size, "%s", env);
+   return len > 0 && (size_t)len < size;
+}
+
+static bool
+vrend_probe_cache_path(const char *name, char *path, size_t size)
+{
+   char dir[PATH_MAX];
+
+   if (!vrend_probe_cache_dir(dir, sizeof(dir)))
+      return false;
+
+   const int len = snprintf(path, size, "%s/%s", dir, name);
+   return len > 0 && (size_t)len < size;
+}
+
+/* Creates the cache directory and the missing parents. */
+static bool
+vrend_probe_cache_make_dir(void)
+{
+   char dir[PATH_MAX];
+
+   if (!vrend_probe_cache_dir(dir, sizeof(dir)))
+      return false;
+
+   for (char *p = dir + 1; *p; p++) {
+      if (*p != '/')
+         continue;
+      *p = '\0';
+      if (mkdir(dir, 0755) && errno != EEXIST)
+         return false;
+      *p = '/';
+   }
+
+   return !mkdir(dir, 0755) || errno == EEXIST;
+}
+
+static uint64_t
+vrend_probe_cache_hash_string(uint64_t seed, GLenum name)
+{
+   const char *str = (const char *)glGetString(name);
+
+   return str ? XXH64(str, strlen(str), seed) : seed;
+}
+
+uint64_t
+vrend_probe_cache_key(const void *deps, size_t deps_size)
+{
+   uint64_t key = XXH64(VERSION, strlen(VERSION), 0);
+
+   key = vrend_probe_cache_hash_string(key, GL_VENDOR);
+   key = vrend_probe_cache_hash_string(key, GL_RENDERER);
+   key = vrend_probe_cache_hash_string(key, GL_VERSION);
+   key = vrend_probe_cache_hash_string(key, GL_SHADING_LANGUAGE_VERSION);
+
+   return XXH64(deps, deps_size, key);
+}
+
+bool
+vrend_probe_cache_load(const char *name, uint64_t key, void *data, size_t size)
+{
+   struct vrend_probe_cache_header header;
+   char path[PATH_MAX];
+   struct stat st;
+   bool ok;
+
+   if (!vrend_probe_cache_path(name, path, sizeof(path)))
+      return false;
+
+   FILE *fp = fopen(path, "rb");
+   if (!fp)
+      return false;
+
+   /* a truncated or overlong entry is not trusted, nor one that does not
+    * match its checksum
+    */
+   ok = !fstat(fileno(fp), &st) && (uint64_t)st.st_size == sizeof(header) + size &&
+        fread(&header, sizeof(header), 1, fp) == 1 &&
+        !memcmp(header.magic, VREND_PROBE_CACHE_MAGIC, sizeof(header.magic)) &&
+        header.key == key && header.size == size && fread(data, size, 1, fp) == 1 &&
+        header.checksum == XXH64(data, size, 0);
+   fclose(fp);
+
+   virgl_debug("probe cache %s for %s\n", ok ? "hit" : "miss", name);
+
+   return ok;
+}
+
+void
+vrend_probe_cache_store(const char *name, uint64_t key, const void *data, size_t size)
+{
+   struct vrend_probe_cache_header header = {
+      .key = key,
+      .size = size,
+      .checksum = XXH64(data, size, 0),
+   };
+   char path[PATH_MAX];
+   char tmp_path[PATH_MAX + 16];
+
+   memcpy(header.magic, VREND_PROBE_CACHE_MAGIC, sizeof(header.magic));
+
+   if (!vrend_probe_cache_path(name, path, sizeof(path)) || !vrend_probe_cache_make_dir())
+      return;
+
+   /* concurrent writers each rename their own complete file into place */
+   snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+
+   FILE *fp = fopen(tmp_path, "wb");
+   if (!fp) {
+      virgl_warn("failed to create probe cache entry %s: %s\n", tmp_path, strerror(errno));
+      return;
+   }
+
+   bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(data, size, 1, fp) == 1;
+   ok = !fclose(fp) && ok;
+
+   if (!ok || rename(tmp_path, path)) {
+      virgl_warn("failed to write probe cache entry %s\n", path);
+      unlink(tmp_path);
+   }
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef VREND_PROBE_CACHE_H
+#define VREND_PROBE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * On-disk cache of what vrend probes from the host GL at startup, so that
+ * every VM or vtest client does not have to create a texture and framebuffer
+ * per format again.
+ *
+ * The cache is only used when VIRGL_PROBE_CACHE_DIR names the directory to
+ * keep the entries in.  An entry is only loaded when its size and checksum
+ * match, besides its key.
+ */
+
+/* Hashes the vendor, renderer and version strings of the current GL context
+ * and the virglrenderer version, along with deps, which the caller fills with
+ * whatever else the cached data depends on.
+ */
+uint64_t vrend_probe_cache_key(const void *deps, size_t deps_size);
+
+/* Fills data with the entry called name, if it was stored under key with the
+ * same size and is intact.  data is clobbered on failure.
+ */
+bool vrend_probe_cache_load(const char *name, uint64_t key, void *data, size_t size);
+
+void vrend_probe_cache_store(const char *name, uint64_t key, const void *data, size_t size);
+
+#endif /* VREND_PROBE_CACHE_H */
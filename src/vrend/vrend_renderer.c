@@ -29,6 +29,8 @@
 #include <stdatomic.h>
 #include <stdio.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <time.h>
 #include "pipe/p_shader_tokens.h"
 
 #include "pipe/p_defines.h"
@@ -53,8 +55,12 @@
 #include "vrend_debug.h"
 #include "vrend_winsys.h"
 #include "vrend_blitter.h"
+#include "vrend_probe_cache.h"
+#include "vrend_shader_corpus.h"
+#include "vrend_tgsi_validate.h"
 
 #include "virgl_util.h"
+#include "virgl_context.h"
 
 #include "virgl_hw.h"
 #include "virgl_resource.h"
@@ -102,6 +108,8 @@ struct vrend_fence {
    struct vrend_context *ctx;
    uint32_t flags;
    uint64_t fence_id;
+   /* position among all fences created, see vrend_state.fence_seqno */
+   uint64_t seqno;
 
    union {
       GLsync glsyncobj;
@@ -123,6 +131,11 @@ struct vrend_query {
    int sub_ctx_id;
    struct vrend_resource *res;
    bool fake_samples_passed;
+
+   /* seqno of the first fence created after the query was ended; the
+    * result cannot be available before that fence has retired
+    */
+   uint64_t end_seqno;
 };
 
 struct global_error_state {
@@ -142,6 +155,7 @@ enum features_id
    feat_bind_vertex_buffers,
    feat_bit_encoding,
    feat_blend_equation_advanced,
+   feat_clear_buffer_object,
    feat_clear_texture,
    feat_clip_control,
    feat_compute_shader,
@@ -162,6 +176,7 @@ enum features_id
    feat_framebuffer_fetch,
    feat_framebuffer_fetch_non_coherent,
    feat_geometry_shader,
+   feat_get_texture_sub_image,
    feat_gl_conditional_render,
    feat_gl_prim_restart,
    feat_gles_khr_robustness,
@@ -180,6 +195,7 @@ enum features_id
    feat_mesa_invert,
    feat_ms_scaled_blit,
    feat_multisample,
+   feat_multi_draw,
    feat_multi_draw_indirect,
    feat_nv_conditional_render,
    feat_nv_prim_restart,
@@ -255,6 +271,7 @@ static const  struct {
    FEAT(bind_vertex_buffers, 44, UNAVAIL, NULL),
    FEAT(bit_encoding, 33, UNAVAIL,  "GL_ARB_shader_bit_encoding" ),
    FEAT(blend_equation_advanced, UNAVAIL, 32,  "GL_KHR_blend_equation_advanced" ),
+   FEAT(clear_buffer_object, 43, UNAVAIL, "GL_ARB_clear_buffer_object"),
    FEAT(clear_texture, 44, UNAVAIL, "GL_ARB_clear_texture", "GL_EXT_clear_texture"),
    FEAT(clip_control, 45, UNAVAIL, "GL_ARB_clip_control", "GL_EXT_clip_control"),
    FEAT(compute_shader, 43, 31,  "GL_ARB_compute_shader" ),
@@ -275,6 +292,7 @@ static const  struct {
    FEAT(framebuffer_fetch, UNAVAIL, UNAVAIL,  "GL_EXT_shader_framebuffer_fetch" ),
    FEAT(framebuffer_fetch_non_coherent, UNAVAIL, UNAVAIL,  "GL_EXT_shader_framebuffer_fetch_non_coherent" ),
    FEAT(geometry_shader, 32, 32, "GL_EXT_geometry_shader", "GL_OES_geometry_shader"),
+   FEAT(get_texture_sub_image, 45, UNAVAIL, "GL_ARB_get_texture_sub_image"),
    FEAT(gl_conditional_render, 30, UNAVAIL, NULL),
    FEAT(gl_prim_restart, 31, 30, NULL),
    FEAT(gles_khr_robustness, UNAVAIL, UNAVAIL,  "GL_KHR_robustness" ),
@@ -293,6 +311,7 @@ static const  struct {
    FEAT(mesa_invert, UNAVAIL, UNAVAIL,  "GL_MESA_pack_invert" ),
    FEAT(ms_scaled_blit, UNAVAIL, UNAVAIL,  "GL_EXT_framebuffer_multisample_blit_scaled" ),
    FEAT(multisample, 32, 30,  "GL_ARB_texture_multisample" ),
+   FEAT(multi_draw, 32, UNAVAIL, "GL_ARB_draw_elements_base_vertex"),
    FEAT(multi_draw_indirect, 43, UNAVAIL,  "GL_ARB_multi_draw_indirect", "GL_EXT_multi_draw_indirect" ),
    FEAT(nv_conditional_render, UNAVAIL, UNAVAIL,  "GL_NV_conditional_render" ),
    FEAT(nv_prim_restart, UNAVAIL, UNAVAIL,  "GL_NV_primitive_restart" ),
@@ -344,12 +363,64 @@ static const  struct {
    FEAT(vs_viewport_index, UNAVAIL, UNAVAIL, "GL_AMD_vertex_shader_viewport_index"),
 };
 
+struct vrend_resource_pool_stats {
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t evictions;
+};
+
+struct vrend_const_ring_stats {
+   uint64_t uploads;
+   uint64_t bytes;
+   /* segments that had to be waited for before reuse */
+   uint64_t stalls;
+};
+
+struct vrend_gl_shadow_stats {
+   uint64_t draws;
+   /* GL calls going through the shadow state, and those it skipped */
+   uint64_t issued;
+   uint64_t elided;
+   /* draws folded into the multi-draw of a preceding one */
+   uint64_t merged_draws;
+};
+
+struct vrend_spec_compile_stats {
+   /* variants handed to the speculative compile thread, and compiled by it */
+   uint64_t queued;
+   uint64_t compiled;
+   /* first draws that selected the predicted variant, and those that did not */
+   uint64_t hits;
+   uint64_t misses;
+   /* time first draws spent compiling or waiting for their variants */
+   uint64_t first_draw_stall_ns;
+};
+
 struct global_renderer_state {
    struct vrend_context *ctx0;
    struct vrend_context *current_ctx;
    struct vrend_context *current_hw_ctx;
 
    struct list_head waiting_query_list;
+   struct list_head damage_readback_list;
+   /* bumped whenever the damage of a resource is reset by a readback */
+   uint32_t damage_reset_seq;
+   /* GL storage of destroyed resources, oldest first */
+   struct list_head resource_pool_list;
+   /* and of resources destroyed since the last poll, not in a bucket yet */
+   struct list_head resource_pool_pending;
+   struct hash_table *resource_pool_buckets;
+   uint64_t resource_pool_size;
+   struct vrend_resource_pool_stats resource_pool_stats;
+   /* bumped whenever a GL object that may be in a vrend_gl_shadow is deleted */
+   uint32_t gl_object_epoch;
+   struct vrend_gl_shadow_stats gl_shadow_stats;
+   struct vrend_const_ring_stats const_ring_stats;
+   /* persistently mapped buffers small blobs are carved out of */
+   struct list_head blob_heap_chunks;
+   /* ranges freed while the GPU may still use them */
+   struct list_head blob_heap_pending_frees;
+   uint32_t blob_heap_chunk_count;
    struct list_head fence_list;
    struct list_head fence_wait_list;
    struct vrend_fence *fence_waiting;
@@ -363,12 +434,40 @@ struct global_renderer_state {
 
    cnd_t fence_cond;
 
-   /* only used with async fence callback */
+   /* seqno of the last fence created, and the highest seqno retired; fences
+    * are created and retired from several threads with thread sync
+    */
+   atomic_uint_fast64_t fence_seqno;
+   atomic_uint_fast64_t retired_fence_seqno;
+
+   /* only used with async fence callback; waiting_query_seqno is the lowest
+    * end_seqno in waiting_query_list, 0 when a query has no fence after it
+    */
    atomic_bool has_waiting_queries;
+   atomic_uint_fast64_t waiting_query_seqno;
    bool polling;
    mtx_t poll_mutex;
    cnd_t poll_cond;
 
+   /* threaded contexts, see vrend_renderer_lock */
+   mtx_t renderer_mutex;
+   unsigned renderer_lock_depth;
+   thrd_t caller_thread;
+   /* binding of the caller's thread while a context thread holds the lock */
+   struct vrend_context *caller_ctx;
+   struct vrend_context *caller_hw_ctx;
+   /* fence of the GL work done by the last lock holder */
+   GLsync handoff_sync;
+
+   /* speculative shader compiles, see vrend_spec_compile_queue */
+   mtx_t spec_compile_mutex;
+   cnd_t spec_compile_cond;
+   cnd_t spec_compile_done_cond;
+   thrd_t spec_compile_thread;
+   virgl_gl_context spec_compile_context;
+   struct list_head spec_compile_list;
+   struct vrend_spec_compile_stats spec_compile_stats;
+
    float tess_factors[6];
    int eventfd;
 
@@ -384,12 +483,20 @@ struct global_renderer_state {
    /* inferred GL caching type */
    uint32_t inferred_gl_caching_type;
 
+   /* VREND_USE_CONST_RING */
+   uint32_t const_ring_alignment;
+   uint32_t max_const_block_consts;
+   uint32_t max_stage_uniform_blocks;
+   uint32_t max_uniform_buffer_bindings;
+
    uint64_t features[feat_last / 64 + 1];
 
    bool finishing : 1;
    bool use_gles : 1;
    bool use_core_profile : 1;
    bool use_external_blob : 1;
+   bool use_blob_heap : 1;
+   bool use_const_ring : 1;
    bool use_integer : 1;
    /* these appeared broken on at least one driver */
    bool use_explicit_locations : 1;
@@ -397,6 +504,8 @@ struct global_renderer_state {
    bool stop_sync_thread : 1;
    /* async fence callback */
    bool use_async_fence_cb : 1;
+   bool use_threaded_contexts : 1;
+   bool stop_spec_compile_thread : 1;
 
 #ifdef HAVE_EPOXY_EGL_H
    bool use_egl_fence : 1;
@@ -416,6 +525,21 @@ struct sysval_uniform_block {
 
 static struct global_renderer_state vrend_state;
 
+/* Must be called after deleting a GL object that can be bound through the
+ * shadow state.
+ */
+static inline void vrend_gl_object_deleted(void)
+{
+   vrend_state.gl_object_epoch++;
+}
+
+static uint64_t vrend_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
 static inline bool has_feature(enum features_id feature_id)
 {
    int slot = feature_id / 64;
@@ -468,6 +592,8 @@ struct vrend_linked_shader_program {
    GLuint *shadow_samp_add_locs[PIPE_SHADER_TYPES];
 
    GLint const_location[PIPE_SHADER_TYPES];
+   /* binding of the block guest constants are streamed to */
+   GLuint const_block_bind[PIPE_SHADER_TYPES];
 
    GLuint *attrib_locs;
 
@@ -481,6 +607,9 @@ struct vrend_linked_shader_program {
 
    uint32_t ssbo_used_mask[PIPE_SHADER_TYPES];
 
+   /* sampler uniforms already pointed at their unit, by sampler index */
+   uint32_t sampler_units_set[PIPE_SHADER_TYPES];
+
    int32_t tex_levels_uniform_id[PIPE_SHADER_TYPES];
 
    struct vrend_sub_context *ref_context;
@@ -490,6 +619,13 @@ struct vrend_linked_shader_program {
    bool reads_drawid;
 };
 
+enum vrend_spec_compile_state {
+   VREND_SPEC_COMPILE_NONE,
+   VREND_SPEC_COMPILE_QUEUED,
+   VREND_SPEC_COMPILE_RUNNING,
+   VREND_SPEC_COMPILE_DONE,
+};
+
 struct vrend_shader {
    struct vrend_shader *next_variant;
    struct vrend_shader_selector *sel;
@@ -504,6 +640,14 @@ struct vrend_shader {
    bool is_linked; /* only used for separable shaders */
    struct vrend_shader_key key;
    struct list_head programs;
+
+   /* set while the speculative compile thread owns the shader; spec_state,
+    * spec_link and spec_compile_status are protected by spec_compile_mutex
+    */
+   bool spec_queued;
+   enum vrend_spec_compile_state spec_state;
+   struct list_head spec_link;
+   GLint spec_compile_status;
 };
 
 struct vrend_shader_selector {
@@ -516,6 +660,9 @@ struct vrend_shader_selector {
    struct tgsi_token *tokens;
 
    uint32_t req_local_mem;
+
+   /* variant compiled speculatively, until the first draw using the selector */
+   struct vrend_shader *spec_shader;
 };
 
 struct vrend_long_shader_buffer {
@@ -525,6 +672,8 @@ struct vrend_long_shader_buffer {
    char *tmp_buf;
    uint32_t total_length;
    uint32_t current_length;
+   /* tgsi_token dwords instead of TGSI text */
+   bool binary;
 };
 
 struct vrend_texture {
@@ -645,6 +794,28 @@ struct vrend_constants {
    uint32_t num_allocated_consts;
 };
 
+/*
+ * Persistently mapped buffer that guest constants are streamed to when
+ * shaders keep them in a uniform block.  The ring is split in segments, and
+ * a segment is only written again once a fence placed after its last use
+ * has signaled.
+ */
+#define VREND_CONST_RING_SIZE     (4u << 20)
+#define VREND_CONST_RING_SEGMENTS 4
+#define VREND_CONST_RING_SEGMENT_SIZE (VREND_CONST_RING_SIZE / VREND_CONST_RING_SEGMENTS)
+
+struct vrend_const_ring {
+   GLuint gl_id;
+   uint8_t *map;
+   uint32_t offset;
+   uint32_t segment;
+   GLsync segment_syncs[VREND_CONST_RING_SEGMENTS];
+
+   /* last upload of each stage */
+   uint32_t stage_offset[PIPE_SHADER_TYPES];
+   uint32_t stage_size[PIPE_SHADER_TYPES];
+};
+
 // bound sampler view (texture) state associated with the current
 // program or pipeline stage
 struct vrend_shader_view {
@@ -694,6 +865,76 @@ struct vrend_vertex_buffer {
 #define VREND_PROGRAM_NQUEUES (1 << 8)
 #define VREND_PROGRAM_NQUEUE_MASK (VREND_PROGRAM_NQUEUES - 1)
 
+/* capabilities toggled by the rasterizer and blend state */
+enum vrend_gl_cap {
+   VREND_GL_CAP_BLEND,
+   VREND_GL_CAP_CULL_FACE,
+   VREND_GL_CAP_DEPTH_CLAMP,
+   VREND_GL_CAP_DITHER,
+   VREND_GL_CAP_LINE_SMOOTH,
+   VREND_GL_CAP_LINE_STIPPLE,
+   VREND_GL_CAP_MULTISAMPLE,
+   VREND_GL_CAP_POINT_SPRITE,
+   VREND_GL_CAP_POLYGON_OFFSET_FILL,
+   VREND_GL_CAP_POLYGON_OFFSET_LINE,
+   VREND_GL_CAP_POLYGON_OFFSET_POINT,
+   VREND_GL_CAP_POLYGON_SMOOTH,
+   VREND_GL_CAP_POLYGON_STIPPLE,
+   VREND_GL_CAP_PROGRAM_POINT_SIZE,
+   VREND_GL_CAP_SAMPLE_ALPHA_TO_COVERAGE,
+   VREND_GL_CAP_SAMPLE_ALPHA_TO_ONE,
+   VREND_GL_CAP_SAMPLE_MASK,
+   VREND_GL_CAP_SAMPLE_SHADING,
+   VREND_GL_CAP_VERTEX_PROGRAM_TWO_SIDE,
+   VREND_GL_CAP_COUNT,
+};
+
+enum vrend_gl_buffer_target {
+   VREND_GL_BUFFER_UNIFORM,
+   VREND_GL_BUFFER_SHADER_STORAGE,
+   VREND_GL_BUFFER_ATOMIC_COUNTER,
+   VREND_GL_BUFFER_TARGET_COUNT,
+};
+
+/* bindings past these are not shadowed */
+#define VREND_GL_SHADOW_TEXTURE_UNITS 64
+#define VREND_GL_SHADOW_BUFFER_BINDINGS 64
+
+struct vrend_gl_buffer_binding {
+   GLuint id;
+   GLintptr offset;
+   GLsizeiptr size;
+};
+
+/* What is known to be set in the GL context of a sub context, to skip calls
+ * that would not change anything.  Object bindings are dropped whenever
+ * gl_object_epoch changes, as the name of a deleted object can be reused.
+ * A zero target or id means unknown.
+ */
+struct vrend_gl_shadow {
+   uint32_t object_epoch;
+
+   bool program_known;
+   bool vertex_array_known;
+   GLuint program;
+   GLuint pipeline;
+   GLuint vertex_array;
+
+   /* GL_TEXTURE0 + active_texture, when active_texture_known */
+   bool active_texture_known;
+   GLuint active_texture;
+   struct {
+      GLenum target;
+      GLuint id;
+   } textures[VREND_GL_SHADOW_TEXTURE_UNITS];
+
+   struct vrend_gl_buffer_binding buffers[VREND_GL_BUFFER_TARGET_COUNT]
+                                         [VREND_GL_SHADOW_BUFFER_BINDINGS];
+
+   uint32_t caps_known;
+   uint32_t caps_enabled;
+};
+
 struct vrend_sub_context {
    struct list_head head;
 
@@ -735,6 +976,7 @@ struct vrend_sub_context {
 
    struct vrend_constants consts[PIPE_SHADER_TYPES];
    bool const_dirty[PIPE_SHADER_TYPES];
+   struct vrend_const_ring const_ring;
 
    struct pipe_constant_buffer cbs[PIPE_SHADER_TYPES][PIPE_MAX_CONSTANT_BUFFERS];
    uint32_t const_bufs_used_mask[PIPE_SHADER_TYPES];
@@ -792,6 +1034,13 @@ struct vrend_sub_context {
    struct vrend_image_view image_views[PIPE_SHADER_TYPES][PIPE_MAX_SHADER_IMAGES];
    uint32_t images_used_mask[PIPE_SHADER_TYPES];
 
+   /* Indexed by compute.  The render targets of the last draw or dispatch
+    * were damaged at vrend_state.damage_reset_seq, and the bindings have
+    * not changed since.
+    */
+   bool render_damage_valid[2];
+   uint32_t render_damage_seq[2];
+
    struct vrend_ssbo ssbo[PIPE_SHADER_TYPES][PIPE_MAX_SHADER_BUFFERS];
    uint32_t ssbo_used_mask[PIPE_SHADER_TYPES];
    uint32_t ssbo_binding_offset[PIPE_SHADER_TYPES];
@@ -808,8 +1057,8 @@ struct vrend_sub_context {
    struct vrend_context *parent;
    struct sysval_uniform_block sysvalue_data;
    uint32_t sysvalue_data_cookie;
-   uint32_t current_program_id;
-   uint32_t current_pipeline_id;
+
+   struct vrend_gl_shadow gl_shadow;
 };
 
 struct vrend_untyped_resource {
@@ -868,6 +1117,9 @@ struct vrend_context {
    vrend_context_fence_retire fence_retire;
    void *fence_retire_data;
 
+   /* of the virgl_context, NULL for ctx0 */
+   struct virgl_context_stats *stats;
+
 #ifdef ENABLE_TRACING
    struct hash_table *active_markers;
 #endif
@@ -890,6 +1142,8 @@ static void vrend_apply_sampler_state(struct vrend_sub_context *sub_ctx,
 static void vrend_object_bind_dsa_to_sub_context(struct vrend_sub_context *sub_ctx,
                                                  uint32_t handle);
 static GLenum tgsitargettogltarget(const enum pipe_texture_target target, int nr_samples);
+static void vrend_damage_readback_destroy(struct vrend_damage_readback *readback);
+static inline uint8_t *vrend_blob_heap_map(const struct vrend_resource *res);
 
 void vrend_update_stencil_state(struct vrend_sub_context *sub_ctx);
 
@@ -1277,8 +1531,10 @@ vrend_surface_reference(struct vrend_surface **ptr, struct vrend_surface *surf)
 
 static void vrend_destroy_sampler_view(struct vrend_sampler_view *samp)
 {
-   if (samp->texture->gl_id != samp->gl_id)
+   if (samp->texture->gl_id != samp->gl_id) {
       glDeleteTextures(1, &samp->gl_id);
+      vrend_gl_object_deleted();
+   }
    vrend_resource_reference(&samp->texture, NULL);
    free(samp);
 }
@@ -1322,8 +1578,54 @@ static void vrend_shader_dump(struct vrend_shader *shader)
    virgl_debug("\n");
 }
 
+/* Hands a translated variant to the speculative compile thread, so that it
+ * is usually compiled by the time a draw selects it.
+ */
+static void vrend_spec_compile_queue(struct vrend_shader *shader)
+{
+   if (shader->is_compiled || shader->spec_queued)
+      return;
+
+   mtx_lock(&vrend_state.spec_compile_mutex);
+   shader->spec_state = VREND_SPEC_COMPILE_QUEUED;
+   list_addtail(&shader->spec_link, &vrend_state.spec_compile_list);
+   cnd_signal(&vrend_state.spec_compile_cond);
+   mtx_unlock(&vrend_state.spec_compile_mutex);
+
+   shader->spec_queued = true;
+   vrend_state.spec_compile_stats.queued++;
+}
+
+/* Takes a variant back from the speculative compile thread: a compile that
+ * has not started is dropped and a running one is waited for.  Returns
+ * whether the thread compiled the variant, in which case shader->id and
+ * shader->spec_compile_status are valid.
+ */
+static bool vrend_spec_compile_reclaim(struct vrend_shader *shader)
+{
+   if (!shader->spec_queued)
+      return false;
+   shader->spec_queued = false;
+
+   /* without the thread, nothing can be queued or running anymore */
+   if (vrend_state.spec_compile_thread) {
+      mtx_lock(&vrend_state.spec_compile_mutex);
+      if (shader->spec_state == VREND_SPEC_COMPILE_QUEUED) {
+         list_del(&shader->spec_link);
+         shader->spec_state = VREND_SPEC_COMPILE_NONE;
+      }
+      while (shader->spec_state == VREND_SPEC_COMPILE_RUNNING)
+         cnd_wait(&vrend_state.spec_compile_done_cond, &vrend_state.spec_compile_mutex);
+      mtx_unlock(&vrend_state.spec_compile_mutex);
+   }
+
+   return shader->spec_state == VREND_SPEC_COMPILE_DONE;
+}
+
 static void vrend_shader_destroy(struct vrend_shader *shader)
 {
+   vrend_spec_compile_reclaim(shader);
+
    list_for_each_entry_safe(struct vrend_linked_shader_program, ent, &shader->programs, sl[shader->sel->type])
       vrend_destroy_program(ent);
 
@@ -1387,16 +1689,28 @@ static inline int conv_shader_type(int type)
 static bool vrend_compile_shader(struct vrend_sub_context *sub_ctx,
                                  struct vrend_shader *shader)
 {
+   struct virgl_context_stats *stats = sub_ctx->parent->stats;
+   const uint64_t begin_ns = stats ? vrend_now_ns() : 0;
    GLint param;
    const char *shader_parts[SHADER_MAX_STRINGS];
 
-   for (int i = 0; i < shader->glsl_strings.num_strings; i++)
-      shader_parts[i] = shader->glsl_strings.strings[i].buf;
+   if (vrend_spec_compile_reclaim(shader)) {
+      param = shader->spec_compile_status;
+   } else {
+      for (int i = 0; i < shader->glsl_strings.num_strings; i++)
+         shader_parts[i] = shader->glsl_strings.strings[i].buf;
+
+      shader->id = glCreateShader(conv_shader_type(shader->sel->type));
+      glShaderSource(shader->id, shader->glsl_strings.num_strings, shader_parts, NULL);
+      glCompileShader(shader->id);
+      glGetShaderiv(shader->id, GL_COMPILE_STATUS, &param);
+   }
+
+   if (stats) {
+      virgl_context_stats_add(&stats->shader_compiles, 1);
+      virgl_context_stats_add(&stats->shader_compile_ns, vrend_now_ns() - begin_ns);
+   }
 
-   shader->id = glCreateShader(conv_shader_type(shader->sel->type));
-   glShaderSource(shader->id, shader->glsl_strings.num_strings, shader_parts, NULL);
-   glCompileShader(shader->id);
-   glGetShaderiv(shader->id, GL_COMPILE_STATUS, &param);
    if (param == GL_FALSE) {
       char infolog[65536];
       int len;
@@ -1418,6 +1732,32 @@ static bool vrend_compile_shader(struct vrend_sub_context *sub_ctx,
    return true;
 }
 
+/* Compiles the current variant of sel when needed.  On the first draw after
+ * a speculative compile, also accounts whether the prediction was right and
+ * how long the draw had to wait for its variant.
+ */
+static bool vrend_compile_current_shader(struct vrend_sub_context *sub_ctx,
+                                         struct vrend_shader_selector *sel)
+{
+   struct vrend_shader *shader = sel->current;
+
+   if (!sel->spec_shader)
+      return shader->is_compiled || vrend_compile_shader(sub_ctx, shader);
+
+   struct vrend_spec_compile_stats *stats = &vrend_state.spec_compile_stats;
+   const uint64_t begin_ns = vrend_now_ns();
+   const bool ret = shader->is_compiled || vrend_compile_shader(sub_ctx, shader);
+
+   stats->first_draw_stall_ns += vrend_now_ns() - begin_ns;
+   if (shader == sel->spec_shader)
+      stats->hits++;
+   else
+      stats->misses++;
+   sel->spec_shader = NULL;
+
+   return ret;
+}
+
 void
 vrend_insert_format(struct vrend_format_table *entry, uint32_t bindings, uint32_t flags)
 {
@@ -1450,11 +1790,176 @@ static bool vrend_is_timer_query(GLenum gltype)
       gltype == GL_TIME_ELAPSED;
 }
 
-static void vrend_use_program(struct vrend_linked_shader_program *program)
+static const GLenum vrend_gl_caps[VREND_GL_CAP_COUNT] = {
+   [VREND_GL_CAP_BLEND] = GL_BLEND,
+   [VREND_GL_CAP_CULL_FACE] = GL_CULL_FACE,
+   [VREND_GL_CAP_DEPTH_CLAMP] = GL_DEPTH_CLAMP,
+   [VREND_GL_CAP_DITHER] = GL_DITHER,
+   [VREND_GL_CAP_LINE_SMOOTH] = GL_LINE_SMOOTH,
+   [VREND_GL_CAP_LINE_STIPPLE] = GL_LINE_STIPPLE,
+   [VREND_GL_CAP_MULTISAMPLE] = GL_MULTISAMPLE,
+   [VREND_GL_CAP_POINT_SPRITE] = GL_POINT_SPRITE,
+   [VREND_GL_CAP_POLYGON_OFFSET_FILL] = GL_POLYGON_OFFSET_FILL,
+   [VREND_GL_CAP_POLYGON_OFFSET_LINE] = GL_POLYGON_OFFSET_LINE,
+   [VREND_GL_CAP_POLYGON_OFFSET_POINT] = GL_POLYGON_OFFSET_POINT,
+   [VREND_GL_CAP_POLYGON_SMOOTH] = GL_POLYGON_SMOOTH,
+   [VREND_GL_CAP_POLYGON_STIPPLE] = GL_POLYGON_STIPPLE,
+   [VREND_GL_CAP_PROGRAM_POINT_SIZE] = GL_PROGRAM_POINT_SIZE,
+   [VREND_GL_CAP_SAMPLE_ALPHA_TO_COVERAGE] = GL_SAMPLE_ALPHA_TO_COVERAGE,
+   [VREND_GL_CAP_SAMPLE_ALPHA_TO_ONE] = GL_SAMPLE_ALPHA_TO_ONE,
+   [VREND_GL_CAP_SAMPLE_MASK] = GL_SAMPLE_MASK,
+   [VREND_GL_CAP_SAMPLE_SHADING] = GL_SAMPLE_SHADING,
+   [VREND_GL_CAP_VERTEX_PROGRAM_TWO_SIDE] = GL_VERTEX_PROGRAM_TWO_SIDE,
+};
+
+static const GLenum vrend_gl_buffer_targets[VREND_GL_BUFFER_TARGET_COUNT] = {
+   [VREND_GL_BUFFER_UNIFORM] = GL_UNIFORM_BUFFER,
+   [VREND_GL_BUFFER_SHADER_STORAGE] = GL_SHADER_STORAGE_BUFFER,
+   [VREND_GL_BUFFER_ATOMIC_COUNTER] = GL_ATOMIC_COUNTER_BUFFER,
+};
+
+/* Returns true if the call must be made, and accounts for it. */
+static inline bool vrend_gl_shadow_check(bool changed)
+{
+   if (changed)
+      vrend_state.gl_shadow_stats.issued++;
+   else
+      vrend_state.gl_shadow_stats.elided++;
+   return changed;
+}
+
+static struct vrend_gl_shadow *vrend_gl_shadow_objects(struct vrend_sub_context *sub_ctx)
+{
+   struct vrend_gl_shadow *shadow = &sub_ctx->gl_shadow;
+
+   if (shadow->object_epoch != vrend_state.gl_object_epoch) {
+      shadow->object_epoch = vrend_state.gl_object_epoch;
+      shadow->program_known = false;
+      shadow->vertex_array_known = false;
+      memset(shadow->textures, 0, sizeof(shadow->textures));
+      memset(shadow->buffers, 0, sizeof(shadow->buffers));
+   }
+
+   return shadow;
+}
+
+static void vrend_gl_enable(struct vrend_sub_context *sub_ctx, enum vrend_gl_cap cap,
+                            bool enable)
+{
+   struct vrend_gl_shadow *shadow = &sub_ctx->gl_shadow;
+   const uint32_t bit = 1u << cap;
+
+   if (!vrend_gl_shadow_check(!(shadow->caps_known & bit) ||
+                              !(shadow->caps_enabled & bit) != !enable))
+      return;
+
+   if (enable) {
+      glEnable(vrend_gl_caps[cap]);
+      shadow->caps_enabled |= bit;
+   } else {
+      glDisable(vrend_gl_caps[cap]);
+      shadow->caps_enabled &= ~bit;
+   }
+   shadow->caps_known |= bit;
+}
+
+/* For state set behind the shadow's back, e.g. with glEnablei. */
+static inline void vrend_gl_forget_cap(struct vrend_sub_context *sub_ctx, enum vrend_gl_cap cap)
+{
+   sub_ctx->gl_shadow.caps_known &= ~(1u << cap);
+}
+
+static void vrend_gl_active_texture(struct vrend_sub_context *sub_ctx, GLuint unit)
+{
+   struct vrend_gl_shadow *shadow = &sub_ctx->gl_shadow;
+
+   if (!vrend_gl_shadow_check(!shadow->active_texture_known ||
+                              shadow->active_texture != unit))
+      return;
+
+   glActiveTexture(GL_TEXTURE0 + unit);
+   shadow->active_texture = unit;
+   shadow->active_texture_known = true;
+}
+
+/* Binds a texture to the active unit, which must have been set with
+ * vrend_gl_active_texture.  The last unit is where the active texture is
+ * parked between draws, and where every plain glBindTexture() lands, so
+ * what is bound there is never known.
+ */
+static void vrend_gl_bind_texture(struct vrend_sub_context *sub_ctx, GLenum target, GLuint id)
+{
+   struct vrend_gl_shadow *shadow = vrend_gl_shadow_objects(sub_ctx);
+   const GLuint unit = shadow->active_texture;
+
+   assert(shadow->active_texture_known);
+   if (unit >= VREND_GL_SHADOW_TEXTURE_UNITS || unit == vrend_state.max_texture_units - 1) {
+      glBindTexture(target, id);
+      return;
+   }
+
+   if (!vrend_gl_shadow_check(shadow->textures[unit].target != target ||
+                              shadow->textures[unit].id != id))
+      return;
+
+   glBindTexture(target, id);
+   shadow->textures[unit].target = target;
+   shadow->textures[unit].id = id;
+}
+
+static void vrend_gl_bind_buffer_range(struct vrend_sub_context *sub_ctx,
+                                       enum vrend_gl_buffer_target target, GLuint index,
+                                       GLuint id, GLintptr offset, GLsizeiptr size)
+{
+   struct vrend_gl_shadow *shadow = vrend_gl_shadow_objects(sub_ctx);
+
+   if (index >= VREND_GL_SHADOW_BUFFER_BINDINGS) {
+      glBindBufferRange(vrend_gl_buffer_targets[target], index, id, offset, size);
+      return;
+   }
+
+   struct vrend_gl_buffer_binding *binding = &shadow->buffers[target][index];
+   if (!vrend_gl_shadow_check(binding->id != id || binding->offset != offset ||
+                              binding->size != size))
+      return;
+
+   glBindBufferRange(vrend_gl_buffer_targets[target], index, id, offset, size);
+   binding->id = id;
+   binding->offset = offset;
+   binding->size = size;
+}
+
+static void vrend_gl_bind_vertex_array(struct vrend_sub_context *sub_ctx, GLuint id)
+{
+   struct vrend_gl_shadow *shadow = vrend_gl_shadow_objects(sub_ctx);
+
+   if (!vrend_gl_shadow_check(!shadow->vertex_array_known || shadow->vertex_array != id))
+      return;
+
+   glBindVertexArray(id);
+   shadow->vertex_array = id;
+   shadow->vertex_array_known = true;
+}
+
+static void vrend_use_program(struct vrend_sub_context *sub_ctx,
+                              struct vrend_linked_shader_program *program)
 {
+   struct vrend_gl_shadow *shadow = vrend_gl_shadow_objects(sub_ctx);
    GLuint id = !program ? 0 :
                           program->is_pipeline ? program->id.pipeline :
                                                  program->id.program;
+   GLuint program_id = 0;
+   GLuint pipeline_id = 0;
+
+   if (program && program->is_pipeline)
+      pipeline_id = id;
+   else
+      program_id = id;
+
+   if (!vrend_gl_shadow_check(!shadow->program_known || shadow->program != program_id ||
+                              shadow->pipeline != pipeline_id))
+      return;
+
    if (program && program->is_pipeline) {
       glUseProgram(0);
       glBindProgramPipeline(id);
@@ -1463,6 +1968,10 @@ static void vrend_use_program(struct vrend_linked_shader_program *program)
           glBindProgramPipeline(0);
        glUseProgram(id);
    }
+
+   shadow->program = program_id;
+   shadow->pipeline = pipeline_id;
+   shadow->program_known = true;
 }
 
 static void vrend_depth_test_enable(struct vrend_sub_context *sub_ctx, bool depth_test_enable)
@@ -1686,7 +2195,12 @@ static int bind_sampler_locs(struct vrend_linked_shader_program *sprog,
 static void bind_const_locs(struct vrend_linked_shader_program *sprog,
                             enum pipe_shader_type shader_type)
 {
-  if (sprog->ss[shader_type]->sel->sinfo.num_consts) {
+  sprog->const_block_bind[shader_type] = GL_INVALID_INDEX;
+
+  /* the block is bound by rebind_ubo_and_sampler_locs */
+  if (sprog->ss[shader_type]->sel->sinfo.consts_in_block) {
+     sprog->const_location[shader_type] = -1;
+  } else if (sprog->ss[shader_type]->sel->sinfo.num_consts) {
      char name[32];
      snprintf(name, 32, "%sconst0", pipe_shader_to_prefix(shader_type));
      sprog->const_location[shader_type] = vrend_get_uniform_location(sprog, name,
@@ -1814,6 +2328,37 @@ static void rebind_ubo_and_sampler_locs(struct vrend_linked_shader_program *spro
 
       bind_virgl_block_loc(sprog, shader_type, next_ubo_id);
    }
+
+   /* and the constant blocks follow the VirglBlock */
+   GLuint next_const_bind = next_ubo_id + 1;
+   for (enum pipe_shader_type shader_type = PIPE_SHADER_VERTEX;
+        shader_type <= last_shader;
+        shader_type++) {
+      if (!sprog->ss[shader_type] || !sprog->ss[shader_type]->sel->sinfo.consts_in_block)
+         continue;
+
+      char name[32];
+      snprintf(name, 32, "%sconstblock", pipe_shader_to_prefix(shader_type));
+      GLuint loc = vrend_get_uniform_block_index(sprog, name, shader_type);
+      if (loc == GL_INVALID_INDEX) {
+         sprog->const_block_bind[shader_type] = GL_INVALID_INDEX;
+         continue;
+      }
+
+      /* stages that do not use the constant block may take more than
+       * their share of the bindings
+       */
+      if (next_const_bind >= vrend_state.max_uniform_buffer_bindings) {
+         virgl_warn("no uniform buffer binding left for the %s constants\n",
+                    pipe_shader_to_prefix(shader_type));
+         sprog->const_block_bind[shader_type] = GL_INVALID_INDEX;
+         continue;
+      }
+
+      vrend_set_active_pipeline_stage(sprog, shader_type);
+      vrend_uniform_block_binding(sprog, shader_type, loc, next_const_bind);
+      sprog->const_block_bind[shader_type] = next_const_bind++;
+   }
 }
 
 static void bind_ssbo_locs(struct vrend_linked_shader_program *sprog,
@@ -1971,7 +2516,7 @@ static struct vrend_linked_shader_program *add_cs_shader_program(struct vrend_co
    sprog->id.program = prog_id;
    list_addtail(&sprog->head, &ctx->sub->cs_programs);
 
-   vrend_use_program(sprog);
+   vrend_use_program(ctx->sub, sprog);
 
    bind_sampler_locs(sprog, PIPE_SHADER_COMPUTE, 0);
    bind_ubo_locs(sprog, PIPE_SHADER_COMPUTE, 0);
@@ -2159,7 +2704,7 @@ static struct vrend_linked_shader_program *add_shader_program(struct vrend_sub_c
    sprog->ubo_sysval_buffer_id = GL_INVALID_INDEX;
    sprog->sysvalue_data_cookie = UINT32_MAX;
 
-   vrend_use_program(sprog);
+   vrend_use_program(sub_ctx, sprog);
 
    for (enum pipe_shader_type shader_type = PIPE_SHADER_VERTEX;
         shader_type <= last_shader;
@@ -2254,6 +2799,7 @@ static void vrend_destroy_program(struct vrend_linked_shader_program *ent)
        glDeleteProgramPipelines(1, &ent->id.pipeline);
    else
        glDeleteProgram(ent->id.program);
+   vrend_gl_object_deleted();
 
    list_del(&ent->head);
 
@@ -2465,6 +3011,7 @@ static void vrend_destroy_vertex_elements_object(void *obj_ptr)
 
    if (has_feature(feat_gles31_vertex_attrib_binding)) {
       glDeleteVertexArrays(1, &v->id);
+      vrend_gl_object_deleted();
    }
    FREE(v);
 }
@@ -3162,6 +3709,8 @@ void vrend_set_framebuffer_state(struct vrend_context *ctx,
 
    struct vrend_sub_context *sub_ctx = ctx->sub;
 
+   sub_ctx->render_damage_valid[false] = false;
+
    glBindFramebuffer(GL_FRAMEBUFFER, sub_ctx->fb_id);
 
    if (zsurf_handle) {
@@ -3457,7 +4006,7 @@ void vrend_bind_vertex_elements_state(struct vrend_context *ctx,
 
    if (has_feature(feat_gles31_vertex_attrib_binding) && v->id == 0) {
       glGenVertexArrays(1, &v->id);
-      glBindVertexArray(v->id);
+      vrend_gl_bind_vertex_array(ctx->sub, v->id);
       for (uint32_t i = 0; i < v->count; i++) {
          struct vrend_vertex_element *ve = &v->elements[i];
          GLint size = !vrend_state.use_gles && (v->zyxw_bitmask & (1 << i)) ? GL_BGRA : ve->nr_chan;
@@ -3764,7 +4313,8 @@ void vrend_set_single_sampler_view(struct vrend_context *ctx,
                size = vrend_state.max_texture_buffer_size - offset;
             offset *= blsize;
             size *= blsize;
-            glTexBufferRange(GL_TEXTURE_BUFFER, internalformat, view->texture->gl_id, offset, size);
+            glTexBufferRange(GL_TEXTURE_BUFFER, internalformat, view->texture->gl_id,
+                             view->texture->heap_offset + offset, size);
          } else
             glTexBuffer(GL_TEXTURE_BUFFER, internalformat, view->texture->gl_id);
       }
@@ -3798,6 +4348,8 @@ int vrend_set_single_image_view(struct vrend_context *ctx,
    struct vrend_image_view *iview = &ctx->sub->image_views[shader_type][index];
    struct vrend_resource *res;
 
+   ctx->sub->render_damage_valid[shader_type == PIPE_SHADER_COMPUTE] = false;
+
    if (handle) {
       if (!has_feature(feat_images))
          return EINVAL;
@@ -4337,6 +4889,25 @@ static inline void vrend_fill_shader_key(struct vrend_sub_context *sub_ctx,
    }
 }
 
+/* Saves the shader and its key for the offline translation benchmark. */
+static void vrend_shader_dump_corpus(const struct vrend_context *ctx,
+                                     const struct vrend_shader *shader,
+                                     const struct vrend_shader_key *key)
+{
+   const char *dir = getenv("VREND_SHADER_CORPUS_DIR");
+   struct vrend_shader_corpus_key corpus_key;
+
+   if (!dir)
+      return;
+
+   memset(&corpus_key, 0, sizeof(corpus_key));
+   corpus_key.req_local_mem = shader->sel->req_local_mem;
+   corpus_key.key = *key;
+   corpus_key.cfg = ctx->shader_cfg;
+
+   vrend_shader_corpus_dump(dir, shader->sel->tokens, &corpus_key);
+}
+
 static int vrend_shader_create(struct vrend_context *ctx,
                                struct vrend_shader *shader,
                                struct vrend_shader_key *key)
@@ -4346,6 +4917,8 @@ static int vrend_shader_create(struct vrend_context *ctx,
       VREND_DEBUG(dbg_shader_tgsi, ctx, "TGSI received:");
       VREND_DEBUG_EXT(dbg_shader_tgsi, ctx, vrend_dump_tgsi(shader->sel->tokens, 0));
       VREND_DEBUG(dbg_shader_tgsi, ctx, "\n");
+      if (VREND_DEBUG_ENABLED && vrend_debug(ctx, dbg_shader_tgsi))
+         vrend_shader_dump_corpus(ctx, shader, key);
 
       bool ret = vrend_convert_shader(ctx, &ctx->shader_cfg, shader->sel->tokens,
                                       shader->sel->req_local_mem, key, &shader->sel->sinfo,
@@ -4440,7 +5013,22 @@ static int vrend_finish_shader(struct vrend_context *ctx,
       sel->sinfo.separable_program =
             vrend_shader_query_separable_program(sel->tokens, &ctx->shader_cfg);
 
-   return vrend_shader_select(ctx->sub, sel, NULL) ? EINVAL : 0;
+   if (!vrend_state.spec_compile_thread)
+      return vrend_shader_select(ctx->sub, sel, NULL) ? EINVAL : 0;
+
+   /* Predict the variant of the first draw from the current state, including
+    * the vertex elements that only draws take into account, and compile it
+    * in the background.
+    */
+   ctx->sub->drawing = sel->type == PIPE_SHADER_VERTEX;
+   int ret = vrend_shader_select(ctx->sub, sel, NULL);
+   ctx->sub->drawing = false;
+   if (ret)
+      return EINVAL;
+
+   vrend_spec_compile_queue(sel->current);
+   sel->spec_shader = sel->current;
+   return 0;
 }
 
 static int vrend_shader_assign_tgsi(struct vrend_context *ctx,
@@ -4473,11 +5061,32 @@ static int vrend_shader_assign_tgsi(struct vrend_context *ctx,
    return 0;
 }
 
+/* Binary shaders skip the text parser, but tokens that were not built by it
+ * must be validated before anything walks them.
+ */
+static int vrend_shader_assign_tgsi_tokens(struct vrend_context *ctx,
+                                           struct vrend_shader_selector *sel,
+                                           const char *shader_buf,
+                                           uint32_t current_length,
+                                           uint32_t num_tokens)
+{
+   const struct tgsi_token *tokens = (const struct tgsi_token *)shader_buf;
+
+   if (current_length % sizeof(*tokens) || current_length / sizeof(*tokens) != num_tokens)
+      return EINVAL;
+
+   if (!vrend_tgsi_validate_tokens(tokens, num_tokens, sel->type))
+      return EINVAL;
+
+   return vrend_finish_shader(ctx, sel, tokens) ? EINVAL : 0;
+}
+
 static int vrend_shader_store_long_shader(uint32_t handle,
                                           struct vrend_shader_selector *sel,
                                           uint32_t pkt_length_bytes,
                                           uint32_t expected_token_count,
                                           const char *shd_text,
+                                          bool binary,
                                           struct vrend_long_shader_buffer **lsb)
 {
    /* We only got a partial shader, start a long shader transfer */
@@ -4489,6 +5098,7 @@ static int vrend_shader_store_long_shader(uint32_t handle,
    vrend_shader_state_reference(&lsbuf->sel, sel);
    lsbuf->current_length = pkt_length_bytes;
    lsbuf->total_length = expected_token_count * 4;
+   lsbuf->binary = binary;
    lsbuf->tmp_buf = malloc(lsbuf->total_length);
    if (!lsbuf->tmp_buf) {
       vrend_destroy_long_shader_buffer(lsbuf);
@@ -4505,7 +5115,7 @@ int vrend_create_shader(struct vrend_context *ctx,
                         const struct pipe_stream_output_info *so_info,
                         uint32_t req_local_mem,
                         const char *shd_text, uint32_t offlen, uint32_t num_tokens,
-                        enum pipe_shader_type type, uint32_t pkt_length)
+                        enum pipe_shader_type type, bool binary, uint32_t pkt_length)
 {
    if (type == PIPE_SHADER_GEOMETRY &&
        !has_feature(feat_geometry_shader)) {
@@ -4546,6 +5156,10 @@ int vrend_create_shader(struct vrend_context *ctx,
          virgl_error("Long shader continuation handle invalid\n");
          return EINVAL;
       }
+      if (binary != sub_ctx->long_shader_in_progress[type]->binary) {
+         virgl_error("Long shader continuation encoding mismatch\n");
+         return EINVAL;
+      }
    }
 
    /* Ensure that we won't hit an overflow */
@@ -4563,6 +5177,11 @@ int vrend_create_shader(struct vrend_context *ctx,
         return EINVAL;
       }
 
+      if (binary && expected_token_count != num_tokens) {
+         virgl_error("Binary shader length does not match its token count\n");
+         return EINVAL;
+      }
+
       struct vrend_shader_selector *sel;
       sel = vrend_create_shader_state(so_info, req_local_mem, type);
       if (sel == NULL) {
@@ -4580,7 +5199,7 @@ int vrend_create_shader(struct vrend_context *ctx,
          /* We only got a partial shader, start a long shader transfer */
          int ret = vrend_shader_store_long_shader(handle, sel,
                                                   pkt_length_bytes, expected_token_count,
-                                                  shd_text,
+                                                  shd_text, binary,
                                                   &sub_ctx->long_shader_in_progress[type]);
          if (ret != 0) {
             vrend_renderer_object_destroy(ctx, handle);
@@ -4588,7 +5207,10 @@ int vrend_create_shader(struct vrend_context *ctx,
             return ret;
          }
       } else {
-         int ret = vrend_shader_assign_tgsi(ctx, sel,
+         int ret = binary ?
+                   vrend_shader_assign_tgsi_tokens(ctx, sel, shd_text,
+                                                   pkt_length_bytes, num_tokens) :
+                   vrend_shader_assign_tgsi(ctx, sel,
                                             shd_text, pkt_length_bytes,
                                             num_tokens);
          if (ret != 0) {
@@ -4627,7 +5249,11 @@ int vrend_create_shader(struct vrend_context *ctx,
       memcpy(lsbuf->tmp_buf + lsbuf->current_length, shd_text, pkt_length_bytes);
       lsbuf->current_length += pkt_length_bytes;
       if (lsbuf->current_length == lsbuf->total_length) {
-         int ret = vrend_shader_assign_tgsi(ctx, lsbuf->sel,
+         int ret = lsbuf->binary ?
+                   vrend_shader_assign_tgsi_tokens(ctx, lsbuf->sel,
+                                                   lsbuf->tmp_buf, lsbuf->current_length,
+                                                   num_tokens) :
+                   vrend_shader_assign_tgsi(ctx, lsbuf->sel,
                                             lsbuf->tmp_buf, lsbuf->current_length,
                                             num_tokens);
          sub_ctx->long_shader_in_progress[type] = NULL;
@@ -4795,6 +5421,84 @@ static void vrend_clear_finish(struct vrend_sub_context *sub_ctx,
       glDisable(GL_SCISSOR_TEST);
 }
 
+static void vrend_resource_add_damage(struct vrend_resource *res, uint32_t level,
+                                      const struct pipe_box *box)
+{
+   int x0, y0, x1, y1;
+
+   if (level || box->z > 0 || res->base.target == PIPE_BUFFER)
+      return;
+
+   /* blit boxes can be flipped */
+   x0 = MAX2(MIN2(box->x, box->x + box->width), 0);
+   x1 = MIN2(MAX2(box->x, box->x + box->width), (int)res->base.width0);
+   y0 = MAX2(MIN2(box->y, box->y + box->height), 0);
+   y1 = MIN2(MAX2(box->y, box->y + box->height), (int)res->base.height0);
+   if (x0 >= x1 || y0 >= y1)
+      return;
+
+   if (res->damage.width) {
+      x0 = MIN2(x0, res->damage.x);
+      y0 = MIN2(y0, res->damage.y);
+      x1 = MAX2(x1, res->damage.x + res->damage.width);
+      y1 = MAX2(y1, res->damage.y + res->damage.height);
+   }
+
+   res->damage.x = x0;
+   res->damage.y = y0;
+   res->damage.width = x1 - x0;
+   res->damage.height = y1 - y0;
+   res->damage.depth = 1;
+}
+
+static void vrend_resource_add_full_damage(struct vrend_resource *res)
+{
+   const struct pipe_box box = {
+      .width = res->base.width0,
+      .height = res->base.height0,
+      .depth = 1,
+   };
+   vrend_resource_add_damage(res, 0, &box);
+}
+
+/* Rendering is not clipped against the viewport or scissor here, the whole
+ * attachment is considered damaged.  The damage of a resource only shrinks
+ * on readbacks, so the targets are only walked again after a binding
+ * change or a readback.
+ */
+static void vrend_sub_ctx_add_render_damage(struct vrend_sub_context *sub_ctx,
+                                            bool compute)
+{
+   enum pipe_shader_type first = compute ? PIPE_SHADER_COMPUTE : PIPE_SHADER_VERTEX;
+   enum pipe_shader_type last = compute ? PIPE_SHADER_COMPUTE : PIPE_SHADER_COMPUTE - 1;
+
+   if (likely(sub_ctx->render_damage_valid[compute] &&
+              sub_ctx->render_damage_seq[compute] == vrend_state.damage_reset_seq))
+      return;
+
+   sub_ctx->render_damage_valid[compute] = true;
+   sub_ctx->render_damage_seq[compute] = vrend_state.damage_reset_seq;
+
+   if (!compute) {
+      for (uint32_t i = 0; i < sub_ctx->nr_cbufs; i++) {
+         struct vrend_surface *surf = sub_ctx->surf[i];
+         if (surf && !surf->level && !surf->first_layer)
+            vrend_resource_add_full_damage(surf->texture);
+      }
+   }
+
+   for (enum pipe_shader_type type = first; type <= last; type++) {
+      uint32_t mask = sub_ctx->images_used_mask[type];
+      while (mask) {
+         struct vrend_image_view *iview = &sub_ctx->image_views[type][u_bit_scan(&mask)];
+         if ((iview->access & PIPE_IMAGE_ACCESS_WRITE) &&
+             iview->texture->base.target != PIPE_BUFFER &&
+             !iview->u.tex.level && !iview->u.tex.first_layer)
+            vrend_resource_add_full_damage(iview->texture);
+      }
+   }
+}
+
 void vrend_clear(struct vrend_context *ctx, unsigned buffers,
                  const union pipe_color_union *color, double depth,
                  unsigned stencil) {
@@ -4815,7 +5519,7 @@ void vrend_clear(struct vrend_context *ctx, unsigned buffers,
    if (sub_ctx->viewport_state_dirty)
       vrend_update_viewport_state(sub_ctx);
 
-   vrend_use_program(NULL);
+   vrend_use_program(sub_ctx, NULL);
 
    glDisable(GL_SCISSOR_TEST);
 
@@ -4825,6 +5529,9 @@ void vrend_clear(struct vrend_context *ctx, unsigned buffers,
    vrend_clear_prepare(sub_ctx, sub_ctx->nr_cbufs ? sub_ctx->surf[0] : NULL,
                        buffers, colorf, depth, stencil);
 
+   if (buffers & PIPE_CLEAR_COLOR)
+      vrend_sub_ctx_add_render_damage(sub_ctx, false);
+
    if (buffers & PIPE_CLEAR_COLOR) {
       uint32_t mask = 0;
       for (uint32_t i = 0; i < sub_ctx->nr_cbufs; i++) {
@@ -4893,6 +5600,8 @@ int vrend_clear_texture(struct vrend_context* ctx,
                          box->width, box->height, box->depth,
                          format, type, data);
    }
+
+   vrend_resource_add_damage(res, level, box);
    return 0;
 }
 
@@ -4944,8 +5653,11 @@ void vrend_clear_surface(struct vrend_context *ctx, uint32_t surf_handle,
 
    vrend_clear_prepare(sub_ctx, surf, buffers, colorf, depth, stencil);
 
-   if (buffers & PIPE_CLEAR_COLOR0)
+   if (buffers & PIPE_CLEAR_COLOR0) {
       bits |= GL_COLOR_BUFFER_BIT;
+      if (!surf->level && !surf->first_layer)
+         vrend_resource_add_full_damage(surf->texture);
+   }
    if (buffers & PIPE_CLEAR_DEPTH)
       bits |= GL_DEPTH_BUFFER_BIT;
    if (buffers & PIPE_CLEAR_STENCIL)
@@ -5129,7 +5841,10 @@ static void vrend_draw_bind_vertex_legacy(struct vrend_context *ctx,
       if (vbo->base.stride == 0) {
          void *data;
          /* for 0 stride we are kinda screwed */
-         data = glMapBufferRange(GL_ARRAY_BUFFER, vbo->base.buffer_offset, ve->nr_chan * sizeof(GLfloat), GL_MAP_READ_BIT);
+         if (res->heap_chunk)
+            data = vrend_blob_heap_map(res) + vbo->base.buffer_offset;
+         else
+            data = glMapBufferRange(GL_ARRAY_BUFFER, vbo->base.buffer_offset, ve->nr_chan * sizeof(GLfloat), GL_MAP_READ_BIT);
 
          switch (ve->nr_chan) {
          case 1:
@@ -5145,16 +5860,18 @@ static void vrend_draw_bind_vertex_legacy(struct vrend_context *ctx,
             glVertexAttrib4fv(loc, data);
             break;
          }
-         glUnmapBuffer(GL_ARRAY_BUFFER);
+         if (!res->heap_chunk)
+            glUnmapBuffer(GL_ARRAY_BUFFER);
          disable_bitmask |= (1 << loc);
       } else {
          GLint size = !vrend_state.use_gles && (va->zyxw_bitmask & (1 << i)) ? GL_BGRA : ve->nr_chan;
 
          enable_bitmask |= (1 << loc);
+         const uintptr_t offset = res->heap_offset + ve->base.src_offset + vbo->base.buffer_offset;
          if (util_format_is_pure_integer(ve->base.src_format)) {
-            glVertexAttribIPointer(loc, size, ve->type, vbo->base.stride, (void *)(uintptr_t)(ve->base.src_offset + vbo->base.buffer_offset));
+            glVertexAttribIPointer(loc, size, ve->type, vbo->base.stride, (void *)offset);
          } else {
-            glVertexAttribPointer(loc, size, ve->type, ve->norm, vbo->base.stride, (void *)(uintptr_t)(ve->base.src_offset + vbo->base.buffer_offset));
+            glVertexAttribPointer(loc, size, ve->type, ve->norm, vbo->base.stride, (void *)offset);
          }
          glVertexAttribDivisorARB(loc, ve->base.instance_divisor);
       }
@@ -5183,7 +5900,7 @@ static void vrend_draw_bind_vertex_binding(struct vrend_context *ctx,
 {
    int i;
 
-   glBindVertexArray(va->id);
+   vrend_gl_bind_vertex_array(ctx->sub, va->id);
 
    if (ctx->sub->vbo_dirty) {
       struct vrend_vertex_buffer *vbo = &ctx->sub->vbo[0];
@@ -5199,7 +5916,7 @@ static void vrend_draw_bind_vertex_binding(struct vrend_context *ctx,
             struct vrend_resource *res = (struct vrend_resource *)vbo[i].base.buffer;
             if (res) {
                buffers[i] = res->gl_id;
-               offsets[i] = vbo[i].base.buffer_offset;
+               offsets[i] = res->heap_offset + vbo[i].base.buffer_offset;
                strides[i] = vbo[i].base.stride;
             } else {
                buffers[i] = 0;
@@ -5219,7 +5936,8 @@ static void vrend_draw_bind_vertex_binding(struct vrend_context *ctx,
          for (i = 0; i < ctx->sub->num_vbos; i++) {
             struct vrend_resource *res = (struct vrend_resource *)vbo[i].base.buffer;
             if (res)
-               glBindVertexBuffer(i, res->gl_id, vbo[i].base.buffer_offset, vbo[i].base.stride);
+               glBindVertexBuffer(i, res->gl_id, res->heap_offset + vbo[i].base.buffer_offset,
+                                  vbo[i].base.stride);
             else
                glBindVertexBuffer(i, 0, 0, 0);
          }
@@ -5247,8 +5965,16 @@ static GLuint vrend_draw_bind_samplers_shader(struct vrend_sub_context *sub_ctx,
       struct vrend_sampler_view *tview = shader_view->views[i];
 
       if ((dirty & (1 << i)) && tview) {
-         glActiveTexture(GL_TEXTURE0 + next_sampler_id);
-         glUniform1i(sprog->sampler_locs[shader_type][sampler_index], next_sampler_id);
+         vrend_gl_active_texture(sub_ctx, next_sampler_id);
+
+         /* the unit only depends on the program, unless stages are shared
+          * between pipelines
+          */
+         if (vrend_gl_shadow_check(sprog->is_pipeline ||
+                                   !(sprog->sampler_units_set[shader_type] & (1u << sampler_index)))) {
+            glUniform1i(sprog->sampler_locs[shader_type][sampler_index], next_sampler_id);
+            sprog->sampler_units_set[shader_type] |= 1u << sampler_index;
+         }
 
          if (sprog->shadow_samp_mask[shader_type] & (1 << i)) {
             struct vrend_texture *tex = (struct vrend_texture *)tview->texture;
@@ -5292,7 +6018,7 @@ static GLuint vrend_draw_bind_samplers_shader(struct vrend_sub_context *sub_ctx,
                target = GL_TEXTURE_BUFFER;
             }
 
-            glBindTexture(target, id);
+            vrend_gl_bind_texture(sub_ctx, target, id);
             vrend_apply_sampler_state(sub_ctx, tview->texture,
                                       shader_view->samplers[i],
                                       next_sampler_id, tview);
@@ -5313,7 +6039,7 @@ static GLuint vrend_draw_bind_samplers_shader(struct vrend_sub_context *sub_ctx,
    // Since we use a dirty mask to elide some unnecessary state update API
    // calls, we must ensure that a later glBindTexture() used for another reason
    // (such as texture allocation) doesn't affect our fragile sampler bindings.
-   glActiveTexture(GL_TEXTURE0 + vrend_state.max_texture_units - 1);
+   vrend_gl_active_texture(sub_ctx, vrend_state.max_texture_units - 1);
 
    return next_sampler_id;
 }
@@ -5341,8 +6067,8 @@ static GLuint vrend_draw_bind_ubo_shader(struct vrend_sub_context *sub_ctx,
          cb = &sub_ctx->cbs[shader_type][i];
          res = (struct vrend_resource *)cb->buffer;
 
-         glBindBufferRange(GL_UNIFORM_BUFFER, next_ubo_id, res->gl_id,
-                           cb->buffer_offset, cb->buffer_size);
+         vrend_gl_bind_buffer_range(sub_ctx, VREND_GL_BUFFER_UNIFORM, next_ubo_id, res->gl_id,
+                                    res->heap_offset + cb->buffer_offset, cb->buffer_size);
          dirty &= ~(1 << i);
       }
       next_ubo_id++;
@@ -5352,35 +6078,160 @@ static GLuint vrend_draw_bind_ubo_shader(struct vrend_sub_context *sub_ctx,
    return next_ubo_id;
 }
 
-static void vrend_draw_bind_const_shader(struct vrend_sub_context *sub_ctx,
-                                         int shader_type, bool new_program)
+static bool vrend_const_ring_init(struct vrend_const_ring *ring)
 {
-   if (sub_ctx->consts[shader_type].consts &&
-       sub_ctx->shaders[shader_type] &&
-       (sub_ctx->prog->const_location[shader_type] != -1) &&
-       (sub_ctx->const_dirty[shader_type] || new_program)) {
-      glUniform4uiv(sub_ctx->prog->const_location[shader_type],
-            sub_ctx->shaders[shader_type]->sinfo.num_consts,
-            sub_ctx->consts[shader_type].consts);
-      sub_ctx->const_dirty[shader_type] = false;
+   const GLbitfield flags = GL_MAP_PERSISTENT_BIT | GL_MAP_WRITE_BIT | GL_MAP_COHERENT_BIT;
+
+   glGenBuffersARB(1, &ring->gl_id);
+   glBindBufferARB(GL_COPY_WRITE_BUFFER, ring->gl_id);
+   glBufferStorage(GL_COPY_WRITE_BUFFER, VREND_CONST_RING_SIZE, NULL, flags);
+   ring->map = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, VREND_CONST_RING_SIZE, flags);
+   glBindBufferARB(GL_COPY_WRITE_BUFFER, 0);
+
+   if (!ring->map) {
+      virgl_error("Unable to map the constant ring\n");
+      glDeleteBuffers(1, &ring->gl_id);
+      vrend_gl_object_deleted();
+      ring->gl_id = 0;
+      return false;
    }
+
+   return true;
 }
 
-static void vrend_draw_bind_ssbo_shader(struct vrend_sub_context *sub_ctx,
-                                        int shader_type)
+static void vrend_const_ring_fini(struct vrend_const_ring *ring)
 {
-   uint32_t mask;
-   struct vrend_ssbo *ssbo;
-   struct vrend_resource *res;
-
-   if (!has_feature(feat_ssbo))
-      return;
+   for (uint32_t i = 0; i < VREND_CONST_RING_SEGMENTS; i++) {
+      if (ring->segment_syncs[i])
+         glDeleteSync(ring->segment_syncs[i]);
+   }
 
-   if (!sub_ctx->prog->ssbo_used_mask[shader_type])
-      return;
+   if (ring->gl_id) {
+      glDeleteBuffers(1, &ring->gl_id);
+      vrend_gl_object_deleted();
+   }
 
-   if (!sub_ctx->ssbo_used_mask[shader_type])
-      return;
+   memset(ring, 0, sizeof(*ring));
+}
+
+/* Returns the offset of size bytes the GPU is done with, or -1. */
+static int64_t vrend_const_ring_alloc(struct vrend_const_ring *ring, uint32_t size)
+{
+   if (!ring->gl_id && !vrend_const_ring_init(ring))
+      return -1;
+
+   uint32_t offset = align(ring->offset, vrend_state.const_ring_alignment);
+
+   if (offset + size > (ring->segment + 1) * VREND_CONST_RING_SEGMENT_SIZE) {
+      ring->segment_syncs[ring->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      ring->segment = (ring->segment + 1) % VREND_CONST_RING_SEGMENTS;
+
+      GLsync sync = ring->segment_syncs[ring->segment];
+      if (sync) {
+         if (glClientWaitSync(sync, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            vrend_state.const_ring_stats.stalls++;
+            glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+         }
+         glDeleteSync(sync);
+         ring->segment_syncs[ring->segment] = NULL;
+      }
+
+      /* the uploads still in the segment are about to be overwritten */
+      for (uint32_t i = 0; i < PIPE_SHADER_TYPES; i++) {
+         if (ring->stage_offset[i] / VREND_CONST_RING_SEGMENT_SIZE == ring->segment)
+            ring->stage_size[i] = 0;
+      }
+
+      offset = ring->segment * VREND_CONST_RING_SEGMENT_SIZE;
+   }
+
+   ring->offset = offset + size;
+
+   return offset;
+}
+
+/* Streams the constants to the ring when they changed, or when the shader
+ * reads more of them than the last upload holds.
+ */
+static void vrend_draw_bind_const_block(struct vrend_sub_context *sub_ctx, int shader_type)
+{
+   const struct vrend_constants *consts = &sub_ctx->consts[shader_type];
+   struct vrend_const_ring *ring = &sub_ctx->const_ring;
+   const GLuint bind = sub_ctx->prog->const_block_bind[shader_type];
+   const uint32_t size = sub_ctx->shaders[shader_type]->sinfo.num_consts * 16;
+
+   if (bind == GL_INVALID_INDEX)
+      return;
+
+   if (sub_ctx->const_dirty[shader_type] || ring->stage_size[shader_type] < size) {
+      const uint32_t segment = ring->segment;
+      const int64_t offset = vrend_const_ring_alloc(ring, size);
+      if (offset < 0)
+         return;
+
+      const uint32_t copy_size = MIN2(size, consts->num_consts * sizeof(*consts->consts));
+      if (copy_size)
+         memcpy(ring->map + offset, consts->consts, copy_size);
+      memset(ring->map + offset + copy_size, 0, size - copy_size);
+
+      ring->stage_offset[shader_type] = offset;
+      ring->stage_size[shader_type] = size;
+      sub_ctx->const_dirty[shader_type] = false;
+
+      vrend_state.const_ring_stats.uploads++;
+      vrend_state.const_ring_stats.bytes += size;
+
+      /* the stages bound before this one for the same draw may have lost
+       * their upload to the wrap, move them to the new segment
+       */
+      if (ring->segment != segment && shader_type != PIPE_SHADER_COMPUTE) {
+         for (int i = PIPE_SHADER_VERTEX; i < shader_type; i++) {
+            if (!ring->stage_size[i] && sub_ctx->shaders[i] &&
+                sub_ctx->shaders[i]->sinfo.consts_in_block)
+               vrend_draw_bind_const_block(sub_ctx, i);
+         }
+      }
+   }
+
+   vrend_gl_bind_buffer_range(sub_ctx, VREND_GL_BUFFER_UNIFORM, bind, ring->gl_id,
+                              ring->stage_offset[shader_type], size);
+}
+
+static void vrend_draw_bind_const_shader(struct vrend_sub_context *sub_ctx,
+                                         int shader_type, bool new_program)
+{
+   if (sub_ctx->shaders[shader_type] &&
+       sub_ctx->shaders[shader_type]->sinfo.consts_in_block) {
+      vrend_draw_bind_const_block(sub_ctx, shader_type);
+      return;
+   }
+
+   if (sub_ctx->consts[shader_type].consts &&
+       sub_ctx->shaders[shader_type] &&
+       (sub_ctx->prog->const_location[shader_type] != -1) &&
+       (sub_ctx->const_dirty[shader_type] || new_program)) {
+      glUniform4uiv(sub_ctx->prog->const_location[shader_type],
+            sub_ctx->shaders[shader_type]->sinfo.num_consts,
+            sub_ctx->consts[shader_type].consts);
+      sub_ctx->const_dirty[shader_type] = false;
+   }
+}
+
+static void vrend_draw_bind_ssbo_shader(struct vrend_sub_context *sub_ctx,
+                                        int shader_type)
+{
+   uint32_t mask;
+   struct vrend_ssbo *ssbo;
+   struct vrend_resource *res;
+
+   if (!has_feature(feat_ssbo))
+      return;
+
+   if (!sub_ctx->prog->ssbo_used_mask[shader_type])
+      return;
+
+   if (!sub_ctx->ssbo_used_mask[shader_type])
+      return;
 
    uint32_t offset = sub_ctx->shaders[shader_type]->sinfo.ssbo_binding_offset;
    mask = sub_ctx->ssbo_used_mask[shader_type] &
@@ -5391,8 +6242,8 @@ static void vrend_draw_bind_ssbo_shader(struct vrend_sub_context *sub_ctx,
 
       ssbo = &sub_ctx->ssbo[shader_type][i];
       res = (struct vrend_resource *)ssbo->res;
-      glBindBufferRange(GL_SHADER_STORAGE_BUFFER, i + offset, res->gl_id,
-                        ssbo->buffer_offset, ssbo->buffer_size);
+      vrend_gl_bind_buffer_range(sub_ctx, VREND_GL_BUFFER_SHADER_STORAGE, i + offset, res->gl_id,
+                                 res->heap_offset + ssbo->buffer_offset, ssbo->buffer_size);
    }
 }
 
@@ -5412,8 +6263,8 @@ static void vrend_draw_bind_abo_shader(struct vrend_sub_context *sub_ctx)
 
       abo = &sub_ctx->abo[i];
       res = (struct vrend_resource *)abo->res;
-      glBindBufferRange(GL_ATOMIC_COUNTER_BUFFER, i, res->gl_id,
-                        abo->buffer_offset, abo->buffer_size);
+      vrend_gl_bind_buffer_range(sub_ctx, VREND_GL_BUFFER_ATOMIC_COUNTER, i, res->gl_id,
+                                 res->heap_offset + abo->buffer_offset, abo->buffer_size);
    }
 }
 
@@ -5492,7 +6343,8 @@ static void vrend_draw_bind_images_shader(struct vrend_sub_context *sub_ctx, int
                unsigned size = iview->u.buf.size / blsize;
                if (offset + size > vrend_state.max_texture_buffer_size)
                   size = vrend_state.max_texture_buffer_size - offset;
-               glTexBufferRange(GL_TEXTURE_BUFFER, format, iview->texture->gl_id, iview->u.buf.offset,
+               glTexBufferRange(GL_TEXTURE_BUFFER, format, iview->texture->gl_id,
+                                iview->texture->heap_offset + iview->u.buf.offset,
                                 size * blsize);
             } else {
                glTexBuffer(GL_TEXTURE_BUFFER, format, iview->texture->gl_id);
@@ -5589,9 +6441,9 @@ static void vrend_draw_bind_objects(struct vrend_sub_context *sub_ctx, bool new_
    }
 
    if (sub_ctx->prog->virgl_block_bind != GL_INVALID_INDEX)
-      glBindBufferRange(GL_UNIFORM_BUFFER, sub_ctx->prog->virgl_block_bind,
-                        sub_ctx->prog->ubo_sysval_buffer_id,
-                        0, sizeof(struct sysval_uniform_block));
+      vrend_gl_bind_buffer_range(sub_ctx, VREND_GL_BUFFER_UNIFORM, sub_ctx->prog->virgl_block_bind,
+                                 sub_ctx->prog->ubo_sysval_buffer_id,
+                                 0, sizeof(struct sysval_uniform_block));
 
    vrend_draw_bind_abo_shader(sub_ctx);
 
@@ -5712,11 +6564,8 @@ vrend_select_program(struct vrend_sub_context *sub_ctx, uint8_t vertices_per_pat
       if (!sel)
          continue;
 
-      struct vrend_shader *shader = sel->current;
-      if (shader && !shader->is_compiled) {
-         if (!vrend_compile_shader(sub_ctx, shader))
-            return PROGRAMM_ERROR;
-      }
+      if (sel->current && !vrend_compile_current_shader(sub_ctx, sel))
+         return PROGRAMM_ERROR;
       if (vrend_state.use_gles && sel->sinfo.gles_use_tex_query_level)
          gles_emulate_query_texture_levels_mask |= 1 << i;
    }
@@ -5790,7 +6639,7 @@ vrend_select_program(struct vrend_sub_context *sub_ctx, uint8_t vertices_per_pat
           }
 
           if (need_rebind) {
-             vrend_use_program(prog);
+             vrend_use_program(sub_ctx, prog);
              rebind_ubo_and_sampler_locs(prog, last_shader);
           }
       }
@@ -5886,16 +6735,55 @@ void vrend_link_program_hook(struct vrend_context *ctx, uint32_t *handles)
    ctx->sub->prog = prev_prog;
 }
 
-int vrend_draw_vbo(struct vrend_context *ctx,
-                   const struct pipe_draw_info *info,
-                   uint32_t cso, uint32_t indirect_handle,
-                   uint32_t indirect_draw_count_handle)
+static void vrend_draw_merged(const struct pipe_draw_info *infos, uint32_t count,
+                              uint32_t index_size, uintptr_t ib_offset)
+{
+   GLsizei counts[VREND_MAX_MERGED_DRAWS];
+
+   for (uint32_t i = 0; i < count; i++)
+      counts[i] = infos[i].count;
+
+   if (!infos[0].indexed) {
+      GLint firsts[VREND_MAX_MERGED_DRAWS];
+
+      for (uint32_t i = 0; i < count; i++)
+         firsts[i] = infos[i].start;
+      glMultiDrawArrays(infos[0].mode, firsts, counts, count);
+   } else {
+      const GLvoid *offsets[VREND_MAX_MERGED_DRAWS];
+      GLint basevertices[VREND_MAX_MERGED_DRAWS];
+      GLenum elsz = index_size == 1 ? GL_UNSIGNED_BYTE :
+                    index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+      /* indexed draws take their start from the index buffer offset */
+      for (uint32_t i = 0; i < count; i++) {
+         offsets[i] = (const GLvoid *)ib_offset;
+         basevertices[i] = infos[i].index_bias;
+      }
+      glMultiDrawElementsBaseVertex(infos[0].mode, counts, elsz, offsets, count, basevertices);
+   }
+
+   vrend_state.gl_shadow_stats.merged_draws += count - 1;
+}
+
+/* Draws infos[0], and as many of the following count - 1 draws as can be
+ * folded into the same multi-draw.  The number of draws done is returned in
+ * drawn, the state setup is done once for all of them.
+ */
+static int vrend_draw_vbo_internal(struct vrend_context *ctx,
+                                   const struct pipe_draw_info *infos, uint32_t count,
+                                   uint32_t cso, uint32_t indirect_handle,
+                                   uint32_t indirect_draw_count_handle,
+                                   uint32_t *drawn)
 {
+   const struct pipe_draw_info *info = &infos[0];
    enum select_program_result program_select_result = PROGRAMM_NO_CHANGE;
    struct vrend_resource *indirect_res = NULL;
    struct vrend_resource *indirect_params_res = NULL;
    struct vrend_sub_context *sub_ctx = ctx->sub;
 
+   *drawn = count;
+
    if (ctx->in_error)
       return ENOTRECOVERABLE;
 
@@ -5964,7 +6852,20 @@ int vrend_draw_vbo(struct vrend_context *ctx,
       return 0;
    }
 
-   vrend_use_program(sub_ctx->prog);
+   vrend_use_program(sub_ctx, sub_ctx->prog);
+   vrend_sub_ctx_add_render_damage(sub_ctx, false);
+   vrend_state.gl_shadow_stats.draws++;
+
+   /* gl_DrawID counts up within a multi-draw */
+   if (has_feature(feat_draw_parameters) && sub_ctx->prog->reads_drawid) {
+      for (uint32_t i = 1; i < count; i++) {
+         if (infos[i].drawid != info->drawid + i) {
+            count = 1;
+            *drawn = 1;
+            break;
+         }
+      }
+   }
 
    if (has_feature(feat_draw_parameters) &&
        sub_ctx->prog->reads_drawid &&
@@ -5996,7 +6897,7 @@ int vrend_draw_vbo(struct vrend_context *ctx,
       if (sub_ctx->ve) {
          vrend_draw_bind_vertex_binding(ctx, sub_ctx->ve);
       } else {
-         glBindVertexArray(sub_ctx->vaoid);
+         vrend_gl_bind_vertex_array(sub_ctx, sub_ctx->vaoid);
       }
    } else {
       if (sub_ctx->ve) {
@@ -6008,6 +6909,7 @@ int vrend_draw_vbo(struct vrend_context *ctx,
       }
    }
 
+   uintptr_t ib_offset = sub_ctx->ib.offset;
    if (info->indexed) {
       struct vrend_resource *res = (struct vrend_resource *)sub_ctx->ib.buffer;
       if (!res) {
@@ -6015,6 +6917,15 @@ int vrend_draw_vbo(struct vrend_context *ctx,
          return 0;
       }
 
+      /* let each draw be checked on its own if one of them is too large */
+      for (uint32_t i = 1; i < count; i++) {
+         if (sub_ctx->ib.index_size * infos[i].count + sub_ctx->ib.offset > res->base.width0) {
+            count = 1;
+            *drawn = 1;
+            break;
+         }
+      }
+
       if (!indirect_handle) {
          uint32_t expected_size = sub_ctx->ib.index_size * info->count + sub_ctx->ib.offset;
          if (expected_size > res->base.width0) {
@@ -6025,6 +6936,7 @@ int vrend_draw_vbo(struct vrend_context *ctx,
       }
 
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, res->gl_id);
+      ib_offset += res->heap_offset;
    } else
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
@@ -6056,6 +6968,11 @@ int vrend_draw_vbo(struct vrend_context *ctx,
       }
    }
 
+   const uintptr_t indirect_offset =
+      info->indirect.offset + (indirect_res ? indirect_res->heap_offset : 0);
+   const GLintptr draw_count_offset = info->indirect.indirect_draw_count_offset +
+      (indirect_params_res ? indirect_params_res->heap_offset : 0);
+
    if (has_feature(feat_indirect_draw)) {
       GLint buf = indirect_res ? indirect_res->gl_id : 0;
       glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buf);
@@ -6085,23 +7002,25 @@ int vrend_draw_vbo(struct vrend_context *ctx,
    if (use_advanced_blending) {
       GLenum blend = translate_blend_func_advanced(blend_mode);
       glBlendEquation(blend);
-      glEnable(GL_BLEND);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_BLEND, true);
    }
 
    /* set the vertex state up now on a delay */
-   if (!info->indexed) {
+   if (count > 1) {
+      vrend_draw_merged(infos, count, sub_ctx->ib.index_size, ib_offset);
+   } else if (!info->indexed) {
       GLenum mode = info->mode;
       int count = cso ? cso : info->count;
       int start = cso ? 0 : info->start;
 
       if (indirect_handle) {
          if (indirect_params_res)
-            glMultiDrawArraysIndirectCountARB(mode, (GLvoid const *)(uintptr_t)info->indirect.offset,
-                                              info->indirect.indirect_draw_count_offset, info->indirect.draw_count, info->indirect.stride);
+            glMultiDrawArraysIndirectCountARB(mode, (GLvoid const *)indirect_offset,
+                                              draw_count_offset, info->indirect.draw_count, info->indirect.stride);
          else if (info->indirect.draw_count > 1)
-            glMultiDrawArraysIndirect(mode, (GLvoid const *)(uintptr_t)info->indirect.offset, info->indirect.draw_count, info->indirect.stride);
+            glMultiDrawArraysIndirect(mode, (GLvoid const *)indirect_offset, info->indirect.draw_count, info->indirect.stride);
          else
-            glDrawArraysIndirect(mode, (GLvoid const *)(uintptr_t)info->indirect.offset);
+            glDrawArraysIndirect(mode, (GLvoid const *)indirect_offset);
       } else if (info->instance_count > 0) {
          if (info->start_instance > 0)
             glDrawArraysInstancedBaseInstance(mode, start, count, info->instance_count, info->start_instance);
@@ -6127,34 +7046,34 @@ int vrend_draw_vbo(struct vrend_context *ctx,
 
       if (indirect_handle) {
          if (indirect_params_res)
-            glMultiDrawElementsIndirectCountARB(mode, elsz, (GLvoid const *)(uintptr_t)info->indirect.offset,
-                                                info->indirect.indirect_draw_count_offset, info->indirect.draw_count, info->indirect.stride);
+            glMultiDrawElementsIndirectCountARB(mode, elsz, (GLvoid const *)indirect_offset,
+                                                draw_count_offset, info->indirect.draw_count, info->indirect.stride);
          else if (info->indirect.draw_count > 1)
-            glMultiDrawElementsIndirect(mode, elsz, (GLvoid const *)(uintptr_t)info->indirect.offset, info->indirect.draw_count, info->indirect.stride);
+            glMultiDrawElementsIndirect(mode, elsz, (GLvoid const *)indirect_offset, info->indirect.draw_count, info->indirect.stride);
          else
-            glDrawElementsIndirect(mode, elsz, (GLvoid const *)(uintptr_t)info->indirect.offset);
+            glDrawElementsIndirect(mode, elsz, (GLvoid const *)indirect_offset);
       } else if (info->index_bias) {
          if (info->instance_count > 0) {
             if (info->start_instance > 0)
-               glDrawElementsInstancedBaseVertexBaseInstance(mode, info->count, elsz, (void *)(uintptr_t)sub_ctx->ib.offset,
+               glDrawElementsInstancedBaseVertexBaseInstance(mode, info->count, elsz, (void *)ib_offset,
                                                              info->instance_count, info->index_bias, info->start_instance);
             else
-               glDrawElementsInstancedBaseVertex(mode, info->count, elsz, (void *)(uintptr_t)sub_ctx->ib.offset, info->instance_count, info->index_bias);
+               glDrawElementsInstancedBaseVertex(mode, info->count, elsz, (void *)ib_offset, info->instance_count, info->index_bias);
 
 
          } else if (info->min_index != 0 || info->max_index != (unsigned)-1)
-            glDrawRangeElementsBaseVertex(mode, info->min_index, info->max_index, info->count, elsz, (void *)(uintptr_t)sub_ctx->ib.offset, info->index_bias);
+            glDrawRangeElementsBaseVertex(mode, info->min_index, info->max_index, info->count, elsz, (void *)ib_offset, info->index_bias);
          else
-            glDrawElementsBaseVertex(mode, info->count, elsz, (void *)(uintptr_t)sub_ctx->ib.offset, info->index_bias);
+            glDrawElementsBaseVertex(mode, info->count, elsz, (void *)ib_offset, info->index_bias);
       } else if (info->instance_count > 0) {
          if (info->start_instance > 0) {
-            glDrawElementsInstancedBaseInstance(mode, info->count, elsz, (void *)(uintptr_t)sub_ctx->ib.offset, info->instance_count, info->start_instance);
+            glDrawElementsInstancedBaseInstance(mode, info->count, elsz, (void *)ib_offset, info->instance_count, info->start_instance);
          } else
-            glDrawElementsInstancedARB(mode, info->count, elsz, (void *)(uintptr_t)sub_ctx->ib.offset, info->instance_count);
+            glDrawElementsInstancedARB(mode, info->count, elsz, (void *)ib_offset, info->instance_count);
       } else if (info->min_index != 0 || info->max_index != (unsigned)-1)
-         glDrawRangeElements(mode, info->min_index, info->max_index, info->count, elsz, (void *)(uintptr_t)sub_ctx->ib.offset);
+         glDrawRangeElements(mode, info->min_index, info->max_index, info->count, elsz, (void *)ib_offset);
       else
-         glDrawElements(mode, info->count, elsz, (void *)(uintptr_t)sub_ctx->ib.offset);
+         glDrawElements(mode, info->count, elsz, (void *)ib_offset);
    }
 
    if (info->primitive_restart) {
@@ -6175,7 +7094,52 @@ int vrend_draw_vbo(struct vrend_context *ctx,
    }
 
    if (use_advanced_blending)
-      glDisable(GL_BLEND);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_BLEND, false);
+
+   TRACE_COUNTER_VALUE(gl_calls_elided, vrend_state.gl_shadow_stats.elided);
+   return 0;
+}
+
+int vrend_draw_vbo(struct vrend_context *ctx,
+                   const struct pipe_draw_info *info,
+                   uint32_t cso, uint32_t indirect_handle,
+                   uint32_t indirect_draw_count_handle)
+{
+   uint32_t drawn;
+
+   return vrend_draw_vbo_internal(ctx, info, 1, cso, indirect_handle,
+                                  indirect_draw_count_handle, &drawn);
+}
+
+bool vrend_draw_vbo_can_merge(const struct pipe_draw_info *first,
+                              const struct pipe_draw_info *info)
+{
+   /* multi-draws have no instancing, and an instance count of one is
+    * what the guest sends for plain draws */
+   return has_feature(feat_multi_draw) &&
+          info->mode == first->mode &&
+          info->indexed == first->indexed &&
+          info->instance_count <= 1 && first->instance_count <= 1 &&
+          !info->start_instance && !first->start_instance &&
+          info->primitive_restart == first->primitive_restart &&
+          (!info->primitive_restart || info->restart_index == first->restart_index) &&
+          info->vertices_per_patch == first->vertices_per_patch &&
+          !info->indirect.draw_count && !first->indirect.draw_count;
+}
+
+int vrend_draw_vbo_multi(struct vrend_context *ctx,
+                         const struct pipe_draw_info *infos, uint32_t count)
+{
+   assert(count <= VREND_MAX_MERGED_DRAWS);
+
+   for (uint32_t i = 0; i < count;) {
+      uint32_t drawn;
+      int ret = vrend_draw_vbo_internal(ctx, &infos[i], count - i, 0, 0, 0, &drawn);
+      if (ret)
+         return ret;
+      i += drawn;
+   }
+
    return 0;
 }
 
@@ -6207,11 +7171,9 @@ void vrend_launch_grid(struct vrend_context *ctx,
          virgl_error("Failure to select compute shader variant: %s\n", ctx->debug_name);
          return;
       }
-      if (!sub_ctx->shaders[PIPE_SHADER_COMPUTE]->current->is_compiled) {
-         if (!vrend_compile_shader(sub_ctx, sub_ctx->shaders[PIPE_SHADER_COMPUTE]->current)) {
-            virgl_error("Failure to compile compute shader variant: %s\n", ctx->debug_name);
-            return;
-         }
+      if (!vrend_compile_current_shader(sub_ctx, sub_ctx->shaders[PIPE_SHADER_COMPUTE])) {
+         virgl_error("Failure to compile compute shader variant: %s\n", ctx->debug_name);
+         return;
       }
       if (sub_ctx->shaders[PIPE_SHADER_COMPUTE]->current->id != (GLuint)sub_ctx->prog_ids[PIPE_SHADER_COMPUTE]) {
          prog = lookup_cs_shader_program(ctx, sub_ctx->shaders[PIPE_SHADER_COMPUTE]->current->id);
@@ -6240,7 +7202,8 @@ void vrend_launch_grid(struct vrend_context *ctx,
       return;
    }
 
-   vrend_use_program(sub_ctx->prog);
+   vrend_use_program(sub_ctx, sub_ctx->prog);
+   vrend_sub_ctx_add_render_damage(sub_ctx, true);
 
    vrend_set_active_pipeline_stage(sub_ctx->prog, PIPE_SHADER_COMPUTE);
    vrend_draw_bind_ubo_shader(sub_ctx, PIPE_SHADER_COMPUTE, 0);
@@ -6264,7 +7227,7 @@ void vrend_launch_grid(struct vrend_context *ctx,
       glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
 
    if (indirect_res) {
-      glDispatchComputeIndirect(indirect_offset);
+      glDispatchComputeIndirect(indirect_res->heap_offset + indirect_offset);
    } else {
       glDispatchCompute(grid[0], grid[1], grid[2]);
    }
@@ -6453,6 +7416,7 @@ static void vrend_hw_emit_blend(struct vrend_sub_context *sub_ctx, struct pipe_b
             glEnableIndexedEXT(GL_BLEND, i);
          } else
             glDisableIndexedEXT(GL_BLEND, i);
+         vrend_gl_forget_cap(sub_ctx, VREND_GL_CAP_BLEND);
 
          if (state->rt[i].colormask != sub_ctx->hw_blend_state.rt[i].colormask) {
             sub_ctx->hw_blend_state.rt[i].colormask = state->rt[i].colormask;
@@ -6474,10 +7438,10 @@ static void vrend_hw_emit_blend(struct vrend_sub_context *sub_ctx, struct pipe_b
                              translate_blend_factor(state->rt[0].alpha_dst_factor));
          glBlendEquationSeparate(translate_blend_func(state->rt[0].rgb_func),
                                  translate_blend_func(state->rt[0].alpha_func));
-         glEnable(GL_BLEND);
+         vrend_gl_enable(sub_ctx, VREND_GL_CAP_BLEND, true);
       }
       else
-         glDisable(GL_BLEND);
+         vrend_gl_enable(sub_ctx, VREND_GL_CAP_BLEND, false);
 
       if (state->rt[0].colormask != sub_ctx->hw_blend_state.rt[0].colormask ||
           (sub_ctx->hw_blend_state.independent_blend_enable &&
@@ -6493,23 +7457,12 @@ static void vrend_hw_emit_blend(struct vrend_sub_context *sub_ctx, struct pipe_b
    sub_ctx->hw_blend_state.independent_blend_enable = state->independent_blend_enable;
 
    if (has_feature(feat_multisample)) {
-      if (state->alpha_to_coverage)
-         glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
-      else
-         glDisable(GL_SAMPLE_ALPHA_TO_COVERAGE);
-
-      if (!vrend_state.use_gles) {
-         if (state->alpha_to_one)
-            glEnable(GL_SAMPLE_ALPHA_TO_ONE);
-         else
-            glDisable(GL_SAMPLE_ALPHA_TO_ONE);
-      }
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_SAMPLE_ALPHA_TO_COVERAGE, state->alpha_to_coverage);
+      if (!vrend_state.use_gles)
+         vrend_gl_enable(sub_ctx, VREND_GL_CAP_SAMPLE_ALPHA_TO_ONE, state->alpha_to_one);
    }
 
-   if (state->dither)
-      glEnable(GL_DITHER);
-   else
-      glDisable(GL_DITHER);
+   vrend_gl_enable(sub_ctx, VREND_GL_CAP_DITHER, state->dither);
 }
 
 /* there are a few reasons we might need to patch the blend state.
@@ -6583,7 +7536,7 @@ void vrend_object_bind_blend(struct vrend_context *ctx,
 
    if (handle == 0) {
       memset(&ctx->sub->blend_state, 0, sizeof(ctx->sub->blend_state));
-      glDisable(GL_BLEND);
+      vrend_gl_enable(ctx->sub, VREND_GL_CAP_BLEND, false);
       return;
    }
    state = vrend_object_lookup(ctx->sub->object_hash, handle, VIRGL_OBJECT_BLEND);
@@ -6738,15 +7691,12 @@ static inline GLenum translate_fill(uint32_t mode)
 
 static void vrend_hw_emit_rs(struct vrend_context *ctx)
 {
-   struct pipe_rasterizer_state *state = &ctx->sub->rs_state;
+   struct vrend_sub_context *sub_ctx = ctx->sub;
+   struct pipe_rasterizer_state *state = &sub_ctx->rs_state;
    int i;
 
-   if (has_feature(feat_depth_clamp)) {
-      if (state->depth_clip)
-         glDisable(GL_DEPTH_CLAMP);
-      else
-         glEnable(GL_DEPTH_CLAMP);
-   }
+   if (has_feature(feat_depth_clamp))
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_DEPTH_CLAMP, !state->depth_clip);
 
    if (vrend_state.use_gles) {
       /* guest send invalid glPointSize parameter */
@@ -6756,9 +7706,9 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
          report_gles_warn(ctx, GLES_WARN_POINT_SIZE);
       }
    } else if (state->point_size_per_vertex) {
-      glEnable(GL_PROGRAM_POINT_SIZE);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_PROGRAM_POINT_SIZE, true);
    } else {
-      glDisable(GL_PROGRAM_POINT_SIZE);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_PROGRAM_POINT_SIZE, false);
       if (state->point_size) {
          glPointSize(state->point_size);
       }
@@ -6791,30 +7741,22 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
    } else
       report_core_warn(ctx, CORE_PROFILE_WARN_POLYGON_MODE);
 
-   if (state->offset_tri) {
-      glEnable(GL_POLYGON_OFFSET_FILL);
-   } else {
-      glDisable(GL_POLYGON_OFFSET_FILL);
-   }
+   vrend_gl_enable(sub_ctx, VREND_GL_CAP_POLYGON_OFFSET_FILL, state->offset_tri);
 
    if (vrend_state.use_gles) {
       if (state->offset_line) {
          report_gles_warn(ctx, GLES_WARN_OFFSET_LINE);
       }
-   } else if (state->offset_line) {
-      glEnable(GL_POLYGON_OFFSET_LINE);
    } else {
-      glDisable(GL_POLYGON_OFFSET_LINE);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_POLYGON_OFFSET_LINE, state->offset_line);
    }
 
    if (vrend_state.use_gles) {
       if (state->offset_point) {
          report_gles_warn(ctx, GLES_WARN_OFFSET_POINT);
       }
-   } else if (state->offset_point) {
-      glEnable(GL_POLYGON_OFFSET_POINT);
    } else {
-      glDisable(GL_POLYGON_OFFSET_POINT);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_POLYGON_OFFSET_POINT, state->offset_point);
    }
 
 
@@ -6858,17 +7800,13 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
    else
        glPolygonOffset(state->offset_scale, state->offset_units);
 
-   if (!vrend_shader_use_core(ctx)) {
-      if (state->poly_stipple_enable)
-         glEnable(GL_POLYGON_STIPPLE);
-      else
-         glDisable(GL_POLYGON_STIPPLE);
-   }
+   if (!vrend_shader_use_core(ctx))
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_POLYGON_STIPPLE, state->poly_stipple_enable);
 
    if (state->point_quad_rasterization) {
       if (vrend_state.use_core_profile == false &&
           vrend_state.use_gles == false) {
-         glEnable(GL_POINT_SPRITE);
+         vrend_gl_enable(sub_ctx, VREND_GL_CAP_POINT_SPRITE, true);
       }
 
       if (vrend_state.use_gles == false) {
@@ -6877,7 +7815,7 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
    } else {
       if (vrend_state.use_core_profile == false &&
           vrend_state.use_gles == false) {
-         glDisable(GL_POINT_SPRITE);
+         vrend_gl_enable(sub_ctx, VREND_GL_CAP_POINT_SPRITE, false);
       }
    }
 
@@ -6895,17 +7833,13 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
       default:
          virgl_warn("Unhandled cull-face: %x\n", state->cull_face);
       }
-      glEnable(GL_CULL_FACE);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_CULL_FACE, true);
    } else
-      glDisable(GL_CULL_FACE);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_CULL_FACE, false);
 
    /* two sided lighting handled in shader for core profile */
-   if (vrend_state.use_core_profile == false) {
-      if (state->light_twoside)
-         glEnable(GL_VERTEX_PROGRAM_TWO_SIDE);
-      else
-         glDisable(GL_VERTEX_PROGRAM_TWO_SIDE);
-   }
+   if (vrend_state.use_core_profile == false)
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_VERTEX_PROGRAM_TWO_SIDE, state->light_twoside);
 
    if (state->clip_plane_enable != ctx->sub->hw_rs_state.clip_plane_enable) {
       ctx->sub->hw_rs_state.clip_plane_enable = state->clip_plane_enable;
@@ -6925,10 +7859,7 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
    }
    if (vrend_state.use_core_profile == false) {
       glLineStipple(state->line_stipple_factor, state->line_stipple_pattern);
-      if (state->line_stipple_enable)
-         glEnable(GL_LINE_STIPPLE);
-      else
-         glDisable(GL_LINE_STIPPLE);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_LINE_STIPPLE, state->line_stipple_enable);
    } else if (state->line_stipple_enable) {
       if (vrend_state.use_gles)
          report_core_warn(ctx, GLES_WARN_STIPPLE);
@@ -6941,20 +7872,16 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
       if (state->line_smooth) {
          report_gles_warn(ctx, GLES_WARN_LINE_SMOOTH);
       }
-   } else if (state->line_smooth) {
-      glEnable(GL_LINE_SMOOTH);
    } else {
-      glDisable(GL_LINE_SMOOTH);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_LINE_SMOOTH, state->line_smooth);
    }
 
    if (vrend_state.use_gles) {
       if (state->poly_smooth) {
          report_gles_warn(ctx, GLES_WARN_POLY_SMOOTH);
       }
-   } else if (state->poly_smooth) {
-      glEnable(GL_POLYGON_SMOOTH);
    } else {
-      glDisable(GL_POLYGON_SMOOTH);
+      vrend_gl_enable(sub_ctx, VREND_GL_CAP_POLYGON_SMOOTH, state->poly_smooth);
    }
 
    if (vrend_state.use_core_profile == false) {
@@ -6973,27 +7900,15 @@ static void vrend_hw_emit_rs(struct vrend_context *ctx)
    }
 
    if (has_feature(feat_multisample)) {
-      if (has_feature(feat_sample_mask)) {
-         if (state->multisample)
-            glEnable(GL_SAMPLE_MASK);
-         else
-            glDisable(GL_SAMPLE_MASK);
-      }
+      if (has_feature(feat_sample_mask))
+         vrend_gl_enable(sub_ctx, VREND_GL_CAP_SAMPLE_MASK, state->multisample);
 
       /* GLES doesn't have GL_MULTISAMPLE */
-      if (!vrend_state.use_gles) {
-         if (state->multisample)
-            glEnable(GL_MULTISAMPLE);
-         else
-            glDisable(GL_MULTISAMPLE);
-      }
+      if (!vrend_state.use_gles)
+         vrend_gl_enable(sub_ctx, VREND_GL_CAP_MULTISAMPLE, state->multisample);
 
-      if (has_feature(feat_sample_shading)) {
-         if (state->force_persample_interp)
-            glEnable(GL_SAMPLE_SHADING);
-         else
-            glDisable(GL_SAMPLE_SHADING);
-      }
+      if (has_feature(feat_sample_shading))
+         vrend_gl_enable(sub_ctx, VREND_GL_CAP_SAMPLE_SHADING, state->force_persample_interp);
    }
 
    if (state->scissor)
@@ -7290,6 +8205,12 @@ static bool do_wait(struct vrend_fence *fence, bool can_block)
 }
 
 static void vrend_renderer_check_queries(void);
+static void vrend_renderer_check_damage_readbacks(void);
+static void vrend_renderer_check_resource_pool(void);
+static void vrend_resource_pool_init(uint32_t flags);
+static void vrend_resource_pool_fini(void);
+static void vrend_renderer_check_blob_heap(void);
+static void vrend_blob_heap_fini(void);
 
 void vrend_renderer_poll(void) {
    if (vrend_state.use_async_fence_cb) {
@@ -7306,14 +8227,32 @@ void vrend_renderer_poll(void) {
    } else {
       vrend_renderer_check_fences();
    }
+
+   vrend_renderer_check_damage_readbacks();
+   vrend_renderer_check_resource_pool();
+   vrend_renderer_check_blob_heap();
+}
+
+/* Fences can retire out of order, keep the highest seqno. */
+static void vrend_fence_seqno_retired(uint64_t seqno)
+{
+   uint_fast64_t retired = atomic_load(&vrend_state.retired_fence_seqno);
+
+   while (retired < seqno &&
+          !atomic_compare_exchange_weak(&vrend_state.retired_fence_seqno, &retired, seqno))
+      ;
 }
 
 static void wait_sync(struct vrend_fence *fence)
 {
    struct vrend_context *ctx = fence->ctx;
 
-   bool signal_poll = atomic_load(&vrend_state.has_waiting_queries);
    do_wait(fence, /* can_block */ true);
+   vrend_fence_seqno_retired(fence->seqno);
+
+   /* Queries ended after this fence cannot have become ready. */
+   bool signal_poll = atomic_load(&vrend_state.has_waiting_queries) &&
+                      atomic_load(&vrend_state.waiting_query_seqno) <= fence->seqno;
 
    mtx_lock(&vrend_state.fence_mutex);
    if (vrend_state.use_async_fence_cb) {
@@ -7331,12 +8270,9 @@ static void wait_sync(struct vrend_fence *fence)
       return;
    }
 
-   /* If the current GL fence completed while one or more query was pending,
-    * check queries on the main thread before notifying the caller about fence
-    * completion.
-    * TODO: store seqno of first query in waiting_query_list and compare to
-    * current fence to avoid polling when it (and all later queries) are after
-    * the current fence. */
+   /* If the current GL fence completed a pending query, check queries on the
+    * main thread before notifying the caller about fence completion.
+    */
    if (signal_poll) {
       mtx_lock(&vrend_state.poll_mutex);
       if (write_eventfd(vrend_state.eventfd, 1))
@@ -7446,6 +8382,108 @@ static void vrend_renderer_use_threaded_sync(void)
    }
 }
 
+static int thread_spec_compile(UNUSED void *arg)
+{
+   u_thread_setname("vrend-shader");
+
+   mtx_lock(&vrend_state.spec_compile_mutex);
+   vrend_clicbs->make_current_surfaceless(vrend_state.spec_compile_context);
+
+   while (!vrend_state.stop_spec_compile_thread) {
+      if (list_is_empty(&vrend_state.spec_compile_list)) {
+         if (cnd_wait(&vrend_state.spec_compile_cond, &vrend_state.spec_compile_mutex) != 0) {
+            virgl_warn("Error while waiting on condition\n");
+            break;
+         }
+         continue;
+      }
+
+      struct vrend_shader *shader =
+         list_first_entry(&vrend_state.spec_compile_list, struct vrend_shader, spec_link);
+      list_del(&shader->spec_link);
+      shader->spec_state = VREND_SPEC_COMPILE_RUNNING;
+      mtx_unlock(&vrend_state.spec_compile_mutex);
+
+      /* the GLSL and the type of a translated variant no longer change */
+      const char *shader_parts[SHADER_MAX_STRINGS];
+      GLint param;
+
+      for (int i = 0; i < shader->glsl_strings.num_strings; i++)
+         shader_parts[i] = shader->glsl_strings.strings[i].buf;
+
+      GLuint id = glCreateShader(conv_shader_type(shader->sel->type));
+      glShaderSource(id, shader->glsl_strings.num_strings, shader_parts, NULL);
+      glCompileShader(id);
+      glGetShaderiv(id, GL_COMPILE_STATUS, &param);
+      /* the shader object must be complete before another context uses it */
+      glFinish();
+
+      mtx_lock(&vrend_state.spec_compile_mutex);
+      shader->id = id;
+      shader->spec_compile_status = param;
+      shader->spec_state = VREND_SPEC_COMPILE_DONE;
+      vrend_state.spec_compile_stats.compiled++;
+      cnd_broadcast(&vrend_state.spec_compile_done_cond);
+   }
+
+   vrend_clicbs->make_current_surfaceless(0);
+   vrend_clicbs->destroy_gl_context_surfaceless(vrend_state.spec_compile_context);
+   mtx_unlock(&vrend_state.spec_compile_mutex);
+   return 0;
+}
+
+static void vrend_renderer_use_spec_compile(void)
+{
+   struct virgl_gl_ctx_param ctx_params = {0};
+
+   ctx_params.shared = true;
+   ctx_params.major_ver = vrend_state.gl_major_ver;
+   ctx_params.minor_ver = vrend_state.gl_minor_ver;
+
+   vrend_state.spec_compile_context = vrend_clicbs->create_gl_context_surfaceless(0, &ctx_params);
+   if (vrend_state.spec_compile_context == NULL) {
+      virgl_error("Failed to create shader compile opengl context\n");
+      return;
+   }
+
+   list_inithead(&vrend_state.spec_compile_list);
+   vrend_state.stop_spec_compile_thread = false;
+   mtx_init(&vrend_state.spec_compile_mutex, mtx_plain);
+   cnd_init(&vrend_state.spec_compile_cond);
+   cnd_init(&vrend_state.spec_compile_done_cond);
+
+   vrend_state.spec_compile_thread = u_thread_create(thread_spec_compile, NULL);
+   if (!vrend_state.spec_compile_thread) {
+      vrend_clicbs->destroy_gl_context_surfaceless(vrend_state.spec_compile_context);
+      cnd_destroy(&vrend_state.spec_compile_done_cond);
+      cnd_destroy(&vrend_state.spec_compile_cond);
+      mtx_destroy(&vrend_state.spec_compile_mutex);
+   }
+}
+
+static void vrend_free_spec_compile_thread(void)
+{
+   if (!vrend_state.spec_compile_thread)
+      return;
+
+   /* compiles that have not started are left to the draws */
+   mtx_lock(&vrend_state.spec_compile_mutex);
+   list_for_each_entry_safe(struct vrend_shader, shader, &vrend_state.spec_compile_list, spec_link) {
+      list_del(&shader->spec_link);
+      shader->spec_state = VREND_SPEC_COMPILE_NONE;
+   }
+   vrend_state.stop_spec_compile_thread = true;
+   cnd_signal(&vrend_state.spec_compile_cond);
+   mtx_unlock(&vrend_state.spec_compile_mutex);
+
+   thrd_join(vrend_state.spec_compile_thread, NULL);
+   vrend_state.spec_compile_thread = 0;
+
+   cnd_destroy(&vrend_state.spec_compile_done_cond);
+   cnd_destroy(&vrend_state.spec_compile_cond);
+   mtx_destroy(&vrend_state.spec_compile_mutex);
+}
+
 static void vrend_debug_cb(UNUSED GLenum source, GLenum type, UNUSED GLuint id,
                            UNUSED GLenum severity, UNUSED GLsizei length,
                            UNUSED const GLchar* message, UNUSED const void* userParam)
@@ -7563,6 +8601,86 @@ static bool use_integer(void) {
    return false;
 }
 
+/* What the probed formats and caps depend on besides the GL implementation. */
+struct vrend_probe_cache_deps {
+   uint64_t features[feat_last / 64 + 1];
+   uint32_t format_table_size;
+   uint8_t use_gles;
+   uint8_t use_core_profile;
+   uint8_t use_external_blob;
+   uint8_t gbm_layout_feat;
+   uint8_t has_gbm;
+   uint8_t different_gpu;
+};
+
+/* Caps entries also restore what filling the caps sets in vrend_state.
+ * Filling capset 1 only sets max_texture_buffer_size, the other fields are
+ * set by filling capset 2.
+ */
+struct vrend_caps_cache_entry {
+   union virgl_caps caps;
+   uint32_t max_texture_buffer_size;
+   uint32_t max_texture_2d_size;
+   uint32_t max_texture_3d_size;
+   uint32_t max_texture_cube_size;
+   uint32_t max_shader_patch_varyings;
+   uint32_t inferred_gl_caching_type;
+};
+
+static uint64_t vrend_probe_cache_key_for_state(void)
+{
+   struct vrend_probe_cache_deps deps;
+
+   memset(&deps, 0, sizeof(deps));
+   memcpy(deps.features, vrend_state.features, sizeof(deps.features));
+   deps.format_table_size = sizeof(tex_conv_table);
+   deps.use_gles = vrend_state.use_gles;
+   deps.use_core_profile = vrend_state.use_core_profile;
+   deps.use_external_blob = vrend_state.use_external_blob;
+   deps.gbm_layout_feat = vrend_state.gbm_layout_feat;
+#ifdef HAVE_EPOXY_EGL_H
+   deps.has_gbm = gbm && gbm->device;
+   deps.different_gpu = deps.has_gbm && vrend_winsys_different_gpu();
+#endif
+
+   return vrend_probe_cache_key(&deps, sizeof(deps));
+}
+
+static void vrend_probe_formats(void)
+{
+   const uint64_t key = vrend_probe_cache_key_for_state();
+
+   if (vrend_probe_cache_load("formats", key, tex_conv_table, sizeof(tex_conv_table)))
+      return;
+
+   /* disable for format testing, spews a lot of errors */
+   if (has_feature(feat_debug_cb)) {
+      glDisable(GL_DEBUG_OUTPUT);
+   }
+
+   vrend_build_format_list_common();
+
+   if (vrend_state.use_gles) {
+      vrend_build_format_list_gles();
+   } else {
+      vrend_build_format_list_gl();
+   }
+
+   vrend_check_texture_storage(tex_conv_table);
+
+   if (has_feature(feat_multisample)) {
+      vrend_check_texture_multisample(tex_conv_table,
+                                      has_feature(feat_storage_multisample));
+   }
+
+   /* disable for format testing */
+   if (has_feature(feat_debug_cb)) {
+      glEnable(GL_DEBUG_OUTPUT);
+   }
+
+   vrend_probe_cache_store("formats", key, tex_conv_table, sizeof(tex_conv_table));
+}
+
 static bool vrend_use_gbm_layout_feature(UNUSED uint32_t flags)
 {
 #if defined(ENABLE_GBM_ALLOCATION) && !defined(MINIGBM)
@@ -7589,6 +8707,58 @@ static bool vrend_use_gbm_layout_feature(UNUSED uint32_t flags)
 #endif
 }
 
+/* Shaders only keep their constants in a block when it fits in the block
+ * size and the per-stage block limit, which the shader cfg is given.
+ */
+static void vrend_renderer_init_const_ring(void)
+{
+   static const struct {
+      GLenum pname;
+      enum features_id feature;
+   } stage_limits[] = {
+      { GL_MAX_VERTEX_UNIFORM_BLOCKS, feat_ubo },
+      { GL_MAX_FRAGMENT_UNIFORM_BLOCKS, feat_ubo },
+      { GL_MAX_GEOMETRY_UNIFORM_BLOCKS, feat_geometry_shader },
+      { GL_MAX_TESS_CONTROL_UNIFORM_BLOCKS, feat_tessellation },
+      { GL_MAX_TESS_EVALUATION_UNIFORM_BLOCKS, feat_tessellation },
+   };
+   GLint max_blocks = INT_MAX;
+   GLint max_bindings = 0;
+   GLint block_size = 0;
+   GLint alignment = 0;
+   GLint num_stages = 0;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(stage_limits); i++) {
+      GLint max = 0;
+      if (!has_feature(stage_limits[i].feature))
+         continue;
+      glGetIntegerv(stage_limits[i].pname, &max);
+      max_blocks = MIN2(max_blocks, max);
+      num_stages++;
+   }
+   glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &max_bindings);
+   glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &block_size);
+   glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+   /* The blocks of all the stages of a program share the bindings, and each
+    * stage counts the VirglBlock they share with the others.
+    */
+   if (num_stages)
+      max_blocks = MIN2(max_blocks, (max_bindings - 1) / num_stages + 1);
+
+   if (max_blocks <= 0 || block_size < 16 || alignment <= 0 ||
+       alignment > VREND_CONST_RING_SEGMENT_SIZE) {
+      virgl_warn("constant ring not supported by the host\n");
+      return;
+   }
+
+   vrend_state.const_ring_alignment = alignment;
+   vrend_state.max_const_block_consts = MIN2(block_size / 16, 4096);
+   vrend_state.max_stage_uniform_blocks = MIN2(max_blocks, 255);
+   vrend_state.max_uniform_buffer_bindings = max_bindings;
+   vrend_state.use_const_ring = true;
+}
+
 int vrend_renderer_init(const struct vrend_if_cbs *cbs, uint32_t flags)
 {
    bool gles;
@@ -7693,36 +8863,20 @@ int vrend_renderer_init(const struct vrend_if_cbs *cbs, uint32_t flags)
    vrend_object_set_destroy_callback(VIRGL_OBJECT_VERTEX_ELEMENTS, vrend_destroy_vertex_elements_object);
    vrend_object_set_destroy_callback(VIRGL_OBJECT_DSA, vrend_destroy_dsa_object);
 
-   /* disable for format testing, spews a lot of errors */
-   if (has_feature(feat_debug_cb)) {
-      glDisable(GL_DEBUG_OUTPUT);
-   }
-
-   vrend_build_format_list_common();
-
-   if (vrend_state.use_gles) {
-      vrend_build_format_list_gles();
-   } else {
-      vrend_build_format_list_gl();
-   }
-
-   vrend_check_texture_storage(tex_conv_table);
-
-   if (has_feature(feat_multisample)) {
-      vrend_check_texture_multisample(tex_conv_table,
-                                      has_feature(feat_storage_multisample));
-   }
-
-   /* disable for format testing */
-   if (has_feature(feat_debug_cb)) {
-      glEnable(GL_DEBUG_OUTPUT);
-   }
+   vrend_probe_formats();
 
    vrend_clicbs->destroy_gl_context(gl_context);
    list_inithead(&vrend_state.fence_list);
    list_inithead(&vrend_state.fence_wait_list);
    list_inithead(&vrend_state.waiting_query_list);
+   list_inithead(&vrend_state.damage_readback_list);
+   vrend_resource_pool_init(flags);
+   list_inithead(&vrend_state.blob_heap_chunks);
+   list_inithead(&vrend_state.blob_heap_pending_frees);
+   atomic_store(&vrend_state.fence_seqno, 0);
+   atomic_store(&vrend_state.retired_fence_seqno, 0);
    atomic_store(&vrend_state.has_waiting_queries, false);
+   atomic_store(&vrend_state.waiting_query_seqno, 0);
 
    /* create 0 context */
    vrend_state.ctx0 = vrend_create_context(0, strlen("HOST"), "HOST");
@@ -7741,10 +8895,36 @@ int vrend_renderer_init(const struct vrend_if_cbs *cbs, uint32_t flags)
    if (flags & VREND_USE_EXTERNAL_BLOB)
       vrend_state.use_external_blob = true;
 
+   /* heap ranges are only reachable through the shared mapping */
+   if ((flags & VREND_USE_BLOB_HEAP) && !vrend_state.use_external_blob &&
+       has_feature(feat_arb_buffer_storage) && has_feature(feat_texture_buffer_range))
+      vrend_state.use_blob_heap = true;
+
+   /* the async fence callback would call back from the sync thread, which
+    * cannot take the renderer lock with ctx0 bound
+    */
+   if (flags & VREND_USE_THREADED_CONTEXTS) {
+      if (vrend_state.use_async_fence_cb) {
+         virgl_warn("threaded contexts are not supported with the async fence callback\n");
+      } else if (mtx_init(&vrend_state.renderer_mutex, mtx_plain | mtx_recursive) == thrd_success) {
+         vrend_state.caller_thread = thrd_current();
+         vrend_state.renderer_lock_depth = 0;
+         vrend_state.handoff_sync = NULL;
+         vrend_state.use_threaded_contexts = true;
+      }
+   }
+
 #ifdef HAVE_EPOXY_EGL_H
    vrend_state.use_egl_fence = virgl_egl_supports_fences(egl);
 #endif
 
+   if ((flags & VREND_USE_CONST_RING) && has_feature(feat_arb_buffer_storage) &&
+       has_feature(feat_ubo))
+      vrend_renderer_init_const_ring();
+
+   if (flags & VREND_USE_SPECULATIVE_SHADERS)
+      vrend_renderer_use_spec_compile();
+
    if (!vrend_check_no_error(vrend_state.ctx0)) {
       virgl_error("vrend context creation resulted in errors\n");
       goto cleanup_and_fail;
@@ -7787,12 +8967,52 @@ vrend_renderer_fini(void)
 
    vrend_free_fences();
    vrend_blitter_fini();
+   vrend_resource_pool_fini();
+
+   if (vrend_state.gl_shadow_stats.draws) {
+      const struct vrend_gl_shadow_stats *stats = &vrend_state.gl_shadow_stats;
+      virgl_debug("GL state shadow: %" PRIu64 " draws, %.1f calls issued and %.1f elided per draw\n",
+                  stats->draws, (double)stats->issued / stats->draws,
+                  (double)stats->elided / stats->draws);
+      if (stats->merged_draws)
+         virgl_debug("%" PRIu64 " more draws were merged into multi-draws\n",
+                     stats->merged_draws);
+   }
+   memset(&vrend_state.gl_shadow_stats, 0, sizeof(vrend_state.gl_shadow_stats));
+
+   if (vrend_state.const_ring_stats.uploads) {
+      const struct vrend_const_ring_stats *stats = &vrend_state.const_ring_stats;
+      virgl_debug("constant ring: %" PRIu64 " uploads of %.1f bytes, %" PRIu64 " stalls\n",
+                  stats->uploads, (double)stats->bytes / stats->uploads, stats->stalls);
+   }
+   memset(&vrend_state.const_ring_stats, 0, sizeof(vrend_state.const_ring_stats));
+
+   vrend_free_spec_compile_thread();
+   if (vrend_state.spec_compile_stats.queued) {
+      const struct vrend_spec_compile_stats *stats = &vrend_state.spec_compile_stats;
+      const uint64_t first_draws = stats->hits + stats->misses;
+      virgl_debug("speculative shaders: %" PRIu64 " queued, %" PRIu64 " compiled, "
+                  "%" PRIu64 " of %" PRIu64 " first draws predicted, %.1f us stall per first draw\n",
+                  stats->queued, stats->compiled, stats->hits, first_draws,
+                  first_draws ? stats->first_draw_stall_ns / 1000.0 / first_draws : 0.0);
+   }
+   memset(&vrend_state.spec_compile_stats, 0, sizeof(vrend_state.spec_compile_stats));
 
 #ifdef ENABLE_VIDEO
    vrend_video_fini();
 #endif
 
+   if (vrend_state.use_threaded_contexts) {
+      if (vrend_state.handoff_sync) {
+         glDeleteSync(vrend_state.handoff_sync);
+         vrend_state.handoff_sync = NULL;
+      }
+      mtx_destroy(&vrend_state.renderer_mutex);
+      vrend_state.use_threaded_contexts = false;
+   }
+
    vrend_destroy_context(vrend_state.ctx0);
+   vrend_blob_heap_fini();
 
    vrend_state.current_ctx = NULL;
    vrend_state.current_hw_ctx = NULL;
@@ -7804,6 +9024,8 @@ static void vrend_destroy_sub_context(struct vrend_sub_context *sub)
 {
    vrend_clicbs->make_current(sub->gl_context);
 
+   vrend_const_ring_fini(&sub->const_ring);
+
    if (has_feature(feat_images)) {
       for (int shader_type = PIPE_SHADER_VERTEX;
            shader_type < PIPE_SHADER_TYPES;
@@ -8016,6 +9238,10 @@ struct vrend_context *vrend_create_context(int id, uint32_t nlen, const char *de
    grctx->shader_cfg.use_core_profile = vrend_state.use_core_profile;
    grctx->shader_cfg.use_explicit_locations = vrend_state.use_explicit_locations;
    grctx->shader_cfg.max_draw_buffers = vrend_state.max_draw_buffers;
+   if (vrend_state.use_const_ring) {
+      grctx->shader_cfg.max_const_block_consts = vrend_state.max_const_block_consts;
+      grctx->shader_cfg.max_stage_uniform_blocks = vrend_state.max_stage_uniform_blocks;
+   }
    grctx->shader_cfg.has_arrays_of_arrays = has_feature(feat_arrays_of_arrays);
    grctx->shader_cfg.has_gpu_shader5 = has_feature(feat_gpu_shader5);
    grctx->shader_cfg.has_es31_compat = has_feature(feat_gles31_compatibility);
@@ -8283,7 +9509,258 @@ static int check_resource_valid(const struct vrend_renderer_resource_create_args
    return 0;
 }
 
-static void vrend_create_buffer(struct vrend_resource *gr, uint32_t width, uint32_t flags)
+/* Small persistently mapped blobs are carved out of a few large buffers
+ * instead of getting a buffer and a mapping each, which would otherwise
+ * exhaust the memory slots of the VMM.  Ranges are page aligned so that the
+ * blobs can still be mapped one by one, and the chunks stay mapped until
+ * vrend_renderer_fini().
+ *
+ * A chunk only holds the blobs of the context that owns it, and changes
+ * owner only once it is empty.  Ranges are zeroed when they are handed out,
+ * so a blob never shows what an earlier blob left in its pages.
+ */
+#define VREND_BLOB_HEAP_PAGE_SIZE     4096u
+#define VREND_BLOB_HEAP_CHUNK_SIZE    (8u << 20)
+#define VREND_BLOB_HEAP_CHUNK_PAGES   (VREND_BLOB_HEAP_CHUNK_SIZE / VREND_BLOB_HEAP_PAGE_SIZE)
+#define VREND_BLOB_HEAP_MAX_BLOB_SIZE (256u << 10)
+#define VREND_BLOB_HEAP_MAX_CHUNKS    32
+
+/* heap ranges are always coherent, which satisfies any request */
+#define VREND_BLOB_HEAP_STORAGE_FLAGS \
+   (GL_MAP_PERSISTENT_BIT | GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_COHERENT_BIT)
+
+struct vrend_blob_heap_chunk {
+   struct list_head head;
+   uint32_t ctx_id;
+   GLuint gl_id;
+   uint8_t *map;
+   uint32_t free_pages;
+   uint32_t used[VREND_BLOB_HEAP_CHUNK_PAGES / 32];
+};
+
+struct vrend_blob_heap_range {
+   struct list_head head;
+   struct vrend_blob_heap_chunk *chunk;
+   uint32_t first_page;
+   uint32_t page_count;
+   GLsync sync;
+};
+
+static void vrend_blob_heap_chunk_mark(struct vrend_blob_heap_chunk *chunk,
+                                       uint32_t first_page, uint32_t page_count,
+                                       bool used)
+{
+   for (uint32_t page = first_page; page < first_page + page_count; page++) {
+      if (used)
+         chunk->used[page / 32] |= 1u << (page % 32);
+      else
+         chunk->used[page / 32] &= ~(1u << (page % 32));
+   }
+
+   if (used)
+      chunk->free_pages -= page_count;
+   else
+      chunk->free_pages += page_count;
+}
+
+static int vrend_blob_heap_chunk_find(const struct vrend_blob_heap_chunk *chunk,
+                                      uint32_t page_count)
+{
+   uint32_t run = 0;
+
+   if (chunk->free_pages < page_count)
+      return -1;
+
+   for (uint32_t page = 0; page < VREND_BLOB_HEAP_CHUNK_PAGES; page++) {
+      if (!(page % 32) && chunk->used[page / 32] == UINT32_MAX) {
+         run = 0;
+         page += 31;
+         continue;
+      }
+
+      if (chunk->used[page / 32] & (1u << (page % 32))) {
+         run = 0;
+      } else if (++run == page_count) {
+         return page + 1 - page_count;
+      }
+   }
+
+   return -1;
+}
+
+static struct vrend_blob_heap_chunk *vrend_blob_heap_chunk_create(uint32_t ctx_id)
+{
+   struct vrend_blob_heap_chunk *chunk;
+
+   if (vrend_state.blob_heap_chunk_count >= VREND_BLOB_HEAP_MAX_CHUNKS)
+      return NULL;
+
+   chunk = calloc(1, sizeof(*chunk));
+   if (!chunk)
+      return NULL;
+
+   glGenBuffersARB(1, &chunk->gl_id);
+   glBindBufferARB(GL_COPY_WRITE_BUFFER, chunk->gl_id);
+   glBufferStorage(GL_COPY_WRITE_BUFFER, VREND_BLOB_HEAP_CHUNK_SIZE, NULL,
+                   VREND_BLOB_HEAP_STORAGE_FLAGS);
+   chunk->map = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, VREND_BLOB_HEAP_CHUNK_SIZE,
+                                 VREND_BLOB_HEAP_STORAGE_FLAGS);
+   glBindBufferARB(GL_COPY_WRITE_BUFFER, 0);
+
+   /* the ranges must be mappable into the guest on their own */
+   if (!chunk->map || (uintptr_t)chunk->map % VREND_BLOB_HEAP_PAGE_SIZE) {
+      virgl_warn("Unable to map a blob heap chunk, disabling the blob heap\n");
+      glDeleteBuffers(1, &chunk->gl_id);
+      vrend_gl_object_deleted();
+      free(chunk);
+      vrend_state.use_blob_heap = false;
+      return NULL;
+   }
+
+   chunk->ctx_id = ctx_id;
+   chunk->free_pages = VREND_BLOB_HEAP_CHUNK_PAGES;
+   list_addtail(&chunk->head, &vrend_state.blob_heap_chunks);
+   vrend_state.blob_heap_chunk_count++;
+
+   return chunk;
+}
+
+static void vrend_blob_heap_reclaim(void)
+{
+   list_for_each_entry_safe(struct vrend_blob_heap_range, range,
+                            &vrend_state.blob_heap_pending_frees, head) {
+      const GLenum status = glClientWaitSync(range->sync, 0, 0);
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+         continue;
+
+      vrend_blob_heap_chunk_mark(range->chunk, range->first_page, range->page_count, false);
+      glDeleteSync(range->sync);
+      list_del(&range->head);
+      free(range);
+   }
+}
+
+static void vrend_renderer_check_blob_heap(void)
+{
+   if (list_is_empty(&vrend_state.blob_heap_pending_frees))
+      return;
+
+   vrend_renderer_force_ctx_0();
+   vrend_blob_heap_reclaim();
+}
+
+static bool vrend_blob_heap_alloc(struct vrend_resource *gr, uint32_t size, uint32_t ctx_id)
+{
+   const uint32_t page_count = DIV_ROUND_UP(size, VREND_BLOB_HEAP_PAGE_SIZE);
+   struct vrend_blob_heap_chunk *chunk = NULL;
+   struct vrend_blob_heap_chunk *empty_chunk = NULL;
+   int first_page = -1;
+
+   /* resources created outside of a context have no heap to go to */
+   if (!vrend_state.use_blob_heap || !ctx_id || !size || size > VREND_BLOB_HEAP_MAX_BLOB_SIZE)
+      return false;
+
+   vrend_blob_heap_reclaim();
+
+   list_for_each_entry(struct vrend_blob_heap_chunk, iter, &vrend_state.blob_heap_chunks, head) {
+      if (iter->ctx_id != ctx_id) {
+         if (!empty_chunk && iter->free_pages == VREND_BLOB_HEAP_CHUNK_PAGES)
+            empty_chunk = iter;
+         continue;
+      }
+
+      first_page = vrend_blob_heap_chunk_find(iter, page_count);
+      if (first_page >= 0) {
+         chunk = iter;
+         break;
+      }
+   }
+
+   if (!chunk) {
+      if (empty_chunk) {
+         chunk = empty_chunk;
+         chunk->ctx_id = ctx_id;
+      } else {
+         chunk = vrend_blob_heap_chunk_create(ctx_id);
+         if (!chunk)
+            return false;
+      }
+      first_page = 0;
+   }
+
+   vrend_blob_heap_chunk_mark(chunk, first_page, page_count, true);
+
+   /* the GPU is done with the range, see vrend_blob_heap_reclaim() */
+   memset(chunk->map + (size_t)first_page * VREND_BLOB_HEAP_PAGE_SIZE, 0,
+          (size_t)page_count * VREND_BLOB_HEAP_PAGE_SIZE);
+
+   gr->heap_chunk = chunk;
+   gr->heap_offset = (uint64_t)first_page * VREND_BLOB_HEAP_PAGE_SIZE;
+   gr->gl_id = chunk->gl_id;
+   gr->storage_bits |= VREND_STORAGE_GL_BUFFER | VREND_STORAGE_GL_IMMUTABLE;
+   gr->buffer_storage_flags = VREND_BLOB_HEAP_STORAGE_FLAGS;
+   gr->map_info = vrend_state.inferred_gl_caching_type;
+   gr->size = size;
+
+   return true;
+}
+
+/* The range is only reused once the GPU is done with the old contents. */
+static void vrend_blob_heap_free(struct vrend_resource *res)
+{
+   struct vrend_blob_heap_chunk *chunk = res->heap_chunk;
+   const uint32_t first_page = res->heap_offset / VREND_BLOB_HEAP_PAGE_SIZE;
+   const uint32_t page_count = DIV_ROUND_UP(res->size, VREND_BLOB_HEAP_PAGE_SIZE);
+   struct vrend_blob_heap_range *range;
+
+   res->heap_chunk = NULL;
+
+   /* the whole heap goes away with the host context */
+   if (vrend_state.finishing)
+      return;
+
+   range = calloc(1, sizeof(*range));
+   if (!range) {
+      /* leak the range rather than risk a use after free */
+      return;
+   }
+
+   range->chunk = chunk;
+   range->first_page = first_page;
+   range->page_count = page_count;
+   /* polled from ctx0, which cannot flush the current context */
+   range->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   glFlush();
+   list_addtail(&range->head, &vrend_state.blob_heap_pending_frees);
+}
+
+/* Called once the host context is gone, which took the GL objects with it,
+ * so that the resources it destroyed could still release their range.
+ */
+static void vrend_blob_heap_fini(void)
+{
+   if (!vrend_state.blob_heap_chunk_count)
+      return;
+
+   list_for_each_entry_safe(struct vrend_blob_heap_range, range,
+                            &vrend_state.blob_heap_pending_frees, head)
+      free(range);
+   list_inithead(&vrend_state.blob_heap_pending_frees);
+
+   list_for_each_entry_safe(struct vrend_blob_heap_chunk, chunk,
+                            &vrend_state.blob_heap_chunks, head)
+      free(chunk);
+   list_inithead(&vrend_state.blob_heap_chunks);
+   vrend_state.blob_heap_chunk_count = 0;
+}
+
+static inline uint8_t *vrend_blob_heap_map(const struct vrend_resource *res)
+{
+   return res->heap_chunk->map + res->heap_offset;
+}
+
+static void vrend_create_buffer(struct vrend_resource *gr, uint32_t width, uint32_t flags,
+                                uint32_t ctx_id)
 {
 
    GLbitfield buffer_storage_flags = 0;
@@ -8300,6 +9777,9 @@ static void vrend_create_buffer(struct vrend_resource *gr, uint32_t width, uint3
    if (flags & VIRGL_RESOURCE_FLAG_MAP_COHERENT)
       buffer_storage_flags |= GL_MAP_COHERENT_BIT;
 
+   if ((buffer_storage_flags & GL_MAP_PERSISTENT_BIT) && vrend_blob_heap_alloc(gr, width, ctx_id))
+      return;
+
    gr->storage_bits |= VREND_STORAGE_GL_BUFFER;
    glGenBuffersARB(1, &gr->gl_id);
    glBindBufferARB(gr->target, gr->gl_id);
@@ -8353,7 +9833,7 @@ static void vrend_create_buffer(struct vrend_resource *gr, uint32_t width, uint3
 }
 
 static int
-vrend_resource_alloc_buffer(struct vrend_resource *gr, uint32_t flags)
+vrend_resource_alloc_buffer(struct vrend_resource *gr, uint32_t flags, uint32_t ctx_id)
 {
    const uint32_t bind = gr->base.bind;
    const uint32_t size = gr->base.width0;
@@ -8368,25 +9848,25 @@ vrend_resource_alloc_buffer(struct vrend_resource *gr, uint32_t flags)
      /* staging buffers only use guest memory -- nothing to do. */
    } else if (bind == VIRGL_BIND_INDEX_BUFFER) {
       gr->target = GL_ELEMENT_ARRAY_BUFFER_ARB;
-      vrend_create_buffer(gr, size, flags);
+      vrend_create_buffer(gr, size, flags, ctx_id);
    } else if (bind == VIRGL_BIND_STREAM_OUTPUT) {
       gr->target = GL_TRANSFORM_FEEDBACK_BUFFER;
-      vrend_create_buffer(gr, size, flags);
+      vrend_create_buffer(gr, size, flags, ctx_id);
    } else if (bind == VIRGL_BIND_VERTEX_BUFFER) {
       gr->target = GL_ARRAY_BUFFER_ARB;
-      vrend_create_buffer(gr, size, flags);
+      vrend_create_buffer(gr, size, flags, ctx_id);
    } else if (bind == VIRGL_BIND_CONSTANT_BUFFER) {
       gr->target = GL_UNIFORM_BUFFER;
-      vrend_create_buffer(gr, size, flags);
+      vrend_create_buffer(gr, size, flags, ctx_id);
    } else if (bind == VIRGL_BIND_QUERY_BUFFER) {
       gr->target = GL_QUERY_BUFFER;
-      vrend_create_buffer(gr, size, flags);
+      vrend_create_buffer(gr, size, flags, ctx_id);
    } else if (bind == VIRGL_BIND_COMMAND_ARGS) {
       gr->target = GL_DRAW_INDIRECT_BUFFER;
-      vrend_create_buffer(gr, size, flags);
+      vrend_create_buffer(gr, size, flags, ctx_id);
    } else if (bind == 0 || bind == VIRGL_BIND_SHADER_BUFFER) {
       gr->target = GL_ARRAY_BUFFER_ARB;
-      vrend_create_buffer(gr, size, flags);
+      vrend_create_buffer(gr, size, flags, ctx_id);
    } else if (bind & VIRGL_BIND_SAMPLER_VIEW) {
       /*
     * On Desktop we use GL_ARB_texture_buffer_object on GLES we use
@@ -8402,7 +9882,7 @@ vrend_resource_alloc_buffer(struct vrend_resource *gr, uint32_t flags)
       } else {
          gr->target = GL_PIXEL_PACK_BUFFER_ARB;
       }
-      vrend_create_buffer(gr, size, flags);
+      vrend_create_buffer(gr, size, flags, ctx_id);
    } else {
       virgl_error("%s: Illegal buffer binding flags 0x%x\n", __func__, bind);
       return -EINVAL;
@@ -8864,18 +10344,401 @@ vrend_resource_create(const struct vrend_renderer_resource_create_args *args)
 
    vrend_renderer_resource_copy_args(args, gr);
    gr->storage_bits = VREND_STORAGE_GUEST_MEMORY;
+   gr->create_flags = args->flags;
 
    if (args->flags & VIRGL_RESOURCE_Y_0_TOP)
       gr->y_0_top = true;
 
+   /* the first damage readback reads everything */
+   vrend_resource_add_full_damage(gr);
+
    pipe_reference_init(&gr->base.reference, 1);
 
    return gr;
 }
 
-struct pipe_resource *
-vrend_renderer_resource_create(const struct vrend_renderer_resource_create_args *args,
-                               void *image_oes)
+/* Destroyed resources keep their GL storage in a pool for a while, so that
+ * the staging and transient resources that guest drivers create and destroy
+ * every frame do not go through glGenTextures/glTexStorage or glBufferData
+ * each time.  Entries are bucketed by their creation arguments and are only
+ * reused once a fence inserted at destruction has signaled, so that pending
+ * GL work on the old contents cannot race with the new owner.  The storage
+ * is cleared before it is handed out, as the new owner may be another
+ * context, so only what can be cleared with GL is pooled.
+ *
+ * Resources can be destroyed in the middle of a command buffer, so the
+ * destroy path only fences in the current context and queues the storage;
+ * vrend_renderer_poll() puts it in its bucket and evicts from ctx0.
+ */
+#define VREND_RESOURCE_POOL_MAX_SIZE   (64ull << 20)
+#define VREND_RESOURCE_POOL_MAX_AGE_NS (1000ull * 1000 * 1000)
+
+struct vrend_resource_pool_bucket {
+   struct vrend_renderer_resource_create_args key;
+   struct list_head entries;
+};
+
+struct vrend_resource_pool_entry {
+   struct list_head head;
+   struct list_head bucket_head;
+   struct vrend_resource_pool_bucket *bucket;
+
+   /* GL object and the texture state tracked for it */
+   struct vrend_texture tex;
+   GLsync sync;
+   uint64_t size;
+   uint64_t release_time_ns;
+};
+
+static uint32_t vrend_resource_pool_key_hash(const void *key)
+{
+   return _mesa_hash_data(key, sizeof(struct vrend_renderer_resource_create_args));
+}
+
+static bool vrend_resource_pool_key_equal(const void *a, const void *b)
+{
+   return !memcmp(a, b, sizeof(struct vrend_renderer_resource_create_args));
+}
+
+static void
+vrend_resource_pool_make_key(struct vrend_renderer_resource_create_args *key,
+                             const struct vrend_resource *res)
+{
+   const struct pipe_resource *pr = &res->base;
+
+   memset(key, 0, sizeof(*key));
+   key->target = pr->target;
+   key->format = pr->format;
+   key->bind = pr->bind;
+   key->width = pr->width0;
+   key->height = pr->height0;
+   key->depth = pr->depth0;
+   key->array_size = pr->array_size;
+   key->last_level = pr->last_level;
+   key->nr_samples = pr->nr_samples;
+   key->flags = res->create_flags;
+}
+
+static uint64_t vrend_resource_storage_size(const struct pipe_resource *pr)
+{
+   uint64_t size = 0;
+
+   if (pr->target == PIPE_BUFFER)
+      return pr->width0;
+
+   for (unsigned level = 0; level <= pr->last_level; level++) {
+      const uint32_t width = u_minify(pr->width0, level);
+      const uint32_t height = u_minify(pr->height0, level);
+      const uint32_t depth = pr->target == PIPE_TEXTURE_3D ?
+                             u_minify(pr->depth0, level) : MAX2(pr->array_size, 1);
+
+      size += (uint64_t)util_format_get_2d_size(pr->format,
+                                                util_format_get_stride(pr->format, width),
+                                                height) * depth;
+   }
+
+   return size * MAX2(pr->nr_samples, 1);
+}
+
+static bool vrend_resource_can_recycle(const struct vrend_resource *res)
+{
+   const uint32_t gl_storage_bits = VREND_STORAGE_GUEST_MEMORY |
+                                    VREND_STORAGE_GL_TEXTURE |
+                                    VREND_STORAGE_GL_BUFFER |
+                                    VREND_STORAGE_GL_IMMUTABLE;
+
+   if (vrend_state.finishing || !vrend_state.resource_pool_buckets)
+      return false;
+
+   if ((res->storage_bits & ~gl_storage_bits) ||
+       !(res->storage_bits & (VREND_STORAGE_GL_TEXTURE | VREND_STORAGE_GL_BUFFER)))
+      return false;
+
+   /* persistent mappings and imported storage belong to someone else */
+   if (res->is_imported || res->egl_image || res->gbm_bo || res->buffer_storage_flags)
+      return false;
+
+   /* the GL buffer is shared with other resources, or the texture has a
+    * renderbuffer next to it
+    */
+   if (res->heap_chunk || res->rbo_id)
+      return false;
+
+   if (res->base.target == PIPE_BUFFER) {
+      if (!has_feature(feat_clear_buffer_object))
+         return false;
+   } else if (!has_feature(feat_clear_texture) ||
+              util_format_is_compressed(res->base.format)) {
+      return false;
+   }
+
+   /* the VMM may still hold an exported handle to these */
+   if (res->base.bind & (VIRGL_BIND_DISPLAY_TARGET | VIRGL_BIND_SCANOUT |
+                         VIRGL_BIND_SHARED | VIRGL_BIND_CURSOR))
+      return false;
+
+   return true;
+}
+
+static void vrend_resource_pool_entry_destroy(struct vrend_resource_pool_entry *entry)
+{
+   struct vrend_resource_pool_bucket *bucket = entry->bucket;
+   struct vrend_resource *res = &entry->tex.base;
+
+   if (has_bit(res->storage_bits, VREND_STORAGE_GL_TEXTURE))
+      glDeleteTextures(1, &res->gl_id);
+   else if (has_bit(res->storage_bits, VREND_STORAGE_GL_BUFFER))
+      glDeleteBuffers(1, &res->gl_id);
+   vrend_gl_object_deleted();
+
+   if (entry->sync)
+      glDeleteSync(entry->sync);
+
+   vrend_state.resource_pool_size -= entry->size;
+   list_del(&entry->head);
+   if (bucket)
+      list_del(&entry->bucket_head);
+   free(entry);
+
+   if (bucket && list_is_empty(&bucket->entries)) {
+      _mesa_hash_table_remove_key(vrend_state.resource_pool_buckets, &bucket->key);
+      free(bucket);
+   }
+}
+
+/* Evicts entries older than VREND_RESOURCE_POOL_MAX_AGE_NS and then the
+ * oldest entries until the pool is no larger than max_size.
+ */
+static void vrend_resource_pool_evict(uint64_t max_size, uint64_t now_ns)
+{
+   bool made_current = false;
+
+   list_for_each_entry_safe(struct vrend_resource_pool_entry, entry,
+                            &vrend_state.resource_pool_list, head) {
+      if (vrend_state.resource_pool_size <= max_size &&
+          now_ns - entry->release_time_ns < VREND_RESOURCE_POOL_MAX_AGE_NS)
+         break;
+
+      if (!made_current) {
+         vrend_renderer_force_ctx_0();
+         made_current = true;
+      }
+
+      vrend_resource_pool_entry_destroy(entry);
+      vrend_state.resource_pool_stats.evictions++;
+   }
+
+   if (made_current)
+      TRACE_COUNTER_VALUE(resource_pool_bytes, vrend_state.resource_pool_size);
+}
+
+/* Puts the storage queued by vrend_resource_pool_put() in its bucket. */
+static void vrend_resource_pool_insert(struct vrend_resource_pool_entry *entry)
+{
+   struct vrend_resource_pool_bucket *bucket;
+   struct vrend_renderer_resource_create_args key;
+   struct hash_entry *he;
+
+   vrend_resource_pool_make_key(&key, &entry->tex.base);
+   he = _mesa_hash_table_search(vrend_state.resource_pool_buckets, &key);
+   if (he) {
+      bucket = he->data;
+   } else {
+      bucket = calloc(1, sizeof(*bucket));
+      if (!bucket) {
+         vrend_resource_pool_entry_destroy(entry);
+         return;
+      }
+      bucket->key = key;
+      list_inithead(&bucket->entries);
+      _mesa_hash_table_insert(vrend_state.resource_pool_buckets, &bucket->key, bucket);
+   }
+
+   entry->bucket = bucket;
+   list_del(&entry->head);
+   list_addtail(&entry->head, &vrend_state.resource_pool_list);
+   list_addtail(&entry->bucket_head, &bucket->entries);
+}
+
+static void vrend_renderer_check_resource_pool(void)
+{
+   if (!list_is_empty(&vrend_state.resource_pool_pending)) {
+      vrend_renderer_force_ctx_0();
+      list_for_each_entry_safe(struct vrend_resource_pool_entry, entry,
+                               &vrend_state.resource_pool_pending, head)
+         vrend_resource_pool_insert(entry);
+      TRACE_COUNTER_VALUE(resource_pool_bytes, vrend_state.resource_pool_size);
+   }
+
+   if (!list_is_empty(&vrend_state.resource_pool_list))
+      vrend_resource_pool_evict(VREND_RESOURCE_POOL_MAX_SIZE, vrend_now_ns());
+}
+
+static bool vrend_resource_pool_put(struct vrend_resource *res)
+{
+   struct vrend_resource_pool_entry *entry;
+
+   if (!vrend_resource_can_recycle(res))
+      return false;
+
+   const uint64_t size = vrend_resource_storage_size(&res->base);
+   if (size > VREND_RESOURCE_POOL_MAX_SIZE / 4)
+      return false;
+
+   entry = calloc(1, sizeof(*entry));
+   if (!entry)
+      return false;
+
+   /* texture buffer views are recreated with the format of the new owner */
+   if (res->tbo_tex_id) {
+      glDeleteTextures(1, &res->tbo_tex_id);
+      res->tbo_tex_id = 0;
+      vrend_gl_object_deleted();
+   }
+
+   /* Fence after what the current context did with the object, the sync
+    * object is shared with ctx0, which polls it.
+    */
+   entry->tex = *(struct vrend_texture *)res;
+   entry->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   glFlush();
+   entry->size = size;
+   entry->release_time_ns = vrend_now_ns();
+   list_addtail(&entry->head, &vrend_state.resource_pool_pending);
+   vrend_state.resource_pool_size += size;
+
+   return true;
+}
+
+/* Zeroes the storage of a recycled resource, vrend_resource_can_recycle()
+ * made sure that GL can.
+ */
+static void vrend_resource_pool_clear(struct vrend_resource *res)
+{
+   if (res->base.target == PIPE_BUFFER) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, res->gl_id);
+      glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R8, GL_RED, GL_UNSIGNED_BYTE, NULL);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      return;
+   }
+
+   const GLenum format = tex_conv_table[res->base.format].glformat;
+   const GLenum type = tex_conv_table[res->base.format].gltype;
+
+   for (uint32_t level = 0; level <= res->base.last_level; level++) {
+      if (vrend_state.use_gles)
+         glClearTexImageEXT(res->gl_id, level, format, type, NULL);
+      else
+         glClearTexImage(res->gl_id, level, format, type, NULL);
+   }
+}
+
+static bool vrend_resource_pool_take(struct vrend_resource *gr,
+                                     const struct vrend_renderer_resource_create_args *args)
+{
+   struct vrend_renderer_resource_create_args key;
+   struct hash_entry *he;
+
+   if (!vrend_state.resource_pool_buckets)
+      return false;
+
+   /* buffers with storage flags are never recycled */
+   if (args->target == PIPE_BUFFER &&
+       (args->flags & (VIRGL_RESOURCE_FLAG_MAP_PERSISTENT | VIRGL_RESOURCE_FLAG_MAP_COHERENT)))
+      return false;
+
+   vrend_resource_pool_make_key(&key, gr);
+   he = _mesa_hash_table_search(vrend_state.resource_pool_buckets, &key);
+   if (he) {
+      struct vrend_resource_pool_bucket *bucket = he->data;
+
+      list_for_each_entry(struct vrend_resource_pool_entry, entry,
+                          &bucket->entries, bucket_head) {
+         const GLenum status = glClientWaitSync(entry->sync, 0, 0);
+         if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            continue;
+
+         struct vrend_texture *gt = (struct vrend_texture *)gr;
+         const struct vrend_texture *old = &entry->tex;
+
+         gr->gl_id = old->base.gl_id;
+         gr->target = old->base.target;
+         gr->map_info = old->base.map_info;
+         gr->storage_bits |= old->base.storage_bits;
+         gt->state = old->state;
+         memcpy(gt->cur_swizzle, old->cur_swizzle, sizeof(gt->cur_swizzle));
+         gt->cur_srgb_decode = old->cur_srgb_decode;
+         gt->cur_base = old->cur_base;
+         gt->cur_max = old->cur_max;
+
+         /* the GL object now belongs to gr */
+         entry->tex.base.storage_bits &= ~(VREND_STORAGE_GL_TEXTURE | VREND_STORAGE_GL_BUFFER);
+         entry->tex.base.gl_id = 0;
+         vrend_resource_pool_entry_destroy(entry);
+
+         vrend_resource_pool_clear(gr);
+
+         vrend_state.resource_pool_stats.hits++;
+         TRACE_COUNTER_VALUE(resource_pool_hits, vrend_state.resource_pool_stats.hits);
+         TRACE_COUNTER_VALUE(resource_pool_bytes, vrend_state.resource_pool_size);
+         return true;
+      }
+   }
+
+   vrend_state.resource_pool_stats.misses++;
+   TRACE_COUNTER_VALUE(resource_pool_misses, vrend_state.resource_pool_stats.misses);
+   return false;
+}
+
+static void vrend_resource_pool_init(uint32_t flags)
+{
+   list_inithead(&vrend_state.resource_pool_list);
+   list_inithead(&vrend_state.resource_pool_pending);
+   vrend_state.resource_pool_size = 0;
+   if (!(flags & VREND_USE_RESOURCE_POOL))
+      return;
+
+   vrend_state.resource_pool_buckets =
+      _mesa_hash_table_create(NULL, vrend_resource_pool_key_hash,
+                              vrend_resource_pool_key_equal);
+}
+
+void vrend_renderer_resource_pool_stats(uint64_t *hits, uint64_t *misses)
+{
+   *hits = vrend_state.resource_pool_stats.hits;
+   *misses = vrend_state.resource_pool_stats.misses;
+}
+
+static void vrend_resource_pool_fini(void)
+{
+   if (!vrend_state.resource_pool_buckets)
+      return;
+
+   if (!list_is_empty(&vrend_state.resource_pool_pending)) {
+      vrend_renderer_force_ctx_0();
+      list_for_each_entry_safe(struct vrend_resource_pool_entry, entry,
+                               &vrend_state.resource_pool_pending, head)
+         vrend_resource_pool_entry_destroy(entry);
+   }
+   if (!list_is_empty(&vrend_state.resource_pool_list))
+      vrend_resource_pool_evict(0, UINT64_MAX);
+
+   virgl_debug("resource pool: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " evictions\n",
+               vrend_state.resource_pool_stats.hits,
+               vrend_state.resource_pool_stats.misses,
+               vrend_state.resource_pool_stats.evictions);
+
+   _mesa_hash_table_destroy(vrend_state.resource_pool_buckets, NULL);
+   vrend_state.resource_pool_buckets = NULL;
+   memset(&vrend_state.resource_pool_stats, 0, sizeof(vrend_state.resource_pool_stats));
+}
+
+/* ctx_id is the context creating the resource, 0 for resources created
+ * outside of any context.
+ */
+static struct vrend_resource *
+vrend_resource_create_with_storage(const struct vrend_renderer_resource_create_args *args,
+                                   void *image_oes, uint32_t ctx_id)
 {
    struct vrend_resource *gr;
    int ret;
@@ -8884,8 +10747,10 @@ vrend_renderer_resource_create(const struct vrend_renderer_resource_create_args
    if (!gr)
       return NULL;
 
-   if (args->target == PIPE_BUFFER) {
-      ret = vrend_resource_alloc_buffer(gr, args->flags);
+   if (!image_oes && vrend_resource_pool_take(gr, args)) {
+      ret = 0;
+   } else if (args->target == PIPE_BUFFER) {
+      ret = vrend_resource_alloc_buffer(gr, args->flags, ctx_id);
    } else {
       const enum virgl_formats format = gr->base.format;
       ret = vrend_resource_alloc_texture(gr, format, image_oes);
@@ -8896,17 +10761,36 @@ vrend_renderer_resource_create(const struct vrend_renderer_resource_create_args
       return NULL;
    }
 
-   return &gr->base;
+   return gr;
+}
+
+struct pipe_resource *
+vrend_renderer_resource_create(const struct vrend_renderer_resource_create_args *args,
+                               void *image_oes)
+{
+   struct vrend_resource *gr = vrend_resource_create_with_storage(args, image_oes, 0);
+   return gr ? &gr->base : NULL;
 }
 
 void vrend_renderer_resource_destroy(struct vrend_resource *res)
 {
+   if (res->damage_readback)
+      vrend_damage_readback_destroy(res->damage_readback);
+
+   if (vrend_resource_pool_put(res))
+      res->storage_bits &= ~(VREND_STORAGE_GL_TEXTURE | VREND_STORAGE_GL_BUFFER);
+
    if (has_bit(res->storage_bits, VREND_STORAGE_GL_TEXTURE)) {
       glDeleteTextures(1, &res->gl_id);
+      vrend_gl_object_deleted();
    } else if (has_bit(res->storage_bits, VREND_STORAGE_GL_BUFFER)) {
-      glDeleteBuffers(1, &res->gl_id);
+      if (res->heap_chunk)
+         vrend_blob_heap_free(res);
+      else
+         glDeleteBuffers(1, &res->gl_id);
       if (res->tbo_tex_id)
          glDeleteTextures(1, &res->tbo_tex_id);
+      vrend_gl_object_deleted();
    } else if (has_bit(res->storage_bits, VREND_STORAGE_HOST_SYSTEM_MEMORY)) {
       free(res->ptr);
    }
@@ -9293,7 +11177,13 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
       return 0;
    }
 
-   if (has_bit(res->storage_bits, VREND_STORAGE_GL_BUFFER)) {
+   if (res->heap_chunk) {
+      /* the heap is persistently mapped and coherent */
+      if (info->synchronized)
+         glFinish();
+      vrend_read_from_iovec(iov, num_iovs, info->offset,
+                            (char *)vrend_blob_heap_map(res) + info->box->x, info->box->width);
+   } else if (has_bit(res->storage_bits, VREND_STORAGE_GL_BUFFER)) {
       GLuint map_flags = GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_WRITE_BIT;
       struct virgl_sub_upload_data d;
       d.box = info->box;
@@ -9325,7 +11215,7 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
       uint32_t stride = info->stride;
       uint32_t layer_stride = info->layer_stride;
 
-      vrend_use_program(NULL);
+      vrend_use_program(ctx->sub, NULL);
 
       if (!stride)
          stride = util_format_get_nblocksx(res->base.format, u_minify(res->base.width0, info->level)) * elsize;
@@ -9422,7 +11312,7 @@ static int vrend_renderer_transfer_write_iov(struct vrend_context *ctx,
 
          buffers = GL_COLOR_ATTACHMENT0;
          glDrawBuffers(1, &buffers);
-         glDisable(GL_BLEND);
+         vrend_gl_enable(ctx->sub, VREND_GL_CAP_BLEND, false);
 
          vrend_depth_test_enable(ctx->sub, false);
          vrend_alpha_test_enable(ctx->sub, false);
@@ -9729,6 +11619,29 @@ static void do_readpixels(struct vrend_resource *res,
    glDeleteFramebuffers(1, &fb_id);
 }
 
+static GLenum vrend_get_readpixels_format(const struct vrend_resource *res)
+{
+   enum virgl_formats fmt = res->base.format;
+
+   if (vrend_state.use_gles &&
+       res->gbm_bo) {
+      switch (fmt) {
+      case VIRGL_FORMAT_B8G8R8X8_UNORM:
+         return tex_conv_table[VIRGL_FORMAT_B8G8R8A8_UNORM].glformat;
+      case VIRGL_FORMAT_B8G8R8X8_SRGB:
+         return tex_conv_table[VIRGL_FORMAT_B8G8R8A8_SRGB].glformat;
+      case VIRGL_FORMAT_R8G8B8X8_UNORM:
+         return tex_conv_table[VIRGL_FORMAT_R8G8B8A8_UNORM].glformat;
+      case VIRGL_FORMAT_R8G8B8X8_SRGB:
+         return tex_conv_table[VIRGL_FORMAT_R8G8B8A8_SRGB].glformat;
+      default:
+         break;
+      }
+   }
+
+   return tex_conv_table[fmt].glformat;
+}
+
 static int vrend_transfer_send_readpixels(struct vrend_context *ctx,
                                           struct vrend_resource *res,
                                           const struct iovec *iov, int num_iovs,
@@ -9744,34 +11657,14 @@ static int vrend_transfer_send_readpixels(struct vrend_context *ctx,
    uint32_t h = u_minify(res->base.height0, info->level);
    int elsize = util_format_get_blocksize(res->base.format);
    float depth_scale;
-   int row_stride = info->stride / elsize;
-   GLint old_fbo;
-
-   vrend_use_program(NULL);
-
-   enum virgl_formats fmt = res->base.format;
-
-   format = tex_conv_table[fmt].glformat;
-   if (vrend_state.use_gles &&
-       res->gbm_bo) {
-      switch (fmt) {
-      case VIRGL_FORMAT_B8G8R8X8_UNORM:
-         format = tex_conv_table[VIRGL_FORMAT_B8G8R8A8_UNORM].glformat;
-         break;
-      case VIRGL_FORMAT_B8G8R8X8_SRGB:
-         format = tex_conv_table[VIRGL_FORMAT_B8G8R8A8_SRGB].glformat;
-         break;
-      case VIRGL_FORMAT_R8G8B8X8_UNORM:
-         format = tex_conv_table[VIRGL_FORMAT_R8G8B8A8_UNORM].glformat;
-         break;
-      case VIRGL_FORMAT_R8G8B8X8_SRGB:
-         format = tex_conv_table[VIRGL_FORMAT_R8G8B8A8_SRGB].glformat;
-         break;
-      default:
-         break;
-      }
-   }
+   int row_stride = info->stride / elsize;
+   GLint old_fbo;
+
+   vrend_use_program(ctx->sub, NULL);
+
+   enum virgl_formats fmt = res->base.format;
 
+   format = vrend_get_readpixels_format(res);
    type = tex_conv_table[fmt].gltype;
    /* if we are asked to invert and reading from a front then don't */
 
@@ -9944,7 +11837,10 @@ static int vrend_renderer_transfer_send_iov(struct vrend_context *ctx,
       return 0;
    }
 
-   if (has_bit(res->storage_bits, VREND_STORAGE_GL_BUFFER)) {
+   if (res->heap_chunk) {
+      vrend_write_to_iovec(iov, num_iovs, info->offset,
+                           (char *)vrend_blob_heap_map(res) + info->box->x, info->box->width);
+   } else if (has_bit(res->storage_bits, VREND_STORAGE_GL_BUFFER)) {
       glBindBufferARB(res->target, res->gl_id);
       void *data = glMapBufferRange(res->target, info->box->x, info->box->width, GL_MAP_READ_BIT);
       if (!data)
@@ -9989,6 +11885,9 @@ static int vrend_renderer_transfer_internal(struct vrend_context *ctx,
    if (!vrend_hw_switch_context(ctx, true))
       return EINVAL;
 
+   if (transfer_mode == VIRGL_TRANSFER_TO_HOST)
+      vrend_resource_add_damage(res, info->level, info->box);
+
    assert(check_transfer_iovec(res, info));
    if (info->iovec && info->iovec_cnt) {
       iov = info->iovec;
@@ -10123,6 +12022,8 @@ int vrend_renderer_copy_transfer3d(struct vrend_context *ctx,
       return EINVAL;
    }
 
+   vrend_resource_add_damage(dst_res, info->level, info->box);
+
 #if defined(HAVE_EPOXY_EGL_H) && defined(ENABLE_GBM_ALLOCATION)
    if (dst_res->gbm_bo && !TRANSFER_NO_GBM_MAPPING(info)) {
       bool use_gbm = true;
@@ -10329,8 +12230,11 @@ static void vrend_hw_emit_streamout_targets(UNUSED struct vrend_context *ctx, st
    for (i = 0; i < so_obj->num_targets; i++) {
       if (!so_obj->so_targets[i])
          glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, i, 0);
-      else if (so_obj->so_targets[i]->buffer_offset || so_obj->so_targets[i]->buffer_size < so_obj->so_targets[i]->buffer->base.width0)
-         glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, i, so_obj->so_targets[i]->buffer->gl_id, so_obj->so_targets[i]->buffer_offset, so_obj->so_targets[i]->buffer_size);
+      else if (so_obj->so_targets[i]->buffer_offset || so_obj->so_targets[i]->buffer->heap_chunk ||
+               so_obj->so_targets[i]->buffer_size < so_obj->so_targets[i]->buffer->base.width0)
+         glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, i, so_obj->so_targets[i]->buffer->gl_id,
+                           so_obj->so_targets[i]->buffer->heap_offset + so_obj->so_targets[i]->buffer_offset,
+                           so_obj->so_targets[i]->buffer_size);
       else
          glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, i, so_obj->so_targets[i]->buffer->gl_id);
    }
@@ -10399,11 +12303,117 @@ static void vrend_resource_buffer_copy(UNUSED struct vrend_context *ctx,
    glBindBuffer(GL_COPY_READ_BUFFER, src_res->gl_id);
    glBindBuffer(GL_COPY_WRITE_BUFFER, dst_res->gl_id);
 
-   glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, srcx, dstx, width);
+   glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                       src_res->heap_offset + srcx, dst_res->heap_offset + dstx, width);
    glBindBuffer(GL_COPY_READ_BUFFER, 0);
    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 }
 
+/* Copies the box through a pixel buffer, reading back only the box with
+ * GL_ARB_get_texture_sub_image so that the data stays on the GPU.
+ */
+static bool vrend_resource_copy_fallback_sub_image(struct vrend_resource *src_res,
+                                                   struct vrend_resource *dst_res,
+                                                   uint32_t dst_level,
+                                                   uint32_t dstx, uint32_t dsty,
+                                                   uint32_t dstz, uint32_t src_level,
+                                                   const struct pipe_box *src_box)
+{
+   enum virgl_formats format = src_res->base.format;
+   bool compressed = util_format_is_compressed(format);
+   GLenum glformat = tex_conv_table[format].glformat;
+   GLenum gltype = tex_conv_table[format].gltype;
+   uint32_t stride, layer_stride, total_size;
+   uint32_t layers = 1, depth = src_box->depth;
+   GLuint pbo;
+
+   if (!has_feature(feat_get_texture_sub_image) || src_res->base.nr_samples > 0)
+      return false;
+
+   /* cube faces are uploaded one by one, to the faces or layers of dst */
+   if (src_res->target == GL_TEXTURE_CUBE_MAP ||
+       dst_res->target == GL_TEXTURE_CUBE_MAP) {
+      layers = src_box->depth;
+      depth = 1;
+   }
+
+   stride = util_format_get_stride(format, src_box->width);
+   layer_stride = util_format_get_2d_size(format, stride, src_box->height);
+   total_size = layer_stride * src_box->depth;
+
+   glGenBuffers(1, &pbo);
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+   glBufferData(GL_PIXEL_PACK_BUFFER, total_size, NULL, GL_STREAM_COPY);
+
+   glPixelStorei(GL_PACK_ALIGNMENT, 1);
+   if (compressed) {
+      glGetCompressedTextureSubImage(src_res->gl_id, src_level,
+                                     src_box->x, src_box->y, src_box->z,
+                                     src_box->width, src_box->height, src_box->depth,
+                                     total_size, NULL);
+      glformat = tex_conv_table[format].internalformat;
+   } else {
+      glGetTextureSubImage(src_res->gl_id, src_level,
+                           src_box->x, src_box->y, src_box->z,
+                           src_box->width, src_box->height, src_box->depth,
+                           glformat, gltype, total_size, NULL);
+   }
+   glPixelStorei(GL_PACK_ALIGNMENT, 4);
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+   glBindTexture(dst_res->target, dst_res->gl_id);
+
+   for (uint32_t i = 0; i < layers; i++) {
+      GLenum ctarget = dst_res->target;
+      const void *offset = (const void *)(uintptr_t)(i * layer_stride);
+      uint32_t z = dstz + i;
+
+      if (dst_res->target == GL_TEXTURE_CUBE_MAP) {
+         ctarget = GL_TEXTURE_CUBE_MAP_POSITIVE_X + dstz + i;
+         z = 0;
+      }
+
+      if (ctarget == GL_TEXTURE_1D) {
+         if (compressed)
+            glCompressedTexSubImage1D(ctarget, dst_level, dstx, src_box->width,
+                                      glformat, layer_stride, offset);
+         else
+            glTexSubImage1D(ctarget, dst_level, dstx, src_box->width,
+                            glformat, gltype, offset);
+      } else if (ctarget == GL_TEXTURE_3D ||
+                 ctarget == GL_TEXTURE_2D_ARRAY ||
+                 ctarget == GL_TEXTURE_CUBE_MAP_ARRAY) {
+         if (compressed)
+            glCompressedTexSubImage3D(ctarget, dst_level, dstx, dsty, z,
+                                      src_box->width, src_box->height, depth,
+                                      glformat, layer_stride * depth, offset);
+         else
+            glTexSubImage3D(ctarget, dst_level, dstx, dsty, z,
+                            src_box->width, src_box->height, depth,
+                            glformat, gltype, offset);
+      } else {
+         if (compressed)
+            glCompressedTexSubImage2D(ctarget, dst_level, dstx, dsty,
+                                      src_box->width, src_box->height,
+                                      glformat, layer_stride, offset);
+         else
+            glTexSubImage2D(ctarget, dst_level, dstx, dsty,
+                            src_box->width, src_box->height,
+                            glformat, gltype, offset);
+      }
+   }
+
+   glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+   glBindTexture(dst_res->target, 0);
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+   glDeleteBuffers(1, &pbo);
+
+   TRACE_COUNTER_VALUE(copy_fallback_gpu_bytes, total_size);
+   return true;
+}
+
 static void vrend_resource_copy_fallback(struct vrend_resource *src_res,
                                          struct vrend_resource *dst_res,
                                          uint32_t dst_level,
@@ -10412,6 +12422,7 @@ static void vrend_resource_copy_fallback(struct vrend_resource *src_res,
                                          const struct pipe_box *src_box)
 {
    char *tptr;
+   GLuint pbo = 0;
    uint32_t total_size, src_stride, dst_stride, src_layer_stride;
    GLenum glformat, gltype;
    int elsize = util_format_get_blocksize(dst_res->base.format);
@@ -10429,6 +12440,11 @@ static void vrend_resource_copy_fallback(struct vrend_resource *src_res,
       return;
    }
 
+   if (!vrend_state.use_gles &&
+       vrend_resource_copy_fallback_sub_image(src_res, dst_res, dst_level, dstx, dsty, dstz,
+                                              src_level, src_box))
+      return;
+
    box = *src_box;
    box.depth = vrend_get_texture_depth(src_res, src_level);
    dst_stride = util_format_get_stride(dst_res->base.format, dst_res->base.width0);
@@ -10438,9 +12454,21 @@ static void vrend_resource_copy_fallback(struct vrend_resource *src_res,
                 util_format_get_blocksize(src_res->base.format);
    total_size = slice_size * vrend_get_texture_depth(src_res, src_level);
 
-   tptr = malloc(total_size);
-   if (!tptr)
-      return;
+   if (vrend_state.use_gles) {
+      tptr = malloc(total_size);
+      if (!tptr)
+         return;
+      TRACE_COUNTER_VALUE(copy_fallback_cpu_bytes, total_size);
+   } else {
+      /* Stage the level in a pixel buffer instead of system memory, tptr
+       * is the base of the buffer offsets below.
+       */
+      glGenBuffers(1, &pbo);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+      glBufferData(GL_PIXEL_PACK_BUFFER, total_size, NULL, GL_STREAM_COPY);
+      tptr = NULL;
+      TRACE_COUNTER_VALUE(copy_fallback_gpu_bytes, total_size);
+   }
 
    glformat = tex_conv_table[src_res->base.format].glformat;
    gltype = tex_conv_table[src_res->base.format].gltype;
@@ -10514,17 +12542,19 @@ static void vrend_resource_copy_fallback(struct vrend_resource *src_res,
                             (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i) : src_res->target;
          if (compressed) {
             if (has_feature(feat_arb_robustness))
-               glGetnCompressedTexImageARB(ctarget, src_level, read_chunk_size, tptr + slice_offset);
+               glGetnCompressedTexImageARB(ctarget, src_level, read_chunk_size, (void *)((uintptr_t)tptr + slice_offset));
             else
-               glGetCompressedTexImage(ctarget, src_level, tptr + slice_offset);
+               glGetCompressedTexImage(ctarget, src_level, (void *)((uintptr_t)tptr + slice_offset));
          } else {
             if (has_feature(feat_arb_robustness))
-               glGetnTexImageARB(ctarget, src_level, glformat, gltype, read_chunk_size, tptr + slice_offset);
+               glGetnTexImageARB(ctarget, src_level, glformat, gltype, read_chunk_size, (void *)((uintptr_t)tptr + slice_offset));
             else
-               glGetTexImage(ctarget, src_level, glformat, gltype, tptr + slice_offset);
+               glGetTexImage(ctarget, src_level, glformat, gltype, (void *)((uintptr_t)tptr + slice_offset));
          }
          slice_offset += slice_size;
       }
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
    }
 
    glPixelStorei(GL_PACK_ALIGNMENT, 4);
@@ -10562,21 +12592,21 @@ static void vrend_resource_copy_fallback(struct vrend_resource *src_res,
          if (ctarget == GL_TEXTURE_1D) {
             glCompressedTexSubImage1D(ctarget, dst_level, dstx,
                                       src_box->width,
-                                      glformat, slice_size, tptr + slice_offset);
+                                      glformat, slice_size, (void *)((uintptr_t)tptr + slice_offset));
          } else {
             glCompressedTexSubImage2D(ctarget, dst_level, dstx, dsty,
                                       src_box->width, src_box->height,
-                                      glformat, slice_size, tptr + slice_offset);
+                                      glformat, slice_size, (void *)((uintptr_t)tptr + slice_offset));
          }
       } else {
          if (ctarget == GL_TEXTURE_1D) {
-            glTexSubImage1D(ctarget, dst_level, dstx, src_box->width, glformat, gltype, tptr + slice_offset);
+            glTexSubImage1D(ctarget, dst_level, dstx, src_box->width, glformat, gltype, (void *)((uintptr_t)tptr + slice_offset));
          } else if (ctarget == GL_TEXTURE_3D ||
                     ctarget == GL_TEXTURE_2D_ARRAY ||
                     ctarget == GL_TEXTURE_CUBE_MAP_ARRAY) {
-            glTexSubImage3D(ctarget, dst_level, dstx, dsty, dstz, src_box->width, src_box->height, src_box->depth, glformat, gltype, tptr + slice_offset);
+            glTexSubImage3D(ctarget, dst_level, dstx, dsty, dstz, src_box->width, src_box->height, src_box->depth, glformat, gltype, (void *)((uintptr_t)tptr + slice_offset));
          } else {
-            glTexSubImage2D(ctarget, dst_level, dstx, dsty, src_box->width, src_box->height, glformat, gltype, tptr + slice_offset);
+            glTexSubImage2D(ctarget, dst_level, dstx, dsty, src_box->width, src_box->height, glformat, gltype, (void *)((uintptr_t)tptr + slice_offset));
          }
       }
       slice_offset += slice_size;
@@ -10584,7 +12614,12 @@ static void vrend_resource_copy_fallback(struct vrend_resource *src_res,
 
 cleanup:
    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-   free(tptr);
+   if (pbo) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      glDeleteBuffers(1, &pbo);
+   } else {
+      free(tptr);
+   }
    glBindTexture(dst_res->target, 0);
 }
 
@@ -10690,6 +12725,20 @@ void vrend_renderer_resource_copy_region(struct vrend_context *ctx,
       return;
    }
 
+   /* compressed <-> uncompressed copies are rare enough to overestimate */
+   struct pipe_box dst_box = *src_box;
+   dst_box.x = dstx;
+   dst_box.y = dsty;
+   dst_box.z = dstz;
+   if (util_format_get_blockwidth(src_res->base.format) !=
+       util_format_get_blockwidth(dst_res->base.format)) {
+      dst_box.x = 0;
+      dst_box.y = 0;
+      dst_box.width = dst_res->base.width0;
+      dst_box.height = dst_res->base.height0;
+   }
+   vrend_resource_add_damage(dst_res, dst_level, &dst_box);
+
    VREND_DEBUG(dbg_copy_resource, ctx, "COPY_REGION: From %s ms:%d [%d, %d, %d]+[%d, %d, %d] lvl:%d "
                                    "To %s ms:%d [%d, %d, %d]\n",
                                    util_format_name(src_res->base.format), src_res->base.nr_samples,
@@ -11247,6 +13296,8 @@ void vrend_renderer_blit(struct vrend_context *ctx,
       return;
    }
 
+   vrend_resource_add_damage(dst_res, info->dst.level, &info->dst.box);
+
    if (info->render_condition_enable == false)
       vrend_pause_render_condition(ctx, true);
 
@@ -11332,6 +13383,13 @@ void vrend_renderer_set_fence_retire(struct vrend_context *ctx,
    ctx->fence_retire_data = retire_data;
 }
 
+void vrend_renderer_set_stats(struct vrend_context *ctx,
+                              struct virgl_context_stats *stats)
+{
+   assert(ctx->ctx_id);
+   ctx->stats = stats;
+}
+
 int vrend_renderer_create_fence(struct vrend_context *ctx,
                                 uint32_t flags,
                                 uint64_t fence_id)
@@ -11345,6 +13403,7 @@ int vrend_renderer_create_fence(struct vrend_context *ctx,
    fence->ctx = ctx;
    fence->flags = flags;
    fence->fence_id = fence_id;
+   fence->seqno = atomic_fetch_add(&vrend_state.fence_seqno, 1) + 1;
 
 #ifdef HAVE_EPOXY_EGL_H
    if (vrend_state.use_egl_fence) {
@@ -11420,6 +13479,8 @@ void vrend_renderer_check_fences(void)
          /* vrend_free_fences_for_context might have marked the fence invalid
           * by setting fence->ctx to NULL
           */
+         vrend_fence_seqno_retired(fence->seqno);
+
          if (!fence->ctx) {
             free_fence_locked(fence);
             continue;
@@ -11438,6 +13499,7 @@ void vrend_renderer_check_fences(void)
 
       list_for_each_entry_safe(struct vrend_fence, fence, &vrend_state.fence_list, fences) {
          if (do_wait(fence, /* can_block */ false)) {
+            vrend_fence_seqno_retired(fence->seqno);
             list_del(&fence->fences);
             list_addtail(&fence->fences, &retired_fences);
          } else {
@@ -11578,22 +13640,69 @@ static bool vrend_hw_switch_context_with_sub(struct vrend_context *ctx, int sub_
    return true;
 }
 
+/* Whether a fence created after the end of the query has retired.  A query
+ * no fence was created after can only be found ready by polling it, the
+ * guest might wait on it without submitting anything else.  Fences can
+ * retire out of order, so this is a hint that spares polling queries that
+ * cannot be ready yet, not a guarantee that the result is available.
+ */
+static bool vrend_query_may_be_ready(const struct vrend_query *query, uint64_t retired_seqno)
+{
+   return query->end_seqno <= retired_seqno ||
+          query->end_seqno > atomic_load(&vrend_state.fence_seqno);
+}
+
+static void vrend_update_waiting_queries(void)
+{
+   const uint64_t fence_seqno = atomic_load(&vrend_state.fence_seqno);
+   uint64_t seqno = UINT64_MAX;
+
+   list_for_each_entry(struct vrend_query, query, &vrend_state.waiting_query_list, waiting_queries)
+      seqno = MIN2(seqno, query->end_seqno > fence_seqno ? 0 : query->end_seqno);
+
+   atomic_store(&vrend_state.waiting_query_seqno, seqno);
+   atomic_store(&vrend_state.has_waiting_queries,
+                !list_is_empty(&vrend_state.waiting_query_list));
+}
+
 static void vrend_renderer_check_queries(void)
 {
+   const uint64_t retired_seqno = atomic_load(&vrend_state.retired_fence_seqno);
+   struct list_head ready_queries;
+
+   /* Leave the queries that cannot be ready alone instead of switching to
+    * their context.
+    */
+   list_inithead(&ready_queries);
    list_for_each_entry_safe(struct vrend_query, query, &vrend_state.waiting_query_list, waiting_queries) {
-      if (!vrend_hw_switch_context_with_sub(query->ctx, query->sub_ctx_id)) {
-         virgl_warn("Failed to switch to context (%d) with sub (%d) for query %u\n",
-                      query->ctx->ctx_id, query->sub_ctx_id, query->id);
-      }
-      else if (!vrend_check_query(query)) {
-         continue;
+      if (vrend_query_may_be_ready(query, retired_seqno)) {
+         list_del(&query->waiting_queries);
+         list_addtail(&query->waiting_queries, &ready_queries);
       }
+   }
+
+   /* check the ready queries with one context switch per sub context */
+   while (!list_is_empty(&ready_queries)) {
+      struct vrend_query *first = list_first_entry(&ready_queries, struct vrend_query, waiting_queries);
+      struct vrend_context *ctx = first->ctx;
+      const int sub_ctx_id = first->sub_ctx_id;
+      const bool switched = vrend_hw_switch_context_with_sub(ctx, sub_ctx_id);
+
+      list_for_each_entry_safe(struct vrend_query, query, &ready_queries, waiting_queries) {
+         if (query->ctx != ctx || query->sub_ctx_id != sub_ctx_id)
+            continue;
 
-      list_delinit(&query->waiting_queries);
+         list_delinit(&query->waiting_queries);
+         if (!switched) {
+            virgl_warn("Failed to switch to context (%d) with sub (%d) for query %u\n",
+                       ctx->ctx_id, sub_ctx_id, query->id);
+         } else if (!vrend_check_query(query)) {
+            list_addtail(&query->waiting_queries, &vrend_state.waiting_query_list);
+         }
+      }
    }
 
-   atomic_store(&vrend_state.has_waiting_queries,
-                !list_is_empty(&vrend_state.waiting_query_list));
+   vrend_update_waiting_queries();
 }
 
 bool vrend_hw_switch_context(struct vrend_context *ctx, bool now)
@@ -11821,6 +13930,9 @@ int vrend_end_query(struct vrend_context *ctx, uint32_t handle)
    if (q->index > 0 && !has_feature(feat_transform_feedback3))
       return EINVAL;
 
+   /* the next fence created covers the query end */
+   q->end_seqno = atomic_load(&vrend_state.fence_seqno) + 1;
+
    if (vrend_is_timer_query(q->gltype)) {
       if (q->gltype == GL_TIMESTAMP && !has_feature(feat_timer_query)) {
          report_gles_warn(ctx, GLES_WARN_TIMESTAMP);
@@ -11857,8 +13969,7 @@ int vrend_get_query_result(struct vrend_context *ctx, uint32_t handle,
       list_addtail(&q->waiting_queries, &vrend_state.waiting_query_list);
    }
 
-   atomic_store(&vrend_state.has_waiting_queries,
-                !list_is_empty(&vrend_state.waiting_query_list));
+   vrend_update_waiting_queries();
    return 0;
 }
 
@@ -11898,6 +14009,7 @@ int vrend_get_query_result_qbo(struct vrend_context *ctx, uint32_t handle,
   VREND_DEBUG(dbg_query, ctx, "Get query result from Query:%d\n", q->id);
 
   GLenum qtype;
+  const intptr_t qbo_offset = res->heap_offset + offset;
 
   if (index == -1)
      qtype = GL_QUERY_RESULT_AVAILABLE;
@@ -11908,16 +14020,16 @@ int vrend_get_query_result_qbo(struct vrend_context *ctx, uint32_t handle,
      glBindBuffer(GL_QUERY_BUFFER, res->gl_id);
      switch ((enum pipe_query_value_type)result_type) {
      case PIPE_QUERY_TYPE_I32:
-        glGetQueryObjectiv(q->id, qtype, buffer_offset(offset));
+        glGetQueryObjectiv(q->id, qtype, buffer_offset(qbo_offset));
         break;
      case PIPE_QUERY_TYPE_U32:
-        glGetQueryObjectuiv(q->id, qtype, buffer_offset(offset));
+        glGetQueryObjectuiv(q->id, qtype, buffer_offset(qbo_offset));
         break;
      case PIPE_QUERY_TYPE_I64:
-        glGetQueryObjecti64v(q->id, qtype, buffer_offset(offset));
+        glGetQueryObjecti64v(q->id, qtype, buffer_offset(qbo_offset));
         break;
      case PIPE_QUERY_TYPE_U64:
-        glGetQueryObjectui64v(q->id, qtype, buffer_offset(offset));
+        glGetQueryObjectui64v(q->id, qtype, buffer_offset(qbo_offset));
         break;
      }
   } else {
@@ -11930,25 +14042,25 @@ int vrend_get_query_result_qbo(struct vrend_context *ctx, uint32_t handle,
      case PIPE_QUERY_TYPE_I32: {
         GLint value;
         glGetQueryObjectiv(q->id, qtype, &value);
-        COPY_QUERY_RESULT_TO_BUFFER(q->id, offset, value, 4, ctx->sub->fake_occlusion_query_samples_passed_multiplier);
+        COPY_QUERY_RESULT_TO_BUFFER(q->id, qbo_offset, value, 4, ctx->sub->fake_occlusion_query_samples_passed_multiplier);
         break;
      }
      case PIPE_QUERY_TYPE_U32: {
         GLuint value;
         glGetQueryObjectuiv(q->id, qtype, &value);
-        COPY_QUERY_RESULT_TO_BUFFER(q->id, offset, value, 4, ctx->sub->fake_occlusion_query_samples_passed_multiplier);
+        COPY_QUERY_RESULT_TO_BUFFER(q->id, qbo_offset, value, 4, ctx->sub->fake_occlusion_query_samples_passed_multiplier);
         break;
      }
      case PIPE_QUERY_TYPE_I64: {
         GLint64 value;
         glGetQueryObjecti64v(q->id, qtype, &value);
-        COPY_QUERY_RESULT_TO_BUFFER(q->id, offset, value, 8, ctx->sub->fake_occlusion_query_samples_passed_multiplier);
+        COPY_QUERY_RESULT_TO_BUFFER(q->id, qbo_offset, value, 8, ctx->sub->fake_occlusion_query_samples_passed_multiplier);
         break;
      }
      case PIPE_QUERY_TYPE_U64: {
         GLuint64 value;
         glGetQueryObjectui64v(q->id, qtype, &value);
-        COPY_QUERY_RESULT_TO_BUFFER(q->id, offset, value, 8, ctx->sub->fake_occlusion_query_samples_passed_multiplier);
+        COPY_QUERY_RESULT_TO_BUFFER(q->id, qbo_offset, value, 8, ctx->sub->fake_occlusion_query_samples_passed_multiplier);
         break;
      }
      }
@@ -12858,6 +14970,53 @@ static void vrend_renderer_fill_caps_v2(int gl_ver, int gles_ver,  union virgl_c
 #endif
    if (vrend_state.gbm_layout_feat)
       caps->v2.capability_bits_v2 |= VIRGL_CAP_V2_RESOURCE_LAYOUT;
+
+   caps->v2.capability_bits_v2 |= VIRGL_CAP_V2_BINARY_TGSI;
+}
+
+static bool vrend_renderer_load_cached_caps(const char *name, uint64_t key,
+                                            union virgl_caps *caps, size_t caps_size,
+                                            bool fill_capset2)
+{
+   struct vrend_caps_cache_entry entry;
+
+   if (!vrend_probe_cache_load(name, key, &entry, sizeof(entry)))
+      return false;
+
+   memcpy(caps, &entry.caps, caps_size);
+   vrend_state.max_texture_buffer_size = entry.max_texture_buffer_size;
+   if (fill_capset2) {
+      vrend_state.max_texture_2d_size = entry.max_texture_2d_size;
+      vrend_state.max_texture_3d_size = entry.max_texture_3d_size;
+      vrend_state.max_texture_cube_size = entry.max_texture_cube_size;
+      vrend_state.max_shader_patch_varyings = entry.max_shader_patch_varyings;
+      vrend_state.inferred_gl_caching_type = entry.inferred_gl_caching_type;
+   }
+
+#ifdef ENABLE_VIDEO
+   /* video caps come from VA-API, which the key does not cover */
+   if (caps_size == sizeof(*caps))
+      vrend_video_fill_caps(caps);
+#endif
+
+   return true;
+}
+
+static void vrend_renderer_store_cached_caps(const char *name, uint64_t key,
+                                             const union virgl_caps *caps, size_t caps_size)
+{
+   struct vrend_caps_cache_entry entry;
+
+   memset(&entry, 0, sizeof(entry));
+   memcpy(&entry.caps, caps, caps_size);
+   entry.max_texture_buffer_size = vrend_state.max_texture_buffer_size;
+   entry.max_texture_2d_size = vrend_state.max_texture_2d_size;
+   entry.max_texture_3d_size = vrend_state.max_texture_3d_size;
+   entry.max_texture_cube_size = vrend_state.max_texture_cube_size;
+   entry.max_shader_patch_varyings = vrend_state.max_shader_patch_varyings;
+   entry.inferred_gl_caching_type = vrend_state.inferred_gl_caching_type;
+
+   vrend_probe_cache_store(name, key, &entry, sizeof(entry));
 }
 
 void vrend_renderer_fill_caps(uint32_t set, uint32_t version,
@@ -12866,6 +15025,8 @@ void vrend_renderer_fill_caps(uint32_t set, uint32_t version,
    int gl_ver, gles_ver;
    GLenum err;
    bool fill_capset2 = false;
+   const char *cache_name;
+   size_t caps_size;
 
    if (!caps)
       return;
@@ -12874,15 +15035,19 @@ void vrend_renderer_fill_caps(uint32_t set, uint32_t version,
    case VIRTGPU_DRM_CAPSET_VIRGL:
       if (version > VREND_CAPSET_VIRGL_MAX_VERSION)
          return;
-      memset(caps, 0, sizeof(struct virgl_caps_v1));
+      caps_size = sizeof(struct virgl_caps_v1);
+      memset(caps, 0, caps_size);
       caps->max_version = VREND_CAPSET_VIRGL_MAX_VERSION;
+      cache_name = "caps-virgl";
       break;
    case VIRTGPU_DRM_CAPSET_VIRGL2:
       if (version > VREND_CAPSET_VIRGL2_MAX_VERSION)
          return;
-      memset(caps, 0, sizeof(*caps));
+      caps_size = sizeof(*caps);
+      memset(caps, 0, caps_size);
       caps->max_version = VREND_CAPSET_VIRGL2_MAX_VERSION;
       fill_capset2 = true;
+      cache_name = "caps-virgl2";
       break;
    default:
       return;
@@ -12902,15 +15067,19 @@ void vrend_renderer_fill_caps(uint32_t set, uint32_t version,
       gl_ver = epoxy_gl_version();
    }
 
+   const uint64_t cache_key = vrend_probe_cache_key_for_state();
+   if (vrend_renderer_load_cached_caps(cache_name, cache_key, caps, caps_size, fill_capset2))
+      return;
+
    vrend_fill_caps_glsl_version(gl_ver, gles_ver, caps);
    VREND_DEBUG(dbg_features, NULL, "GLSL support level: %d", caps->v1.glsl_level);
 
    vrend_renderer_fill_caps_v1(gl_ver, gles_ver, caps);
 
-   if (!fill_capset2)
-      return;
+   if (fill_capset2)
+      vrend_renderer_fill_caps_v2(gl_ver, gles_ver, caps);
 
-   vrend_renderer_fill_caps_v2(gl_ver, gles_ver, caps);
+   vrend_renderer_store_cached_caps(cache_name, cache_key, caps, caps_size);
 }
 
 GLint64 vrend_renderer_get_timestamp(void)
@@ -12981,11 +15150,125 @@ void *vrend_renderer_get_cursor_contents(struct pipe_resource *pres,
 void vrend_renderer_force_ctx_0(void)
 {
    TRACE_FUNC();
+
+   /* ctx0 stays bound to the caller's thread; a context thread keeps its
+    * own context, which shares the objects this is called for
+    */
+   if (vrend_state.use_threaded_contexts &&
+       !thrd_equal(thrd_current(), vrend_state.caller_thread))
+      return;
+
    vrend_state.current_ctx = NULL;
    vrend_state.current_hw_ctx = NULL;
    vrend_hw_switch_context(vrend_state.ctx0, true);
 }
 
+bool vrend_renderer_use_threaded_contexts(void)
+{
+   return vrend_state.use_threaded_contexts;
+}
+
+static void vrend_renderer_signal_handoff(void)
+{
+   if (vrend_state.handoff_sync)
+      glDeleteSync(vrend_state.handoff_sync);
+
+   vrend_state.handoff_sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   glFlush();
+}
+
+static void vrend_renderer_wait_handoff(void)
+{
+   if (!vrend_state.handoff_sync)
+      return;
+
+   glWaitSync(vrend_state.handoff_sync, 0, GL_TIMEOUT_IGNORED);
+   glDeleteSync(vrend_state.handoff_sync);
+   vrend_state.handoff_sync = NULL;
+}
+
+void vrend_renderer_lock(void)
+{
+   if (!vrend_state.use_threaded_contexts)
+      return;
+
+   mtx_lock(&vrend_state.renderer_mutex);
+   if (vrend_state.renderer_lock_depth++)
+      return;
+
+   /* ctx0 has stayed bound to this thread */
+   vrend_renderer_wait_handoff();
+}
+
+void vrend_renderer_unlock(void)
+{
+   if (!vrend_state.use_threaded_contexts)
+      return;
+
+   assert(vrend_state.renderer_lock_depth);
+   if (!--vrend_state.renderer_lock_depth) {
+      /* leave the contexts of the context threads unbound here */
+      if (vrend_state.current_hw_ctx != vrend_state.ctx0 ||
+          vrend_state.current_ctx != vrend_state.ctx0)
+         vrend_renderer_force_ctx_0();
+
+      /* Commands are only queued with the lock held, so without queued
+       * commands no context thread needs to see this work before this
+       * thread takes the lock again.
+       */
+      if (vrend_renderer_context_queues_pending())
+         vrend_renderer_signal_handoff();
+   }
+
+   mtx_unlock(&vrend_state.renderer_mutex);
+}
+
+/* Fully releases the lock of the caller's thread, to wait for a context
+ * thread, and returns the depth to give to vrend_renderer_relock.
+ */
+unsigned vrend_renderer_unlock_all(void)
+{
+   const unsigned depth = vrend_state.renderer_lock_depth;
+
+   for (unsigned i = 0; i < depth; i++)
+      vrend_renderer_unlock();
+
+   return depth;
+}
+
+void vrend_renderer_relock(unsigned depth)
+{
+   for (unsigned i = 0; i < depth; i++)
+      vrend_renderer_lock();
+}
+
+void vrend_renderer_lock_context(struct vrend_context *ctx)
+{
+   mtx_lock(&vrend_state.renderer_mutex);
+
+   /* the tracked binding is the one of the caller's thread */
+   vrend_state.caller_ctx = vrend_state.current_ctx;
+   vrend_state.caller_hw_ctx = vrend_state.current_hw_ctx;
+
+   vrend_state.current_ctx = ctx;
+   vrend_state.current_hw_ctx = ctx;
+   ctx->ctx_switch_pending = false;
+   vrend_clicbs->make_current(ctx->sub->gl_context);
+
+   vrend_renderer_wait_handoff();
+}
+
+void vrend_renderer_unlock_context(void)
+{
+   vrend_renderer_signal_handoff();
+   vrend_clicbs->make_current(NULL);
+
+   vrend_state.current_ctx = vrend_state.caller_ctx;
+   vrend_state.current_hw_ctx = vrend_state.caller_hw_ctx;
+
+   mtx_unlock(&vrend_state.renderer_mutex);
+}
+
 void vrend_renderer_get_rect(struct pipe_resource *pres,
                              const struct iovec *iov, unsigned int num_iovs,
                              uint32_t offset,
@@ -13017,6 +15300,190 @@ void vrend_renderer_get_rect(struct pipe_resource *pres,
                                 VIRGL_TRANSFER_FROM_HOST);
 }
 
+/* A readback of the damaged region of a resource into a pixel buffer, the
+ * rows are tightly packed in GL order.
+ */
+struct vrend_damage_readback {
+   struct list_head head;
+   struct vrend_resource *res;
+   struct pipe_box box;
+   GLuint pbo_id;
+   GLsync sync;
+   uint32_t size;
+
+   const struct iovec *iov;
+   unsigned int num_iovs;
+   uint32_t offset;
+   vrend_damage_read_cb cb;
+   void *cb_data;
+};
+
+static void vrend_damage_readback_destroy(struct vrend_damage_readback *readback)
+{
+   readback->res->damage_readback = NULL;
+   list_del(&readback->head);
+   glDeleteSync(readback->sync);
+   glDeleteBuffers(1, &readback->pbo_id);
+   free(readback);
+}
+
+static bool vrend_damage_readback_write(struct vrend_damage_readback *readback)
+{
+   struct vrend_resource *res = readback->res;
+   const struct pipe_box *box = &readback->box;
+   const int elsize = util_format_get_blocksize(res->base.format);
+   const uint32_t row_size = box->width * elsize;
+   const uint32_t stride = util_format_get_nblocksx(res->base.format, res->base.width0) * elsize;
+   const bool swizzle = vrend_state.use_gles && vrend_format_is_bgra(res->base.format);
+   char *row = NULL;
+   const char *data;
+
+   if (swizzle) {
+      row = malloc(row_size);
+      if (!row)
+         return false;
+   }
+
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo_id);
+   data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback->size, GL_MAP_READ_BIT);
+   if (data) {
+      for (int h = 0; h < box->height; h++) {
+         /* rows of y_0_top resources were read bottom-up */
+         const int y = res->y_0_top ? box->y + box->height - h - 1 : box->y + h;
+         const char *src = data + (size_t)h * row_size;
+
+         if (swizzle) {
+            memcpy(row, src, row_size);
+            vrend_swizzle_data_bgra(row_size, row);
+            src = row;
+         }
+
+         vrend_write_to_iovec(readback->iov, readback->num_iovs,
+                              readback->offset + (size_t)y * stride + box->x * elsize,
+                              src, row_size);
+      }
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+   }
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+   free(row);
+   return data;
+}
+
+static void vrend_damage_readback_finish(struct vrend_damage_readback *readback)
+{
+   struct vrend_resource *res = readback->res;
+   const struct pipe_box box = readback->box;
+   vrend_damage_read_cb cb = readback->cb;
+   void *cb_data = readback->cb_data;
+   bool ok = vrend_damage_readback_write(readback);
+
+   vrend_damage_readback_destroy(readback);
+
+   if (ok) {
+      cb(cb_data, box.x, box.y, box.width, box.height);
+   } else {
+      /* read it again next time */
+      vrend_resource_add_damage(res, 0, &box);
+      cb(cb_data, box.x, box.y, 0, 0);
+   }
+}
+
+static void vrend_renderer_check_damage_readbacks(void)
+{
+   if (list_is_empty(&vrend_state.damage_readback_list))
+      return;
+
+   vrend_renderer_force_ctx_0();
+
+   list_for_each_entry_safe(struct vrend_damage_readback, readback,
+                            &vrend_state.damage_readback_list, head) {
+      if (glClientWaitSync(readback->sync, 0, 0) == GL_TIMEOUT_EXPIRED)
+         break;
+      vrend_damage_readback_finish(readback);
+   }
+}
+
+int vrend_renderer_read_damage(struct pipe_resource *pres,
+                               const struct iovec *iov, unsigned int num_iovs,
+                               uint32_t offset,
+                               vrend_damage_read_cb cb, void *data)
+{
+   struct vrend_resource *res = (struct vrend_resource *)pres;
+   struct vrend_damage_readback *readback;
+   GLenum format, type;
+   GLint old_fbo;
+   GLint y;
+
+   if (!has_bit(res->storage_bits, VREND_STORAGE_GL_TEXTURE) ||
+       res->base.nr_samples > 0 ||
+       util_format_is_compressed(res->base.format) ||
+       vrend_format_is_ds(res->base.format))
+      return -EINVAL;
+
+   if (res->damage_readback)
+      return -EBUSY;
+
+   if (!res->damage.width)
+      return -ENODATA;
+
+   readback = calloc(1, sizeof(*readback));
+   if (!readback)
+      return -ENOMEM;
+
+   readback->res = res;
+   readback->box = res->damage;
+   readback->size = readback->box.width * readback->box.height *
+                    util_format_get_blocksize(res->base.format);
+   readback->iov = iov;
+   readback->num_iovs = num_iovs;
+   readback->offset = offset;
+   readback->cb = cb;
+   readback->cb_data = data;
+
+   vrend_renderer_force_ctx_0();
+
+   format = vrend_get_readpixels_format(res);
+   type = tex_conv_table[res->base.format].gltype;
+   if (res->y_0_top)
+      y = res->base.height0 - readback->box.y - readback->box.height;
+   else
+      y = readback->box.y;
+
+   glGenBuffers(1, &readback->pbo_id);
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->pbo_id);
+   glBufferData(GL_PIXEL_PACK_BUFFER, readback->size, NULL, GL_STREAM_READ);
+
+   glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &old_fbo);
+#if UTIL_ARCH_BIG_ENDIAN
+   glPixelStorei(GL_PACK_SWAP_BYTES, 1);
+#endif
+   glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+   do_readpixels(res, 0, 0, 0, readback->box.x, y,
+                 readback->box.width, readback->box.height,
+                 format, type, readback->size, NULL);
+
+   glPixelStorei(GL_PACK_ALIGNMENT, 4);
+#if UTIL_ARCH_BIG_ENDIAN
+   glPixelStorei(GL_PACK_SWAP_BYTES, 0);
+#endif
+   glBindFramebuffer(GL_FRAMEBUFFER, old_fbo);
+   glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+   readback->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   glFlush();
+
+   list_addtail(&readback->head, &vrend_state.damage_readback_list);
+   res->damage_readback = readback;
+   memset(&res->damage, 0, sizeof(res->damage));
+   vrend_state.damage_reset_seq++;
+
+   TRACE_COUNTER_VALUE(damage_readback_bytes, readback->size);
+
+   return 0;
+}
+
 static struct vrend_untyped_resource *
 vrend_renderer_find_untyped_resource(struct vrend_context *ctx, uint32_t res_id)
 {
@@ -13193,7 +15660,7 @@ void vrend_renderer_create_sub_ctx(struct vrend_context *ctx, int sub_ctx_id)
 
    glGenVertexArrays(1, &sub->vaoid);
    if (!has_feature(feat_gles31_vertex_attrib_binding)) {
-      glBindVertexArray(sub->vaoid);
+      vrend_gl_bind_vertex_array(sub, sub->vaoid);
    }
 
    glGenFramebuffers(1, &sub->fb_id);
@@ -13315,7 +15782,7 @@ int vrend_renderer_pipe_resource_create(struct vrend_context *ctx, uint32_t blob
                                         const struct vrend_renderer_resource_create_args *args)
 {
    struct vrend_resource *res;
-   res = (struct vrend_resource *)vrend_renderer_resource_create(args, NULL);
+   res = vrend_resource_create_with_storage(args, NULL, ctx->ctx_id);
    if (!res)
       return EINVAL;
 
@@ -13507,6 +15974,12 @@ int vrend_renderer_resource_map(struct pipe_resource *pres, void **map, uint64_t
    if (!has_bits(res->storage_bits, VREND_STORAGE_GL_BUFFER | VREND_STORAGE_GL_IMMUTABLE))
       return -EINVAL;
 
+   if (res->heap_chunk) {
+      *map = vrend_blob_heap_map(res);
+      *out_size = res->size;
+      return 0;
+   }
+
    glBindBufferARB(res->target, res->gl_id);
    *map = glMapBufferRange(res->target, 0, res->size, res->buffer_storage_flags);
    if (!*map)
@@ -13523,12 +15996,29 @@ int vrend_renderer_resource_unmap(struct pipe_resource *pres)
    if (!has_bits(res->storage_bits, VREND_STORAGE_GL_BUFFER | VREND_STORAGE_GL_IMMUTABLE))
       return -EINVAL;
 
+   /* the heap stays mapped */
+   if (res->heap_chunk)
+      return 0;
+
    glBindBufferARB(res->target, res->gl_id);
    glUnmapBuffer(res->target);
    glBindBufferARB(res->target, 0);
    return 0;
 }
 
+int vrend_renderer_resource_get_map_region(struct pipe_resource *pres, void **base,
+                                           uint64_t *size, uint64_t *offset)
+{
+   struct vrend_resource *res = (struct vrend_resource *)pres;
+   if (!res->heap_chunk)
+      return -ENODATA;
+
+   *base = res->heap_chunk->map;
+   *size = align(res->size, VREND_BLOB_HEAP_PAGE_SIZE);
+   *offset = res->heap_offset;
+   return 0;
+}
+
 int vrend_renderer_create_ctx0_fence(uint32_t fence_id)
 {
    if (!vrend_state.ctx0)
@@ -61,8 +61,11 @@ struct virgl_gl_ctx_param {
 };
 
 struct virgl_context;
+struct virgl_context_stats;
 struct virgl_resource;
 struct vrend_context;
+struct vrend_damage_readback;
+struct vrend_blob_heap_chunk;
 
 /* Number of mipmap levels for which to keep the backing iov offsets.
  * Value mirrored from mesa/virgl
@@ -89,6 +92,8 @@ struct vrend_resource {
 
    GLuint tbo_tex_id;/* tbos have two ids to track */
    bool y_0_top;
+   /* VIRGL_RESOURCE_* flags the resource was created with */
+   uint32_t create_flags;
 
    /* used for keeping track of multisampled renderbuffer for
     * GL_EXT_multisampled_render_to_texture. */
@@ -112,9 +117,21 @@ struct vrend_resource {
    GLbitfield buffer_storage_flags;
    GLuint memobj;
 
+   /* Set when the buffer is carved out of a shared blob heap buffer, gl_id
+    * is then the heap buffer and every use must add heap_offset.
+    */
+   struct vrend_blob_heap_chunk *heap_chunk;
+   uint64_t heap_offset;
+
    uint32_t blob_id;
    struct list_head head;
    bool is_imported;
+
+   /* Bounding box of level 0, layer 0 written since the last
+    * vrend_renderer_read_damage(), in transfer coordinates.
+    */
+   struct pipe_box damage;
+   struct vrend_damage_readback *damage_readback;
 };
 
 #define VIRGL_TEXTURE_NEED_SWIZZLE        (1 << 0)
@@ -198,6 +215,11 @@ struct vrend_if_cbs {
 #define VREND_USE_COMPAT_CONTEXT (1 << 5)
 #define VREND_USE_GLES (1 << 6)
 #define VREND_USE_GBM_LAYOUT (1 << 7)
+#define VREND_USE_BLOB_HEAP (1 << 8)
+#define VREND_USE_THREADED_CONTEXTS (1 << 9)
+#define VREND_USE_CONST_RING (1 << 10)
+#define VREND_USE_SPECULATIVE_SHADERS (1 << 11)
+#define VREND_USE_RESOURCE_POOL (1 << 12)
 
 bool vrend_check_no_error(struct vrend_context *ctx);
 
@@ -218,7 +240,7 @@ int vrend_create_shader(struct vrend_context *ctx,
                         const struct pipe_stream_output_info *stream_output,
                         uint32_t req_local_mem,
                         const char *shd_text, uint32_t offlen, uint32_t num_tokens,
-                        enum pipe_shader_type type, uint32_t pkt_length);
+                        enum pipe_shader_type type, bool binary, uint32_t pkt_length);
 
 void vrend_link_program_hook(struct vrend_context *ctx, uint32_t *handles);
 
@@ -250,6 +272,19 @@ int vrend_draw_vbo(struct vrend_context *ctx,
                    const struct pipe_draw_info *info,
                    uint32_t cso, uint32_t indirect_handle, uint32_t indirect_draw_count_handle);
 
+/* Upper bound of the draws passed to vrend_draw_vbo_multi() at once. */
+#define VREND_MAX_MERGED_DRAWS 64
+
+/* Whether info can be drawn in the same multi-draw as first, when no other
+ * command comes between them. */
+bool vrend_draw_vbo_can_merge(const struct pipe_draw_info *first,
+                              const struct pipe_draw_info *info);
+
+/* Draws adjacent direct draws that vrend_draw_vbo_can_merge() accepted,
+ * with as few GL draw calls as the current program allows. */
+int vrend_draw_vbo_multi(struct vrend_context *ctx,
+                         const struct pipe_draw_info *infos, uint32_t count);
+
 void vrend_set_framebuffer_state(struct vrend_context *ctx,
                                  uint32_t nr_cbufs, uint32_t surf_handle[PIPE_MAX_COLOR_BUFS],
                                  uint32_t zsurf_handle);
@@ -260,6 +295,14 @@ struct virgl_context *vrend_renderer_context_create(uint32_t handle,
                                                     uint32_t nlen,
                                                     const char *name);
 
+/* With VREND_USE_THREADED_CONTEXTS, a ctx0 fence is only created once the
+ * commands queued to the context threads before it have run, and the
+ * operations that must see those commands flush the queues first.
+ */
+int vrend_renderer_queue_ctx0_fence(uint32_t fence_id);
+void vrend_renderer_flush_context_queues(void);
+bool vrend_renderer_context_queues_pending(void);
+
 struct vrend_renderer_resource_create_args {
    enum pipe_texture_target target;
    uint32_t format;
@@ -455,6 +498,9 @@ void vrend_renderer_set_fence_retire(struct vrend_context *ctx,
                                      vrend_context_fence_retire retire,
                                      void *retire_data);
 
+void vrend_renderer_set_stats(struct vrend_context *ctx,
+                              struct virgl_context_stats *stats);
+
 int vrend_renderer_create_fence(struct vrend_context *ctx,
                                 uint32_t flags,
                                 uint64_t fence_id);
@@ -523,11 +569,42 @@ vrend_resource_reference(struct vrend_resource **ptr, struct vrend_resource *tex
 
 void vrend_renderer_force_ctx_0(void);
 
+void vrend_renderer_resource_pool_stats(uint64_t *hits, uint64_t *misses);
+
+/*
+ * With VREND_USE_THREADED_CONTEXTS, every context decodes its commands on
+ * its own thread and vrend is serialized by the renderer lock, which is
+ * only taken to run the commands, not to split the command buffers.  The
+ * caller's thread keeps ctx0 bound and takes the lock, recursively, around
+ * every call into vrend; a context thread takes it with its own GL context
+ * bound instead.  A release fences the GL work done under the lock when
+ * another thread can take the lock next, and that holder waits for the
+ * fence on the GPU.  The caller's thread does not fence its work while no
+ * commands are queued, as it is then the only thread taking the lock.
+ *
+ * Without VREND_USE_THREADED_CONTEXTS, these are no-ops.
+ */
+bool vrend_renderer_use_threaded_contexts(void);
+void vrend_renderer_lock(void);
+void vrend_renderer_unlock(void);
+unsigned vrend_renderer_unlock_all(void);
+void vrend_renderer_relock(unsigned depth);
+void vrend_renderer_lock_context(struct vrend_context *ctx);
+void vrend_renderer_unlock_context(void);
+
 void vrend_renderer_get_rect(struct pipe_resource *pres,
                              const struct iovec *iov, unsigned int num_iovs,
                              uint32_t offset,
                              int x, int y, int width, int height);
 
+/* This typedef must be kept in sync with virglrenderer.h */
+typedef void (*vrend_damage_read_cb)(void *data, int x, int y, int width, int height);
+
+int vrend_renderer_read_damage(struct pipe_resource *pres,
+                               const struct iovec *iov, unsigned int num_iovs,
+                               uint32_t offset,
+                               vrend_damage_read_cb cb, void *data);
+
 void vrend_renderer_attach_res_ctx(struct vrend_context *ctx,
                                    struct virgl_resource *res);
 void vrend_renderer_detach_res_ctx(struct vrend_context *ctx,
@@ -633,6 +710,8 @@ uint32_t vrend_renderer_resource_get_map_info(struct pipe_resource *pres);
 int vrend_renderer_resource_map(struct pipe_resource *pres, void **map, uint64_t *out_size);
 
 int vrend_renderer_resource_unmap(struct pipe_resource *pres);
+int vrend_renderer_resource_get_map_region(struct pipe_resource *pres, void **base,
+                                           uint64_t *size, uint64_t *offset);
 
 void vrend_renderer_get_meminfo(struct vrend_context *ctx, uint32_t res_handle);
 
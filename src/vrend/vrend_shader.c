@@ -2929,24 +2929,26 @@ static const char *get_tex_inst_ext(const struct tgsi_full_instruction *inst)
    }
 }
 
+/* Appends the name of a temporary register to buf. */
 static void
 get_temp(const struct dump_ctx *ctx,
          bool indirect_dim, int dim, int reg,
-         char buf[static 64], bool *require_dummy_value)
+         struct vrend_strbuf *buf, bool *require_dummy_value)
 {
    struct vrend_temp_range *range = find_temp_range(ctx, reg);
    if (range) {
       if (indirect_dim) {
-         snprintf(buf, 64, "temp%d[addr%d + %d]", range->first, dim, reg - range->first);
+         strbuf_appendf(buf, "temp%d[addr%d + %d]", range->first, dim, reg - range->first);
       } else {
          if (range->array_id > 0) {
-            snprintf(buf, 64, "temp%d[%d]", range->first, reg - range->first);
+            strbuf_appendf(buf, "temp%d[%d]", range->first, reg - range->first);
          } else {
-            snprintf(buf, 64, "temp%d", reg);
+            strbuf_append(buf, "temp");
+            strbuf_append_int(buf, reg);
          }
       }
    } else {
-      snprintf(buf, 64, "dummy_value");
+      strbuf_append(buf, "dummy_value");
       *require_dummy_value = true;
    }
 }
@@ -2990,7 +2992,9 @@ static bool fill_offset_buffer(const struct dump_ctx *ctx,
       }
    } else if (inst->TexOffsets[0].File == TGSI_FILE_TEMPORARY) {
       char temp_buf[64];
-      get_temp(ctx, false, 0, inst->TexOffsets[0].Index, temp_buf, require_dummy_value);
+      struct vrend_strbuf temp;
+      strbuf_alloc_fixed(&temp, temp_buf, sizeof(temp_buf));
+      get_temp(ctx, false, 0, inst->TexOffsets[0].Index, &temp, require_dummy_value);
       switch (inst->Texture.Texture) {
       case TGSI_TEXTURE_1D:
       case TGSI_TEXTURE_1D_ARRAY:
@@ -4475,10 +4479,10 @@ get_destination_info(struct dump_ctx *ctx,
          break;
       }
       case TGSI_FILE_TEMPORARY: {
-         char temp_buf[64];
+         strbuf_reset(&dst_bufs[i]);
          get_temp(ctx, dst_reg->Register.Indirect, 0, dst_reg->Register.Index,
-                  temp_buf, &ctx->require_dummy_value);
-         strbuf_fmt(&dst_bufs[i], "%s%s", temp_buf, writemask);
+                  &dst_bufs[i], &ctx->require_dummy_value);
+         strbuf_append(&dst_bufs[i], writemask);
          if (inst->Instruction.Precise) {
             struct vrend_temp_range *range = find_temp_range(ctx, dst_reg->Register.Index);
             if (range && ctx->cfg->has_gpu_shader5) {
@@ -4862,10 +4866,10 @@ get_source_info(struct dump_ctx *ctx,
             stprefix = true;
             stypeprefix = FLOAT_BITS_TO_INT;
          }
-         char temp_buf[64];
+         strbuf_fmt(src_buf, "%s%cvec4(%s", get_string(stypeprefix), stprefix ? '(' : ' ', prefix);
          get_temp(ctx, src->Register.Indirect, src->Indirect.Index, src->Register.Index,
-                  temp_buf, &ctx->require_dummy_value);
-         strbuf_fmt(src_buf, "%s%cvec4(%s%s)%s%c", get_string(stypeprefix), stprefix ? '(' : ' ', prefix, temp_buf, swizzle, stprefix ? ')' : ' ');
+                  src_buf, &ctx->require_dummy_value);
+         strbuf_appendf(src_buf, ")%s%c", swizzle, stprefix ? ')' : ' ');
          break;
       }
       case TGSI_FILE_CONSTANT: {
@@ -5033,31 +5037,29 @@ get_source_info(struct dump_ctx *ctx,
                case TGSI_IMM_FLOAT32:
                   if (isinf(imd->val[idx].f) || isnan(imd->val[idx].f)) {
                      ctx->shader_req_bits |= SHADER_REQ_INTS;
-                     snprintf(temp, 48, "uintBitsToFloat(%uU)", imd->val[idx].ui);
-                  } else
+                     strbuf_appendf(src_buf, "uintBitsToFloat(%uU)", imd->val[idx].ui);
+                  } else {
                      snprintf(temp, 25, "%.8g", imd->val[idx].f);
+                     strbuf_append(src_buf, temp);
+                  }
                   break;
                case TGSI_IMM_UINT32:
-                  snprintf(temp, 25, "%uU", imd->val[idx].ui);
+               case TGSI_IMM_FLOAT64:
+                  strbuf_append_uint(src_buf, imd->val[idx].ui);
+                  strbuf_append_char(src_buf, 'U');
                   break;
                case TGSI_IMM_INT32:
-                  snprintf(temp, 25, "%d", imd->val[idx].i);
+                  strbuf_append_int(src_buf, imd->val[idx].i);
                   sinfo->imm_value = imd->val[idx].i;
                   break;
-               case TGSI_IMM_FLOAT64:
-                  snprintf(temp, 48, "%uU", imd->val[idx].ui);
-                  break;
                default:
                   virgl_error("Unhandled imm type: %x\n", imd->type);
                   return false;
                }
-               strbuf_append(src_buf, temp);
                if (j < 3)
-                  strbuf_append(src_buf, ",");
-               else {
-                  snprintf(temp, 4, "))%c", isfloatabsolute ? ')' : 0);
-                  strbuf_append(src_buf, temp);
-               }
+                  strbuf_append_char(src_buf, ',');
+               else
+                  strbuf_append(src_buf, isfloatabsolute ? ")))" : "))");
             }
       }  break;
       case  TGSI_FILE_SYSTEM_VALUE: {
@@ -6628,6 +6630,15 @@ static void emit_image_decl(const struct dump_ctx *ctx,
                access, volatile_str, coherent_str, precision, ptc, stc, sname, i);
 }
 
+/* The block takes a binding next to the guest UBOs and the VirglBlock. */
+static bool use_const_block(const struct dump_ctx *ctx)
+{
+   return ctx->num_consts &&
+          ctx->prog_type != TGSI_PROCESSOR_COMPUTE &&
+          ctx->num_consts <= (int)ctx->cfg->max_const_block_consts &&
+          util_bitcount(ctx->ubo_used_mask) + 2 <= ctx->cfg->max_stage_uniform_blocks;
+}
+
 static int emit_ios_common(const struct dump_ctx *ctx,
                            struct vrend_glsl_strbufs *glsl_strbufs,
                            uint32_t *shadow_samp_mask)
@@ -6673,7 +6684,11 @@ static int emit_ios_common(const struct dump_ctx *ctx,
    }
    if (ctx->num_consts) {
       const char *cname = tgsi_proc_to_prefix(ctx->prog_type);
-      emit_hdrf(glsl_strbufs, "uniform uvec4 %sconst0[%d];\n", cname, ctx->num_consts);
+      if (use_const_block(ctx))
+         emit_hdrf(glsl_strbufs, "layout (std140) uniform %sconstblock { uvec4 %sconst0[%d]; };\n",
+                   cname, cname, ctx->num_consts);
+      else
+         emit_hdrf(glsl_strbufs, "uniform uvec4 %sconst0[%d];\n", cname, ctx->num_consts);
    }
 
    if (ctx->ubo_used_mask) {
@@ -7842,6 +7857,7 @@ static void fill_sinfo(const struct dump_ctx *ctx, struct vrend_shader_info *sin
    sinfo->image_binding_offset = ctx->key->image_binding_offset;
    sinfo->image_last_binding = ctx->key->image_binding_offset + ctx->image_last_binding;
    sinfo->num_consts = ctx->num_consts;
+   sinfo->consts_in_block = use_const_block(ctx);
    sinfo->ubo_used_mask = ctx->ubo_used_mask;
    sinfo->fog_input_mask = ctx->fog_input_mask;
    sinfo->fog_output_mask = ctx->fog_output_mask;
@@ -7932,15 +7948,31 @@ static void fill_sinfo(const struct dump_ctx *ctx, struct vrend_shader_info *sin
    }
 }
 
-static bool allocate_strbuffers(struct vrend_glsl_strbufs* glsl_strbufs)
+/* Rough GLSL output sizes, so that most shaders are emitted without
+ * growing the buffers. */
+#define GLSL_MAIN_MIN_SIZE 4096
+#define GLSL_MAIN_SIZE_PER_INSTRUCTION 64
+#define GLSL_HDR_MIN_SIZE 1024
+#define GLSL_HDR_SIZE_PER_IO 64
+
+static bool allocate_strbuffers(struct vrend_glsl_strbufs* glsl_strbufs,
+                                const struct tgsi_shader_info *info)
 {
-   if (!strbuf_alloc(&glsl_strbufs->glsl_main, 4096))
+   size_t main_size = GLSL_MAIN_MIN_SIZE;
+   size_t hdr_size = GLSL_HDR_MIN_SIZE;
+
+   if (info) {
+      main_size += (size_t)info->num_instructions * GLSL_MAIN_SIZE_PER_INSTRUCTION;
+      hdr_size += (size_t)(info->num_inputs + info->num_outputs) * GLSL_HDR_SIZE_PER_IO;
+   }
+
+   if (!strbuf_alloc(&glsl_strbufs->glsl_main, main_size))
       return false;
 
    if (strbuf_get_error(&glsl_strbufs->glsl_main))
       return false;
 
-   if (!strbuf_alloc(&glsl_strbufs->glsl_hdr, 1024))
+   if (!strbuf_alloc(&glsl_strbufs->glsl_hdr, hdr_size))
       return false;
 
    if (!strbuf_alloc(&glsl_strbufs->glsl_ver_ext, 1024))
@@ -8172,7 +8204,7 @@ bool vrend_convert_shader(const struct vrend_context *rctx,
    if (ctx.info.indirect_files & (1 << TGSI_FILE_SAMPLER))
       ctx.shader_req_bits |= SHADER_REQ_GPU_SHADER5;
 
-   if (!allocate_strbuffers(&ctx.glsl_strbufs))
+   if (!allocate_strbuffers(&ctx.glsl_strbufs, &ctx.info))
       goto fail;
 
    bret = tgsi_iterate_shader(tokens, &ctx.iter);
@@ -8381,7 +8413,7 @@ bool vrend_shader_create_passthrough_tcs(const struct vrend_context *rctx,
    ctx.ssbo_atomic_array_base = 0xffffffff;
    ctx.has_sample_input = false;
 
-   if (!allocate_strbuffers(&ctx.glsl_strbufs))
+   if (!allocate_strbuffers(&ctx.glsl_strbufs, NULL))
       goto fail;
 
    tgsi_iterate_shader(vs_tokens, &ctx.iter);
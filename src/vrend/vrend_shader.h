@@ -164,6 +164,7 @@ struct vrend_shader_info {
    uint8_t has_output_arrays : 1;
    uint8_t use_pervertex_in : 1;
    uint8_t reads_drawid : 1;
+   uint8_t consts_in_block : 1;
 };
 
 struct vrend_variable_shader_info {
@@ -259,6 +260,11 @@ struct vrend_shader_cfg {
    uint32_t has_texture_shadow_lod : 1;
    uint32_t has_vs_layer : 1;
    uint32_t has_vs_viewport_index : 1;
+   /* Guest constants up to this many vec4 go into a uniform block the
+    * renderer streams them to, 0 keeps them in plain uniforms. */
+   uint32_t max_const_block_consts : 13;
+   /* Uniform blocks a single stage may declare. */
+   uint32_t max_stage_uniform_blocks : 8;
 };
 
 struct vrend_context;
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vrend_shader_corpus.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tgsi/tgsi_dump.h"
+#include "virgl_util.h"
+#include "vrend_strbuf.h"
+
+#define XXH_INLINE_ALL
+#include "util/xxhash.h"
+
+#define VREND_SHADER_CORPUS_MAGIC "VRSHKEY1"
+
+struct vrend_shader_corpus_header {
+   char magic[8];
+   uint32_t key_size;
+   uint32_t cfg_size;
+};
+
+static void
+vrend_shader_corpus_logger(const char *fmt, va_list ap, void *user_data)
+{
+   strbuf_vappendf(user_data, fmt, ap);
+}
+
+static bool
+vrend_shader_corpus_write(const char *path, const void *data, size_t size)
+{
+   FILE *fp = fopen(path, "wb");
+   if (!fp) {
+      virgl_warn("failed to create %s: %s\n", path, strerror(errno));
+      return false;
+   }
+
+   bool ok = fwrite(data, size, 1, fp) == 1;
+   ok = !fclose(fp) && ok;
+   if (!ok)
+      virgl_warn("failed to write %s\n", path);
+
+   return ok;
+}
+
+bool
+vrend_shader_corpus_dump(const char *dir,
+                         const struct tgsi_token *tokens,
+                         const struct vrend_shader_corpus_key *key)
+{
+   struct vrend_strbuf text = { 0 };
+   char path[PATH_MAX];
+
+   if (!strbuf_alloc(&text, STRBUF_MIN_MALLOC))
+      return false;
+
+   /* floats as hex for tgsi_text_translate to read them back exactly */
+   tgsi_dump_with_logger(tokens, TGSI_DUMP_FLOAT_AS_HEX, vrend_shader_corpus_logger, &text);
+   if (strbuf_get_error(&text)) {
+      strbuf_free(&text);
+      return false;
+   }
+
+   /* the same shader translated with the same key is only dumped once */
+   const uint64_t hash = XXH64(key, sizeof(*key), XXH64(text.buf, text.size, 0));
+
+   struct {
+      struct vrend_shader_corpus_header header;
+      struct vrend_shader_corpus_key key;
+   } key_file = {
+      .header = {
+         .key_size = sizeof(key->key),
+         .cfg_size = sizeof(key->cfg),
+      },
+      .key = *key,
+   };
+   memcpy(key_file.header.magic, VREND_SHADER_CORPUS_MAGIC, sizeof(key_file.header.magic));
+
+   snprintf(path, sizeof(path), "%s/%016" PRIx64 ".tgsi", dir, hash);
+   bool ok = vrend_shader_corpus_write(path, text.buf, text.size);
+   if (ok) {
+      snprintf(path, sizeof(path), "%s/%016" PRIx64 ".key", dir, hash);
+      ok = vrend_shader_corpus_write(path, &key_file, sizeof(key_file));
+   }
+
+   strbuf_free(&text);
+
+   return ok;
+}
+
+bool
+vrend_shader_corpus_load_key(const char *path, struct vrend_shader_corpus_key *key)
+{
+   struct vrend_shader_corpus_header header;
+
+   FILE *fp = fopen(path, "rb");
+   if (!fp)
+      return false;
+
+   const bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+                   !memcmp(header.magic, VREND_SHADER_CORPUS_MAGIC, sizeof(header.magic)) &&
+                   header.key_size == sizeof(key->key) &&
+                   header.cfg_size == sizeof(key->cfg) &&
+                   fread(key, sizeof(*key), 1, fp) == 1;
+   fclose(fp);
+
+   return ok;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef VREND_SHADER_CORPUS_H
+#define VREND_SHADER_CORPUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vrend_shader.h"
+
+/*
+ * Shaders dumped for offline translation benchmarks.  Every shader is stored
+ * as <name>.tgsi, the TGSI text, and optionally <name>.key, the key and cfg
+ * it was translated with.  A .key file is only valid for the build that
+ * wrote it, it is rejected when the struct sizes differ.
+ *
+ * With VREND_DEBUG=tgsi, vrend dumps every shader it translates to
+ * $VREND_SHADER_CORPUS_DIR, if set.
+ */
+
+struct tgsi_token;
+
+struct vrend_shader_corpus_key {
+   uint32_t req_local_mem;
+   struct vrend_shader_key key;
+   struct vrend_shader_cfg cfg;
+};
+
+bool
+vrend_shader_corpus_dump(const char *dir,
+                         const struct tgsi_token *tokens,
+                         const struct vrend_shader_corpus_key *key);
+
+bool
+vrend_shader_corpus_load_key(const char *path, struct vrend_shader_corpus_key *key);
+
+#endif /* VREND_SHADER_CORPUS_H */
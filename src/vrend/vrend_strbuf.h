@@ -29,6 +29,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 #include "util/u_math.h"
 
 #include "vrend_debug.h"
@@ -111,9 +112,11 @@ static inline bool strbuf_grow(struct vrend_strbuf *sb, int len)
          return false;
       }
       /* Reallocate to the larger size of current alloc + min realloc,
-       * or the resulting string size if larger.
+       * twice the current alloc, or the resulting string size if larger.
+       * Doubling keeps the number of reallocs logarithmic for large shaders.
        */
-      size_t new_size = MAX2(sb->size + len + 1, sb->alloc_size + STRBUF_MIN_MALLOC);
+      size_t new_size = MAX3(sb->size + len + 1, sb->alloc_size + STRBUF_MIN_MALLOC,
+                             sb->alloc_size * 2);
       char *new = realloc(sb->buf, new_size);
       if (!new) {
          strbuf_set_error(sb);
@@ -141,8 +144,98 @@ static inline void strbuf_append(struct vrend_strbuf *sb, const char *addstr)
    strbuf_append_buffer(sb, addstr, strlen(addstr));
 }
 
+static inline void strbuf_append_char(struct vrend_strbuf *sb, char c)
+{
+   strbuf_append_buffer(sb, &c, 1);
+}
+
+static inline void strbuf_append_uint(struct vrend_strbuf *sb, unsigned val)
+{
+   char digits[10];
+   int pos = sizeof(digits);
+
+   do {
+      digits[--pos] = '0' + val % 10;
+      val /= 10;
+   } while (val);
+
+   strbuf_append_buffer(sb, digits + pos, sizeof(digits) - pos);
+}
+
+static inline void strbuf_append_int(struct vrend_strbuf *sb, int val)
+{
+   if (val < 0) {
+      strbuf_append_char(sb, '-');
+      strbuf_append_uint(sb, -(unsigned)val);
+   } else {
+      strbuf_append_uint(sb, val);
+   }
+}
+
+/* Whether fmt only uses plain %s, %c, %d, %u and %%, which covers most of
+ * what the shader emitter formats.
+ */
+static inline bool strbuf_is_simple_fmt(const char *fmt)
+{
+   for (const char *p = strchr(fmt, '%'); p; p = strchr(p + 2, '%')) {
+      if (p[1] != 's' && p[1] != 'c' && p[1] != 'd' && p[1] != 'u' && p[1] != '%')
+         return false;
+   }
+   return true;
+}
+
+/* Appends a strbuf_is_simple_fmt() format without going through
+ * vsnprintf, which has to format twice whenever the buffer grows.
+ */
+static inline void strbuf_simple_vappendf(struct vrend_strbuf *sb, const char *fmt, va_list ap)
+{
+   /* make sure there is a terminated string even if nothing is appended */
+   if (!strbuf_grow(sb, 0))
+      return;
+   sb->buf[sb->size] = '\0';
+
+   for (const char *p = strchr(fmt, '%'); p; p = strchr(fmt, '%')) {
+      if (p != fmt)
+         strbuf_append_buffer(sb, fmt, p - fmt);
+
+      switch (p[1]) {
+      case 's': {
+         const char *str = va_arg(ap, const char *);
+         strbuf_append(sb, str ? str : "(null)");
+         break;
+      }
+      case 'c': {
+         const char c = va_arg(ap, int);
+         if (c)
+            strbuf_append_char(sb, c);
+         break;
+      }
+      case 'd':
+         strbuf_append_int(sb, va_arg(ap, int));
+         break;
+      case 'u':
+         strbuf_append_uint(sb, va_arg(ap, unsigned));
+         break;
+      default:
+         strbuf_append_char(sb, '%');
+         break;
+      }
+
+      fmt = p + 2;
+   }
+
+   if (*fmt)
+      strbuf_append(sb, fmt);
+}
+
 static inline void strbuf_vappendf(struct vrend_strbuf *sb, const char *fmt, va_list ap)
 {
+   if (strbuf_is_simple_fmt(fmt)) {
+      strbuf_simple_vappendf(sb, fmt, ap);
+      va_end(ap);
+      return;
+   }
+
    va_list cp;
    va_copy(cp, ap);
 
@@ -170,6 +263,13 @@ static inline void strbuf_appendf(struct vrend_strbuf *sb, const char *fmt, ...)
 
 static inline void strbuf_vfmt(struct vrend_strbuf *sb, const char *fmt, va_list ap)
 {
+   if (strbuf_is_simple_fmt(fmt)) {
+      strbuf_reset(sb);
+      strbuf_simple_vappendf(sb, fmt, ap);
+      va_end(ap);
+      return;
+   }
+
    va_list cp;
    va_copy(cp, ap);
 
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vrend_tgsi_validate.h"
+
+#include "pipe/p_shader_tokens.h"
+#include "tgsi/tgsi_info.h"
+#include "tgsi/tgsi_parse.h"
+#include "util/u_format.h"
+#include "virgl_util.h"
+
+static bool
+validate_processor(unsigned processor, enum pipe_shader_type type)
+{
+   switch (type) {
+   case PIPE_SHADER_VERTEX: return processor == TGSI_PROCESSOR_VERTEX;
+   case PIPE_SHADER_FRAGMENT: return processor == TGSI_PROCESSOR_FRAGMENT;
+   case PIPE_SHADER_GEOMETRY: return processor == TGSI_PROCESSOR_GEOMETRY;
+   case PIPE_SHADER_TESS_CTRL: return processor == TGSI_PROCESSOR_TESS_CTRL;
+   case PIPE_SHADER_TESS_EVAL: return processor == TGSI_PROCESSOR_TESS_EVAL;
+   case PIPE_SHADER_COMPUTE: return processor == TGSI_PROCESSOR_COMPUTE;
+   default:
+      return false;
+   }
+}
+
+static bool
+validate_declaration(const struct tgsi_full_declaration *decl)
+{
+   if (decl->Declaration.File >= TGSI_FILE_COUNT || decl->Range.First > decl->Range.Last)
+      return false;
+
+   if (decl->Declaration.Interpolate &&
+       (decl->Interp.Interpolate >= TGSI_INTERPOLATE_COUNT ||
+        decl->Interp.Location >= TGSI_INTERPOLATE_LOC_COUNT))
+      return false;
+
+   if (decl->Declaration.Semantic && decl->Semantic.Name >= TGSI_SEMANTIC_COUNT)
+      return false;
+
+   if (decl->Declaration.File == TGSI_FILE_IMAGE &&
+       (decl->Image.Resource >= TGSI_TEXTURE_COUNT || decl->Image.Format >= PIPE_FORMAT_COUNT))
+      return false;
+
+   if (decl->Declaration.File == TGSI_FILE_SAMPLER_VIEW &&
+       (decl->SamplerView.Resource >= TGSI_TEXTURE_COUNT ||
+        decl->SamplerView.ReturnTypeX >= TGSI_RETURN_TYPE_COUNT ||
+        decl->SamplerView.ReturnTypeY >= TGSI_RETURN_TYPE_COUNT ||
+        decl->SamplerView.ReturnTypeZ >= TGSI_RETURN_TYPE_COUNT ||
+        decl->SamplerView.ReturnTypeW >= TGSI_RETURN_TYPE_COUNT))
+      return false;
+
+   return true;
+}
+
+static bool
+validate_dimension(const struct tgsi_dimension *dim, const struct tgsi_ind_register *indirect)
+{
+   return !dim->Indirect || indirect->File < TGSI_FILE_COUNT;
+}
+
+static bool
+validate_instruction(const struct tgsi_full_instruction *inst)
+{
+   if (inst->Instruction.Opcode >= TGSI_OPCODE_LAST)
+      return false;
+
+   /* the text parser takes the operand counts from the opcode */
+   const struct tgsi_opcode_info *info = tgsi_get_opcode_info(inst->Instruction.Opcode);
+   if (inst->Instruction.NumDstRegs != info->num_dst ||
+       inst->Instruction.NumSrcRegs != info->num_src)
+      return false;
+
+   if (inst->Instruction.Texture) {
+      if (inst->Texture.Texture >= TGSI_TEXTURE_COUNT)
+         return false;
+      for (unsigned i = 0; i < inst->Texture.NumOffsets; i++) {
+         if (inst->TexOffsets[i].File >= TGSI_FILE_COUNT)
+            return false;
+      }
+   }
+
+   if (inst->Instruction.Memory &&
+       (inst->Memory.Texture >= TGSI_TEXTURE_COUNT || inst->Memory.Format >= PIPE_FORMAT_COUNT))
+      return false;
+
+   for (unsigned i = 0; i < inst->Instruction.NumDstRegs; i++) {
+      const struct tgsi_full_dst_register *dst = &inst->Dst[i];
+      if (dst->Register.File >= TGSI_FILE_COUNT ||
+          (dst->Register.Indirect && dst->Indirect.File >= TGSI_FILE_COUNT) ||
+          (dst->Register.Dimension && !validate_dimension(&dst->Dimension, &dst->DimIndirect)))
+         return false;
+   }
+
+   for (unsigned i = 0; i < inst->Instruction.NumSrcRegs; i++) {
+      const struct tgsi_full_src_register *src = &inst->Src[i];
+      if (src->Register.File >= TGSI_FILE_COUNT ||
+          (src->Register.Indirect && src->Indirect.File >= TGSI_FILE_COUNT) ||
+          (src->Register.Dimension && !validate_dimension(&src->Dimension, &src->DimIndirect)))
+         return false;
+   }
+
+   return true;
+}
+
+bool
+vrend_tgsi_validate_tokens(const struct tgsi_token *tokens,
+                           uint32_t num_tokens,
+                           enum pipe_shader_type type)
+{
+   struct tgsi_parse_context parse;
+
+   /* the parser reads the header and the processor unconditionally */
+   if (num_tokens < 2)
+      return false;
+
+   const struct tgsi_header *header = (const struct tgsi_header *)tokens;
+   if (header->HeaderSize != 2 || header->HeaderSize + header->BodySize != num_tokens)
+      return false;
+
+   if (tgsi_parse_init(&parse, tokens) != TGSI_PARSE_OK ||
+       !validate_processor(parse.FullHeader.Processor.Processor, type))
+      return false;
+
+   /* the parser stops at the end of the body, so the tokens declaring more
+    * words than they have are caught by comparing their sizes
+    */
+   while (!tgsi_parse_end_of_tokens(&parse)) {
+      const unsigned start = parse.Position;
+
+      if (!tgsi_parse_token(&parse)) {
+         virgl_debug("invalid TGSI token at %u\n", start);
+         return false;
+      }
+
+      const unsigned size = parse.Position - start;
+      bool valid;
+
+      switch (parse.FullToken.Token.Type) {
+      case TGSI_TOKEN_TYPE_DECLARATION:
+         valid = parse.FullToken.FullDeclaration.Declaration.NrTokens == size &&
+                 validate_declaration(&parse.FullToken.FullDeclaration);
+         break;
+      case TGSI_TOKEN_TYPE_INSTRUCTION:
+         /* tgsi_build does not count the instruction word itself */
+         valid = parse.FullToken.FullInstruction.Instruction.NrTokens + 1 == size &&
+                 validate_instruction(&parse.FullToken.FullInstruction);
+         break;
+      case TGSI_TOKEN_TYPE_PROPERTY:
+         valid = parse.FullToken.FullProperty.Property.PropertyName < TGSI_PROPERTY_COUNT;
+         break;
+      default:
+         /* immediates are sized by their NrTokens when parsed */
+         valid = true;
+         break;
+      }
+
+      if (!valid) {
+         virgl_debug("invalid TGSI token at %u\n", start);
+         return false;
+      }
+   }
+
+   tgsi_parse_free(&parse);
+   return true;
+}
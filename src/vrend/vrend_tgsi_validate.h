@@ -0,0 +1,29 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef VREND_TGSI_VALIDATE_H
+#define VREND_TGSI_VALIDATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pipe/p_defines.h"
+
+struct tgsi_token;
+
+/*
+ * Checks TGSI tokens received in binary form, see
+ * VIRGL_OBJ_SHADER_TYPE_BINARY, before they are handed to code that only ever
+ * saw tokens built by the TGSI text parser.  The header must describe exactly
+ * num_tokens tokens of a shader of the given type, every token must parse to
+ * the size it declares, and every enum, opcode and operand count must be one
+ * the text parser could have produced.
+ */
+bool
+vrend_tgsi_validate_tokens(const struct tgsi_token *tokens,
+                           uint32_t num_tokens,
+                           enum pipe_shader_type type);
+
+#endif /* VREND_TGSI_VALIDATE_H */
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Measures the host side cost of CS_SUBMIT BO list handling in the amdgpu
+ * native context: a list of res_ids sent inline with every submit, versus
+ * a persistent AMDGPU_CCMD_BO_LIST updated by delta.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/macros.h"
+
+#include "drm_bench.h"
+#include "amdgpu_virtio_proto.h"
+
+struct submit_desc {
+   uint16_t chunk_id;
+   uint16_t length_dw;
+   uint32_t offset;
+};
+
+static struct drm_bench bench;
+static uint32_t num_bos = 512;
+static uint32_t iterations = 20000;
+static uint32_t *res_ids;
+static uint32_t amdgpu_ctx_id;
+
+static void
+check_rsp(const char *what)
+{
+   const struct amdgpu_ccmd_rsp *rsp = drm_bench_rsp(&bench, 0);
+   if (rsp->ret) {
+      fprintf(stderr, "%s failed: %d\n", what, rsp->ret);
+      exit(1);
+   }
+}
+
+static void
+setup_bos(void)
+{
+   res_ids = calloc(num_bos + 1, sizeof(*res_ids));
+
+   /* One extra BO to swap in and out of the list in the delta updates. */
+   for (uint32_t i = 0; i <= num_bos; i++) {
+      struct amdgpu_ccmd_gem_new_req req = {
+         .hdr = AMDGPU_CCMD(GEM_NEW, sizeof(req)),
+         .blob_id = i + 1,
+         .r = {
+            .alloc_size = 4096,
+            .phys_alignment = 4096,
+            .preferred_heap = AMDGPU_GEM_DOMAIN_GTT,
+         },
+      };
+      if (drm_bench_submit(&bench, &req, sizeof(req)))
+         exit(1);
+
+      res_ids[i] = drm_bench_create_blob(&bench, req.blob_id, req.r.alloc_size);
+      if (!res_ids[i])
+         exit(1);
+   }
+
+   struct amdgpu_ccmd_create_ctx_req req = {
+      .hdr = AMDGPU_CCMD(CREATE_CTX, sizeof(req)),
+   };
+   if (drm_bench_submit(&bench, &req, sizeof(req)))
+      exit(1);
+   check_rsp("CREATE_CTX");
+
+   const struct amdgpu_ccmd_create_ctx_rsp *rsp = drm_bench_rsp(&bench, 0);
+   amdgpu_ctx_id = rsp->ctx_id;
+}
+
+static void *
+build_submit(uint16_t chunk_id, const void *chunk, uint32_t chunk_size, size_t *out_size)
+{
+   size_t size = sizeof(struct amdgpu_ccmd_cs_submit_req) + sizeof(struct submit_desc) +
+                 ALIGN_POT(chunk_size, 8);
+   struct amdgpu_ccmd_cs_submit_req *req = calloc(1, size);
+
+   req->hdr = AMDGPU_CCMD(CS_SUBMIT, size);
+   req->ctx_id = amdgpu_ctx_id;
+   req->num_chunks = 1;
+   req->ring_idx = 1;
+
+   /* Descriptor offsets are relative to the end of the descriptors. */
+   struct submit_desc *desc = (struct submit_desc *)req->payload;
+   desc->chunk_id = chunk_id;
+   desc->length_dw = chunk_size / 4;
+   desc->offset = 0;
+   memcpy(&req->payload[sizeof(*desc)], chunk, chunk_size);
+
+   *out_size = size;
+   return req;
+}
+
+static void
+run_submits(const char *name, void *req, size_t size)
+{
+   uint64_t start = drm_bench_now_ns();
+   for (uint32_t i = 0; i < iterations; i++) {
+      if (drm_bench_submit(&bench, req, size))
+         exit(1);
+   }
+   drm_bench_report(name, iterations, drm_bench_now_ns() - start);
+   check_rsp(name);
+}
+
+static void
+bench_inline_list(struct drm_amdgpu_bo_list_entry *entries)
+{
+   size_t size;
+   void *req = build_submit(AMDGPU_CHUNK_ID_BO_HANDLES, entries,
+                            num_bos * sizeof(*entries), &size);
+
+   run_submits("CS_SUBMIT inline BO list", req, size);
+   free(req);
+}
+
+static void
+bench_persistent_list(struct drm_amdgpu_bo_list_entry *entries)
+{
+   const uint32_t list_id = 1;
+   size_t size = sizeof(struct amdgpu_ccmd_bo_list_req) + num_bos * sizeof(*entries);
+   struct amdgpu_ccmd_bo_list_req *create = calloc(1, size);
+
+   create->hdr = AMDGPU_CCMD(BO_LIST, size);
+   create->list_id = list_id;
+   create->op = AMDGPU_CCMD_BO_LIST_OP_CREATE;
+   create->num_add = num_bos;
+   memcpy(create->payload, entries, num_bos * sizeof(*entries));
+   if (drm_bench_submit(&bench, create, size))
+      exit(1);
+   check_rsp("BO_LIST create");
+   free(create);
+
+   const struct amdgpu_ccmd_cs_bo_list_chunk chunk = {
+      .list_id = list_id,
+   };
+   size_t submit_size;
+   void *submit = build_submit(AMDGPU_CCMD_CHUNK_ID_BO_LIST, &chunk, sizeof(chunk),
+                               &submit_size);
+
+   run_submits("CS_SUBMIT persistent BO list", submit, submit_size);
+
+   /* A frame that swaps one BO in and out of the list before submitting. */
+   struct {
+      struct amdgpu_ccmd_bo_list_req req;
+      struct drm_amdgpu_bo_list_entry add;
+      uint32_t remove;
+      uint32_t pad;
+   } update = {
+      .req = {
+         .hdr = AMDGPU_CCMD(BO_LIST, sizeof(update)),
+         .list_id = list_id,
+         .op = AMDGPU_CCMD_BO_LIST_OP_UPDATE,
+         .num_add = 1,
+         .num_remove = 1,
+      },
+   };
+   size_t frame_size = sizeof(update) + submit_size;
+   uint8_t *frame = malloc(frame_size);
+
+   uint64_t start = drm_bench_now_ns();
+   for (uint32_t i = 0; i < iterations; i++) {
+      uint32_t in = i & 1 ? 0 : num_bos;
+      uint32_t out = i & 1 ? num_bos : 0;
+      update.add = (struct drm_amdgpu_bo_list_entry){ .bo_handle = res_ids[in] };
+      update.remove = res_ids[out];
+      memcpy(frame, &update, sizeof(update));
+      memcpy(&frame[sizeof(update)], submit, submit_size);
+      if (drm_bench_submit(&bench, frame, frame_size))
+         exit(1);
+   }
+   drm_bench_report("BO_LIST delta + CS_SUBMIT", iterations, drm_bench_now_ns() - start);
+   check_rsp("BO_LIST delta + CS_SUBMIT");
+
+   free(frame);
+   free(submit);
+}
+
+int
+main(int argc, char **argv)
+{
+   if (argc > 1)
+      num_bos = atoi(argv[1]);
+   if (argc > 2)
+      iterations = atoi(argv[2]);
+   if (!num_bos || !iterations) {
+      fprintf(stderr, "usage: %s [num_bos] [iterations]\n", argv[0]);
+      return 1;
+   }
+
+   if (drm_bench_init(&bench, "bench_amdgpu_bo_list"))
+      return 1;
+
+   setup_bos();
+
+   struct drm_amdgpu_bo_list_entry *entries = calloc(num_bos, sizeof(*entries));
+   for (uint32_t i = 0; i < num_bos; i++)
+      entries[i].bo_handle = res_ids[i];
+
+   printf("%u BOs per submit\n", num_bos);
+   bench_inline_list(entries);
+   bench_persistent_list(entries);
+
+   free(entries);
+   free(res_ids);
+   drm_bench_fini(&bench);
+
+   return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Measures the per-ccmd overhead of the drm native context dispatch loop,
+ * using the small msm ccmds that dominate the command count of a typical
+ * guest: GEM_CPU_PREP, WAIT_FENCE and SUBMITQUEUE_QUERY.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "msm_drm.h"
+#include "util/macros.h"
+
+#include "drm_bench.h"
+#include "msm_proto.h"
+
+#define BATCH_SIZE 64
+
+static struct drm_bench bench;
+static uint32_t iterations = 20000;
+static uint32_t bo_res_id;
+static uint32_t queue_id;
+
+static void
+setup(void)
+{
+   struct msm_ccmd_gem_new_req gem_new = {
+      .hdr = MSM_CCMD(GEM_NEW, sizeof(gem_new)),
+      .iova = 0x100000000ull,
+      .size = 4096,
+      .flags = MSM_BO_WC,
+      .blob_id = 1,
+   };
+   if (drm_bench_submit(&bench, &gem_new, sizeof(gem_new)))
+      exit(1);
+
+   bo_res_id = drm_bench_create_blob(&bench, gem_new.blob_id, gem_new.size);
+   if (!bo_res_id)
+      exit(1);
+
+   struct {
+      struct msm_ccmd_ioctl_simple_req req;
+      struct drm_msm_submitqueue args;
+   } sq_new = {
+      .req = {
+         .hdr = MSM_CCMD(IOCTL_SIMPLE, sizeof(sq_new)),
+         .cmd = DRM_IOCTL_MSM_SUBMITQUEUE_NEW,
+      },
+      .args = {
+         .prio = 1,
+      },
+   };
+   if (drm_bench_submit(&bench, &sq_new, sizeof(sq_new)))
+      exit(1);
+
+   const struct msm_ccmd_ioctl_simple_rsp *rsp = drm_bench_rsp(&bench, 0);
+   if (rsp->ret) {
+      fprintf(stderr, "SUBMITQUEUE_NEW failed: %d\n", rsp->ret);
+      exit(1);
+   }
+   queue_id = ((const struct drm_msm_submitqueue *)rsp->payload)->id;
+}
+
+/* Replicates a single ccmd BATCH_SIZE times and submits the batch. */
+static void
+run_batch(const char *name, const void *ccmd, size_t ccmd_size)
+{
+   size_t size = ccmd_size * BATCH_SIZE;
+   uint8_t *buf = malloc(size);
+
+   for (unsigned i = 0; i < BATCH_SIZE; i++)
+      memcpy(&buf[i * ccmd_size], ccmd, ccmd_size);
+
+   uint64_t start = drm_bench_now_ns();
+   for (uint32_t i = 0; i < iterations; i++) {
+      if (drm_bench_submit(&bench, buf, size))
+         exit(1);
+   }
+   drm_bench_report(name, (uint64_t)iterations * BATCH_SIZE, drm_bench_now_ns() - start);
+
+   /* Every ccmd of the batch shares the response slot at offset 0. */
+   const int32_t *ret = (const int32_t *)((uint8_t *)drm_bench_rsp(&bench, 0) +
+                                          sizeof(struct vdrm_ccmd_rsp));
+   if (*ret) {
+      fprintf(stderr, "%s failed: %d\n", name, *ret);
+      exit(1);
+   }
+
+   free(buf);
+}
+
+int
+main(int argc, char **argv)
+{
+   if (argc > 1)
+      iterations = atoi(argv[1]);
+   if (!iterations) {
+      fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+      return 1;
+   }
+
+   if (drm_bench_init(&bench, "bench_msm_ccmd"))
+      return 1;
+
+   setup();
+
+   printf("%u ccmds per submit\n", BATCH_SIZE);
+
+   const struct msm_ccmd_gem_cpu_prep_req cpu_prep = {
+      .hdr = MSM_CCMD(GEM_CPU_PREP, sizeof(cpu_prep)),
+      .res_id = bo_res_id,
+      .op = MSM_PREP_READ,
+   };
+   run_batch("GEM_CPU_PREP", &cpu_prep, sizeof(cpu_prep));
+
+   const struct msm_ccmd_wait_fence_req wait_fence = {
+      .hdr = MSM_CCMD(WAIT_FENCE, sizeof(wait_fence)),
+      .queue_id = queue_id,
+      .fence = 1,
+   };
+   run_batch("WAIT_FENCE", &wait_fence, sizeof(wait_fence));
+
+   const struct msm_ccmd_submitqueue_query_req query = {
+      .hdr = MSM_CCMD(SUBMITQUEUE_QUERY, sizeof(query)),
+      .queue_id = queue_id,
+      .param = MSM_SUBMITQUEUE_PARAM_FAULTS,
+      .len = sizeof(uint32_t),
+   };
+   run_batch("SUBMITQUEUE_QUERY", &query, sizeof(query));
+
+   drm_bench_fini(&bench);
+
+   return 0;
+}
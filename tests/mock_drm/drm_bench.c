@@ -0,0 +1,173 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util/macros.h"
+#include "virglrenderer.h"
+#include "virtgpu_drm.h"
+
+#include "drm_bench.h"
+
+#define DRM_BENCH_SHMEM_SIZE 0x10000
+
+static void
+drm_bench_write_context_fence(UNUSED void *cookie, UNUSED uint32_t ctx_id,
+                              UNUSED uint32_t ring_idx, UNUSED uint64_t fence_id)
+{
+}
+
+static struct virgl_renderer_callbacks drm_bench_callbacks = {
+   .version = 3,
+   .write_context_fence = drm_bench_write_context_fence,
+};
+
+int
+drm_bench_init_context(struct drm_bench *bench, const char *name)
+{
+   int ret;
+
+   memset(bench, 0, sizeof(*bench));
+
+   ret = virgl_renderer_init(NULL, VIRGL_RENDERER_NO_VIRGL | VIRGL_RENDERER_DRM |
+                                   VIRGL_RENDERER_ASYNC_FENCE_CB,
+                             &drm_bench_callbacks);
+   if (ret) {
+      fprintf(stderr, "virgl_renderer_init failed: %d\n", ret);
+      return ret;
+   }
+
+   bench->ctx_id = 1;
+   ret = virgl_renderer_context_create_with_flags(bench->ctx_id, VIRTGPU_DRM_CAPSET_DRM,
+                                                  strlen(name), name);
+   if (ret) {
+      fprintf(stderr, "context creation failed: %d\n", ret);
+      virgl_renderer_cleanup(NULL);
+      return ret;
+   }
+
+   bench->next_res_id = 1;
+
+   return 0;
+}
+
+int
+drm_bench_init(struct drm_bench *bench, const char *name)
+{
+   int ret = drm_bench_init_context(bench, name);
+   if (ret)
+      return ret;
+
+   /* blob_id 0 is the shmem buffer used for responses. */
+   bench->shmem_res_id = drm_bench_create_blob(bench, 0, DRM_BENCH_SHMEM_SIZE);
+   if (!bench->shmem_res_id) {
+      ret = -ENOMEM;
+      goto fail_context;
+   }
+
+   void *map;
+   ret = virgl_renderer_resource_map(bench->shmem_res_id, &map, &bench->shmem_size);
+   if (ret) {
+      fprintf(stderr, "shmem map failed: %d\n", ret);
+      goto fail_context;
+   }
+   bench->shmem = map;
+
+   return 0;
+
+fail_context:
+   virgl_renderer_context_destroy(bench->ctx_id);
+   virgl_renderer_cleanup(NULL);
+   return ret;
+}
+
+void
+drm_bench_fini(struct drm_bench *bench)
+{
+   if (bench->shmem)
+      virgl_renderer_resource_unmap(bench->shmem_res_id);
+   for (uint32_t res_id = 1; res_id < bench->next_res_id; res_id++)
+      virgl_renderer_resource_unref(res_id);
+   virgl_renderer_context_destroy(bench->ctx_id);
+   virgl_renderer_cleanup(NULL);
+}
+
+int
+drm_bench_submit(struct drm_bench *bench, void *cmds, size_t size)
+{
+   uint8_t *buf = cmds;
+
+   for (size_t off = 0; off + sizeof(struct vdrm_ccmd_req) <= size;) {
+      struct vdrm_ccmd_req *hdr = (struct vdrm_ccmd_req *)&buf[off];
+      hdr->seqno = ++bench->seqno;
+      if (!hdr->len)
+         break;
+      off += hdr->len;
+   }
+
+   return virgl_renderer_submit_cmd(cmds, bench->ctx_id, size / 4);
+}
+
+int
+drm_bench_create_resource(struct drm_bench *bench, uint32_t res_id, uint64_t blob_id,
+                          uint64_t size, uint32_t blob_flags)
+{
+   const struct virgl_renderer_resource_create_blob_args args = {
+      .res_handle = res_id,
+      .ctx_id = bench->ctx_id,
+      .blob_mem = VIRGL_RENDERER_BLOB_MEM_HOST3D,
+      .blob_flags = blob_flags,
+      .blob_id = blob_id,
+      .size = size,
+   };
+
+   int ret = virgl_renderer_resource_create_blob(&args);
+   if (ret) {
+      fprintf(stderr, "blob %" PRIu64 " creation failed: %d\n", blob_id, ret);
+      return ret;
+   }
+
+   virgl_renderer_ctx_attach_resource(bench->ctx_id, args.res_handle);
+
+   return 0;
+}
+
+uint32_t
+drm_bench_create_blob(struct drm_bench *bench, uint64_t blob_id, uint64_t size)
+{
+   if (drm_bench_create_resource(bench, bench->next_res_id, blob_id, size,
+                                 VIRGL_RENDERER_BLOB_FLAG_USE_MAPPABLE))
+      return 0;
+
+   return bench->next_res_id++;
+}
+
+void *
+drm_bench_rsp(struct drm_bench *bench, uint32_t rsp_off)
+{
+   return (uint8_t *)bench->shmem + bench->shmem->rsp_mem_offset + rsp_off;
+}
+
+uint64_t
+drm_bench_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void
+drm_bench_report(const char *name, uint64_t count, uint64_t elapsed_ns)
+{
+   printf("%-32s %10" PRIu64 " iterations %10.1f ns/iter %12.0f iter/s\n", name, count,
+          (double)elapsed_ns / count, count * 1e9 / elapsed_ns);
+}
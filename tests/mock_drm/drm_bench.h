@@ -0,0 +1,65 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DRM_BENCH_H_
+#define DRM_BENCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "drm_hw.h"
+
+/*
+ * Minimal guest-side driver for benchmarking a drm native context through
+ * the public virglrenderer API, normally on top of the mock drm device.
+ */
+struct drm_bench {
+   uint32_t ctx_id;
+   uint32_t next_res_id;
+   uint32_t seqno;
+
+   uint32_t shmem_res_id;
+   struct vdrm_shmem *shmem;
+   uint64_t shmem_size;
+};
+
+/* Creates the context and its shmem blob. */
+int
+drm_bench_init(struct drm_bench *bench, const char *name);
+
+/* Only creates the context, the shmem blob is left to the caller. */
+int
+drm_bench_init_context(struct drm_bench *bench, const char *name);
+
+void
+drm_bench_fini(struct drm_bench *bench);
+
+/* Fills in the seqno and submits a buffer of ccmds. */
+int
+drm_bench_submit(struct drm_bench *bench, void *cmds, size_t size);
+
+/* Creates the resource for a blob previously allocated by a ccmd, and
+ * returns its res_id or 0.
+ */
+uint32_t
+drm_bench_create_blob(struct drm_bench *bench, uint64_t blob_id, uint64_t size);
+
+/* Same with the res_id and blob flags chosen by the caller, which also
+ * releases the resource.
+ */
+int
+drm_bench_create_resource(struct drm_bench *bench, uint32_t res_id, uint64_t blob_id,
+                          uint64_t size, uint32_t blob_flags);
+
+void *
+drm_bench_rsp(struct drm_bench *bench, uint32_t rsp_off);
+
+uint64_t
+drm_bench_now_ns(void);
+
+void
+drm_bench_report(const char *name, uint64_t count, uint64_t elapsed_ns);
+
+#endif /* DRM_BENCH_H_ */
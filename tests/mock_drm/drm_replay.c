@@ -0,0 +1,223 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Replays a ccmd stream recorded with VIRGL_DRM_TRACE (see drm_trace.h) to
+ * measure the host side cost per ccmd.  Everything up to the last blob
+ * creation or release before the final run of submits is treated as setup
+ * and replayed once, that run of submits is replayed for each iteration.
+ *
+ * With -j, every context is replayed by its own process, like the render
+ * server runs one process per context, and the aggregate throughput is
+ * reported.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "util/macros.h"
+
+#include "drm_bench.h"
+#include "drm_trace_replay.h"
+
+struct replay_trace {
+   struct drm_trace_file file;
+
+   /* Records replayed for each iteration, the blobs released after them
+    * are left to the context destruction.
+    */
+   uint32_t body_start;
+   uint32_t body_end;
+   uint64_t body_ccmd_count;
+};
+
+struct replay_result {
+   uint64_t ccmd_count;
+   uint64_t elapsed_ns;
+};
+
+static uint64_t
+count_ccmds(const struct drm_trace_replay_record *record)
+{
+   const uint8_t *buf = (const uint8_t *)record->data + sizeof(struct drm_trace_submit_cmd);
+   size_t len = record->len - sizeof(struct drm_trace_submit_cmd);
+   uint64_t count = 0;
+
+   for (size_t off = 0; off + sizeof(struct vdrm_ccmd_req) <= len;) {
+      const struct vdrm_ccmd_req *hdr = (const struct vdrm_ccmd_req *)&buf[off];
+      if (!hdr->len)
+         break;
+      off += hdr->len;
+      count++;
+   }
+
+   return count;
+}
+
+static int
+load_trace(struct replay_trace *trace, const char *path)
+{
+   memset(trace, 0, sizeof(*trace));
+   if (drm_trace_load(&trace->file, path))
+      return -1;
+
+   for (uint32_t i = 0; i < trace->file.record_count; i++) {
+      if (trace->file.records[i].type == DRM_TRACE_SUBMIT_CMD)
+         trace->body_end = i + 1;
+   }
+
+   for (uint32_t i = 0; i < trace->body_end; i++) {
+      if (trace->file.records[i].type != DRM_TRACE_SUBMIT_CMD)
+         trace->body_start = i + 1;
+   }
+
+   for (uint32_t i = trace->body_start; i < trace->body_end; i++)
+      trace->body_ccmd_count += count_ccmds(&trace->file.records[i]);
+
+   if (!trace->body_ccmd_count) {
+      fprintf(stderr, "no ccmds to replay after setup\n");
+      return -1;
+   }
+
+   return 0;
+}
+
+/* Runs in each context process, the result is written to result_fd. */
+static int
+replay_context(const struct replay_trace *trace, uint32_t iterations, int ready_fd,
+               int start_fd, int result_fd)
+{
+   struct drm_bench bench;
+   char c = 0;
+
+   if (drm_bench_init_context(&bench, trace->file.header.name))
+      return 1;
+
+   if (drm_trace_replay(&bench, &trace->file, 0, trace->body_start))
+      return 1;
+
+   /* Start timing all contexts together. */
+   if (write(ready_fd, &c, 1) != 1)
+      return 1;
+   close(ready_fd);
+   if (read(start_fd, &c, 1) != 1)
+      return 1;
+
+   uint64_t start = drm_bench_now_ns();
+   for (uint32_t i = 0; i < iterations; i++) {
+      if (drm_trace_replay(&bench, &trace->file, trace->body_start, trace->body_end))
+         return 1;
+   }
+
+   const struct replay_result result = {
+      .ccmd_count = trace->body_ccmd_count * iterations,
+      .elapsed_ns = drm_bench_now_ns() - start,
+   };
+
+   drm_bench_fini(&bench);
+
+   return write(result_fd, &result, sizeof(result)) == sizeof(result) ? 0 : 1;
+}
+
+static void
+usage(const char *name)
+{
+   fprintf(stderr, "usage: %s [-n iterations] [-j contexts] trace\n", name);
+}
+
+int
+main(int argc, char **argv)
+{
+   uint32_t iterations = 100;
+   uint32_t contexts = 1;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:j:")) != -1) {
+      switch (opt) {
+      case 'n':
+         iterations = atoi(optarg);
+         break;
+      case 'j':
+         contexts = atoi(optarg);
+         break;
+      default:
+         usage(argv[0]);
+         return 1;
+      }
+   }
+
+   if (optind != argc - 1 || !iterations || !contexts) {
+      usage(argv[0]);
+      return 1;
+   }
+
+   /* Do not record the replay itself. */
+   unsetenv("VIRGL_DRM_TRACE");
+
+   struct replay_trace trace;
+   if (load_trace(&trace, argv[optind]))
+      return 1;
+
+   int ready_pipe[2], start_pipe[2], result_pipe[2];
+   if (pipe(ready_pipe) || pipe(start_pipe) || pipe(result_pipe)) {
+      perror("pipe");
+      return 1;
+   }
+
+   for (uint32_t i = 0; i < contexts; i++) {
+      pid_t pid = fork();
+      if (pid < 0) {
+         perror("fork");
+         return 1;
+      }
+      if (!pid)
+         _exit(replay_context(&trace, iterations, ready_pipe[1], start_pipe[0],
+                              result_pipe[1]));
+   }
+
+   close(ready_pipe[1]);
+   close(start_pipe[0]);
+   close(result_pipe[1]);
+
+   uint32_t ready = 0;
+   char c;
+   while (ready < contexts && read(ready_pipe[0], &c, 1) == 1)
+      ready++;
+   for (uint32_t i = 0; i < ready; i++) {
+      if (write(start_pipe[1], &c, 1) != 1)
+         break;
+   }
+
+   struct replay_result total = { 0 };
+   struct replay_result result;
+   uint32_t done = 0;
+   while (read(result_pipe[0], &result, sizeof(result)) == sizeof(result)) {
+      total.ccmd_count += result.ccmd_count;
+      total.elapsed_ns = MAX2(total.elapsed_ns, result.elapsed_ns);
+      done++;
+   }
+
+   int status, failed = 0;
+   while (wait(&status) > 0)
+      failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+
+   if (failed || done != contexts) {
+      fprintf(stderr, "%u of %u contexts failed\n", contexts - done, contexts);
+      return 1;
+   }
+
+   printf("%s: %u context(s), %" PRIu64 " ccmds per iteration\n", trace.file.header.name,
+          contexts, trace.body_ccmd_count);
+   drm_bench_report("ccmd", total.ccmd_count, total.elapsed_ns);
+
+   return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/macros.h"
+#include "virglrenderer.h"
+
+#include "drm_trace_replay.h"
+
+static bool
+record_valid(const struct drm_trace_record *record)
+{
+   switch (record->type) {
+   case DRM_TRACE_CREATE_BLOB:
+      return record->len == sizeof(struct drm_trace_create_blob);
+   case DRM_TRACE_SUBMIT_CMD:
+      return record->len >= sizeof(struct drm_trace_submit_cmd);
+   case DRM_TRACE_DETACH_RESOURCE:
+      return record->len == sizeof(struct drm_trace_detach_resource);
+   default:
+      return false;
+   }
+}
+
+int
+drm_trace_load(struct drm_trace_file *trace, const char *path)
+{
+   FILE *fp = fopen(path, "rb");
+   if (!fp) {
+      fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+      return -1;
+   }
+
+   memset(trace, 0, sizeof(*trace));
+   if (fread(&trace->header, sizeof(trace->header), 1, fp) != 1 ||
+       memcmp(trace->header.magic, DRM_TRACE_MAGIC, sizeof(trace->header.magic)) ||
+       trace->header.version != DRM_TRACE_VERSION) {
+      fprintf(stderr, "%s is not a version %u drm trace\n", path, DRM_TRACE_VERSION);
+      fclose(fp);
+      return -1;
+   }
+   trace->header.name[sizeof(trace->header.name) - 1] = '\0';
+
+   struct drm_trace_record record;
+   while (fread(&record, sizeof(record), 1, fp) == 1) {
+      if (!record_valid(&record)) {
+         fprintf(stderr, "record %u: invalid type %u or length %u\n", trace->record_count,
+                 record.type, record.len);
+         goto fail;
+      }
+
+      uint32_t padded_len = ALIGN_POT(record.len, 8);
+      void *data = malloc(padded_len);
+
+      if (!data || fread(data, padded_len, 1, fp) != 1) {
+         fprintf(stderr, "truncated record %u\n", trace->record_count);
+         free(data);
+         goto fail;
+      }
+
+      struct drm_trace_replay_record *records =
+         realloc(trace->records, (trace->record_count + 1) * sizeof(*records));
+      if (!records) {
+         free(data);
+         goto fail;
+      }
+      trace->records = records;
+      trace->records[trace->record_count++] = (struct drm_trace_replay_record){
+         .type = record.type,
+         .len = record.len,
+         .data = data,
+      };
+   }
+   fclose(fp);
+
+   return 0;
+
+fail:
+   fclose(fp);
+   drm_trace_free(trace);
+   return -1;
+}
+
+void
+drm_trace_free(struct drm_trace_file *trace)
+{
+   for (uint32_t i = 0; i < trace->record_count; i++)
+      free(trace->records[i].data);
+   free(trace->records);
+   trace->records = NULL;
+   trace->record_count = 0;
+}
+
+int
+drm_trace_replay(struct drm_bench *bench, const struct drm_trace_file *trace,
+                 uint32_t start, uint32_t end)
+{
+   for (uint32_t i = start; i < end; i++) {
+      const struct drm_trace_replay_record *record = &trace->records[i];
+
+      switch (record->type) {
+      case DRM_TRACE_CREATE_BLOB: {
+         const struct drm_trace_create_blob *blob = record->data;
+         if (drm_bench_create_resource(bench, blob->res_id, blob->blob_id, blob->size,
+                                       blob->blob_flags)) {
+            fprintf(stderr, "record %u: res_id %u creation failed\n", i, blob->res_id);
+            return -1;
+         }
+         break;
+      }
+      case DRM_TRACE_SUBMIT_CMD: {
+         const struct drm_trace_submit_cmd *submit = record->data;
+         int ret = drm_bench_submit(bench, (uint8_t *)record->data + sizeof(*submit),
+                                    record->len - sizeof(*submit));
+         if (!ret != !submit->ret) {
+            fprintf(stderr, "record %u: submit returned %d, recorded %d\n", i, ret,
+                    submit->ret);
+            return -1;
+         }
+         break;
+      }
+      case DRM_TRACE_DETACH_RESOURCE: {
+         const struct drm_trace_detach_resource *detach = record->data;
+         virgl_renderer_resource_unref(detach->res_id);
+         break;
+      }
+      default:
+         UNREACHABLE("record type checked at load");
+      }
+   }
+
+   return 0;
+}
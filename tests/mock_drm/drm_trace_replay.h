@@ -0,0 +1,41 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DRM_TRACE_REPLAY_H_
+#define DRM_TRACE_REPLAY_H_
+
+#include <stdint.h>
+
+#include "drm_bench.h"
+#include "drm_trace.h"
+
+struct drm_trace_replay_record {
+   uint32_t type;
+   uint32_t len;
+   void *data;
+};
+
+/* A trace recorded with VIRGL_DRM_TRACE, loaded in memory. */
+struct drm_trace_file {
+   struct drm_trace_header header;
+   struct drm_trace_replay_record *records;
+   uint32_t record_count;
+};
+
+int
+drm_trace_load(struct drm_trace_file *trace, const char *path);
+
+void
+drm_trace_free(struct drm_trace_file *trace);
+
+/* Replays records [start, end) on a context created with
+ * drm_bench_init_context().  Submits must succeed or fail like they did
+ * when recorded.
+ */
+int
+drm_trace_replay(struct drm_bench *bench, const struct drm_trace_file *trace,
+                 uint32_t start, uint32_t end);
+
+#endif /* DRM_TRACE_REPLAY_H_ */
@@ -0,0 +1,393 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <amdgpu.h>
+#include <xf86drm.h>
+
+#include "amdgpu_drm.h"
+#include "util/macros.h"
+
+#include "mock_drm.h"
+
+/*
+ * libdrm_amdgpu entry points used by the amdgpu native context, on top of
+ * the fake render node.  The device/bo/context structs are opaque to
+ * libdrm_amdgpu users, so the mock is free to define its own.
+ */
+
+struct amdgpu_device {
+   int fd;
+   struct mock_drm_file *file;
+   uint32_t next_ctx_id;
+};
+
+struct amdgpu_bo {
+   struct amdgpu_device *dev;
+   uint32_t handle;
+   struct amdgpu_bo_alloc_request request;
+   struct amdgpu_bo_metadata metadata;
+};
+
+struct amdgpu_context {
+   struct amdgpu_device *dev;
+   uint32_t id;
+   uint64_t last_seq;
+};
+
+/* Size of the BO list of the last successful submit. */
+static uint32_t last_submit_bo_count;
+
+#define MOCK_AMDGPU_VRAM_SIZE (8ull << 30)
+#define MOCK_AMDGPU_GTT_SIZE  (16ull << 30)
+
+static int
+mock_amdgpu_ioctl(struct mock_drm_file *file, unsigned long request, void *arg)
+{
+   switch (request) {
+   case DRM_IOCTL_AMDGPU_INFO: {
+      struct drm_amdgpu_info *info = arg;
+      void *out = (void *)(uintptr_t)info->return_pointer;
+      if (out)
+         memset(out, 0, info->return_size);
+      return 0;
+   }
+   case DRM_IOCTL_AMDGPU_GEM_MMAP: {
+      union drm_amdgpu_gem_mmap *args = arg;
+      uint64_t size;
+      if (!mock_drm_bo_get_size(file, args->in.handle, &size))
+         return -ENOENT;
+      args->out.addr_ptr = mock_drm_bo_mmap_offset(file, args->in.handle);
+      return 0;
+   }
+   default:
+      return -EINVAL;
+   }
+}
+
+const struct mock_drm_driver mock_amdgpu_driver = {
+   .name = "amdgpu",
+   .version_major = 3,
+   .version_minor = 59,
+   .version_patchlevel = 0,
+   .ioctl = mock_amdgpu_ioctl,
+};
+
+MOCK_DRM_EXPORT int
+amdgpu_device_initialize2(int fd, UNUSED bool deduplicate_device,
+                          uint32_t *major_version, uint32_t *minor_version,
+                          amdgpu_device_handle *device_handle)
+{
+   struct mock_drm_file *file = mock_drm_file_lookup(fd);
+   if (!file)
+      return -ENODEV;
+
+   struct amdgpu_device *dev = calloc(1, sizeof(*dev));
+   if (!dev)
+      return -ENOMEM;
+
+   dev->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+   dev->file = file;
+   dev->next_ctx_id = 1;
+
+   *major_version = mock_amdgpu_driver.version_major;
+   *minor_version = mock_amdgpu_driver.version_minor;
+   *device_handle = dev;
+
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_device_deinitialize(amdgpu_device_handle dev)
+{
+   close(dev->fd);
+   free(dev);
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_device_get_fd(amdgpu_device_handle dev)
+{
+   return dev->fd;
+}
+
+MOCK_DRM_EXPORT const char *
+amdgpu_get_marketing_name(UNUSED amdgpu_device_handle dev)
+{
+   return "virglrenderer mock amdgpu";
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_query_sw_info(UNUSED amdgpu_device_handle dev, UNUSED enum amdgpu_sw_info info,
+                     void *value)
+{
+   *(uint32_t *)value = 0xffff8000;
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_query_buffer_size_alignment(UNUSED amdgpu_device_handle dev,
+                                   struct amdgpu_buffer_size_alignments *info)
+{
+   info->size_local = 4096;
+   info->size_remote = 4096;
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_query_gpu_info(UNUSED amdgpu_device_handle dev, struct amdgpu_gpu_info *info)
+{
+   memset(info, 0, sizeof(*info));
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_query_hw_ip_info(UNUSED amdgpu_device_handle dev, unsigned type,
+                        UNUSED unsigned ip_instance, struct drm_amdgpu_info_hw_ip *info)
+{
+   memset(info, 0, sizeof(*info));
+
+   /* A single gfx ring is enough for a single timeline. */
+   if (type == AMDGPU_HW_IP_GFX)
+      info->available_rings = 1;
+
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_query_heap_info(UNUSED amdgpu_device_handle dev, uint32_t heap,
+                       UNUSED uint32_t flags, struct amdgpu_heap_info *info)
+{
+   memset(info, 0, sizeof(*info));
+   info->heap_size = heap == AMDGPU_GEM_DOMAIN_VRAM ? MOCK_AMDGPU_VRAM_SIZE :
+                                                      MOCK_AMDGPU_GTT_SIZE;
+   info->max_allocation = info->heap_size;
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_bo_alloc(amdgpu_device_handle dev, struct amdgpu_bo_alloc_request *alloc_buffer,
+                amdgpu_bo_handle *buf_handle)
+{
+   struct amdgpu_bo *bo = calloc(1, sizeof(*bo));
+   if (!bo)
+      return -ENOMEM;
+
+   bo->dev = dev;
+   bo->request = *alloc_buffer;
+   bo->handle = mock_drm_bo_create(dev->file, alloc_buffer->alloc_size);
+   if (!bo->handle) {
+      free(bo);
+      return -ENOMEM;
+   }
+
+   *buf_handle = bo;
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_bo_free(amdgpu_bo_handle bo)
+{
+   mock_drm_bo_close(bo->dev->file, bo->handle);
+   free(bo);
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_bo_export(amdgpu_bo_handle bo, enum amdgpu_bo_handle_type type,
+                 uint32_t *shared_handle)
+{
+   switch (type) {
+   case amdgpu_bo_handle_type_kms:
+   case amdgpu_bo_handle_type_kms_noimport:
+      *shared_handle = bo->handle;
+      return 0;
+   case amdgpu_bo_handle_type_dma_buf_fd: {
+      int fd = mock_drm_bo_export(bo->dev->file, bo->handle);
+      if (fd < 0)
+         return -EINVAL;
+      *shared_handle = fd;
+      return 0;
+   }
+   default:
+      return -EINVAL;
+   }
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_bo_import(amdgpu_device_handle dev, enum amdgpu_bo_handle_type type,
+                 uint32_t shared_handle, struct amdgpu_bo_import_result *output)
+{
+   if (type != amdgpu_bo_handle_type_dma_buf_fd)
+      return -EINVAL;
+
+   struct amdgpu_bo *bo = calloc(1, sizeof(*bo));
+   if (!bo)
+      return -ENOMEM;
+
+   bo->dev = dev;
+   bo->handle = mock_drm_bo_import(dev->file, shared_handle);
+   if (!bo->handle ||
+       !mock_drm_bo_get_size(dev->file, bo->handle, &bo->request.alloc_size)) {
+      free(bo);
+      return -EINVAL;
+   }
+
+   output->buf_handle = bo;
+   output->alloc_size = bo->request.alloc_size;
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_bo_query_info(amdgpu_bo_handle bo, struct amdgpu_bo_info *info)
+{
+   memset(info, 0, sizeof(*info));
+   info->alloc_size = bo->request.alloc_size;
+   info->phys_alignment = bo->request.phys_alignment;
+   info->preferred_heap = bo->request.preferred_heap;
+   info->alloc_flags = bo->request.flags;
+   info->metadata = bo->metadata;
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_bo_set_metadata(amdgpu_bo_handle bo, struct amdgpu_bo_metadata *info)
+{
+   bo->metadata = *info;
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_bo_va_op_raw(UNUSED amdgpu_device_handle dev, UNUSED amdgpu_bo_handle bo,
+                    UNUSED uint64_t offset, UNUSED uint64_t size, UNUSED uint64_t addr,
+                    UNUSED uint64_t flags, UNUSED uint32_t ops)
+{
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_cs_ctx_create2(amdgpu_device_handle dev, UNUSED uint32_t priority,
+                      amdgpu_context_handle *context)
+{
+   struct amdgpu_context *ctx = calloc(1, sizeof(*ctx));
+   if (!ctx)
+      return -ENOMEM;
+
+   ctx->dev = dev;
+   ctx->id = dev->next_ctx_id++;
+
+   *context = ctx;
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_cs_ctx_free(amdgpu_context_handle context)
+{
+   free(context);
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_cs_ctx_stable_pstate(UNUSED amdgpu_context_handle context, UNUSED uint32_t op,
+                            UNUSED uint32_t flags, uint32_t *out_flags)
+{
+   *out_flags = 0;
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_vm_reserve_vmid(UNUSED amdgpu_device_handle dev, UNUSED uint32_t flags)
+{
+   return 0;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_vm_unreserve_vmid(UNUSED amdgpu_device_handle dev, UNUSED uint32_t flags)
+{
+   return 0;
+}
+
+MOCK_DRM_EXPORT void
+amdgpu_cs_chunk_fence_to_dep(struct amdgpu_cs_fence *fence,
+                             struct drm_amdgpu_cs_chunk_dep *dep)
+{
+   dep->ip_type = fence->ip_type;
+   dep->ip_instance = fence->ip_instance;
+   dep->ring = fence->ring;
+   dep->ctx_id = fence->context->id;
+   dep->handle = fence->fence;
+}
+
+MOCK_DRM_EXPORT void
+amdgpu_cs_chunk_fence_info_to_data(struct amdgpu_cs_fence_info *fence_info,
+                                   struct drm_amdgpu_cs_chunk_data *data)
+{
+   data->fence_data.handle = fence_info->handle->handle;
+   data->fence_data.offset = fence_info->offset * sizeof(uint64_t);
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_cs_submit_raw2(amdgpu_device_handle dev, amdgpu_context_handle context,
+                      UNUSED uint32_t bo_list_handle, int num_chunks,
+                      struct drm_amdgpu_cs_chunk *chunks, uint64_t *seq_no)
+{
+   uint32_t bo_count = 0;
+
+   if (!context)
+      return -ENOENT;
+
+   for (int i = 0; i < num_chunks; i++) {
+      const void *data = (const void *)(uintptr_t)chunks[i].chunk_data;
+
+      switch (chunks[i].chunk_id) {
+      case AMDGPU_CHUNK_ID_BO_HANDLES: {
+         /* Like the kernel, resolve every handle of the list. */
+         const struct drm_amdgpu_bo_list_in *in = data;
+         const struct drm_amdgpu_bo_list_entry *entries =
+            (const void *)(uintptr_t)in->bo_info_ptr;
+         for (uint32_t j = 0; j < in->bo_number; j++) {
+            uint64_t size;
+            if (!mock_drm_bo_get_size(dev->file, entries[j].bo_handle, &size))
+               return -ENOENT;
+         }
+         bo_count = in->bo_number;
+         break;
+      }
+      case AMDGPU_CHUNK_ID_SYNCOBJ_OUT: {
+         const struct drm_amdgpu_cs_chunk_sem *sem = data;
+         if (!mock_drm_syncobj_signal_later(dev->file, sem->handle))
+            return -EINVAL;
+         break;
+      }
+      default:
+         break;
+      }
+   }
+
+   last_submit_bo_count = bo_count;
+   *seq_no = ++context->last_seq;
+   return 0;
+}
+
+MOCK_DRM_EXPORT uint32_t
+mock_amdgpu_last_submit_bo_count(void)
+{
+   return last_submit_bo_count;
+}
+
+MOCK_DRM_EXPORT int
+amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence, UNUSED uint64_t timeout_ns,
+                             UNUSED uint64_t flags, uint32_t *expired)
+{
+   *expired = fence->fence <= fence->context->last_seq;
+   return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include <xf86drm.h>
+
+#include "asahi_drm.h"
+#include "util/macros.h"
+#include "util/u_atomic.h"
+
+#include "mock_drm.h"
+
+/*
+ * Emulates a single die G13G (M1).  VM binds are only validated, and every
+ * out syncobj of a submit is signaled after the mock fence delay.
+ */
+
+#define MOCK_ASAHI_VM_START 0x1000000ull
+#define MOCK_ASAHI_VM_END   0x7fffffffffull
+
+static uint32_t mock_asahi_next_vm_id;
+static uint32_t mock_asahi_next_queue_id;
+static uint32_t mock_asahi_next_object_handle;
+
+static uint64_t
+mock_asahi_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int
+mock_asahi_get_params(struct drm_asahi_get_params *args)
+{
+   if (args->param_group != 0)
+      return -EINVAL;
+
+   struct drm_asahi_params_global params = {
+      .gpu_generation = 13,
+      .gpu_variant = 'G',
+      .gpu_revision = 0x11,
+      .chip_id = 0x8103,
+      .num_dies = 1,
+      .num_clusters_total = 1,
+      .num_cores_per_cluster = 8,
+      .max_frequency_khz = 1278000,
+      .core_masks = { 0xff },
+      .vm_start = MOCK_ASAHI_VM_START,
+      .vm_end = MOCK_ASAHI_VM_END,
+      .vm_kernel_min_size = 0x20000000,
+      .max_commands_per_submission = 64,
+      .max_attachments = 64,
+      .command_timestamp_frequency_hz = 24000000,
+   };
+
+   memcpy((void *)(uintptr_t)args->pointer, &params, MIN2(args->size, sizeof(params)));
+   args->size = MIN2(args->size, sizeof(params));
+
+   return 0;
+}
+
+static int
+mock_asahi_vm_bind(struct mock_drm_file *file, const struct drm_asahi_vm_bind *args)
+{
+   const uint8_t *ops = (const void *)(uintptr_t)args->userptr;
+   uint64_t size;
+
+   if (args->stride < sizeof(struct drm_asahi_gem_bind_op))
+      return -EINVAL;
+
+   for (uint32_t i = 0; i < args->num_binds; i++) {
+      const struct drm_asahi_gem_bind_op *op = (const void *)&ops[i * args->stride];
+      if (op->flags & DRM_ASAHI_BIND_UNBIND)
+         continue;
+      if (!mock_drm_bo_get_size(file, op->handle, &size) || op->offset + op->range > size)
+         return -EINVAL;
+   }
+
+   return 0;
+}
+
+static int
+mock_asahi_submit(struct mock_drm_file *file, const struct drm_asahi_submit *args)
+{
+   const struct drm_asahi_sync *syncs = (const void *)(uintptr_t)args->syncs;
+
+   if (!args->queue_id || args->queue_id > p_atomic_read(&mock_asahi_next_queue_id))
+      return -ENOENT;
+
+   for (uint32_t i = 0; i < args->out_sync_count; i++) {
+      const struct drm_asahi_sync *sync = &syncs[args->in_sync_count + i];
+      if (sync->sync_type != DRM_ASAHI_SYNC_SYNCOBJ)
+         return -EINVAL;
+      if (!mock_drm_syncobj_signal_later(file, sync->handle))
+         return -ENOENT;
+   }
+
+   return 0;
+}
+
+static int
+mock_asahi_ioctl(struct mock_drm_file *file, unsigned long request, void *arg)
+{
+   uint64_t size;
+
+   switch (_IOC_NR(request) - DRM_COMMAND_BASE) {
+   case DRM_ASAHI_GET_PARAMS:
+      return mock_asahi_get_params(arg);
+   case DRM_ASAHI_GET_TIME: {
+      struct drm_asahi_get_time *args = arg;
+      args->gpu_timestamp = mock_asahi_now_ns();
+      return 0;
+   }
+   case DRM_ASAHI_VM_CREATE: {
+      struct drm_asahi_vm_create *args = arg;
+      args->vm_id = p_atomic_inc_return(&mock_asahi_next_vm_id);
+      return 0;
+   }
+   case DRM_ASAHI_VM_DESTROY:
+   case DRM_ASAHI_QUEUE_DESTROY:
+      return 0;
+   case DRM_ASAHI_VM_BIND:
+      return mock_asahi_vm_bind(file, arg);
+   case DRM_ASAHI_GEM_CREATE: {
+      struct drm_asahi_gem_create *args = arg;
+      args->handle = mock_drm_bo_create(file, args->size);
+      return args->handle ? 0 : -ENOMEM;
+   }
+   case DRM_ASAHI_GEM_MMAP_OFFSET: {
+      struct drm_asahi_gem_mmap_offset *args = arg;
+      if (!mock_drm_bo_get_size(file, args->handle, &size))
+         return -ENOENT;
+      args->offset = mock_drm_bo_mmap_offset(file, args->handle);
+      return 0;
+   }
+   case DRM_ASAHI_GEM_BIND_OBJECT: {
+      struct drm_asahi_gem_bind_object *args = arg;
+      if (args->op != DRM_ASAHI_BIND_OBJECT_OP_BIND)
+         return 0;
+      if (!mock_drm_bo_get_size(file, args->handle, &size))
+         return -ENOENT;
+      args->object_handle = p_atomic_inc_return(&mock_asahi_next_object_handle);
+      return 0;
+   }
+   case DRM_ASAHI_QUEUE_CREATE: {
+      struct drm_asahi_queue_create *args = arg;
+      args->queue_id = p_atomic_inc_return(&mock_asahi_next_queue_id);
+      return 0;
+   }
+   case DRM_ASAHI_SUBMIT:
+      return mock_asahi_submit(file, arg);
+   default:
+      return -EINVAL;
+   }
+}
+
+const struct mock_drm_driver mock_asahi_driver = {
+   .name = "asahi",
+   .version_major = 1,
+   .version_minor = 0,
+   .version_patchlevel = 0,
+   .ioctl = mock_asahi_ioctl,
+};
@@ -0,0 +1,869 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "config.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <linux/dma-buf.h>
+
+#include <xf86drm.h>
+
+#include "util/macros.h"
+
+#include "mock_drm.h"
+
+#ifdef ENABLE_DRM_AMDGPU
+extern const struct mock_drm_driver mock_amdgpu_driver;
+#endif
+#ifdef ENABLE_DRM_MSM
+extern const struct mock_drm_driver mock_msm_driver;
+#endif
+#ifdef ENABLE_DRM_I915
+extern const struct mock_drm_driver mock_i915_driver;
+#endif
+#ifdef ENABLE_DRM_PANFROST
+extern const struct mock_drm_driver mock_panfrost_driver;
+#endif
+#ifdef ENABLE_DRM_ASAHI
+extern const struct mock_drm_driver mock_asahi_driver;
+#endif
+
+static const struct mock_drm_driver *const drivers[] = {
+#ifdef ENABLE_DRM_AMDGPU
+   &mock_amdgpu_driver,
+#endif
+#ifdef ENABLE_DRM_MSM
+   &mock_msm_driver,
+#endif
+#ifdef ENABLE_DRM_I915
+   &mock_i915_driver,
+#endif
+#ifdef ENABLE_DRM_PANFROST
+   &mock_panfrost_driver,
+#endif
+#ifdef ENABLE_DRM_ASAHI
+   &mock_asahi_driver,
+#endif
+   NULL,
+};
+
+struct mock_drm_bo {
+   int fd;
+   ino_t ino;
+   uint64_t size;
+   int refcount;
+   struct mock_drm_bo *next;
+};
+
+struct mock_drm_file {
+   int fd;
+   ino_t ino;
+
+   /* Indexed by handle - 1. */
+   struct mock_drm_bo **bos;
+   uint32_t bo_count;
+
+   /* Fence fd of each syncobj, indexed by handle - 1. */
+   int *syncobjs;
+   uint32_t syncobj_count;
+
+   struct mock_drm_file *next;
+};
+
+static pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mock_drm_file *mock_files;
+static struct mock_drm_bo *mock_bos;
+
+static int (*real_ioctl)(int fd, unsigned long request, ...);
+static void *(*real_mmap)(void *addr, size_t len, int prot, int flags, int fd, off_t off);
+static int (*real_drmOpenWithType)(const char *name, const char *busid, int type);
+static int (*real_drmGetDevice2)(int fd, uint32_t flags, drmDevicePtr *device);
+static void (*real_drmFreeDevice)(drmDevicePtr *device);
+
+static void
+mock_drm_init_real(void)
+{
+   if (!real_ioctl)
+      real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+   if (!real_mmap)
+      real_mmap = dlsym(RTLD_NEXT, "mmap");
+   if (!real_drmOpenWithType)
+      real_drmOpenWithType = dlsym(RTLD_NEXT, "drmOpenWithType");
+   if (!real_drmGetDevice2)
+      real_drmGetDevice2 = dlsym(RTLD_NEXT, "drmGetDevice2");
+   if (!real_drmFreeDevice)
+      real_drmFreeDevice = dlsym(RTLD_NEXT, "drmFreeDevice");
+}
+
+const struct mock_drm_driver *
+mock_drm_get_driver(void)
+{
+   static const struct mock_drm_driver *driver;
+
+   if (driver)
+      return driver;
+
+   const char *name = getenv("MOCK_DRM_DRIVER");
+   if (!name)
+      name = "amdgpu";
+
+   for (unsigned i = 0; drivers[i]; i++) {
+      if (!strcmp(drivers[i]->name, name))
+         driver = drivers[i];
+   }
+
+   if (!driver)
+      fprintf(stderr, "mock_drm: unsupported driver %s\n", name);
+
+   return driver;
+}
+
+static ino_t
+mock_drm_fd_ino(int fd)
+{
+   struct stat st;
+
+   if (fd < 0 || fstat(fd, &st))
+      return 0;
+
+   return st.st_ino;
+}
+
+static struct mock_drm_file *
+mock_drm_file_lookup_locked(ino_t ino)
+{
+   for (struct mock_drm_file *file = mock_files; file; file = file->next) {
+      if (file->ino == ino)
+         return file;
+   }
+   return NULL;
+}
+
+struct mock_drm_file *
+mock_drm_file_lookup(int fd)
+{
+   ino_t ino = mock_drm_fd_ino(fd);
+   if (!ino)
+      return NULL;
+
+   pthread_mutex_lock(&mock_lock);
+   struct mock_drm_file *file = mock_drm_file_lookup_locked(ino);
+   pthread_mutex_unlock(&mock_lock);
+
+   return file;
+}
+
+int
+mock_drm_file_open(void)
+{
+   struct mock_drm_file *file = calloc(1, sizeof(*file));
+   if (!file)
+      return -1;
+
+   file->fd = memfd_create("mock-drm-render-node", MFD_CLOEXEC);
+   file->ino = mock_drm_fd_ino(file->fd);
+   if (!file->ino) {
+      if (file->fd >= 0)
+         close(file->fd);
+      free(file);
+      return -1;
+   }
+
+   pthread_mutex_lock(&mock_lock);
+   file->next = mock_files;
+   mock_files = file;
+   pthread_mutex_unlock(&mock_lock);
+
+   /* The memfd is kept by the mock, so that the inode outlives the
+    * caller's fds and is never reused by another file.
+    */
+   return fcntl(file->fd, F_DUPFD_CLOEXEC, 0);
+}
+
+static void
+mock_drm_bo_unref_locked(struct mock_drm_bo *bo)
+{
+   if (--bo->refcount)
+      return;
+
+   for (struct mock_drm_bo **p = &mock_bos; *p; p = &(*p)->next) {
+      if (*p == bo) {
+         *p = bo->next;
+         break;
+      }
+   }
+
+   close(bo->fd);
+   free(bo);
+}
+
+static uint32_t
+mock_drm_file_add_bo_locked(struct mock_drm_file *file, struct mock_drm_bo *bo)
+{
+   for (uint32_t i = 0; i < file->bo_count; i++) {
+      if (file->bos[i] == bo)
+         return i + 1;
+   }
+
+   for (uint32_t i = 0; i < file->bo_count; i++) {
+      if (!file->bos[i]) {
+         file->bos[i] = bo;
+         bo->refcount++;
+         return i + 1;
+      }
+   }
+
+   struct mock_drm_bo **bos = realloc(file->bos, (file->bo_count + 1) * sizeof(*bos));
+   if (!bos)
+      return 0;
+
+   file->bos = bos;
+   file->bos[file->bo_count++] = bo;
+   bo->refcount++;
+
+   return file->bo_count;
+}
+
+static struct mock_drm_bo *
+mock_drm_file_get_bo_locked(struct mock_drm_file *file, uint32_t handle)
+{
+   if (handle == 0 || handle > file->bo_count)
+      return NULL;
+
+   return file->bos[handle - 1];
+}
+
+uint32_t
+mock_drm_bo_create(struct mock_drm_file *file, uint64_t size)
+{
+   struct mock_drm_bo *bo = calloc(1, sizeof(*bo));
+   if (!bo)
+      return 0;
+
+   bo->fd = memfd_create("mock-drm-bo", MFD_CLOEXEC);
+   if (bo->fd < 0 || ftruncate(bo->fd, size)) {
+      if (bo->fd >= 0)
+         close(bo->fd);
+      free(bo);
+      return 0;
+   }
+   bo->ino = mock_drm_fd_ino(bo->fd);
+   bo->size = size;
+
+   pthread_mutex_lock(&mock_lock);
+   bo->next = mock_bos;
+   mock_bos = bo;
+   uint32_t handle = mock_drm_file_add_bo_locked(file, bo);
+   if (!handle) {
+      bo->refcount = 1;
+      mock_drm_bo_unref_locked(bo);
+   }
+   pthread_mutex_unlock(&mock_lock);
+
+   return handle;
+}
+
+bool
+mock_drm_bo_close(struct mock_drm_file *file, uint32_t handle)
+{
+   pthread_mutex_lock(&mock_lock);
+   struct mock_drm_bo *bo = mock_drm_file_get_bo_locked(file, handle);
+   if (bo) {
+      file->bos[handle - 1] = NULL;
+      mock_drm_bo_unref_locked(bo);
+   }
+   pthread_mutex_unlock(&mock_lock);
+
+   return bo != NULL;
+}
+
+bool
+mock_drm_bo_get_size(struct mock_drm_file *file, uint32_t handle, uint64_t *size)
+{
+   pthread_mutex_lock(&mock_lock);
+   struct mock_drm_bo *bo = mock_drm_file_get_bo_locked(file, handle);
+   if (bo)
+      *size = bo->size;
+   pthread_mutex_unlock(&mock_lock);
+
+   return bo != NULL;
+}
+
+uint64_t
+mock_drm_bo_mmap_offset(UNUSED struct mock_drm_file *file, uint32_t handle)
+{
+   return (uint64_t)handle << 32;
+}
+
+int
+mock_drm_bo_export(struct mock_drm_file *file, uint32_t handle)
+{
+   int fd = -1;
+
+   pthread_mutex_lock(&mock_lock);
+   struct mock_drm_bo *bo = mock_drm_file_get_bo_locked(file, handle);
+   if (bo)
+      fd = fcntl(bo->fd, F_DUPFD_CLOEXEC, 0);
+   pthread_mutex_unlock(&mock_lock);
+
+   return fd;
+}
+
+uint32_t
+mock_drm_bo_import(struct mock_drm_file *file, int fd)
+{
+   ino_t ino = mock_drm_fd_ino(fd);
+   uint32_t handle = 0;
+
+   pthread_mutex_lock(&mock_lock);
+   for (struct mock_drm_bo *bo = mock_bos; bo; bo = bo->next) {
+      if (bo->ino == ino) {
+         handle = mock_drm_file_add_bo_locked(file, bo);
+         break;
+      }
+   }
+   pthread_mutex_unlock(&mock_lock);
+
+   return handle;
+}
+
+static long
+mock_drm_fence_delay_us(void)
+{
+   static long delay_us = -1;
+
+   if (delay_us < 0) {
+      const char *delay = getenv("MOCK_DRM_FENCE_DELAY_US");
+      delay_us = delay ? MAX2(atol(delay), 0) : 0;
+   }
+
+   return delay_us;
+}
+
+static uint64_t
+mock_drm_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct sw_sync_create_fence_data {
+   uint32_t value;
+   char name[32];
+   int32_t fence;
+};
+
+#define SW_SYNC_IOC_CREATE_FENCE _IOWR('W', 0, struct sw_sync_create_fence_data)
+#define SW_SYNC_IOC_INC          _IOW('W', 1, uint32_t)
+
+#define MOCK_SW_SYNC_MAX_PENDING 1024
+
+/*
+ * With MOCK_DRM_FENCE=sw_sync, job fences are real sync_files on a single
+ * sw_sync timeline, so that sync_file merging and SYNC_IOC_FILE_INFO work
+ * on them.  Since every job takes the same time, fences signal in creation
+ * order, and one thread advances the timeline as their deadlines pass.
+ */
+static struct {
+   pthread_once_t once;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+   pthread_t thread;
+   int fd;
+
+   uint32_t seqno;
+   uint32_t signaled;
+   uint64_t deadlines[MOCK_SW_SYNC_MAX_PENDING];
+} mock_sw_sync = {
+   .once = PTHREAD_ONCE_INIT,
+   .lock = PTHREAD_MUTEX_INITIALIZER,
+   .cond = PTHREAD_COND_INITIALIZER,
+   .fd = -1,
+};
+
+static void *
+mock_sw_sync_thread(UNUSED void *arg)
+{
+   pthread_mutex_lock(&mock_sw_sync.lock);
+   while (true) {
+      while (mock_sw_sync.signaled == mock_sw_sync.seqno)
+         pthread_cond_wait(&mock_sw_sync.cond, &mock_sw_sync.lock);
+
+      uint64_t deadline =
+         mock_sw_sync.deadlines[(mock_sw_sync.signaled + 1) % MOCK_SW_SYNC_MAX_PENDING];
+      pthread_mutex_unlock(&mock_sw_sync.lock);
+
+      struct timespec ts = {
+         .tv_sec = deadline / 1000000000ull,
+         .tv_nsec = deadline % 1000000000ull,
+      };
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+         ;
+
+      uint32_t inc = 1;
+      real_ioctl(mock_sw_sync.fd, SW_SYNC_IOC_INC, &inc);
+
+      pthread_mutex_lock(&mock_sw_sync.lock);
+      mock_sw_sync.signaled++;
+      pthread_cond_broadcast(&mock_sw_sync.cond);
+   }
+
+   return NULL;
+}
+
+static void
+mock_sw_sync_init(void)
+{
+   const char *mode = getenv("MOCK_DRM_FENCE");
+
+   if (!mode || strcmp(mode, "sw_sync"))
+      return;
+
+   mock_drm_init_real();
+
+   int fd = open("/sys/kernel/debug/sync/sw_sync", O_RDWR | O_CLOEXEC);
+   if (fd < 0) {
+      fprintf(stderr, "mock_drm: sw_sync unavailable (%s), using eventfd fences\n",
+              strerror(errno));
+      return;
+   }
+
+   if (mock_drm_fence_delay_us() &&
+       pthread_create(&mock_sw_sync.thread, NULL, mock_sw_sync_thread, NULL)) {
+      fprintf(stderr, "mock_drm: failed to start the sw_sync thread\n");
+      close(fd);
+      return;
+   }
+
+   mock_sw_sync.fd = fd;
+}
+
+static int
+mock_sw_sync_fence_create(void)
+{
+   long delay_us = mock_drm_fence_delay_us();
+
+   pthread_mutex_lock(&mock_sw_sync.lock);
+
+   /* Throttle like a full ring would. */
+   while (mock_sw_sync.seqno - mock_sw_sync.signaled >= MOCK_SW_SYNC_MAX_PENDING)
+      pthread_cond_wait(&mock_sw_sync.cond, &mock_sw_sync.lock);
+
+   struct sw_sync_create_fence_data data = {
+      .value = mock_sw_sync.seqno + 1,
+      .name = "mock-drm-job",
+   };
+   if (real_ioctl(mock_sw_sync.fd, SW_SYNC_IOC_CREATE_FENCE, &data)) {
+      pthread_mutex_unlock(&mock_sw_sync.lock);
+      return -1;
+   }
+
+   mock_sw_sync.seqno++;
+   if (delay_us) {
+      mock_sw_sync.deadlines[mock_sw_sync.seqno % MOCK_SW_SYNC_MAX_PENDING] =
+         mock_drm_now_ns() + delay_us * 1000;
+      pthread_cond_broadcast(&mock_sw_sync.cond);
+   } else {
+      uint32_t inc = 1;
+      real_ioctl(mock_sw_sync.fd, SW_SYNC_IOC_INC, &inc);
+      mock_sw_sync.signaled++;
+   }
+
+   pthread_mutex_unlock(&mock_sw_sync.lock);
+
+   return data.fence;
+}
+
+int
+mock_drm_fence_create(void)
+{
+   long delay_us = mock_drm_fence_delay_us();
+
+   pthread_once(&mock_sw_sync.once, mock_sw_sync_init);
+   if (mock_sw_sync.fd >= 0)
+      return mock_sw_sync_fence_create();
+
+   if (!delay_us)
+      return eventfd(1, EFD_CLOEXEC);
+
+   /* A timerfd is readable, and thus polls as signaled, once it expired. */
+   int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+   if (fd < 0)
+      return -1;
+
+   struct itimerspec its = {
+      .it_value = {
+         .tv_sec = delay_us / 1000000,
+         .tv_nsec = (delay_us % 1000000) * 1000,
+      },
+   };
+   if (timerfd_settime(fd, 0, &its, NULL)) {
+      close(fd);
+      return -1;
+   }
+
+   return fd;
+}
+
+static int *
+mock_drm_file_get_syncobj_locked(struct mock_drm_file *file, uint32_t handle)
+{
+   if (handle == 0 || handle > file->syncobj_count)
+      return NULL;
+
+   int *fence = &file->syncobjs[handle - 1];
+   return *fence == -2 ? NULL : fence;
+}
+
+bool
+mock_drm_syncobj_signal_later(struct mock_drm_file *file, uint32_t handle)
+{
+   int fd = mock_drm_fence_create();
+   if (fd < 0)
+      return false;
+
+   pthread_mutex_lock(&mock_lock);
+   int *fence = mock_drm_file_get_syncobj_locked(file, handle);
+   if (fence) {
+      if (*fence >= 0)
+         close(*fence);
+      *fence = fd;
+   }
+   pthread_mutex_unlock(&mock_lock);
+
+   if (!fence)
+      close(fd);
+
+   return fence != NULL;
+}
+
+static int
+mock_drm_syncobj_create(struct mock_drm_file *file, struct drm_syncobj_create *args)
+{
+   int fd = -1;
+
+   if (args->flags & DRM_SYNCOBJ_CREATE_SIGNALED) {
+      fd = eventfd(1, EFD_CLOEXEC);
+      if (fd < 0)
+         return -errno;
+   }
+
+   pthread_mutex_lock(&mock_lock);
+   uint32_t i;
+   /* -2 marks a free slot, -1 a syncobj without fence. */
+   for (i = 0; i < file->syncobj_count; i++) {
+      if (file->syncobjs[i] == -2)
+         break;
+   }
+   if (i == file->syncobj_count) {
+      int *syncobjs = realloc(file->syncobjs, (i + 1) * sizeof(*syncobjs));
+      if (!syncobjs) {
+         pthread_mutex_unlock(&mock_lock);
+         if (fd >= 0)
+            close(fd);
+         return -ENOMEM;
+      }
+      file->syncobjs = syncobjs;
+      file->syncobj_count++;
+   }
+   file->syncobjs[i] = fd;
+   args->handle = i + 1;
+   pthread_mutex_unlock(&mock_lock);
+
+   return 0;
+}
+
+static int
+mock_drm_syncobj_destroy(struct mock_drm_file *file, struct drm_syncobj_destroy *args)
+{
+   pthread_mutex_lock(&mock_lock);
+   int *fence = mock_drm_file_get_syncobj_locked(file, args->handle);
+   if (fence) {
+      if (*fence >= 0)
+         close(*fence);
+      *fence = -2;
+   }
+   pthread_mutex_unlock(&mock_lock);
+
+   return fence ? 0 : -EINVAL;
+}
+
+static int
+mock_drm_syncobj_handle_to_fd(struct mock_drm_file *file, struct drm_syncobj_handle *args)
+{
+   if (args->flags != DRM_SYNCOBJ_HANDLE_TO_FD_FLAGS_EXPORT_SYNC_FILE)
+      return -EINVAL;
+
+   pthread_mutex_lock(&mock_lock);
+   int *fence = mock_drm_file_get_syncobj_locked(file, args->handle);
+   int fd = -1;
+   if (fence) {
+      /* Like the kernel, a syncobj without fence exports a signaled stub. */
+      fd = *fence >= 0 ? fcntl(*fence, F_DUPFD_CLOEXEC, 0) : eventfd(1, EFD_CLOEXEC);
+   }
+   pthread_mutex_unlock(&mock_lock);
+
+   if (!fence)
+      return -EINVAL;
+   if (fd < 0)
+      return -errno;
+
+   args->fd = fd;
+   return 0;
+}
+
+static int
+mock_drm_syncobj_fd_to_handle(struct mock_drm_file *file, struct drm_syncobj_handle *args)
+{
+   if (args->flags != DRM_SYNCOBJ_FD_TO_HANDLE_FLAGS_IMPORT_SYNC_FILE)
+      return -EINVAL;
+
+   int fd = fcntl(args->fd, F_DUPFD_CLOEXEC, 0);
+   if (fd < 0)
+      return -errno;
+
+   pthread_mutex_lock(&mock_lock);
+   int *fence = mock_drm_file_get_syncobj_locked(file, args->handle);
+   if (fence) {
+      if (*fence >= 0)
+         close(*fence);
+      *fence = fd;
+   }
+   pthread_mutex_unlock(&mock_lock);
+
+   if (!fence) {
+      close(fd);
+      return -EINVAL;
+   }
+
+   return 0;
+}
+
+static void
+mock_drm_copy_string(char *dst, __kernel_size_t *len, const char *src)
+{
+   size_t src_len = strlen(src);
+
+   if (dst && *len)
+      memcpy(dst, src, MIN2(*len, src_len));
+   *len = src_len;
+}
+
+static int
+mock_drm_ioctl(struct mock_drm_file *file, unsigned long request, void *arg)
+{
+   const struct mock_drm_driver *driver = mock_drm_get_driver();
+
+   if (!driver)
+      return -ENODEV;
+
+   switch (request) {
+   case DRM_IOCTL_VERSION: {
+      struct drm_version *v = arg;
+      v->version_major = driver->version_major;
+      v->version_minor = driver->version_minor;
+      v->version_patchlevel = driver->version_patchlevel;
+      mock_drm_copy_string(v->name, &v->name_len, driver->name);
+      mock_drm_copy_string(v->date, &v->date_len, "0");
+      mock_drm_copy_string(v->desc, &v->desc_len, "virglrenderer mock drm device");
+      return 0;
+   }
+   case DRM_IOCTL_SET_CLIENT_NAME:
+      return 0;
+   case DRM_IOCTL_GEM_CLOSE: {
+      struct drm_gem_close *args = arg;
+      return mock_drm_bo_close(file, args->handle) ? 0 : -EINVAL;
+   }
+   case DRM_IOCTL_PRIME_HANDLE_TO_FD: {
+      struct drm_prime_handle *args = arg;
+      args->fd = mock_drm_bo_export(file, args->handle);
+      return args->fd >= 0 ? 0 : -EINVAL;
+   }
+   case DRM_IOCTL_PRIME_FD_TO_HANDLE: {
+      struct drm_prime_handle *args = arg;
+      args->handle = mock_drm_bo_import(file, args->fd);
+      return args->handle ? 0 : -EINVAL;
+   }
+   case DRM_IOCTL_SYNCOBJ_CREATE:
+      return mock_drm_syncobj_create(file, arg);
+   case DRM_IOCTL_SYNCOBJ_DESTROY:
+      return mock_drm_syncobj_destroy(file, arg);
+   case DRM_IOCTL_SYNCOBJ_HANDLE_TO_FD:
+      return mock_drm_syncobj_handle_to_fd(file, arg);
+   case DRM_IOCTL_SYNCOBJ_FD_TO_HANDLE:
+      return mock_drm_syncobj_fd_to_handle(file, arg);
+   default:
+      break;
+   }
+
+   if (driver->ioctl)
+      return driver->ioctl(file, request, arg);
+
+   return -EINVAL;
+}
+
+static bool
+mock_drm_fd_is_bo(int fd)
+{
+   ino_t ino = mock_drm_fd_ino(fd);
+   bool found = false;
+
+   if (!ino)
+      return false;
+
+   pthread_mutex_lock(&mock_lock);
+   for (struct mock_drm_bo *bo = mock_bos; bo && !found; bo = bo->next)
+      found = bo->ino == ino;
+   pthread_mutex_unlock(&mock_lock);
+
+   return found;
+}
+
+/* Implicit sync on exported objects: there is never an outstanding job. */
+static int
+mock_drm_dma_buf_ioctl(unsigned long request, void *arg)
+{
+   switch (request) {
+   case DMA_BUF_IOCTL_EXPORT_SYNC_FILE: {
+      struct dma_buf_export_sync_file *args = arg;
+      args->fd = eventfd(1, EFD_CLOEXEC);
+      return args->fd >= 0 ? 0 : -errno;
+   }
+   case DMA_BUF_IOCTL_IMPORT_SYNC_FILE:
+   case DMA_BUF_IOCTL_SYNC:
+      return 0;
+   default:
+      return -ENOTTY;
+   }
+}
+
+MOCK_DRM_EXPORT int
+ioctl(int fd, unsigned long request, ...)
+{
+   va_list va;
+   va_start(va, request);
+   void *arg = va_arg(va, void *);
+   va_end(va);
+
+   mock_drm_init_real();
+
+   int ret;
+   struct mock_drm_file *file = mock_drm_file_lookup(fd);
+   if (file)
+      ret = mock_drm_ioctl(file, request, arg);
+   else if (_IOC_TYPE(request) == DMA_BUF_BASE && mock_drm_fd_is_bo(fd))
+      ret = mock_drm_dma_buf_ioctl(request, arg);
+   else
+      return real_ioctl(fd, request, arg);
+
+   if (ret < 0) {
+      errno = -ret;
+      return -1;
+   }
+
+   return 0;
+}
+
+MOCK_DRM_EXPORT void *
+mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off)
+{
+   mock_drm_init_real();
+
+   if (fd < 0 || (flags & MAP_ANONYMOUS))
+      return real_mmap(addr, len, prot, flags, fd, off);
+
+   struct mock_drm_file *file = mock_drm_file_lookup(fd);
+   if (!file)
+      return real_mmap(addr, len, prot, flags, fd, off);
+
+   pthread_mutex_lock(&mock_lock);
+   struct mock_drm_bo *bo = mock_drm_file_get_bo_locked(file, (uint64_t)off >> 32);
+   int bo_fd = bo ? fcntl(bo->fd, F_DUPFD_CLOEXEC, 0) : -1;
+   pthread_mutex_unlock(&mock_lock);
+
+   if (bo_fd < 0) {
+      errno = EINVAL;
+      return MAP_FAILED;
+   }
+
+   void *map = real_mmap(addr, len, prot, flags, bo_fd, off & 0xffffffff);
+   close(bo_fd);
+
+   return map;
+}
+
+MOCK_DRM_EXPORT int
+drmOpenWithType(const char *name, const char *busid, int type)
+{
+   const struct mock_drm_driver *driver = mock_drm_get_driver();
+
+   mock_drm_init_real();
+
+   if (driver && name && !strcmp(name, driver->name))
+      return mock_drm_file_open();
+
+   return real_drmOpenWithType ? real_drmOpenWithType(name, busid, type) : -1;
+}
+
+static drmPciBusInfo mock_bus_info;
+static drmPciDeviceInfo mock_device_info;
+static drmDevice mock_device = {
+   .bustype = DRM_BUS_PCI,
+   .businfo.pci = &mock_bus_info,
+   .deviceinfo.pci = &mock_device_info,
+};
+
+MOCK_DRM_EXPORT int
+drmGetDevice2(int fd, uint32_t flags, drmDevicePtr *device)
+{
+   mock_drm_init_real();
+
+   if (!mock_drm_file_lookup(fd))
+      return real_drmGetDevice2 ? real_drmGetDevice2(fd, flags, device) : -ENODEV;
+
+   const struct mock_drm_driver *driver = mock_drm_get_driver();
+   if (!driver || !driver->pci_vendor_id)
+      return -ENODEV;
+
+   /* A fixed slot, the fake node is the only device. */
+   mock_bus_info = (drmPciBusInfo){ .bus = 1 };
+   mock_device_info = (drmPciDeviceInfo){
+      .vendor_id = driver->pci_vendor_id,
+      .device_id = driver->pci_device_id,
+      .revision_id = driver->pci_revision_id,
+   };
+   *device = &mock_device;
+
+   return 0;
+}
+
+MOCK_DRM_EXPORT void
+drmFreeDevice(drmDevicePtr *device)
+{
+   mock_drm_init_real();
+
+   if (device && *device == &mock_device) {
+      *device = NULL;
+      return;
+   }
+
+   if (real_drmFreeDevice)
+      real_drmFreeDevice(device);
+}
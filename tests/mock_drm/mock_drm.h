@@ -0,0 +1,94 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef MOCK_DRM_H_
+#define MOCK_DRM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Fake DRM render node, meant to be LD_PRELOADed into a process using the
+ * drm native context backends.  Each open of the fake node is a memfd, and
+ * each GEM object is backed by its own memfd, so that mmap and dma-buf
+ * export/import behave like on real hardware.  The libc ioctl() and mmap()
+ * entry points are interposed for those fds only, everything else is
+ * forwarded to the real implementation.
+ *
+ * The emulated driver is selected with MOCK_DRM_DRIVER (default "amdgpu").
+ * Job fences signal MOCK_DRM_FENCE_DELAY_US microseconds after submission
+ * (default 0).  They are eventfds or timerfds, unless MOCK_DRM_FENCE=sw_sync
+ * selects real sync_files from the sw_sync debugfs interface.
+ */
+
+/* Interposed entry points must be visible despite -fvisibility=hidden. */
+#define MOCK_DRM_EXPORT __attribute__((visibility("default")))
+
+struct mock_drm_file;
+
+struct mock_drm_driver {
+   const char *name;
+   int version_major;
+   int version_minor;
+   int version_patchlevel;
+
+   /* Reported by drmGetDevice2(), for drivers that probe the PCI id. */
+   uint16_t pci_vendor_id;
+   uint16_t pci_device_id;
+   uint8_t pci_revision_id;
+
+   /* Driver specific ioctls, returns 0 or -errno. */
+   int (*ioctl)(struct mock_drm_file *file, unsigned long request, void *arg);
+};
+
+const struct mock_drm_driver *
+mock_drm_get_driver(void);
+
+/* Returns the mock file backing fd, or NULL if fd is not a fake node. */
+struct mock_drm_file *
+mock_drm_file_lookup(int fd);
+
+int
+mock_drm_file_open(void);
+
+/* GEM objects, handles are per-file like with a real drm_file. */
+uint32_t
+mock_drm_bo_create(struct mock_drm_file *file, uint64_t size);
+
+bool
+mock_drm_bo_close(struct mock_drm_file *file, uint32_t handle);
+
+bool
+mock_drm_bo_get_size(struct mock_drm_file *file, uint32_t handle, uint64_t *size);
+
+/* Fake mmap offset of the object, to be used with the node fd. */
+uint64_t
+mock_drm_bo_mmap_offset(struct mock_drm_file *file, uint32_t handle);
+
+int
+mock_drm_bo_export(struct mock_drm_file *file, uint32_t handle);
+
+uint32_t
+mock_drm_bo_import(struct mock_drm_file *file, int fd);
+
+/* Returns a pollable fd that becomes readable once the emulated job
+ * completes.
+ */
+int
+mock_drm_fence_create(void);
+
+/* Attaches a new job fence to a syncobj, like a submit with an out
+ * syncobj would.
+ */
+bool
+mock_drm_syncobj_signal_later(struct mock_drm_file *file, uint32_t handle);
+
+/* For tests linking the mock directly: the number of BOs in the list of
+ * the last successful amdgpu submit.
+ */
+MOCK_DRM_EXPORT uint32_t
+mock_amdgpu_last_submit_bo_count(void);
+
+#endif /* MOCK_DRM_H_ */
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include <xf86drm.h>
+
+#include "i915_drm.h"
+#include "util/macros.h"
+#include "util/u_atomic.h"
+
+#include "mock_drm.h"
+
+/*
+ * Emulates a Tiger Lake GT2 without local memory.  Queries the mock does
+ * not know about fail per item, like on an older kernel.
+ */
+
+#define MOCK_I915_DEVICE_ID 0x9a49
+#define MOCK_I915_REVISION  0x01
+
+/* RING_TIMESTAMP of the render engine, read by the guest for queries. */
+#define MOCK_I915_RENDER_RING_TIMESTAMP 0x2358
+
+static uint32_t mock_i915_next_ctx_id;
+static uint32_t mock_i915_next_vm_id;
+
+static int
+mock_i915_getparam(struct drm_i915_getparam *args)
+{
+   switch (args->param) {
+   case I915_PARAM_CHIPSET_ID:
+      *args->value = MOCK_I915_DEVICE_ID;
+      return 0;
+   case I915_PARAM_REVISION:
+      *args->value = MOCK_I915_REVISION;
+      return 0;
+   case I915_PARAM_CS_TIMESTAMP_FREQUENCY:
+      *args->value = 19200000;
+      return 0;
+   case I915_PARAM_MMAP_VERSION:
+   case I915_PARAM_MMAP_GTT_VERSION:
+      *args->value = 4;
+      return 0;
+   case I915_PARAM_HAS_EXEC_SOFTPIN:
+   case I915_PARAM_HAS_EXEC_FENCE:
+   case I915_PARAM_HAS_EXEC_FENCE_ARRAY:
+   case I915_PARAM_HAS_CONTEXT_ISOLATION:
+   case I915_PARAM_HAS_EXEC_TIMELINE_FENCES:
+      *args->value = 1;
+      return 0;
+   default:
+      return -EINVAL;
+   }
+}
+
+static int
+mock_i915_query(struct drm_i915_query *args)
+{
+   struct drm_i915_query_item *items = (void *)(uintptr_t)args->items_ptr;
+
+   for (uint32_t i = 0; i < args->num_items; i++)
+      items[i].length = -EINVAL;
+
+   return 0;
+}
+
+static int
+mock_i915_execbuffer(struct mock_drm_file *file, struct drm_i915_gem_execbuffer2 *args)
+{
+   const struct drm_i915_gem_exec_object2 *objs = (void *)(uintptr_t)args->buffers_ptr;
+   uint64_t size;
+
+   for (uint32_t i = 0; i < args->buffer_count; i++) {
+      if (!mock_drm_bo_get_size(file, objs[i].handle, &size))
+         return -ENOENT;
+   }
+
+   if (args->flags & I915_EXEC_FENCE_OUT) {
+      int fd = mock_drm_fence_create();
+      if (fd < 0)
+         return -ENOMEM;
+      args->rsvd2 = (args->rsvd2 & 0xffffffff) | ((uint64_t)fd << 32);
+   }
+
+   return 0;
+}
+
+static int
+mock_i915_check_bo(struct mock_drm_file *file, uint32_t handle)
+{
+   uint64_t size;
+   return mock_drm_bo_get_size(file, handle, &size) ? 0 : -ENOENT;
+}
+
+static int
+mock_i915_ioctl(struct mock_drm_file *file, unsigned long request, void *arg)
+{
+   switch (request) {
+   case DRM_IOCTL_I915_GETPARAM:
+      return mock_i915_getparam(arg);
+   case DRM_IOCTL_I915_QUERY:
+      return mock_i915_query(arg);
+   case DRM_IOCTL_I915_GEM_CREATE: {
+      struct drm_i915_gem_create *args = arg;
+      args->handle = mock_drm_bo_create(file, args->size);
+      return args->handle ? 0 : -ENOMEM;
+   }
+   case DRM_IOCTL_I915_GEM_CREATE_EXT: {
+      struct drm_i915_gem_create_ext *args = arg;
+      args->handle = mock_drm_bo_create(file, args->size);
+      return args->handle ? 0 : -ENOMEM;
+   }
+   case DRM_IOCTL_I915_GEM_CONTEXT_CREATE:
+   case DRM_IOCTL_I915_GEM_CONTEXT_CREATE_EXT: {
+      /* ctx_id is at the same offset in both structs. */
+      struct drm_i915_gem_context_create *args = arg;
+      args->ctx_id = p_atomic_inc_return(&mock_i915_next_ctx_id);
+      return 0;
+   }
+   case DRM_IOCTL_I915_GEM_CONTEXT_DESTROY:
+   case DRM_IOCTL_I915_GEM_CONTEXT_SETPARAM:
+   case DRM_IOCTL_I915_GEM_VM_DESTROY:
+      return 0;
+   case DRM_IOCTL_I915_GEM_CONTEXT_GETPARAM: {
+      struct drm_i915_gem_context_param *args = arg;
+      args->value = args->param == I915_CONTEXT_PARAM_GTT_SIZE ? 1ull << 47 : 0;
+      return 0;
+   }
+   case DRM_IOCTL_I915_GEM_VM_CREATE: {
+      struct drm_i915_gem_vm_control *args = arg;
+      args->vm_id = p_atomic_inc_return(&mock_i915_next_vm_id);
+      return 0;
+   }
+   case DRM_IOCTL_I915_GEM_EXECBUFFER2_WR:
+      return mock_i915_execbuffer(file, arg);
+   case DRM_IOCTL_I915_GEM_BUSY: {
+      struct drm_i915_gem_busy *args = arg;
+      args->busy = 0;
+      return mock_i915_check_bo(file, args->handle);
+   }
+   case DRM_IOCTL_I915_GEM_SET_TILING: {
+      struct drm_i915_gem_set_tiling *args = arg;
+      args->swizzle_mode = I915_BIT_6_SWIZZLE_NONE;
+      return mock_i915_check_bo(file, args->handle);
+   }
+   case DRM_IOCTL_I915_GEM_GET_TILING: {
+      struct drm_i915_gem_get_tiling *args = arg;
+      args->tiling_mode = I915_TILING_NONE;
+      args->swizzle_mode = I915_BIT_6_SWIZZLE_NONE;
+      args->phys_swizzle_mode = I915_BIT_6_SWIZZLE_NONE;
+      return mock_i915_check_bo(file, args->handle);
+   }
+   case DRM_IOCTL_I915_GEM_SET_DOMAIN: {
+      const struct drm_i915_gem_set_domain *args = arg;
+      return mock_i915_check_bo(file, args->handle);
+   }
+   case DRM_IOCTL_I915_GEM_GET_APERTURE: {
+      struct drm_i915_gem_get_aperture *args = arg;
+      args->aper_size = 4ull << 30;
+      args->aper_available_size = args->aper_size;
+      return 0;
+   }
+   case DRM_IOCTL_I915_REG_READ: {
+      struct drm_i915_reg_read *args = arg;
+      if ((args->offset & ~1ull) != MOCK_I915_RENDER_RING_TIMESTAMP)
+         return -EINVAL;
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      args->val = ((uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec) * 192 / 10000;
+      return 0;
+   }
+   case DRM_IOCTL_I915_GET_RESET_STATS: {
+      struct drm_i915_reset_stats *args = arg;
+      args->reset_count = 0;
+      args->batch_active = 0;
+      args->batch_pending = 0;
+      return 0;
+   }
+   default:
+      return -EINVAL;
+   }
+}
+
+const struct mock_drm_driver mock_i915_driver = {
+   .name = "i915",
+   .version_major = 1,
+   .version_minor = 6,
+   .version_patchlevel = 0,
+   .pci_vendor_id = 0x8086,
+   .pci_device_id = MOCK_I915_DEVICE_ID,
+   .pci_revision_id = MOCK_I915_REVISION,
+   .ioctl = mock_i915_ioctl,
+};
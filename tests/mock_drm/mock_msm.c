@@ -0,0 +1,163 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+#include <xf86drm.h>
+
+#include "msm_drm.h"
+#include "util/macros.h"
+#include "util/u_atomic.h"
+
+#include "mock_drm.h"
+
+/*
+ * Emulates an a660 with three submitqueue priorities.  Jobs complete after
+ * the mock fence delay, and waits never block.
+ */
+
+#define MOCK_MSM_PRIORITIES 3
+#define MOCK_MSM_VA_START   0x100000000ull
+#define MOCK_MSM_VA_SIZE    0x100000000ull
+
+static uint32_t mock_msm_next_queue_id;
+
+static int
+mock_msm_get_param(struct drm_msm_param *args)
+{
+   switch (args->param) {
+   case MSM_PARAM_GPU_ID:
+      args->value = 660;
+      return 0;
+   case MSM_PARAM_GMEM_SIZE:
+      args->value = 1024 * 1024;
+      return 0;
+   case MSM_PARAM_CHIP_ID:
+      args->value = 0x06060001;
+      return 0;
+   case MSM_PARAM_MAX_FREQ:
+      args->value = 840000000;
+      return 0;
+   case MSM_PARAM_PRIORITIES:
+      args->value = MOCK_MSM_PRIORITIES;
+      return 0;
+   case MSM_PARAM_VA_START:
+      args->value = MOCK_MSM_VA_START;
+      return 0;
+   case MSM_PARAM_VA_SIZE:
+      args->value = MOCK_MSM_VA_SIZE;
+      return 0;
+   case MSM_PARAM_HIGHEST_BANK_BIT:
+      args->value = 16;
+      return 0;
+   case MSM_PARAM_GMEM_BASE:
+   case MSM_PARAM_FAULTS:
+   case MSM_PARAM_SUSPENDS:
+   case MSM_PARAM_TIMESTAMP:
+      args->value = 0;
+      return 0;
+   default:
+      return -EINVAL;
+   }
+}
+
+static int
+mock_msm_gem_info(struct mock_drm_file *file, struct drm_msm_gem_info *args)
+{
+   uint64_t size;
+
+   if (!mock_drm_bo_get_size(file, args->handle, &size))
+      return -ENOENT;
+
+   switch (args->info) {
+   case MSM_INFO_GET_OFFSET:
+      args->value = mock_drm_bo_mmap_offset(file, args->handle);
+      return 0;
+   case MSM_INFO_SET_IOVA:
+   case MSM_INFO_SET_NAME:
+      return 0;
+   default:
+      return -EINVAL;
+   }
+}
+
+static int
+mock_msm_gem_submit(struct mock_drm_file *file, struct drm_msm_gem_submit *args)
+{
+   const struct drm_msm_gem_submit_bo *bos = (void *)(uintptr_t)args->bos;
+   uint64_t size;
+
+   for (uint32_t i = 0; i < args->nr_bos; i++) {
+      if (!mock_drm_bo_get_size(file, bos[i].handle, &size))
+         return -EINVAL;
+   }
+
+   if (args->flags & MSM_SUBMIT_FENCE_FD_OUT) {
+      args->fence_fd = mock_drm_fence_create();
+      if (args->fence_fd < 0)
+         return -ENOMEM;
+   }
+
+   return 0;
+}
+
+static int
+mock_msm_ioctl(struct mock_drm_file *file, unsigned long request, void *arg)
+{
+   switch (_IOC_NR(request) - DRM_COMMAND_BASE) {
+   case DRM_MSM_GET_PARAM:
+      return mock_msm_get_param(arg);
+   case DRM_MSM_SET_PARAM:
+      return 0;
+   case DRM_MSM_GEM_NEW: {
+      struct drm_msm_gem_new *args = arg;
+      args->handle = mock_drm_bo_create(file, args->size);
+      return args->handle ? 0 : -ENOMEM;
+   }
+   case DRM_MSM_GEM_INFO:
+      return mock_msm_gem_info(file, arg);
+   case DRM_MSM_GEM_CPU_PREP: {
+      const struct drm_msm_gem_cpu_prep *args = arg;
+      uint64_t size;
+      return mock_drm_bo_get_size(file, args->handle, &size) ? 0 : -ENOENT;
+   }
+   case DRM_MSM_GEM_SUBMIT:
+      return mock_msm_gem_submit(file, arg);
+   case DRM_MSM_WAIT_FENCE:
+      return 0;
+   case DRM_MSM_SUBMITQUEUE_NEW: {
+      struct drm_msm_submitqueue *args = arg;
+      if (args->prio >= MOCK_MSM_PRIORITIES)
+         return -EINVAL;
+      args->id = p_atomic_inc_return(&mock_msm_next_queue_id);
+      return 0;
+   }
+   case DRM_MSM_SUBMITQUEUE_CLOSE:
+      return 0;
+   case DRM_MSM_SUBMITQUEUE_QUERY: {
+      struct drm_msm_submitqueue_query *args = arg;
+      if (args->param != MSM_SUBMITQUEUE_PARAM_FAULTS)
+         return -EINVAL;
+      if (args->len >= sizeof(uint32_t) && args->data)
+         memset((void *)(uintptr_t)args->data, 0, sizeof(uint32_t));
+      args->len = sizeof(uint32_t);
+      return 0;
+   }
+   default:
+      return -EINVAL;
+   }
+}
+
+const struct mock_drm_driver mock_msm_driver = {
+   .name = "msm",
+   .version_major = 1,
+   .version_minor = 12,
+   .version_patchlevel = 0,
+   .ioctl = mock_msm_ioctl,
+};
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include <xf86drm.h>
+
+#include "panfrost_drm.h"
+#include "util/macros.h"
+#include "util/u_atomic.h"
+
+#include "mock_drm.h"
+
+/*
+ * Emulates a Mali-G52 with two shader cores.  GPU VAs are handed out by a
+ * bump allocator and never reused, and jobs signal the out syncobj after
+ * the mock fence delay.
+ */
+
+#define MOCK_PANFROST_VA_START 0x1000000ull
+
+static uint64_t mock_panfrost_next_va = MOCK_PANFROST_VA_START;
+
+static int
+mock_panfrost_get_param(struct drm_panfrost_get_param *args)
+{
+   switch (args->param) {
+   case DRM_PANFROST_PARAM_GPU_PROD_ID:
+      args->value = 0x7402;
+      return 0;
+   case DRM_PANFROST_PARAM_SHADER_PRESENT:
+      args->value = 0x3;
+      return 0;
+   case DRM_PANFROST_PARAM_TILER_PRESENT:
+   case DRM_PANFROST_PARAM_L2_PRESENT:
+   case DRM_PANFROST_PARAM_AS_PRESENT:
+      args->value = 0x1;
+      return 0;
+   case DRM_PANFROST_PARAM_JS_PRESENT:
+      args->value = 0x7;
+      return 0;
+   case DRM_PANFROST_PARAM_THREAD_TLS_ALLOC:
+      args->value = 256;
+      return 0;
+   case DRM_PANFROST_PARAM_NR_CORE_GROUPS:
+      args->value = 1;
+      return 0;
+   case DRM_PANFROST_PARAM_SYSTEM_TIMESTAMP: {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      args->value = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+      return 0;
+   }
+   case DRM_PANFROST_PARAM_SYSTEM_TIMESTAMP_FREQUENCY:
+      args->value = 1000000000ull;
+      return 0;
+   default:
+      if (args->param > DRM_PANFROST_PARAM_ALLOWED_JM_CTX_PRIORITIES)
+         return -EINVAL;
+      /* Feature registers the mock does not model read as zero. */
+      args->value = 0;
+      return 0;
+   }
+}
+
+static int
+mock_panfrost_submit(struct mock_drm_file *file, struct drm_panfrost_submit *args)
+{
+   const uint32_t *handles = (void *)(uintptr_t)args->bo_handles;
+   uint64_t size;
+
+   if (!args->jc)
+      return -EINVAL;
+
+   for (uint32_t i = 0; i < args->bo_handle_count; i++) {
+      if (!mock_drm_bo_get_size(file, handles[i], &size))
+         return -ENOENT;
+   }
+
+   if (args->out_sync && !mock_drm_syncobj_signal_later(file, args->out_sync))
+      return -ENODEV;
+
+   return 0;
+}
+
+static int
+mock_panfrost_create_bo(struct mock_drm_file *file, struct drm_panfrost_create_bo *args)
+{
+   if (!args->size)
+      return -EINVAL;
+
+   args->handle = mock_drm_bo_create(file, args->size);
+   if (!args->handle)
+      return -ENOMEM;
+
+   args->offset =
+      p_atomic_add_return(&mock_panfrost_next_va, ALIGN_POT(args->size, 4096)) -
+      ALIGN_POT(args->size, 4096);
+
+   return 0;
+}
+
+static int
+mock_panfrost_ioctl(struct mock_drm_file *file, unsigned long request, void *arg)
+{
+   uint64_t size;
+
+   switch (_IOC_NR(request) - DRM_COMMAND_BASE) {
+   case DRM_PANFROST_SUBMIT:
+      return mock_panfrost_submit(file, arg);
+   case DRM_PANFROST_WAIT_BO: {
+      const struct drm_panfrost_wait_bo *args = arg;
+      return mock_drm_bo_get_size(file, args->handle, &size) ? 0 : -ENOENT;
+   }
+   case DRM_PANFROST_CREATE_BO:
+      return mock_panfrost_create_bo(file, arg);
+   case DRM_PANFROST_MMAP_BO: {
+      struct drm_panfrost_mmap_bo *args = arg;
+      if (!mock_drm_bo_get_size(file, args->handle, &size))
+         return -ENOENT;
+      args->offset = mock_drm_bo_mmap_offset(file, args->handle);
+      return 0;
+   }
+   case DRM_PANFROST_GET_PARAM:
+      return mock_panfrost_get_param(arg);
+   case DRM_PANFROST_GET_BO_OFFSET: {
+      /* Not tracked per BO, only the guest needs the real VA. */
+      struct drm_panfrost_get_bo_offset *args = arg;
+      if (!mock_drm_bo_get_size(file, args->handle, &size))
+         return -ENOENT;
+      args->offset = MOCK_PANFROST_VA_START;
+      return 0;
+   }
+   case DRM_PANFROST_MADVISE: {
+      struct drm_panfrost_madvise *args = arg;
+      if (!mock_drm_bo_get_size(file, args->handle, &size))
+         return -ENOENT;
+      args->retained = 1;
+      return 0;
+   }
+   default:
+      return -EINVAL;
+   }
+}
+
+const struct mock_drm_driver mock_panfrost_driver = {
+   .name = "panfrost",
+   .version_major = 1,
+   .version_minor = 2,
+   .version_patchlevel = 0,
+   .ioctl = mock_panfrost_ioctl,
+};
@@ -0,0 +1,259 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * AMDGPU_CCMD_BO_LIST tests, on top of the mock amdgpu device.  The mock
+ * reports the size of the BO list it was last submitted with.
+ */
+
+#include "config.h"
+
+#include <check.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/macros.h"
+#include "virglrenderer.h"
+#include "virtgpu_drm.h"
+
+#include "drm_bench.h"
+#include "mock_drm.h"
+#include "amdgpu_virtio_proto.h"
+
+#define NUM_BOS 8
+
+struct submit_desc {
+   uint16_t chunk_id;
+   uint16_t length_dw;
+   uint32_t offset;
+};
+
+static struct drm_bench bench;
+static uint32_t res_ids[NUM_BOS];
+static uint32_t amdgpu_ctx_id;
+
+static int
+rsp_ret(void)
+{
+   const struct amdgpu_ccmd_rsp *rsp = drm_bench_rsp(&bench, 0);
+   return rsp->ret;
+}
+
+static void
+setup(void)
+{
+   ck_assert_int_eq(drm_bench_init(&bench, "test_amdgpu_bo_list"), 0);
+
+   for (uint32_t i = 0; i < NUM_BOS; i++) {
+      struct amdgpu_ccmd_gem_new_req req = {
+         .hdr = AMDGPU_CCMD(GEM_NEW, sizeof(req)),
+         .blob_id = i + 1,
+         .r = {
+            .alloc_size = 4096,
+            .phys_alignment = 4096,
+            .preferred_heap = AMDGPU_GEM_DOMAIN_GTT,
+         },
+      };
+      ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+
+      res_ids[i] = drm_bench_create_blob(&bench, req.blob_id, req.r.alloc_size);
+      ck_assert_uint_ne(res_ids[i], 0);
+   }
+
+   struct amdgpu_ccmd_create_ctx_req req = {
+      .hdr = AMDGPU_CCMD(CREATE_CTX, sizeof(req)),
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+   ck_assert_int_eq(rsp_ret(), 0);
+
+   const struct amdgpu_ccmd_create_ctx_rsp *rsp = drm_bench_rsp(&bench, 0);
+   amdgpu_ctx_id = rsp->ctx_id;
+}
+
+static void
+teardown(void)
+{
+   drm_bench_fini(&bench);
+}
+
+/* Sends a BO_LIST with count entries of res_ids[first...] to add, and
+ * the res_ids in remove.  A failed command is not answered, so only the
+ * partial failures are reported through the response.
+ */
+static int
+bo_list(uint32_t list_id, uint32_t op, uint32_t first, uint32_t count,
+        const uint32_t *remove, uint32_t num_remove)
+{
+   size_t size = sizeof(struct amdgpu_ccmd_bo_list_req) +
+                 count * sizeof(struct drm_amdgpu_bo_list_entry) +
+                 ALIGN_POT(num_remove * sizeof(uint32_t), 8);
+   struct amdgpu_ccmd_bo_list_req *req = calloc(1, size);
+
+   req->hdr = AMDGPU_CCMD(BO_LIST, size);
+   req->list_id = list_id;
+   req->op = op;
+   req->num_add = count;
+   req->num_remove = num_remove;
+
+   struct drm_amdgpu_bo_list_entry *add = (void *)req->payload;
+   for (uint32_t i = 0; i < count; i++)
+      add[i].bo_handle = res_ids[first + i];
+   memcpy(&add[count], remove, num_remove * sizeof(uint32_t));
+
+   int ret = drm_bench_submit(&bench, req, size);
+   free(req);
+
+   return ret ? ret : rsp_ret();
+}
+
+static int
+submit_list(uint32_t list_id)
+{
+   struct {
+      struct amdgpu_ccmd_cs_submit_req req;
+      struct submit_desc desc;
+      struct amdgpu_ccmd_cs_bo_list_chunk chunk;
+   } submit = {
+      .req = {
+         .hdr = AMDGPU_CCMD(CS_SUBMIT, sizeof(submit)),
+         .ctx_id = amdgpu_ctx_id,
+         .num_chunks = 1,
+         .ring_idx = 1,
+      },
+      .desc = {
+         .chunk_id = AMDGPU_CCMD_CHUNK_ID_BO_LIST,
+         .length_dw = sizeof(submit.chunk) / 4,
+      },
+      .chunk = {
+         .list_id = list_id,
+      },
+   };
+
+   return drm_bench_submit(&bench, &submit, sizeof(submit));
+}
+
+START_TEST(amdgpu_bo_list_cap)
+{
+   struct virgl_renderer_capset_drm caps;
+   uint32_t max_version, max_size;
+
+   virgl_renderer_get_cap_set(VIRTGPU_DRM_CAPSET_DRM, &max_version, &max_size);
+   ck_assert_uint_eq(max_size, sizeof(caps));
+
+   memset(&caps, 0, sizeof(caps));
+   virgl_renderer_fill_caps(VIRTGPU_DRM_CAPSET_DRM, 0, &caps);
+   ck_assert_uint_eq(caps.context_type, VIRTGPU_DRM_CONTEXT_AMDGPU);
+   ck_assert_uint_eq(caps.u.amdgpu.has_bo_list, 1);
+}
+END_TEST
+
+START_TEST(amdgpu_bo_list_create_submit)
+{
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_CREATE, 0, NUM_BOS, NULL, 0), 0);
+   ck_assert_int_eq(submit_list(1), 0);
+   ck_assert_uint_eq(mock_amdgpu_last_submit_bo_count(), NUM_BOS);
+
+   /* a second list is independent of the first */
+   ck_assert_int_eq(bo_list(2, AMDGPU_CCMD_BO_LIST_OP_CREATE, 0, 2, NULL, 0), 0);
+   ck_assert_int_eq(submit_list(2), 0);
+   ck_assert_uint_eq(mock_amdgpu_last_submit_bo_count(), 2);
+   ck_assert_int_eq(submit_list(1), 0);
+   ck_assert_uint_eq(mock_amdgpu_last_submit_bo_count(), NUM_BOS);
+
+   /* list ids are not reusable until destroyed, and 0 is not valid */
+   ck_assert_int_ne(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_CREATE, 0, 1, NULL, 0), 0);
+   ck_assert_int_ne(bo_list(0, AMDGPU_CCMD_BO_LIST_OP_CREATE, 0, 1, NULL, 0), 0);
+}
+END_TEST
+
+START_TEST(amdgpu_bo_list_update)
+{
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_CREATE, 0, 4, NULL, 0), 0);
+
+   /* swap res_ids[0] for res_ids[4] */
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_UPDATE, 4, 1, &res_ids[0], 1), 0);
+   ck_assert_int_eq(submit_list(1), 0);
+   ck_assert_uint_eq(mock_amdgpu_last_submit_bo_count(), 4);
+
+   /* re-adding an entry updates it in place */
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_UPDATE, 1, 3, NULL, 0), 0);
+   ck_assert_int_eq(submit_list(1), 0);
+   ck_assert_uint_eq(mock_amdgpu_last_submit_bo_count(), 4);
+
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_UPDATE, 0, 0, &res_ids[1], 2), 0);
+   ck_assert_int_eq(submit_list(1), 0);
+   ck_assert_uint_eq(mock_amdgpu_last_submit_bo_count(), 2);
+
+   /* unknown lists cannot be updated */
+   ck_assert_int_ne(bo_list(2, AMDGPU_CCMD_BO_LIST_OP_UPDATE, 0, 1, NULL, 0), 0);
+}
+END_TEST
+
+START_TEST(amdgpu_bo_list_destroy)
+{
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_CREATE, 0, NUM_BOS, NULL, 0), 0);
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_DESTROY, 0, 0, NULL, 0), 0);
+   ck_assert_int_ne(submit_list(1), 0);
+   ck_assert_int_ne(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_DESTROY, 0, 0, NULL, 0), 0);
+
+   /* the id is free again */
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_CREATE, 0, 1, NULL, 0), 0);
+   ck_assert_int_eq(submit_list(1), 0);
+   ck_assert_uint_eq(mock_amdgpu_last_submit_bo_count(), 1);
+}
+END_TEST
+
+START_TEST(amdgpu_bo_list_stale_entry)
+{
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_CREATE, 0, NUM_BOS, NULL, 0), 0);
+
+   /* a freed BO still in the list fails the submit instead of being dropped */
+   virgl_renderer_resource_unref(res_ids[NUM_BOS - 1]);
+   ck_assert_int_ne(submit_list(1), 0);
+
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_UPDATE, 0, 0,
+                            &res_ids[NUM_BOS - 1], 1), 0);
+   ck_assert_int_eq(submit_list(1), 0);
+   ck_assert_uint_eq(mock_amdgpu_last_submit_bo_count(), NUM_BOS - 1);
+
+   /* so does an unknown res_id, which the update reports */
+   uint32_t saved = res_ids[0];
+   res_ids[0] = 0xdead;
+   ck_assert_int_eq(bo_list(1, AMDGPU_CCMD_BO_LIST_OP_UPDATE, 0, 1, NULL, 0), -EINVAL);
+   res_ids[0] = saved;
+   ck_assert_int_ne(submit_list(1), 0);
+}
+END_TEST
+
+static Suite *
+amdgpu_bo_list_suite(void)
+{
+   Suite *s = suite_create("amdgpu_bo_list");
+   TCase *tc_core = tcase_create("bo_list");
+
+   tcase_add_checked_fixture(tc_core, setup, teardown);
+   tcase_add_test(tc_core, amdgpu_bo_list_cap);
+   tcase_add_test(tc_core, amdgpu_bo_list_create_submit);
+   tcase_add_test(tc_core, amdgpu_bo_list_update);
+   tcase_add_test(tc_core, amdgpu_bo_list_destroy);
+   tcase_add_test(tc_core, amdgpu_bo_list_stale_entry);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
+
+int
+main(void)
+{
+   Suite *s = amdgpu_bo_list_suite();
+   SRunner *sr = srunner_create(s);
+
+   srunner_run_all(sr, CK_NORMAL);
+   int number_failed = srunner_ntests_failed(sr);
+   srunner_free(sr);
+
+   return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,352 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Records a small workload with VIRGL_DRM_TRACE on whichever mock device
+ * MOCK_DRM_DRIVER selects, checks what the context recorded, and replays
+ * the trace on a fresh context.
+ */
+
+#include "config.h"
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/macros.h"
+#include "virglrenderer.h"
+#include "virtgpu_drm.h"
+
+#include "drm_bench.h"
+#include "drm_trace_replay.h"
+
+#ifdef ENABLE_DRM_AMDGPU
+#  include "amdgpu_virtio_proto.h"
+#endif
+#ifdef ENABLE_DRM_MSM
+#  include "msm_drm.h"
+#  include "msm_proto.h"
+#endif
+#ifdef ENABLE_DRM_I915
+#  include "i915_drm.h"
+#  include "i915_proto.h"
+#endif
+#ifdef ENABLE_DRM_PANFROST
+#  include "panfrost_drm.h"
+#  include "panfrost_proto.h"
+#endif
+#ifdef ENABLE_DRM_ASAHI
+#  include "asahi_drm.h"
+#  include "asahi_proto.h"
+#endif
+
+#define BO_SIZE 4096
+
+static struct drm_bench bench;
+
+/* Driver specific ccmds: alloc() creates the GEM object for blob_id, and
+ * query() sends one that neither allocates nor fails.
+ */
+struct trace_workload {
+   uint32_t context_type;
+   void (*alloc)(uint32_t blob_id);
+   void (*query)(void);
+};
+
+#ifdef ENABLE_DRM_AMDGPU
+static void
+amdgpu_alloc(uint32_t blob_id)
+{
+   struct amdgpu_ccmd_gem_new_req req = {
+      .hdr = AMDGPU_CCMD(GEM_NEW, sizeof(req)),
+      .blob_id = blob_id,
+      .r = {
+         .alloc_size = BO_SIZE,
+         .phys_alignment = 4096,
+         .preferred_heap = AMDGPU_GEM_DOMAIN_GTT,
+      },
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+}
+
+static void
+amdgpu_query(void)
+{
+   struct amdgpu_ccmd_create_ctx_req req = {
+      .hdr = AMDGPU_CCMD(CREATE_CTX, sizeof(req)),
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+}
+#endif
+
+#ifdef ENABLE_DRM_MSM
+static void
+msm_alloc(uint32_t blob_id)
+{
+   struct msm_ccmd_gem_new_req req = {
+      .hdr = MSM_CCMD(GEM_NEW, sizeof(req)),
+      .iova = 0x100000000ull + blob_id * BO_SIZE,
+      .size = BO_SIZE,
+      .flags = MSM_BO_WC,
+      .blob_id = blob_id,
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+}
+
+static void
+msm_query(void)
+{
+   struct {
+      struct msm_ccmd_ioctl_simple_req req;
+      struct drm_msm_submitqueue args;
+   } sq_new = {
+      .req = {
+         .hdr = MSM_CCMD(IOCTL_SIMPLE, sizeof(sq_new)),
+         .cmd = DRM_IOCTL_MSM_SUBMITQUEUE_NEW,
+      },
+      .args = {
+         .prio = 1,
+      },
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &sq_new, sizeof(sq_new)), 0);
+}
+#endif
+
+#ifdef ENABLE_DRM_I915
+static void
+i915_alloc(uint32_t blob_id)
+{
+   struct i915_ccmd_gem_create_req req = {
+      .hdr = I915_CCMD(GEM_CREATE, sizeof(req)),
+      .size = BO_SIZE,
+      .blob_id = blob_id,
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+}
+
+static void
+i915_query(void)
+{
+   struct i915_ccmd_getparam_req req = {
+      .hdr = I915_CCMD(GETPARAM, sizeof(req)),
+      .param = I915_PARAM_CHIPSET_ID,
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+}
+#endif
+
+#ifdef ENABLE_DRM_PANFROST
+static void
+panfrost_alloc(uint32_t blob_id)
+{
+   struct panfrost_ccmd_create_bo_req req = {
+      .hdr = { .cmd = PANFROST_CCMD_CREATE_BO, .len = sizeof(req) },
+      .size = BO_SIZE,
+      .blob_id = blob_id,
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+}
+
+static void
+panfrost_query(void)
+{
+   struct panfrost_ccmd_get_param_req req = {
+      .hdr = { .cmd = PANFROST_CCMD_GET_PARAM, .len = sizeof(req) },
+      .param = DRM_PANFROST_PARAM_GPU_PROD_ID,
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+}
+#endif
+
+#ifdef ENABLE_DRM_ASAHI
+static void
+asahi_alloc(uint32_t blob_id)
+{
+   struct asahi_ccmd_gem_new_req req = {
+      .hdr = ASAHI_CCMD(GEM_NEW, sizeof(req)),
+      .blob_id = blob_id,
+      .size = BO_SIZE,
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+}
+
+static void
+asahi_query(void)
+{
+   struct asahi_ccmd_nop_req req = {
+      .hdr = ASAHI_CCMD(NOP, sizeof(req)),
+   };
+   ck_assert_int_eq(drm_bench_submit(&bench, &req, sizeof(req)), 0);
+}
+#endif
+
+static const struct trace_workload workloads[] = {
+#ifdef ENABLE_DRM_AMDGPU
+   { VIRTGPU_DRM_CONTEXT_AMDGPU, amdgpu_alloc, amdgpu_query },
+#endif
+#ifdef ENABLE_DRM_MSM
+   { VIRTGPU_DRM_CONTEXT_MSM, msm_alloc, msm_query },
+#endif
+#ifdef ENABLE_DRM_I915
+   { VIRTGPU_DRM_CONTEXT_I915, i915_alloc, i915_query },
+#endif
+#ifdef ENABLE_DRM_PANFROST
+   { VIRTGPU_DRM_CONTEXT_PANFROST, panfrost_alloc, panfrost_query },
+#endif
+#ifdef ENABLE_DRM_ASAHI
+   { VIRTGPU_DRM_CONTEXT_ASAHI, asahi_alloc, asahi_query },
+#endif
+};
+
+static const struct trace_workload *
+get_workload(uint32_t *context_type)
+{
+   struct virgl_renderer_capset_drm caps;
+
+   memset(&caps, 0, sizeof(caps));
+   virgl_renderer_fill_caps(VIRTGPU_DRM_CAPSET_DRM, 0, &caps);
+   *context_type = caps.context_type;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(workloads); i++) {
+      if (workloads[i].context_type == caps.context_type)
+         return &workloads[i];
+   }
+
+   return NULL;
+}
+
+/* Returns the index of the first record of type for res_id, or -1. */
+static int
+find_record(const struct drm_trace_file *trace, uint32_t type, uint32_t res_id)
+{
+   for (uint32_t i = 0; i < trace->record_count; i++) {
+      const struct drm_trace_replay_record *record = &trace->records[i];
+
+      if (record->type != type)
+         continue;
+      if (type == DRM_TRACE_CREATE_BLOB &&
+          ((const struct drm_trace_create_blob *)record->data)->res_id == res_id)
+         return i;
+      if (type == DRM_TRACE_DETACH_RESOURCE &&
+          ((const struct drm_trace_detach_resource *)record->data)->res_id == res_id)
+         return i;
+   }
+
+   return -1;
+}
+
+START_TEST(drm_trace_capture_replay)
+{
+   char dir[] = "/tmp/test_drm_trace.XXXXXX";
+   char prefix[64], path[128];
+
+   ck_assert_ptr_nonnull(mkdtemp(dir));
+   snprintf(prefix, sizeof(prefix), "%s/trace", dir);
+   snprintf(path, sizeof(path), "%s.%d.0", prefix, (int)getpid());
+
+   /* capture */
+   setenv("VIRGL_DRM_TRACE", prefix, 1);
+   ck_assert_int_eq(drm_bench_init(&bench, "test_drm_trace"), 0);
+
+   uint32_t context_type;
+   const struct trace_workload *w = get_workload(&context_type);
+   ck_assert_ptr_nonnull(w);
+
+   uint32_t res_ids[3];
+   w->alloc(1);
+   res_ids[0] = drm_bench_create_blob(&bench, 1, BO_SIZE);
+   w->alloc(2);
+   res_ids[1] = drm_bench_create_blob(&bench, 2, BO_SIZE);
+   w->query();
+
+   /* res_ids[0] is released in the middle of the trace */
+   virgl_renderer_resource_unref(res_ids[0]);
+   w->alloc(3);
+   res_ids[2] = drm_bench_create_blob(&bench, 3, BO_SIZE);
+   w->query();
+
+   /* and failed submits are recorded as such */
+   struct vdrm_ccmd_req bad = {
+      .cmd = 0xffff,
+      .len = sizeof(bad),
+   };
+   ck_assert_int_ne(drm_bench_submit(&bench, &bad, sizeof(bad)), 0);
+
+   uint32_t shmem_res_id = bench.shmem_res_id;
+   drm_bench_fini(&bench);
+   unsetenv("VIRGL_DRM_TRACE");
+
+   /* check what was recorded */
+   struct drm_trace_file trace;
+   ck_assert_int_eq(drm_trace_load(&trace, path), 0);
+   ck_assert_uint_eq(trace.header.context_type, context_type);
+   ck_assert_str_eq(trace.header.name, "test_drm_trace");
+
+   /* the shmem blob comes first, under the res_id it was created with */
+   ck_assert_int_eq(find_record(&trace, DRM_TRACE_CREATE_BLOB, shmem_res_id), 0);
+   ck_assert_uint_eq(((const struct drm_trace_create_blob *)trace.records[0].data)->blob_id, 0);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(res_ids); i++) {
+      int index = find_record(&trace, DRM_TRACE_CREATE_BLOB, res_ids[i]);
+      ck_assert_int_ge(index, 0);
+      const struct drm_trace_create_blob *blob = trace.records[index].data;
+      ck_assert_uint_eq(blob->blob_id, i + 1);
+      ck_assert_uint_eq(blob->size, BO_SIZE);
+      ck_assert_uint_eq(blob->blob_flags, VIRGL_RENDERER_BLOB_FLAG_USE_MAPPABLE);
+   }
+
+   /* the release comes before the blob created after it */
+   int detach = find_record(&trace, DRM_TRACE_DETACH_RESOURCE, res_ids[0]);
+   ck_assert_int_ge(detach, 0);
+   ck_assert_int_lt(detach, find_record(&trace, DRM_TRACE_CREATE_BLOB, res_ids[2]));
+
+   uint32_t submits = 0, failed = 0;
+   for (uint32_t i = 0; i < trace.record_count; i++) {
+      if (trace.records[i].type != DRM_TRACE_SUBMIT_CMD)
+         continue;
+      const struct drm_trace_submit_cmd *submit = trace.records[i].data;
+      submits++;
+      failed += submit->ret != 0;
+   }
+   ck_assert_uint_eq(submits, 6);
+   ck_assert_uint_eq(failed, 1);
+
+   /* replay */
+   ck_assert_int_eq(drm_bench_init_context(&bench, trace.header.name), 0);
+   ck_assert_int_eq(drm_trace_replay(&bench, &trace, 0, trace.record_count), 0);
+   drm_bench_fini(&bench);
+
+   drm_trace_free(&trace);
+   unlink(path);
+   rmdir(dir);
+}
+END_TEST
+
+static Suite *
+drm_trace_suite(void)
+{
+   Suite *s = suite_create("drm_trace");
+   TCase *tc_core = tcase_create("trace");
+
+   tcase_add_test(tc_core, drm_trace_capture_replay);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
+
+int
+main(void)
+{
+   Suite *s = drm_trace_suite();
+   SRunner *sr = srunner_create(s);
+
+   srunner_run_all(sr, CK_NORMAL);
+   int number_failed = srunner_ntests_failed(sr);
+   srunner_free(sr);
+
+   return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,391 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Translates a corpus of TGSI shaders to GLSL without a GL context and
+ * reports the time spent, the GLSL produced and the allocations made by the
+ * conversion, per shader stage.  The time spent parsing the TGSI text is
+ * compared to the time spent validating the same shader sent as binary
+ * tokens, see VIRGL_OBJ_SHADER_TYPE_BINARY.  Every <name>.tgsi in the given directories
+ * is translated with the key and cfg from <name>.key when there is one, see
+ * vrend_shader_corpus.h, and with a zeroed key and a desktop GL 3.3 core cfg
+ * otherwise.
+ *
+ * A corpus of the shaders an application really uses can be dumped by
+ * running it with VREND_DEBUG=tgsi and VREND_SHADER_CORPUS_DIR set.
+ *
+ * Exits with an error when a shader fails to translate, so running it on a
+ * corpus once doubles as a test.
+ */
+
+#include <dirent.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pipe/p_shader_tokens.h"
+#include "tgsi/tgsi_parse.h"
+#include "tgsi/tgsi_text.h"
+#include "util/macros.h"
+#include "vrend_shader.h"
+#include "vrend_shader_corpus.h"
+#include "vrend_tgsi_validate.h"
+
+#ifdef BENCH_COUNT_ALLOCS
+/* linked with --wrap=malloc,--wrap=calloc,--wrap=realloc */
+static uint64_t bench_alloc_count;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+void *
+__wrap_malloc(size_t size)
+{
+   bench_alloc_count++;
+   return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t nmemb, size_t size)
+{
+   bench_alloc_count++;
+   return __real_calloc(nmemb, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+   bench_alloc_count++;
+   return __real_realloc(ptr, size);
+}
+#endif
+
+struct bench_stage_stats {
+   uint32_t shader_count;
+   uint64_t translate_ns;
+   uint64_t validate_ns;
+   uint64_t convert_ns;
+   uint64_t glsl_bytes;
+   uint64_t alloc_count;
+};
+
+struct bench_state {
+   uint32_t iterations;
+   uint32_t failure_count;
+   /* indexed by TGSI_PROCESSOR_* */
+   struct bench_stage_stats stages[TGSI_PROCESSOR_COMPUTE + 1];
+};
+
+static const char *const bench_stage_names[TGSI_PROCESSOR_COMPUTE + 1] = {
+   [TGSI_PROCESSOR_VERTEX] = "vertex",
+   [TGSI_PROCESSOR_FRAGMENT] = "fragment",
+   [TGSI_PROCESSOR_GEOMETRY] = "geometry",
+   [TGSI_PROCESSOR_TESS_CTRL] = "tess_ctrl",
+   [TGSI_PROCESSOR_TESS_EVAL] = "tess_eval",
+   [TGSI_PROCESSOR_COMPUTE] = "compute",
+};
+
+static const enum pipe_shader_type bench_pipe_types[TGSI_PROCESSOR_COMPUTE + 1] = {
+   [TGSI_PROCESSOR_VERTEX] = PIPE_SHADER_VERTEX,
+   [TGSI_PROCESSOR_FRAGMENT] = PIPE_SHADER_FRAGMENT,
+   [TGSI_PROCESSOR_GEOMETRY] = PIPE_SHADER_GEOMETRY,
+   [TGSI_PROCESSOR_TESS_CTRL] = PIPE_SHADER_TESS_CTRL,
+   [TGSI_PROCESSOR_TESS_EVAL] = PIPE_SHADER_TESS_EVAL,
+   [TGSI_PROCESSOR_COMPUTE] = PIPE_SHADER_COMPUTE,
+};
+
+static uint64_t
+bench_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t
+bench_alloc_count_get(void)
+{
+#ifdef BENCH_COUNT_ALLOCS
+   return bench_alloc_count;
+#else
+   return 0;
+#endif
+}
+
+static char *
+bench_read_file(const char *path)
+{
+   FILE *fp = fopen(path, "rb");
+   if (!fp)
+      return NULL;
+
+   char *buf = NULL;
+   long size;
+   if (!fseek(fp, 0, SEEK_END) && (size = ftell(fp)) >= 0 && !fseek(fp, 0, SEEK_SET)) {
+      buf = malloc(size + 1);
+      if (buf && fread(buf, 1, size, fp) == (size_t)size) {
+         buf[size] = '\0';
+      } else {
+         free(buf);
+         buf = NULL;
+      }
+   }
+
+   fclose(fp);
+   return buf;
+}
+
+static void
+bench_default_key(struct vrend_shader_corpus_key *key)
+{
+   memset(key, 0, sizeof(*key));
+
+   key->cfg.glsl_version = 330;
+   key->cfg.max_draw_buffers = 8;
+   key->cfg.max_shader_patch_varyings = 30;
+   key->cfg.use_core_profile = 1;
+   key->cfg.use_explicit_locations = 1;
+   key->cfg.use_integer = 1;
+   key->cfg.has_dual_src_blend = 1;
+   key->cfg.max_stage_uniform_blocks = 12;
+}
+
+static void
+bench_sinfo_fini(struct vrend_shader_info *sinfo)
+{
+   if (sinfo->so_names)
+      for (uint32_t i = 0; i < sinfo->so_info.num_outputs; i++)
+         free(sinfo->so_names[i]);
+   free(sinfo->so_names);
+   free(sinfo->sampler_arrays);
+   free(sinfo->image_arrays);
+}
+
+static bool
+bench_shader(struct bench_state *state, const char *dir, const char *name)
+{
+   struct vrend_shader_corpus_key key;
+   char path[4096];
+
+   snprintf(path, sizeof(path), "%s/%s", dir, name);
+   char *text = bench_read_file(path);
+   if (!text) {
+      fprintf(stderr, "%s: failed to read\n", path);
+      return false;
+   }
+
+   /* <name>.tgsi -> <name>.key */
+   snprintf(path + strlen(path) - strlen("tgsi"), strlen("key") + 1, "key");
+   if (!vrend_shader_corpus_load_key(path, &key))
+      bench_default_key(&key);
+   path[strlen(path) - strlen("key")] = '\0';
+
+   /* a token is never shorter than a character of text */
+   const size_t max_tokens = strlen(text) + 64;
+   struct tgsi_token *tokens = malloc(max_tokens * sizeof(*tokens));
+   if (!tokens) {
+      free(text);
+      return false;
+   }
+
+   bool ok = true;
+   for (uint32_t iter = 0; iter < state->iterations && ok; iter++) {
+      struct vrend_shader_info sinfo = { 0 };
+      struct vrend_variable_shader_info var_sinfo = { 0 };
+      struct vrend_strarray glsl;
+
+      const uint64_t begin = bench_now_ns();
+
+      if (!tgsi_text_translate(text, tokens, max_tokens)) {
+         fprintf(stderr, "%stgsi: failed to parse\n", path);
+         ok = false;
+         break;
+      }
+
+      const uint64_t translated = bench_now_ns();
+
+      struct tgsi_parse_context parse;
+      tgsi_parse_init(&parse, tokens);
+      const unsigned stage = parse.FullHeader.Processor.Processor;
+      tgsi_parse_free(&parse);
+
+      if (stage > TGSI_PROCESSOR_COMPUTE) {
+         fprintf(stderr, "%stgsi: invalid processor\n", path);
+         ok = false;
+         break;
+      }
+
+      /* what the host does instead of parsing when sent the tokens */
+      const uint64_t validate_begin = bench_now_ns();
+      if (!vrend_tgsi_validate_tokens(tokens, tgsi_num_tokens(tokens), bench_pipe_types[stage])) {
+         fprintf(stderr, "%stgsi: failed to validate tokens\n", path);
+         ok = false;
+         break;
+      }
+      const uint64_t validated = bench_now_ns();
+
+      const uint64_t alloc_begin = bench_alloc_count_get();
+
+      ok = strarray_alloc(&glsl, SHADER_MAX_STRINGS) &&
+           vrend_convert_shader(NULL, &key.cfg, tokens, key.req_local_mem, &key.key,
+                                &sinfo, &var_sinfo, &glsl);
+
+      const uint64_t converted = bench_now_ns();
+      const uint64_t alloc_end = bench_alloc_count_get();
+
+      if (ok) {
+         struct bench_stage_stats *stats = &state->stages[stage];
+         if (!iter)
+            stats->shader_count++;
+         stats->translate_ns += translated - begin;
+         stats->validate_ns += validated - validate_begin;
+         stats->convert_ns += converted - validated;
+         stats->alloc_count += alloc_end - alloc_begin;
+         for (int i = 0; i < glsl.num_strings; i++)
+            stats->glsl_bytes += glsl.strings[i].size;
+      } else {
+         fprintf(stderr, "%stgsi: failed to convert\n", path);
+      }
+
+      strarray_free(&glsl, true);
+      bench_sinfo_fini(&sinfo);
+   }
+
+   free(tokens);
+   free(text);
+
+   return ok;
+}
+
+static int
+bench_filter(const struct dirent *dirent)
+{
+   const size_t len = strlen(dirent->d_name);
+   return len > strlen(".tgsi") && !strcmp(dirent->d_name + len - strlen(".tgsi"), ".tgsi");
+}
+
+static bool
+bench_dir(struct bench_state *state, const char *dir)
+{
+   struct dirent **dirents;
+
+   /* sorted, so that runs on the same corpus are comparable */
+   const int count = scandir(dir, &dirents, bench_filter, alphasort);
+   if (count < 0) {
+      fprintf(stderr, "%s: failed to scan\n", dir);
+      return false;
+   }
+
+   for (int i = 0; i < count; i++) {
+      if (!bench_shader(state, dir, dirents[i]->d_name))
+         state->failure_count++;
+      free(dirents[i]);
+   }
+   free(dirents);
+
+   return true;
+}
+
+static void
+bench_report(const struct bench_state *state)
+{
+   struct bench_stage_stats total = { 0 };
+
+   printf("%-10s %8s %14s %14s %14s %14s %14s\n", "stage", "shaders", "parse us/sh",
+          "validate us/sh", "convert us/sh", "glsl B/sh", "allocs/sh");
+
+   /* in pipeline order */
+   static const unsigned stage_order[] = {
+      TGSI_PROCESSOR_VERTEX,    TGSI_PROCESSOR_TESS_CTRL, TGSI_PROCESSOR_TESS_EVAL,
+      TGSI_PROCESSOR_GEOMETRY,  TGSI_PROCESSOR_FRAGMENT,  TGSI_PROCESSOR_COMPUTE,
+   };
+
+   for (unsigned i = 0; i < ARRAY_SIZE(stage_order); i++) {
+      const unsigned stage = stage_order[i];
+      const struct bench_stage_stats *stats = &state->stages[stage];
+      if (!stats->shader_count)
+         continue;
+
+      const double runs = (double)stats->shader_count * state->iterations;
+      printf("%-10s %8u %14.2f %14.2f %14.2f %14.0f %14.1f\n", bench_stage_names[stage],
+             stats->shader_count, stats->translate_ns / runs / 1000.0,
+             stats->validate_ns / runs / 1000.0, stats->convert_ns / runs / 1000.0,
+             stats->glsl_bytes / runs, stats->alloc_count / runs);
+
+      total.shader_count += stats->shader_count;
+      total.translate_ns += stats->translate_ns;
+      total.validate_ns += stats->validate_ns;
+      total.convert_ns += stats->convert_ns;
+      total.glsl_bytes += stats->glsl_bytes;
+      total.alloc_count += stats->alloc_count;
+   }
+
+   if (!total.shader_count)
+      return;
+
+   const double runs = (double)total.shader_count * state->iterations;
+   printf("%-10s %8u %14.2f %14.2f %14.2f %14.0f %14.1f\n", "total", total.shader_count,
+          total.translate_ns / runs / 1000.0, total.validate_ns / runs / 1000.0,
+          total.convert_ns / runs / 1000.0, total.glsl_bytes / runs,
+          total.alloc_count / runs);
+
+#ifndef BENCH_COUNT_ALLOCS
+   printf("(allocations are not counted in this build)\n");
+#endif
+}
+
+static void
+usage(const char *prog)
+{
+   fprintf(stderr, "usage: %s [-n iterations] corpus_dir...\n", prog);
+}
+
+int
+main(int argc, char **argv)
+{
+   struct bench_state state = {
+      .iterations = 100,
+   };
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:")) != -1) {
+      switch (opt) {
+      case 'n':
+         state.iterations = strtoul(optarg, NULL, 0);
+         break;
+      default:
+         usage(argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (optind >= argc || !state.iterations) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   for (int i = optind; i < argc; i++) {
+      if (!bench_dir(&state, argv[i]))
+         return EXIT_FAILURE;
+   }
+
+   bench_report(&state);
+
+   if (state.failure_count) {
+      fprintf(stderr, "%u shaders failed\n", state.failure_count);
+      return EXIT_FAILURE;
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,326 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * drm_timeline tests.  sw_sync stands in for hardware fences when debugfs
+ * is available, otherwise each fence is an eventfd that the test writes to.
+ */
+
+#include <check.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+
+#include "virgl_context.h"
+#include "virgl_fence.h"
+#include "drm/drm_fence.h"
+#include "util/macros.h"
+#include "util/u_atomic.h"
+
+struct sw_sync_create_fence_data {
+   uint32_t value;
+   char name[32];
+   int32_t fence;
+};
+
+#define SW_SYNC_IOC_CREATE_FENCE _IOWR('W', 0, struct sw_sync_create_fence_data)
+#define SW_SYNC_IOC_INC          _IOW('W', 1, uint32_t)
+
+#define MAX_FENCES 64
+
+/* A source of fences that signal in order. */
+struct test_timeline {
+   int sw_sync_fd;
+   uint32_t seqno;
+   uint32_t signaled;
+   int eventfds[MAX_FENCES];
+};
+
+static void
+test_timeline_init(struct test_timeline *tl)
+{
+   memset(tl, 0, sizeof(*tl));
+   tl->sw_sync_fd = open("/sys/kernel/debug/sync/sw_sync", O_RDWR | O_CLOEXEC);
+}
+
+static void
+test_timeline_fini(struct test_timeline *tl)
+{
+   if (tl->sw_sync_fd >= 0)
+      close(tl->sw_sync_fd);
+   for (uint32_t i = 0; i < tl->seqno; i++)
+      close(tl->eventfds[i]);
+}
+
+/* Returns a new fence fd, owned by the caller. */
+static int
+test_timeline_create_fence(struct test_timeline *tl)
+{
+   ck_assert_int_lt(tl->seqno, MAX_FENCES);
+   uint32_t seqno = ++tl->seqno;
+
+   if (tl->sw_sync_fd >= 0) {
+      struct sw_sync_create_fence_data data = {
+         .value = seqno,
+         .name = "test",
+      };
+      ck_assert_int_eq(ioctl(tl->sw_sync_fd, SW_SYNC_IOC_CREATE_FENCE, &data), 0);
+      return data.fence;
+   }
+
+   int fd = eventfd(0, EFD_CLOEXEC);
+   ck_assert_int_ge(fd, 0);
+   tl->eventfds[seqno - 1] = fd;
+   return dup(fd);
+}
+
+static void
+test_timeline_signal(struct test_timeline *tl, uint32_t seqno)
+{
+   if (tl->sw_sync_fd >= 0) {
+      uint32_t inc = seqno - tl->signaled;
+      ck_assert_int_eq(ioctl(tl->sw_sync_fd, SW_SYNC_IOC_INC, &inc), 0);
+   } else {
+      uint64_t val = 1;
+      for (uint32_t i = tl->signaled; i < seqno; i++)
+         ck_assert_int_eq(write(tl->eventfds[i], &val, sizeof(val)), sizeof(val));
+   }
+   tl->signaled = seqno;
+}
+
+static uint32_t retired_count[4];
+static uint64_t last_retired[4];
+static bool out_of_order;
+
+static void
+test_fence_retire(UNUSED struct virgl_context *vctx, uint32_t ring_idx, uint64_t fence_id)
+{
+   if (fence_id <= last_retired[ring_idx])
+      out_of_order = true;
+   last_retired[ring_idx] = fence_id;
+   p_atomic_inc(&retired_count[ring_idx]);
+}
+
+static struct drm_timeline *fini_on_retire;
+static bool fini_on_retire_done;
+
+/* Tears down fini_on_retire from the waiter thread, like a context
+ * destroyed by its own fence callback.
+ */
+static void
+test_fence_retire_fini(struct virgl_context *vctx, uint32_t ring_idx, uint64_t fence_id)
+{
+   test_fence_retire(vctx, ring_idx, fence_id);
+
+   if (fini_on_retire) {
+      drm_timeline_fini(fini_on_retire);
+      fini_on_retire = NULL;
+      p_atomic_set(&fini_on_retire_done, true);
+   }
+}
+
+static void
+reset_retired(void)
+{
+   memset(retired_count, 0, sizeof(retired_count));
+   memset(last_retired, 0, sizeof(last_retired));
+   out_of_order = false;
+}
+
+static bool
+wait_retired(uint32_t ring_idx, uint32_t count)
+{
+   for (int i = 0; i < 2000; i++) {
+      if (p_atomic_read(&retired_count[ring_idx]) >= count)
+         return true;
+      usleep(1000);
+   }
+   return false;
+}
+
+static void
+submit(struct drm_timeline *timeline, struct test_timeline *tl, uint64_t fence_id)
+{
+   drm_timeline_set_last_fence_fd(timeline, test_timeline_create_fence(tl));
+   ck_assert_int_eq(drm_timeline_submit_fence(timeline, 0, fence_id), 0);
+}
+
+static int
+count_threads(void)
+{
+   DIR *dir = opendir("/proc/self/task");
+   int count = 0;
+
+   if (!dir)
+      return -1;
+   while (readdir(dir))
+      count++;
+   closedir(dir);
+
+   return count;
+}
+
+START_TEST(drm_fence_retire_in_order)
+{
+   struct virgl_context vctx = { 0 };
+   struct drm_timeline timelines[2];
+   struct test_timeline tls[2];
+
+   reset_retired();
+
+   for (int i = 0; i < 2; i++) {
+      test_timeline_init(&tls[i]);
+      drm_timeline_init(&timelines[i], &vctx, "test-sync", i + 1, test_fence_retire);
+   }
+
+   for (uint64_t id = 1; id <= 8; id++) {
+      submit(&timelines[0], &tls[0], id);
+      submit(&timelines[1], &tls[1], 100 + id);
+   }
+
+   test_timeline_signal(&tls[1], 3);
+   ck_assert(wait_retired(2, 3));
+
+   test_timeline_signal(&tls[0], 8);
+   ck_assert(wait_retired(1, 8));
+
+   test_timeline_signal(&tls[1], 8);
+   ck_assert(wait_retired(2, 8));
+
+   ck_assert(!out_of_order);
+   ck_assert_int_eq(last_retired[1], 8);
+   ck_assert_int_eq(last_retired[2], 108);
+   ck_assert_int_eq(timelines[0].retired_count, 8);
+   ck_assert_int_le(timelines[0].retire_latency_max_ns, 2000000000ull);
+
+   for (int i = 0; i < 2; i++) {
+      drm_timeline_fini(&timelines[i]);
+      test_timeline_fini(&tls[i]);
+   }
+}
+END_TEST
+
+START_TEST(drm_fence_shared_waiter)
+{
+   struct virgl_context vctx = { 0 };
+   struct drm_timeline timelines[32];
+
+   int before = count_threads();
+
+   for (unsigned i = 0; i < ARRAY_SIZE(timelines); i++)
+      drm_timeline_init(&timelines[i], &vctx, "test-sync", 1, test_fence_retire);
+
+   /* All timelines share a single waiter thread. */
+   if (before >= 0)
+      ck_assert_int_le(count_threads(), before + 1);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(timelines); i++)
+      drm_timeline_fini(&timelines[i]);
+}
+END_TEST
+
+START_TEST(drm_fence_fini_pending)
+{
+   struct virgl_context vctx = { 0 };
+   struct drm_timeline timeline;
+   struct test_timeline tl;
+
+   reset_retired();
+   test_timeline_init(&tl);
+   drm_timeline_init(&timeline, &vctx, "test-sync", 3, test_fence_retire);
+
+   submit(&timeline, &tl, 1);
+   submit(&timeline, &tl, 2);
+
+   /* Tearing down with unsignaled fences must not block or retire them. */
+   drm_timeline_fini(&timeline);
+   test_timeline_signal(&tl, 2);
+   usleep(10000);
+   ck_assert_int_eq(p_atomic_read(&retired_count[3]), 0);
+
+   test_timeline_fini(&tl);
+}
+END_TEST
+
+START_TEST(drm_fence_fini_from_retire)
+{
+   struct virgl_context vctx = { 0 };
+   struct drm_timeline timeline, next;
+   struct test_timeline tl;
+
+   reset_retired();
+   test_timeline_init(&tl);
+
+   /* The only timeline, so the waiter thread drops the last reference. */
+   drm_timeline_init(&timeline, &vctx, "test-sync", 1, test_fence_retire_fini);
+   submit(&timeline, &tl, 1);
+   submit(&timeline, &tl, 2);
+
+   fini_on_retire = &timeline;
+   fini_on_retire_done = false;
+   test_timeline_signal(&tl, 2);
+
+   for (int i = 0; i < 2000 && !p_atomic_read(&fini_on_retire_done); i++)
+      usleep(1000);
+   ck_assert(p_atomic_read(&fini_on_retire_done));
+
+   /* Nothing is retired once the timeline is gone. */
+   usleep(10000);
+   ck_assert_int_eq(p_atomic_read(&retired_count[1]), 1);
+
+   /* The next timeline starts a new waiter. */
+   drm_timeline_init(&next, &vctx, "test-sync", 1, test_fence_retire);
+   submit(&next, &tl, 3);
+   test_timeline_signal(&tl, 3);
+   ck_assert(wait_retired(1, 2));
+   ck_assert_int_eq(last_retired[1], 3);
+
+   drm_timeline_fini(&next);
+   test_timeline_fini(&tl);
+}
+END_TEST
+
+static Suite *
+drm_fence_suite(void)
+{
+   Suite *s = suite_create("drm_fence");
+   TCase *tc_core = tcase_create("timeline");
+
+   tcase_add_test(tc_core, drm_fence_retire_in_order);
+   tcase_add_test(tc_core, drm_fence_shared_waiter);
+   tcase_add_test(tc_core, drm_fence_fini_pending);
+   tcase_add_test(tc_core, drm_fence_fini_from_retire);
+   suite_add_tcase(s, tc_core);
+
+   return s;
+}
+
+int
+main(void)
+{
+   Suite *s;
+   SRunner *sr;
+   int number_failed;
+
+   virgl_fence_table_init();
+
+   s = drm_fence_suite();
+   sr = srunner_create(s);
+
+   srunner_run_all(sr, CK_NORMAL);
+   number_failed = srunner_ntests_failed(sr);
+   srunner_free(sr);
+
+   virgl_fence_table_cleanup();
+
+   return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -32,6 +32,8 @@
 #include "testvirgl_encode.h"
 #include "virgl_protocol.h"
 #include "util/u_memory.h"
+#include "tgsi/tgsi_parse.h"
+#include "tgsi/tgsi_text.h"
 
 #include "large_shader.h"
 /* test creating objects with same ID causes context err */
@@ -145,6 +147,166 @@ START_TEST(virgl_test_clear)
 }
 END_TEST
 
+/* blue reads back the same with either byte order */
+static const uint32_t test_blue = 0xff0000ff;
+
+static void clear_to(struct virgl_context *ctx, float r, float g, float b)
+{
+    union pipe_color_union color;
+
+    color.f[0] = r;
+    color.f[1] = g;
+    color.f[2] = b;
+    color.f[3] = 1.0;
+    virgl_encode_clear(ctx, PIPE_CLEAR_COLOR0, &color, 0.0, 0);
+    testvirgl_ctx_send_cmdbuf(ctx);
+}
+
+static void bind_cleared_surface(struct virgl_context *ctx, struct virgl_resource *res)
+{
+    struct virgl_surface surf;
+    struct pipe_framebuffer_state fb_state;
+
+    virgl_renderer_ctx_attach_resource(ctx->ctx_id, res->handle);
+
+    memset(&surf, 0, sizeof(surf));
+    surf.base.format = PIPE_FORMAT_B8G8R8X8_UNORM;
+    surf.handle = 1;
+    surf.base.texture = &res->base;
+    virgl_encoder_create_surface(ctx, surf.handle, res, &surf.base);
+
+    memset(&fb_state, 0, sizeof(fb_state));
+    fb_state.nr_cbufs = 1;
+    fb_state.cbufs[0] = &surf.base;
+    virgl_encoder_set_framebuffer_state(ctx, &fb_state);
+}
+
+/* commands of two contexts run on their own threads, in submission order
+ * per context, and before the ctx0 fence and transfers that follow them
+ */
+START_TEST(virgl_test_clear_threaded_contexts)
+{
+    struct virgl_context ctx, ctx2;
+    struct virgl_resource res, res2;
+    struct virgl_box box = { .w = 5, .h = 1, .d = 1 };
+    int ret;
+
+    ret = testvirgl_init_ctx_cmdbuf(&ctx, context_flags | VIRGL_RENDERER_THREADED_CONTEXTS);
+    ck_assert_int_eq(ret, 0);
+
+    ret = virgl_renderer_context_create(2, strlen("test2"), "test2");
+    ck_assert_int_eq(ret, 0);
+    ctx2 = ctx;
+    ctx2.ctx_id = 2;
+    ctx2.cbuf = CALLOC_STRUCT(virgl_cmd_buf);
+    ck_assert_ptr_nonnull(ctx2.cbuf);
+    ctx2.cbuf->buf = CALLOC(1, VIRGL_MAX_CMDBUF_DWORDS * 4);
+    ck_assert_ptr_nonnull(ctx2.cbuf->buf);
+
+    ret = testvirgl_create_backed_simple_2d_res(&res, 1, 50, 50);
+    ck_assert_int_eq(ret, 0);
+    ret = testvirgl_create_backed_simple_2d_res(&res2, 2, 50, 50);
+    ck_assert_int_eq(ret, 0);
+
+    bind_cleared_surface(&ctx, &res);
+    bind_cleared_surface(&ctx2, &res2);
+
+    /* the last clear of each context wins */
+    for (int i = 0; i < 8; i++) {
+        clear_to(&ctx, 0.0, i % 2 ? 1.0 : 0.0, i % 2 ? 0.0 : 1.0);
+        clear_to(&ctx2, 0.0, i % 2 ? 0.0 : 1.0, i % 2 ? 1.0 : 0.0);
+    }
+
+    testvirgl_reset_fence();
+    ret = virgl_renderer_create_fence(1, 0);
+    ck_assert_int_eq(ret, 0);
+    while (testvirgl_get_last_fence() < 1) {
+        virgl_renderer_poll();
+        nanosleep((struct timespec[]){{0, 50000}}, NULL);
+    }
+
+    /* a ctx0 transfer and a context transfer */
+    ret = virgl_renderer_transfer_read_iov(res.handle, 0, 0, 50, 0, &box, 0, NULL, 0);
+    ck_assert_int_eq(ret, 0);
+    ret = virgl_renderer_transfer_read_iov(res2.handle, ctx2.ctx_id, 0, 50, 0, &box, 0, NULL, 0);
+    ck_assert_int_eq(ret, 0);
+
+    for (int i = 0; i < 5; i++) {
+        ck_assert_uint_eq(((uint32_t *)res.iovs[0].iov_base)[i], test_green);
+        ck_assert_uint_eq(((uint32_t *)res2.iovs[0].iov_base)[i], test_blue);
+    }
+
+    /* commands queued right before a transfer are seen by it */
+    clear_to(&ctx2, 0.0, 1.0, 0.0);
+    ret = virgl_renderer_transfer_read_iov(res2.handle, ctx2.ctx_id, 0, 50, 0, &box, 0, NULL, 0);
+    ck_assert_int_eq(ret, 0);
+    for (int i = 0; i < 5; i++)
+        ck_assert_uint_eq(((uint32_t *)res2.iovs[0].iov_base)[i], test_green);
+
+    virgl_renderer_ctx_detach_resource(ctx.ctx_id, res.handle);
+    virgl_renderer_ctx_detach_resource(ctx2.ctx_id, res2.handle);
+    testvirgl_destroy_backed_res(&res);
+    testvirgl_destroy_backed_res(&res2);
+
+    FREE(ctx2.cbuf->buf);
+    FREE(ctx2.cbuf);
+    virgl_renderer_context_destroy(ctx2.ctx_id);
+    testvirgl_fini_ctx_cmdbuf(&ctx);
+}
+END_TEST
+
+START_TEST(virgl_test_context_stats)
+{
+    struct virgl_context ctx;
+    struct virgl_resource res;
+    struct virgl_renderer_context_stats stats;
+    union pipe_color_union color = { 0 };
+    struct virgl_box box;
+    int ret;
+
+    ret = testvirgl_init_ctx_cmdbuf(&ctx, context_flags);
+    ck_assert_int_eq(ret, 0);
+
+    ret = testvirgl_create_backed_simple_2d_res(&res, 1, 50, 50);
+    ck_assert_int_eq(ret, 0);
+    virgl_renderer_ctx_attach_resource(ctx.ctx_id, res.handle);
+
+    virgl_encode_clear(&ctx, PIPE_CLEAR_COLOR0, &color, 0.0, 0);
+    testvirgl_ctx_send_cmdbuf(&ctx);
+
+    box.x = 0;
+    box.y = 0;
+    box.z = 0;
+    box.w = 5;
+    box.h = 1;
+    box.d = 1;
+    ret = virgl_renderer_transfer_read_iov(res.handle, ctx.ctx_id, 0, 50, 0, &box, 0, NULL, 0);
+    ck_assert_int_eq(ret, 0);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.version = VIRGL_RENDERER_CONTEXT_STATS_VERSION;
+    ret = virgl_renderer_context_get_stats(ctx.ctx_id, &stats);
+    ck_assert_int_eq(ret, 0);
+    ck_assert_int_eq(stats.version, VIRGL_RENDERER_CONTEXT_STATS_VERSION);
+    ck_assert(stats.submits >= 1);
+    ck_assert(stats.commands >= 1);
+    ck_assert(stats.transfers_from_host == 1);
+    ck_assert(stats.transfer_from_host_bytes == 5 * 4);
+
+    ret = virgl_renderer_context_get_stats(ctx.ctx_id + 1, &stats);
+    ck_assert_int_eq(ret, EINVAL);
+
+    /* versions start at 1 */
+    stats.version = 0;
+    ret = virgl_renderer_context_get_stats(ctx.ctx_id, &stats);
+    ck_assert_int_eq(ret, EINVAL);
+
+    virgl_renderer_ctx_detach_resource(ctx.ctx_id, res.handle);
+    testvirgl_destroy_backed_res(&res);
+    testvirgl_fini_ctx_cmdbuf(&ctx);
+}
+END_TEST
+
 START_TEST(virgl_test_blit_simple)
 {
     struct virgl_context ctx;
@@ -492,6 +654,174 @@ START_TEST(virgl_test_render_simple)
 }
 END_TEST
 
+/* enough 8 KiB vertex constant uploads to wrap the 4 MiB constant ring
+ * while the fragment constants uploaded once stay in use
+ */
+#define CONST_RING_DRAWS 640
+
+START_TEST(virgl_test_render_const_ring_wrap)
+{
+    struct virgl_context ctx;
+    struct virgl_resource res;
+    struct virgl_resource vbo;
+    struct pipe_vertex_element ve;
+    struct pipe_vertex_buffer vbuf;
+    int ve_handle, vs_handle, fs_handle;
+    int ctx_handle = 2;
+    struct virgl_box box;
+    bool blue = false;
+    int ret;
+    int tw = 50, th = 50;
+    static const float vs_consts[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    static const float fs_consts[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+    ret = testvirgl_init_ctx_cmdbuf(&ctx, context_flags | VIRGL_RENDERER_USE_CONST_RING);
+    ck_assert_int_eq(ret, 0);
+
+    ret = testvirgl_create_backed_simple_2d_res(&res, 1, tw, th);
+    ck_assert_int_eq(ret, 0);
+    bind_cleared_surface(&ctx, &res);
+    clear_to(&ctx, 0.0, 1.0, 0.0);
+
+    ve_handle = ctx_handle++;
+    memset(&ve, 0, sizeof(ve));
+    ve.src_offset = Offset(struct vertex, position);
+    ve.src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+    virgl_encoder_create_vertex_elements(&ctx, ve_handle, 1, &ve);
+    virgl_encode_bind_object(&ctx, ve_handle, VIRGL_OBJECT_VERTEX_ELEMENTS);
+
+    ret = testvirgl_create_backed_simple_buffer(&vbo, 2, sizeof(vertices), PIPE_BIND_VERTEX_BUFFER);
+    ck_assert_int_eq(ret, 0);
+    virgl_renderer_ctx_attach_resource(ctx.ctx_id, vbo.handle);
+
+    box.x = 0;
+    box.y = 0;
+    box.z = 0;
+    box.w = sizeof(vertices);
+    box.h = 1;
+    box.d = 1;
+    virgl_encoder_inline_write(&ctx, &vbo, 0, 0, (struct pipe_box *)&box, &vertices, box.w, 0);
+
+    vbuf.stride = sizeof(struct vertex);
+    vbuf.buffer_offset = 0;
+    vbuf.buffer = &vbo.base;
+    virgl_encoder_set_vertex_buffers(&ctx, 1, &vbuf);
+
+    {
+        struct pipe_shader_state vs;
+        const char *text =
+            "VERT\n"
+            "DCL IN[0]\n"
+            "DCL OUT[0], POSITION\n"
+            "DCL CONST[0..511]\n"
+            "  0: ADD OUT[0], IN[0], CONST[511]\n"
+            "  1: END\n";
+        memset(&vs, 0, sizeof(vs));
+        vs_handle = ctx_handle++;
+        virgl_encode_shader_state(&ctx, vs_handle, PIPE_SHADER_VERTEX, &vs, text);
+        virgl_encode_bind_shader(&ctx, vs_handle, PIPE_SHADER_VERTEX);
+    }
+
+    {
+        struct pipe_shader_state fs;
+        const char *text =
+            "FRAG\n"
+            "DCL OUT[0], COLOR\n"
+            "DCL CONST[0]\n"
+            "  0: MOV OUT[0], CONST[0]\n"
+            "  1: END\n";
+        memset(&fs, 0, sizeof(fs));
+        fs_handle = ctx_handle++;
+        virgl_encode_shader_state(&ctx, fs_handle, PIPE_SHADER_FRAGMENT, &fs, text);
+        virgl_encode_bind_shader(&ctx, fs_handle, PIPE_SHADER_FRAGMENT);
+    }
+
+    {
+        uint32_t handles[PIPE_SHADER_TYPES];
+        memset(handles, 0, sizeof(handles));
+        handles[PIPE_SHADER_VERTEX] = vs_handle;
+        handles[PIPE_SHADER_FRAGMENT] = fs_handle;
+        virgl_encode_link_shader(&ctx, handles);
+    }
+
+    {
+        struct pipe_blend_state blend;
+        int blend_handle = ctx_handle++;
+        memset(&blend, 0, sizeof(blend));
+        blend.rt[0].colormask = PIPE_MASK_RGBA;
+        virgl_encode_blend_state(&ctx, blend_handle, &blend);
+        virgl_encode_bind_object(&ctx, blend_handle, VIRGL_OBJECT_BLEND);
+    }
+
+    {
+        struct pipe_rasterizer_state rasterizer;
+        int rs_handle = ctx_handle++;
+        memset(&rasterizer, 0, sizeof(rasterizer));
+        rasterizer.cull_face = PIPE_FACE_NONE;
+        rasterizer.half_pixel_center = 1;
+        rasterizer.bottom_edge_rule = 1;
+        rasterizer.depth_clip = 1;
+        virgl_encode_rasterizer_state(&ctx, rs_handle, &rasterizer);
+        virgl_encode_bind_object(&ctx, rs_handle, VIRGL_OBJECT_RASTERIZER);
+    }
+
+    {
+        struct pipe_viewport_state vp;
+
+        vp.scale[0] = tw / 2.0f;
+        vp.scale[1] = th / 2.0f;
+        vp.scale[2] = 0.5f;
+        vp.translate[0] = tw / 2.0f;
+        vp.translate[1] = th / 2.0f;
+        vp.translate[2] = 0.5f;
+        virgl_encoder_set_viewport_states(&ctx, 0, 1, &vp);
+    }
+
+    virgl_encoder_write_constant_buffer(&ctx, PIPE_SHADER_FRAGMENT, 0, 4, fs_consts);
+
+    /* every draw streams the vertex constants again */
+    for (int i = 0; i < CONST_RING_DRAWS; i++) {
+        struct pipe_draw_info info;
+
+        virgl_encoder_write_constant_buffer(&ctx, PIPE_SHADER_VERTEX, 0, 4, vs_consts);
+        memset(&info, 0, sizeof(info));
+        info.count = 3;
+        info.mode = PIPE_PRIM_TRIANGLES;
+        virgl_encoder_draw_vbo(&ctx, &info);
+
+        if (i % 64 == 63) {
+            ret = testvirgl_ctx_send_cmdbuf(&ctx);
+            ck_assert_int_eq(ret, 0);
+        }
+    }
+    ret = testvirgl_ctx_send_cmdbuf(&ctx);
+    ck_assert_int_eq(ret, 0);
+
+    box.w = tw;
+    box.h = th;
+    ret = virgl_renderer_transfer_read_iov(res.handle, ctx.ctx_id, 0, 0, 0, &box, 0, NULL, 0);
+    ck_assert_int_eq(ret, 0);
+
+    /* the triangle still reads the fragment constants */
+    {
+        uint32_t *ptr = res.iovs[0].iov_base;
+        for (int i = 0; i < tw * th; i++) {
+            if (ptr[i] == test_blue)
+                blue = true;
+            else
+                ck_assert_uint_eq(ptr[i], test_green);
+        }
+        ck_assert(blue);
+    }
+
+    virgl_renderer_ctx_detach_resource(ctx.ctx_id, vbo.handle);
+    virgl_renderer_ctx_detach_resource(ctx.ctx_id, res.handle);
+    testvirgl_destroy_backed_res(&vbo);
+    testvirgl_destroy_backed_res(&res);
+    testvirgl_fini_ctx_cmdbuf(&ctx);
+}
+END_TEST
+
 static void virgl_test_bind_images_shader(int first_layer, int last_layer, int expected_error)
 {
     struct virgl_context ctx;
@@ -1660,6 +1990,57 @@ START_TEST(virgl_test_create_shader_fail)
 }
 END_TEST
 
+static void test_create_shader_binary(uint32_t type, uint32_t body_size_delta,
+                                      int expected_error)
+{
+   struct virgl_context ctx;
+   struct tgsi_token tokens[300];
+   int ret;
+
+   ret = testvirgl_init_ctx_cmdbuf(&ctx, context_flags);
+   ck_assert_int_eq(ret, 0);
+
+   const char *text =
+       "VERT\n"
+       "DCL IN[0]\n"
+       "DCL IN[1]\n"
+       "DCL OUT[0], POSITION\n"
+       "DCL OUT[1], COLOR\n"
+       "  0: MOV OUT[1], IN[1]\n"
+       "  1: MOV OUT[0], IN[0]\n"
+       "  2: END\n";
+   ck_assert(tgsi_text_translate(text, tokens, ARRAY_SIZE(tokens)));
+
+   const uint32_t num_tokens = tgsi_num_tokens(tokens);
+   ((struct tgsi_header *)tokens)->BodySize += body_size_delta;
+
+   ret = virgl_encode_shader_tokens(&ctx, 2000, type, tokens, num_tokens);
+   ck_assert_int_eq(ret, 0);
+
+   ret = testvirgl_ctx_send_cmdbuf(&ctx);
+   ck_assert_int_eq(ret, expected_error);
+
+   testvirgl_fini_ctx_cmdbuf(&ctx);
+}
+
+START_TEST(virgl_test_create_shader_binary_pass)
+{
+   test_create_shader_binary(PIPE_SHADER_VERTEX, 0, 0);
+}
+END_TEST
+
+START_TEST(virgl_test_create_shader_binary_fail_type)
+{
+   test_create_shader_binary(PIPE_SHADER_FRAGMENT, 0, EINVAL);
+}
+END_TEST
+
+START_TEST(virgl_test_create_shader_binary_fail_size)
+{
+   test_create_shader_binary(PIPE_SHADER_VERTEX, 1, EINVAL);
+}
+END_TEST
+
 /* create a resource - clear it to a color, do a transfer */
 START_TEST(virgl_test_clear_texture)
 {
@@ -1977,10 +2358,12 @@ static Suite *virgl_init_suite(void)
   s = suite_create("virgl_clear");
   tc_core = tcase_create("clear");
   tcase_add_test(tc_core, virgl_test_clear);
+  tcase_add_test(tc_core, virgl_test_context_stats);
   tcase_add_test(tc_core, virgl_test_blit_simple);
   tcase_add_test(tc_core, virgl_test_overlap_obj_id);
   tcase_add_test(tc_core, virgl_test_large_shader);
   tcase_add_test(tc_core, virgl_test_render_simple);
+  tcase_add_test(tc_core, virgl_test_render_const_ring_wrap);
   tcase_add_test(tc_core, virgl_test_render_geom_simple);
   tcase_add_test(tc_core, virgl_test_render_xfb);
   tcase_add_test(tc_core, virgl_test_set_viewport_state);
@@ -1997,6 +2380,9 @@ static Suite *virgl_init_suite(void)
   tcase_add_test(tc_core, virgl_test_create_vertex_elements_fail);
   tcase_add_test(tc_core, virgl_test_create_shader_pass);
   tcase_add_test(tc_core, virgl_test_create_shader_fail);
+  tcase_add_test(tc_core, virgl_test_create_shader_binary_pass);
+  tcase_add_test(tc_core, virgl_test_create_shader_binary_fail_type);
+  tcase_add_test(tc_core, virgl_test_create_shader_binary_fail_size);
   tcase_add_test(tc_core, virgl_test_clear_texture);
   tcase_add_test(tc_core, virgl_test_draw_vbo_pass);
   tcase_add_test(tc_core, virgl_test_draw_vbo_fail_indirect_missing_handle);
@@ -2004,6 +2390,7 @@ static Suite *virgl_init_suite(void)
   tcase_add_test(tc_core, virgl_test_bind_images_shader_pass);
   tcase_add_test(tc_core, virgl_test_bind_images_shader_fail_layers);
   tcase_add_test(tc_core, virgl_test_query);
+  tcase_add_test(tc_core, virgl_test_clear_threaded_contexts);
 
   suite_add_tcase(s, tc_core);
   return s;
@@ -31,8 +31,11 @@
 #include <check.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
 #include <virglrenderer.h>
 #include "virgl_hw.h"
+#include "virgl_protocol.h"
 #include "testvirgl.h"
 
 #include "pipe/p_defines.h"
@@ -304,6 +307,181 @@ START_TEST(private_ptr)
 }
 END_TEST
 
+/* destroyed resources may hand their storage over to identical new ones,
+ * cleared
+ */
+START_TEST(recycled_res)
+{
+  int ret;
+  ret = testvirgl_init_single_ctx(context_flags | VIRGL_RENDERER_USE_RESOURCE_POOL);
+  ck_assert_int_eq(ret, 0);
+
+  struct virgl_renderer_resource_create_args args = { 0, PIPE_TEXTURE_2D, PIPE_FORMAT_B8G8R8X8_UNORM,
+                                                      PIPE_BIND_SAMPLER_VIEW, 16, 16, 1, 1, 0, 0, 0 };
+  struct virgl_box box = { .w = 16, .h = 16, .d = 1 };
+  uint32_t data[16 * 16];
+  uint32_t readback[16 * 16];
+  struct iovec iov = { .iov_base = data, .iov_len = sizeof(data) };
+  struct iovec readback_iov = { .iov_base = readback, .iov_len = sizeof(readback) };
+  uint64_t hits, last_hits, misses;
+  uint32_t recycled = 0;
+
+  virgl_renderer_get_resource_pool_stats(&last_hits, &misses);
+
+  for (uint32_t i = 1; i <= 8; i++) {
+    args.handle = i;
+    ret = virgl_renderer_resource_create(&args, NULL, 0);
+    ck_assert_int_eq(ret, 0);
+    virgl_renderer_ctx_attach_resource(1, i);
+
+    virgl_renderer_get_resource_pool_stats(&hits, &misses);
+    if (hits != last_hits) {
+      ck_assert_uint_eq(hits, last_hits + 1);
+      recycled++;
+
+      /* nothing written to the previous resource shows through */
+      ret = virgl_renderer_transfer_read_iov(i, 1, 0, 0, 0, &box, 0, &readback_iov, 1);
+      ck_assert_int_eq(ret, 0);
+      for (unsigned j = 0; j < ARRAY_SIZE(readback); j++)
+        ck_assert_uint_eq(readback[j] & 0xffffff, 0);
+    }
+    last_hits = hits;
+
+    for (unsigned j = 0; j < ARRAY_SIZE(data); j++)
+      data[j] = (i << 16) | j;
+    ret = virgl_renderer_transfer_write_iov(i, 1, 0, 0, 0, &box, 0, &iov, 1);
+    ck_assert_int_eq(ret, 0);
+    ret = virgl_renderer_transfer_read_iov(i, 1, 0, 0, 0, &box, 0, &readback_iov, 1);
+    ck_assert_int_eq(ret, 0);
+    for (unsigned j = 0; j < ARRAY_SIZE(data); j++)
+      ck_assert_int_eq(readback[j] & 0xffffff, data[j] & 0xffffff);
+
+    virgl_renderer_ctx_detach_resource(1, i);
+    virgl_renderer_resource_unref(i);
+    virgl_renderer_poll();
+  }
+
+  ck_assert_uint_gt(recycled, 0);
+
+  /* resources created with other flags do not share the pool */
+  args.handle = 9;
+  args.flags = VIRGL_RESOURCE_Y_0_TOP;
+  ret = virgl_renderer_resource_create(&args, NULL, 0);
+  ck_assert_int_eq(ret, 0);
+  virgl_renderer_get_resource_pool_stats(&hits, &misses);
+  ck_assert_uint_eq(hits, last_hits);
+  virgl_renderer_resource_unref(9);
+
+  testvirgl_fini_single_ctx();
+}
+END_TEST
+
+/* creates a persistently mapped buffer blob of ctx_id */
+static int create_persistent_blob(uint32_t ctx_id, uint32_t res_id, uint32_t size)
+{
+  uint32_t cmd[VIRGL_PIPE_RES_CREATE_SIZE + 1] = { 0 };
+  int ret;
+
+  cmd[0] = VIRGL_CMD0(VIRGL_CCMD_PIPE_RESOURCE_CREATE, 0, VIRGL_PIPE_RES_CREATE_SIZE);
+  cmd[VIRGL_PIPE_RES_CREATE_TARGET] = PIPE_BUFFER;
+  cmd[VIRGL_PIPE_RES_CREATE_FORMAT] = PIPE_FORMAT_R8_UNORM;
+  cmd[VIRGL_PIPE_RES_CREATE_BIND] = PIPE_BIND_VERTEX_BUFFER;
+  cmd[VIRGL_PIPE_RES_CREATE_WIDTH] = size;
+  cmd[VIRGL_PIPE_RES_CREATE_HEIGHT] = 1;
+  cmd[VIRGL_PIPE_RES_CREATE_DEPTH] = 1;
+  cmd[VIRGL_PIPE_RES_CREATE_ARRAY_SIZE] = 1;
+  cmd[VIRGL_PIPE_RES_CREATE_FLAGS] = VIRGL_RESOURCE_FLAG_MAP_PERSISTENT |
+                                     VIRGL_RESOURCE_FLAG_MAP_COHERENT;
+  cmd[VIRGL_PIPE_RES_CREATE_BLOB_ID] = res_id;
+  ret = virgl_renderer_submit_cmd(cmd, ctx_id, ARRAY_SIZE(cmd));
+  if (ret)
+    return ret;
+
+  struct virgl_renderer_resource_create_blob_args args = {
+    .res_handle = res_id,
+    .ctx_id = ctx_id,
+    .blob_mem = VIRGL_RENDERER_BLOB_MEM_HOST3D,
+    .blob_flags = VIRGL_RENDERER_BLOB_FLAG_USE_MAPPABLE,
+    .blob_id = res_id,
+    .size = size,
+  };
+  return virgl_renderer_resource_create_blob(&args);
+}
+
+/* heap blobs only expose their own range, zeroed, and contexts do not share
+ * chunks
+ */
+START_TEST(blob_heap_res)
+{
+  const uint32_t size = 3 * 4096 + 100;
+  void *base, *other_base;
+  uint64_t region_size, offset, other_offset;
+  void *map;
+  uint64_t map_size;
+  int ret;
+
+  ret = testvirgl_init_single_ctx(context_flags | VIRGL_RENDERER_USE_BLOB_HEAP);
+  ck_assert_int_eq(ret, 0);
+  ret = virgl_renderer_context_create(2, strlen("test2"), "test2");
+  ck_assert_int_eq(ret, 0);
+
+  ret = create_persistent_blob(1, 1, size);
+  ck_assert_int_eq(ret, 0);
+  ret = virgl_renderer_resource_get_map_region(1, &base, &region_size, &offset);
+  if (ret == -ENODATA) {
+    /* the host GL cannot back the heap */
+    virgl_renderer_resource_unref(1);
+    virgl_renderer_context_destroy(2);
+    testvirgl_fini_single_ctx();
+    return;
+  }
+  ck_assert_int_eq(ret, 0);
+  ck_assert_uint_eq(region_size, 4 * 4096);
+  ck_assert_uint_eq(offset % 4096, 0);
+
+  ret = virgl_renderer_resource_map(1, &map, &map_size);
+  ck_assert_int_eq(ret, 0);
+  ck_assert_ptr_eq(map, (uint8_t *)base + offset);
+  for (uint32_t i = 0; i < size; i++)
+    ck_assert_uint_eq(((uint8_t *)map)[i], 0);
+  memset(map, 0xaa, size);
+  virgl_renderer_resource_unmap(1);
+
+  /* a second blob of the same context shares the chunk but not the pages */
+  ret = create_persistent_blob(1, 2, size);
+  ck_assert_int_eq(ret, 0);
+  ret = virgl_renderer_resource_get_map_region(2, &other_base, &region_size, &other_offset);
+  ck_assert_int_eq(ret, 0);
+  ck_assert_ptr_eq(other_base, base);
+  ck_assert(other_offset >= offset + region_size || other_offset + region_size <= offset);
+
+  /* another context gets a chunk of its own */
+  ret = create_persistent_blob(2, 3, size);
+  ck_assert_int_eq(ret, 0);
+  ret = virgl_renderer_resource_get_map_region(3, &other_base, &region_size, &other_offset);
+  ck_assert_int_eq(ret, 0);
+  ck_assert_ptr_ne(other_base, base);
+
+  /* released ranges come back zeroed, however soon they are reused */
+  virgl_renderer_resource_unref(1);
+  for (uint32_t res_id = 4; res_id < 8; res_id++) {
+    virgl_renderer_poll();
+    ret = create_persistent_blob(1, res_id, size);
+    ck_assert_int_eq(ret, 0);
+    ret = virgl_renderer_resource_map(res_id, &map, &map_size);
+    ck_assert_int_eq(ret, 0);
+    for (uint32_t i = 0; i < size; i++)
+      ck_assert_uint_eq(((uint8_t *)map)[i], 0);
+    virgl_renderer_resource_unmap(res_id);
+  }
+
+  for (uint32_t res_id = 2; res_id < 8; res_id++)
+    virgl_renderer_resource_unref(res_id);
+  virgl_renderer_context_destroy(2);
+  testvirgl_fini_single_ctx();
+}
+END_TEST
+
 static Suite *virgl_init_suite(void)
 {
   Suite *s;
@@ -315,6 +493,8 @@ static Suite *virgl_init_suite(void)
   tcase_add_loop_test(tc_core, virgl_res_tests, 0, ARRAY_SIZE(testlist));
   tcase_add_loop_test(tc_core, cubemaparray_res_tests, 0, ARRAY_SIZE(cubemaparray_testlist));
   tcase_add_test(tc_core, private_ptr);
+  tcase_add_test(tc_core, recycled_res);
+  tcase_add_test(tc_core, blob_heap_res);
   suite_add_tcase(s, tc_core);
   return s;
 
@@ -185,6 +185,62 @@ START_TEST(strbuf_test_appendf_str)
 END_TEST
 
 
+START_TEST(strbuf_test_appendf_simple)
+{
+   struct vrend_strbuf sb;
+   bool ret;
+   ret = strbuf_alloc(&sb, 1024);
+   ck_assert_int_eq(ret, true);
+   strbuf_appendf(&sb, "temp%d[addr%u + %d]%c%s 100%%", -12, 4294967295u, 0, '.', "xyzw");
+   ck_assert_str_eq(sb.buf, "temp-12[addr4294967295 + 0].xyzw 100%");
+   ck_assert_int_eq(strbuf_get_len(&sb), strlen(sb.buf));
+   strbuf_fmt(&sb, "%d", -2147483647 - 1);
+   ck_assert_str_eq(sb.buf, "-2147483648");
+   strbuf_fmt(&sb, "%s", "");
+   ck_assert_str_eq(sb.buf, "");
+   strbuf_free(&sb);
+}
+END_TEST
+
+START_TEST(strbuf_test_appendf_simple_grow)
+{
+   struct vrend_strbuf sb = { 0, };
+   char str[256];
+
+   for (int i = 0; i < 255; i++)
+      str[i] = 'a' + (i % 26);
+   str[255] = 0;
+
+   /* buffers are also used zero-initialized */
+   strbuf_fmt(&sb, "%s", "");
+   ck_assert_ptr_ne(sb.buf, NULL);
+   ck_assert_str_eq(sb.buf, "");
+
+   for (int i = 0; i < 16; i++)
+      strbuf_appendf(&sb, "%s%d", str, i);
+   ck_assert_int_eq(strbuf_get_error(&sb), false);
+   ck_assert_int_eq(strbuf_get_len(&sb), strlen(sb.buf));
+   ck_assert_int_eq(strbuf_get_len(&sb), 16 * 255 + 10 + 2 * 6);
+   strbuf_free(&sb);
+}
+END_TEST
+
+START_TEST(strbuf_test_append_int)
+{
+   struct vrend_strbuf sb;
+   bool ret;
+   ret = strbuf_alloc(&sb, 16);
+   ck_assert_int_eq(ret, true);
+   strbuf_append_uint(&sb, 0);
+   strbuf_append_char(&sb, ' ');
+   strbuf_append_int(&sb, -7);
+   strbuf_append_char(&sb, ' ');
+   strbuf_append_uint(&sb, 4294967295u);
+   ck_assert_str_eq(sb.buf, "0 -7 4294967295");
+   strbuf_free(&sb);
+}
+END_TEST
+
 START_TEST(strbuf_test_fixed_string)
 {
    struct vrend_strbuf sb;
@@ -219,6 +275,9 @@ static Suite *init_suite(void)
   tcase_add_test(tc_core, strbuf_test_boundary2);
   tcase_add_test(tc_core, strbuf_test_appendf);
   tcase_add_test(tc_core, strbuf_test_appendf_str);
+  tcase_add_test(tc_core, strbuf_test_appendf_simple);
+  tcase_add_test(tc_core, strbuf_test_appendf_simple_grow);
+  tcase_add_test(tc_core, strbuf_test_append_int);
   tcase_add_test(tc_core, strbuf_test_fixed_string);
   return s;
 }
@@ -26,6 +26,8 @@
 #include <check.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <string.h>
+#include <unistd.h>
 #include <virglrenderer.h>
 #include "pipe/p_defines.h"
 #include "virgl_hw.h"
@@ -1011,6 +1013,83 @@ START_TEST(test_vrend_host_backed_memory_no_data_leak)
 END_TEST
 
 
+struct damaged_rect_result {
+  int calls;
+  int x, y, width, height;
+};
+
+static void damaged_rect_cb(void *data, int x, int y, int width, int height)
+{
+  struct damaged_rect_result *result = data;
+  result->calls++;
+  result->x = x;
+  result->y = y;
+  result->width = width;
+  result->height = height;
+}
+
+static void wait_damaged_rect(struct damaged_rect_result *result, int calls)
+{
+  for (int i = 0; i < 1000 && result->calls < calls; i++) {
+    virgl_renderer_poll();
+    if (result->calls < calls)
+      usleep(1000);
+  }
+  ck_assert_int_eq(result->calls, calls);
+}
+
+/* only the region written since the last call is read back */
+START_TEST(virgl_test_get_damaged_rect)
+{
+  struct virgl_resource res;
+  uint32_t image[50 * 50];
+  uint32_t data[4] = { 0x112233, 0x445566, 0x778899, 0xaabbcc };
+  struct iovec image_iov = { .iov_base = image, .iov_len = sizeof(image) };
+  struct iovec iov = { .iov_base = data, .iov_len = sizeof(data) };
+  struct damaged_rect_result result = { 0 };
+  struct virgl_box box = { .x = 10, .y = 20, .z = 0, .w = 2, .h = 2, .d = 1 };
+  int ret;
+
+  ret = testvirgl_create_backed_simple_2d_res(&res, 1, 50, 50);
+  ck_assert_int_eq(ret, 0);
+  virgl_renderer_ctx_attach_resource(1, res.handle);
+
+  /* the first readback covers the whole resource */
+  ret = virgl_renderer_get_damaged_rect(res.handle, &image_iov, 1, 0, damaged_rect_cb, &result);
+  ck_assert_int_eq(ret, 0);
+  wait_damaged_rect(&result, 1);
+  ck_assert_int_eq(result.x, 0);
+  ck_assert_int_eq(result.y, 0);
+  ck_assert_int_eq(result.width, 50);
+  ck_assert_int_eq(result.height, 50);
+
+  ret = virgl_renderer_get_damaged_rect(res.handle, &image_iov, 1, 0, damaged_rect_cb, &result);
+  ck_assert_int_eq(ret, -ENODATA);
+
+  ret = virgl_renderer_transfer_write_iov(res.handle, 1, 0, 0, 0, &box, 0, &iov, 1);
+  ck_assert_int_eq(ret, 0);
+
+  memset(image, 0, sizeof(image));
+  ret = virgl_renderer_get_damaged_rect(res.handle, &image_iov, 1, 0, damaged_rect_cb, &result);
+  ck_assert_int_eq(ret, 0);
+  wait_damaged_rect(&result, 2);
+  ck_assert_int_eq(result.x, 10);
+  ck_assert_int_eq(result.y, 20);
+  ck_assert_int_eq(result.width, 2);
+  ck_assert_int_eq(result.height, 2);
+
+  ck_assert_int_eq(image[20 * 50 + 10] & 0xffffff, data[0]);
+  ck_assert_int_eq(image[20 * 50 + 11] & 0xffffff, data[1]);
+  ck_assert_int_eq(image[21 * 50 + 10] & 0xffffff, data[2]);
+  ck_assert_int_eq(image[21 * 50 + 11] & 0xffffff, data[3]);
+  ck_assert_int_eq(image[0], 0);
+
+  virgl_renderer_ctx_detach_resource(1, res.handle);
+  testvirgl_destroy_backed_res(&res);
+}
+END_TEST
+
+
 static Suite *virgl_init_suite(void)
 {
   Suite *s;
@@ -1073,6 +1152,12 @@ static Suite *virgl_init_suite(void)
 
   suite_add_tcase(s, tc_core);
 
+  tc_core = tcase_create("damage");
+  tcase_add_checked_fixture(tc_core, testvirgl_init_single_ctx_nr, testvirgl_fini_single_ctx);
+  tcase_add_test(tc_core, virgl_test_get_damaged_rect);
+
+  suite_add_tcase(s, tc_core);
+
   return s;
 
 }
@@ -0,0 +1,247 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <check.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vkr_physical_device.h"
+#include "vkr_query_cache.h"
+
+/* Test that the venus query cache is shared through VIRGL_PROBE_CACHE_DIR,
+ * the way the render server workers of a device share it
+ */
+
+/* the formats vkr_query_cache_prewarm() queries */
+#define PROBED_FORMATS (VK_FORMAT_ASTC_12x12_SRGB_BLOCK - VK_FORMAT_R4G4_UNORM_PACK8 + 1)
+
+static char cache_dir[] = "/tmp/vkr-query-cache-XXXXXX";
+
+static struct vkr_physical_device physical_dev;
+static unsigned host_queries;
+
+static void VKAPI_PTR
+fake_get_format_properties(UNUSED VkPhysicalDevice handle,
+                           VkFormat format,
+                           VkFormatProperties2 *props)
+{
+   host_queries++;
+   props->formatProperties = (VkFormatProperties){
+      .linearTilingFeatures = format,
+      .optimalTilingFeatures = format * 3,
+      .bufferFeatures = format * 5,
+   };
+}
+
+static void
+init_physical_device(struct vkr_physical_device *dev, uint8_t uuid)
+{
+   memset(dev, 0, sizeof(*dev));
+   memset(dev->id_properties.deviceUUID, uuid, VK_UUID_SIZE);
+   memset(dev->id_properties.driverUUID, 0x42, VK_UUID_SIZE);
+   dev->properties.driverVersion = 7;
+   dev->api_version = VK_API_VERSION_1_3;
+   dev->proc_table.GetPhysicalDeviceFormatProperties2 = fake_get_format_properties;
+}
+
+/* Runs a worker: loads the cache and queries format. */
+static void
+run_worker(struct vkr_physical_device *dev, VkFormat format)
+{
+   VkFormatProperties2 props = {
+      .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
+   };
+
+   ck_assert(vkr_query_cache_init());
+   vkr_query_cache_load(dev);
+   vkr_query_cache_get_format_properties(dev, format, &props);
+   ck_assert_uint_eq(props.formatProperties.linearTilingFeatures, format);
+   ck_assert_uint_eq(props.formatProperties.optimalTilingFeatures, format * 3);
+   ck_assert_uint_eq(props.formatProperties.bufferFeatures, format * 5);
+   vkr_query_cache_fini();
+}
+
+static unsigned
+count_cache_files(void)
+{
+   unsigned count = 0;
+   DIR *dir = opendir(cache_dir);
+
+   ck_assert_ptr_nonnull(dir);
+   for (struct dirent *ent = readdir(dir); ent; ent = readdir(dir)) {
+      if (!strncmp(ent->d_name, "vkr-query-", 10))
+         count++;
+   }
+   closedir(dir);
+
+   return count;
+}
+
+static void
+cache_file_path(char *path, size_t size)
+{
+   DIR *dir = opendir(cache_dir);
+
+   ck_assert_ptr_nonnull(dir);
+   path[0] = '\0';
+   for (struct dirent *ent = readdir(dir); ent; ent = readdir(dir)) {
+      if (!strncmp(ent->d_name, "vkr-query-", 10))
+         snprintf(path, size, "%s/%s", cache_dir, ent->d_name);
+   }
+   closedir(dir);
+   ck_assert(path[0]);
+}
+
+static void
+setup(void)
+{
+   strcpy(cache_dir, "/tmp/vkr-query-cache-XXXXXX");
+   ck_assert_ptr_nonnull(mkdtemp(cache_dir));
+   setenv("VIRGL_PROBE_CACHE_DIR", cache_dir, 1);
+
+   init_physical_device(&physical_dev, 0x11);
+   host_queries = 0;
+}
+
+static void
+teardown(void)
+{
+   char path[512];
+   DIR *dir = opendir(cache_dir);
+
+   if (dir) {
+      for (struct dirent *ent = readdir(dir); ent; ent = readdir(dir)) {
+         if (ent->d_name[0] == '.')
+            continue;
+         snprintf(path, sizeof(path), "%s/%s", cache_dir, ent->d_name);
+         unlink(path);
+      }
+      closedir(dir);
+   }
+   rmdir(cache_dir);
+   unsetenv("VIRGL_PROBE_CACHE_DIR");
+}
+
+START_TEST(query_cache_shared)
+{
+   /* the first worker probes the core formats, which the query is one of */
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   ck_assert_uint_eq(host_queries, PROBED_FORMATS);
+   ck_assert_uint_eq(count_cache_files(), 1);
+
+   /* the next worker starts from the saved entries */
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   ck_assert_uint_eq(host_queries, PROBED_FORMATS);
+
+   /* what the guest queried is never saved */
+   run_worker(&physical_dev, VK_FORMAT_G8B8G8R8_422_UNORM);
+   ck_assert_uint_eq(host_queries, PROBED_FORMATS + 1);
+   run_worker(&physical_dev, VK_FORMAT_G8B8G8R8_422_UNORM);
+   ck_assert_uint_eq(host_queries, PROBED_FORMATS + 2);
+   ck_assert_uint_eq(count_cache_files(), 1);
+}
+END_TEST
+
+START_TEST(query_cache_other_device)
+{
+   struct vkr_physical_device other_dev;
+
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   ck_assert_uint_eq(host_queries, PROBED_FORMATS);
+
+   init_physical_device(&other_dev, 0x22);
+   run_worker(&other_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   ck_assert_uint_eq(host_queries, 2 * PROBED_FORMATS);
+   ck_assert_uint_eq(count_cache_files(), 2);
+
+   /* nor does a driver update reuse the entries */
+   physical_dev.properties.driverVersion++;
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   ck_assert_uint_eq(host_queries, 3 * PROBED_FORMATS);
+}
+END_TEST
+
+START_TEST(query_cache_opt_in)
+{
+   unsetenv("VIRGL_PROBE_CACHE_DIR");
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   ck_assert_uint_eq(host_queries, 2);
+   ck_assert_uint_eq(count_cache_files(), 0);
+}
+END_TEST
+
+START_TEST(query_cache_corrupt)
+{
+   char path[512];
+   FILE *fp;
+
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   cache_file_path(path, sizeof(path));
+
+   /* flip the last byte of the saved value */
+   fp = fopen(path, "r+b");
+   ck_assert_ptr_nonnull(fp);
+   fseek(fp, -1, SEEK_END);
+   const int c = fgetc(fp);
+   fseek(fp, -1, SEEK_END);
+   fputc(c ^ 0xff, fp);
+   fclose(fp);
+
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   ck_assert_uint_eq(host_queries, PROBED_FORMATS + 1);
+
+   /* the worker did not replace it */
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   ck_assert_uint_eq(host_queries, PROBED_FORMATS + 2);
+
+   /* until it is removed */
+   ck_assert_int_eq(unlink(path), 0);
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   ck_assert_uint_eq(host_queries, 2 * PROBED_FORMATS + 2);
+
+   /* truncated */
+   ck_assert_int_eq(truncate(path, 40), 0);
+   run_worker(&physical_dev, VK_FORMAT_R8G8B8A8_UNORM);
+   ck_assert_uint_eq(host_queries, 2 * PROBED_FORMATS + 3);
+}
+END_TEST
+
+static Suite *
+init_suite(void)
+{
+   Suite *s;
+   TCase *tc_core;
+
+   s = suite_create("vkr_query_cache");
+   tc_core = tcase_create("query_cache");
+
+   tcase_add_checked_fixture(tc_core, setup, teardown);
+   tcase_add_test(tc_core, query_cache_shared);
+   tcase_add_test(tc_core, query_cache_other_device);
+   tcase_add_test(tc_core, query_cache_opt_in);
+   tcase_add_test(tc_core, query_cache_corrupt);
+   suite_add_tcase(s, tc_core);
+   return s;
+}
+
+int
+main(void)
+{
+   Suite *s;
+   SRunner *sr;
+   int number_failed;
+
+   s = init_suite();
+   sr = srunner_create(s);
+
+   srunner_run_all(sr, CK_NORMAL);
+   number_failed = srunner_ntests_failed(sr);
+   srunner_free(sr);
+   return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <check.h>
+#include <stdlib.h>
+
+#include "vkr_udmabuf_extents.h"
+
+/* Test the page allocator of the venus udmabuf pool slabs */
+
+#define SLAB_PAGES 64
+
+static struct vkr_udmabuf_extents extents;
+
+static void setup(void)
+{
+   ck_assert(vkr_udmabuf_extents_init(&extents, SLAB_PAGES));
+}
+
+static void teardown(void)
+{
+   vkr_udmabuf_extents_fini(&extents);
+}
+
+static uint32_t take(uint32_t size)
+{
+   uint32_t offset = ~0u;
+
+   ck_assert(vkr_udmabuf_extents_take(&extents, size, &offset));
+   return offset;
+}
+
+static unsigned count_free_extents(void)
+{
+   return list_length(&extents.free_list);
+}
+
+START_TEST(udmabuf_extents_first_fit)
+{
+   uint32_t offset;
+
+   ck_assert_uint_eq(take(4), 0);
+   ck_assert_uint_eq(take(8), 4);
+   ck_assert_uint_eq(take(4), 12);
+   ck_assert_uint_eq(take(8), 16);
+   ck_assert_uint_eq(extents.free_size, SLAB_PAGES - 24);
+
+   /* holes of 4 pages at 0 and of 4 pages at 12 */
+   vkr_udmabuf_extents_give(&extents, 0, 4);
+   vkr_udmabuf_extents_give(&extents, 12, 4);
+   ck_assert_uint_eq(count_free_extents(), 3);
+
+   /* the lowest extent large enough wins */
+   ck_assert_uint_eq(take(2), 0);
+   ck_assert_uint_eq(take(4), 12);
+   ck_assert_uint_eq(take(3), 24);
+   ck_assert_uint_eq(take(2), 2);
+
+   /* too large for any extent, or empty */
+   ck_assert(!vkr_udmabuf_extents_take(&extents, SLAB_PAGES, &offset));
+   ck_assert(!vkr_udmabuf_extents_take(&extents, 0, &offset));
+   ck_assert_uint_eq(take(SLAB_PAGES - 27), 27);
+   ck_assert_uint_eq(extents.free_size, 0);
+   ck_assert_uint_eq(count_free_extents(), 0);
+   ck_assert(!vkr_udmabuf_extents_take(&extents, 1, &offset));
+}
+END_TEST
+
+START_TEST(udmabuf_extents_coalesce)
+{
+   for (uint32_t i = 0; i < SLAB_PAGES / 8; i++)
+      ck_assert_uint_eq(take(8), i * 8);
+   ck_assert_uint_eq(count_free_extents(), 0);
+
+   /* isolated ranges */
+   vkr_udmabuf_extents_give(&extents, 8, 8);
+   vkr_udmabuf_extents_give(&extents, 32, 8);
+   ck_assert_uint_eq(count_free_extents(), 2);
+   ck_assert_uint_eq(vkr_udmabuf_extents_largest(&extents), 8);
+
+   /* merged with the previous extent */
+   vkr_udmabuf_extents_give(&extents, 16, 8);
+   ck_assert_uint_eq(count_free_extents(), 2);
+   ck_assert_uint_eq(vkr_udmabuf_extents_largest(&extents), 16);
+
+   /* merged with the next extent */
+   vkr_udmabuf_extents_give(&extents, 0, 8);
+   ck_assert_uint_eq(count_free_extents(), 2);
+   ck_assert_uint_eq(vkr_udmabuf_extents_largest(&extents), 24);
+
+   /* bridging two extents */
+   vkr_udmabuf_extents_give(&extents, 24, 8);
+   ck_assert_uint_eq(count_free_extents(), 1);
+   ck_assert_uint_eq(vkr_udmabuf_extents_largest(&extents), 40);
+
+   /* the merged extent is handed out whole */
+   ck_assert_uint_eq(take(40), 0);
+   vkr_udmabuf_extents_give(&extents, 0, 40);
+
+   ck_assert(!vkr_udmabuf_extents_is_idle(&extents));
+   for (uint32_t i = 5; i < SLAB_PAGES / 8; i++)
+      vkr_udmabuf_extents_give(&extents, i * 8, 8);
+   ck_assert(vkr_udmabuf_extents_is_idle(&extents));
+   ck_assert_uint_eq(count_free_extents(), 1);
+   ck_assert_uint_eq(vkr_udmabuf_extents_largest(&extents), SLAB_PAGES);
+}
+END_TEST
+
+static Suite *init_suite(void)
+{
+   Suite *s;
+   TCase *tc_core;
+
+   s = suite_create("vkr_udmabuf_extents");
+   tc_core = tcase_create("udmabuf_extents");
+
+   tcase_add_checked_fixture(tc_core, setup, teardown);
+   tcase_add_test(tc_core, udmabuf_extents_first_fit);
+   tcase_add_test(tc_core, udmabuf_extents_coalesce);
+   suite_add_tcase(s, tc_core);
+   return s;
+}
+
+int main(void)
+{
+   Suite *s;
+   SRunner *sr;
+   int number_failed;
+
+   s = init_suite();
+   sr = srunner_create(s);
+
+   srunner_run_all(sr, CK_NORMAL);
+   number_failed = srunner_ntests_failed(sr);
+   srunner_free(sr);
+   return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <virglrenderer.h>
+
+#include "vrend/vrend_probe_cache.h"
+#include "virgl_hw.h"
+#include "testvirgl.h"
+
+/* Test the on-disk probe cache, and the caps served from it */
+
+static char cache_dir[] = "/tmp/vrend-probe-cache-XXXXXX";
+
+static const uint32_t test_data[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+static void cache_path(const char *name, char *path, size_t size)
+{
+   snprintf(path, size, "%s/%s", cache_dir, name);
+}
+
+static void setup(void)
+{
+   strcpy(cache_dir, "/tmp/vrend-probe-cache-XXXXXX");
+   ck_assert_ptr_nonnull(mkdtemp(cache_dir));
+   setenv("VIRGL_PROBE_CACHE_DIR", cache_dir, 1);
+}
+
+static void teardown(void)
+{
+   static const char *const names[] = { "test", "formats", "caps-virgl", "caps-virgl2" };
+   char path[256];
+
+   for (unsigned i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+      cache_path(names[i], path, sizeof(path));
+      unlink(path);
+   }
+   rmdir(cache_dir);
+   unsetenv("VIRGL_PROBE_CACHE_DIR");
+}
+
+START_TEST(probe_cache_roundtrip)
+{
+   uint32_t data[8];
+
+   vrend_probe_cache_store("test", 42, test_data, sizeof(test_data));
+   ck_assert(vrend_probe_cache_load("test", 42, data, sizeof(data)));
+   ck_assert(!memcmp(data, test_data, sizeof(data)));
+
+   /* other keys and sizes miss */
+   ck_assert(!vrend_probe_cache_load("test", 43, data, sizeof(data)));
+   ck_assert(!vrend_probe_cache_load("test", 42, data, sizeof(data) - 4));
+   ck_assert(!vrend_probe_cache_load("other", 42, data, sizeof(data)));
+}
+END_TEST
+
+START_TEST(probe_cache_opt_in)
+{
+   uint32_t data[8];
+   char path[256];
+   struct stat st;
+
+   unsetenv("VIRGL_PROBE_CACHE_DIR");
+   vrend_probe_cache_store("test", 42, test_data, sizeof(test_data));
+   cache_path("test", path, sizeof(path));
+   ck_assert_int_ne(stat(path, &st), 0);
+
+   setenv("VIRGL_PROBE_CACHE_DIR", "", 1);
+   vrend_probe_cache_store("test", 42, test_data, sizeof(test_data));
+   ck_assert_int_ne(stat(path, &st), 0);
+
+   setenv("VIRGL_PROBE_CACHE_DIR", cache_dir, 1);
+   vrend_probe_cache_store("test", 42, test_data, sizeof(test_data));
+   unsetenv("VIRGL_PROBE_CACHE_DIR");
+   ck_assert(!vrend_probe_cache_load("test", 42, data, sizeof(data)));
+}
+END_TEST
+
+START_TEST(probe_cache_corrupt)
+{
+   uint32_t data[8];
+   char path[256];
+   long data_offset;
+   FILE *fp;
+
+   vrend_probe_cache_store("test", 42, test_data, sizeof(test_data));
+   cache_path("test", path, sizeof(path));
+
+   /* flip a byte of the data */
+   fp = fopen(path, "r+b");
+   ck_assert_ptr_nonnull(fp);
+   fseek(fp, 0, SEEK_END);
+   data_offset = ftell(fp) - (long)sizeof(test_data);
+   fseek(fp, data_offset, SEEK_SET);
+   fputc(0xff, fp);
+   fclose(fp);
+   ck_assert(!vrend_probe_cache_load("test", 42, data, sizeof(data)));
+
+   /* truncated */
+   vrend_probe_cache_store("test", 42, test_data, sizeof(test_data));
+   ck_assert_int_eq(truncate(path, data_offset + sizeof(test_data) - 1), 0);
+   ck_assert(!vrend_probe_cache_load("test", 42, data, sizeof(data)));
+
+   /* trailing garbage */
+   vrend_probe_cache_store("test", 42, test_data, sizeof(test_data));
+   fp = fopen(path, "ab");
+   ck_assert_ptr_nonnull(fp);
+   fputc(0, fp);
+   fclose(fp);
+   ck_assert(!vrend_probe_cache_load("test", 42, data, sizeof(data)));
+}
+END_TEST
+
+static void fill_caps(union virgl_caps *caps_v1, union virgl_caps *caps_v2)
+{
+   memset(caps_v1, 0, sizeof(*caps_v1));
+   memset(caps_v2, 0, sizeof(*caps_v2));
+   virgl_renderer_fill_caps(1, 0, caps_v1);
+   virgl_renderer_fill_caps(2, 0, caps_v2);
+}
+
+/* cached caps match probed ones, and loading them leaves the renderer
+ * usable
+ */
+START_TEST(probe_cache_caps)
+{
+   union virgl_caps probed_v1, probed_v2, cached_v1, cached_v2;
+   struct virgl_renderer_resource_create_args args;
+   char path[256];
+   struct stat st;
+   int ret;
+
+   ret = testvirgl_init_single_ctx(context_flags);
+   ck_assert_int_eq(ret, 0);
+   fill_caps(&probed_v1, &probed_v2);
+   testvirgl_fini_single_ctx();
+
+   cache_path("caps-virgl2", path, sizeof(path));
+   ck_assert_int_eq(stat(path, &st), 0);
+
+   ret = testvirgl_init_single_ctx(context_flags);
+   ck_assert_int_eq(ret, 0);
+   fill_caps(&cached_v1, &cached_v2);
+   ck_assert(!memcmp(&probed_v1, &cached_v1, sizeof(struct virgl_caps_v1)));
+   ck_assert(!memcmp(&probed_v2, &cached_v2, sizeof(probed_v2)));
+
+   testvirgl_init_simple_2d_resource(&args, 1);
+   ret = virgl_renderer_resource_create(&args, NULL, 0);
+   ck_assert_int_eq(ret, 0);
+   virgl_renderer_resource_unref(1);
+
+   testvirgl_fini_single_ctx();
+}
+END_TEST
+
+static Suite *init_suite(void)
+{
+   Suite *s;
+   TCase *tc_core;
+
+   s = suite_create("vrend_probe_cache");
+   tc_core = tcase_create("probe_cache");
+
+   tcase_add_checked_fixture(tc_core, setup, teardown);
+   tcase_add_test(tc_core, probe_cache_roundtrip);
+   tcase_add_test(tc_core, probe_cache_opt_in);
+   tcase_add_test(tc_core, probe_cache_corrupt);
+   tcase_add_test(tc_core, probe_cache_caps);
+   suite_add_tcase(s, tc_core);
+   return s;
+}
+
+int main(void)
+{
+   Suite *s;
+   SRunner *sr;
+   int number_failed;
+
+   if (getenv("VRENDTEST_USE_EGL_SURFACELESS"))
+      context_flags |= VIRGL_RENDERER_USE_SURFACELESS;
+   if (getenv("VRENDTEST_USE_EGL_GLES"))
+      context_flags |= VIRGL_RENDERER_USE_GLES;
+
+   s = init_suite();
+   sr = srunner_create(s);
+
+   srunner_run_all(sr, CK_NORMAL);
+   number_failed = srunner_ntests_failed(sr);
+   srunner_free(sr);
+   return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Captures what vtest_bench sends to virgl_test_server with VTEST_SAVE set,
+ * and replays the trace, plainly and with --benchmark.  The binaries are
+ * given by VTEST_SERVER and VTEST_BENCH.
+ */
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "util/macros.h"
+
+#define MAX_ARGS 16
+
+static char tmp_dir[] = "/tmp/vtest-trace-XXXXXX";
+static char socket_path[256];
+static char trace_path[256];
+
+static char output[64 * 1024];
+
+/* Appends the renderer options of the other tests. */
+static int
+add_renderer_args(const char **argv, int argc)
+{
+   if (getenv("VRENDTEST_USE_EGL_SURFACELESS"))
+      argv[argc++] = "--use-egl-surfaceless";
+   if (getenv("VRENDTEST_USE_EGL_GLES"))
+      argv[argc++] = "--use-gles";
+
+   return argc;
+}
+
+/* Runs argv with VTEST_SAVE set to save, and its stdout to out_fd. */
+static pid_t
+spawn(const char **argv, const char *save, int out_fd)
+{
+   const pid_t pid = fork();
+
+   ck_assert_int_ge(pid, 0);
+   if (pid)
+      return pid;
+
+   if (save)
+      setenv("VTEST_SAVE", save, 1);
+   else
+      unsetenv("VTEST_SAVE");
+   if (out_fd >= 0)
+      dup2(out_fd, STDOUT_FILENO);
+
+   execv(argv[0], (char *const *)argv);
+   _exit(127);
+}
+
+static int
+wait_exit(pid_t pid)
+{
+   int status;
+
+   ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+
+   return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/* Replays the trace with extra_arg, what the server prints goes to output. */
+static int
+replay(const char *extra_arg)
+{
+   const char *argv[MAX_ARGS] = { getenv("VTEST_SERVER") };
+   int argc = add_renderer_args(argv, 1);
+   char buf[4096];
+   int fds[2];
+   size_t size = 0;
+   ssize_t ret;
+
+   if (extra_arg)
+      argv[argc++] = extra_arg;
+   argv[argc++] = trace_path;
+
+   ck_assert_int_eq(pipe(fds), 0);
+   const pid_t pid = spawn(argv, NULL, fds[1]);
+   close(fds[1]);
+
+   /* drain the output before waiting, it can fill the pipe */
+   while ((ret = read(fds[0], buf, sizeof(buf))) > 0) {
+      const size_t n = MIN2((size_t)ret, sizeof(output) - 1 - size);
+      memcpy(output + size, buf, n);
+      size += n;
+   }
+   output[size] = '\0';
+   close(fds[0]);
+
+   return wait_exit(pid);
+}
+
+static void
+setup(void)
+{
+   strcpy(tmp_dir, "/tmp/vtest-trace-XXXXXX");
+   ck_assert_ptr_nonnull(mkdtemp(tmp_dir));
+   snprintf(socket_path, sizeof(socket_path), "%s/socket", tmp_dir);
+   snprintf(trace_path, sizeof(trace_path), "%s/trace", tmp_dir);
+}
+
+static void
+teardown(void)
+{
+   unlink(socket_path);
+   unlink(trace_path);
+   rmdir(tmp_dir);
+}
+
+START_TEST(vtest_trace_capture_replay)
+{
+   const char *server_argv[MAX_ARGS] = {
+      getenv("VTEST_SERVER"), "--no-loop-or-fork", "--socket-path", socket_path,
+   };
+   const char *bench_argv[] = {
+      getenv("VTEST_BENCH"), "-n", "4", "-j", "1", socket_path, NULL,
+   };
+   struct stat st;
+
+   ck_assert_ptr_nonnull(server_argv[0]);
+   ck_assert_ptr_nonnull(bench_argv[0]);
+   add_renderer_args(server_argv, 4);
+
+   const pid_t server = spawn(server_argv, trace_path, -1);
+
+   /* vtest_bench does not retry connecting */
+   for (int i = 0; i < 1000 && stat(socket_path, &st); i++)
+      usleep(10 * 1000);
+   ck_assert_int_eq(stat(socket_path, &st), 0);
+   usleep(10 * 1000);
+
+   ck_assert_int_eq(wait_exit(spawn(bench_argv, NULL, -1)), 0);
+   ck_assert_int_eq(wait_exit(server), 0);
+
+   ck_assert_int_eq(stat(trace_path, &st), 0);
+   ck_assert_int_gt(st.st_size, 0);
+
+   ck_assert_int_eq(replay(NULL), 0);
+
+   ck_assert_int_eq(replay("--benchmark=2"), 0);
+   ck_assert_ptr_nonnull(strstr(output, "replay: 2 iterations after 1 warm-up"));
+   ck_assert_ptr_nonnull(strstr(output, "SUBMIT_CMD"));
+}
+END_TEST
+
+static Suite *
+init_suite(void)
+{
+   Suite *s;
+   TCase *tc_core;
+
+   s = suite_create("vtest_trace");
+   tc_core = tcase_create("vtest_trace");
+
+   tcase_add_checked_fixture(tc_core, setup, teardown);
+   tcase_add_test(tc_core, vtest_trace_capture_replay);
+   tcase_set_timeout(tc_core, 60);
+   suite_add_tcase(s, tc_core);
+   return s;
+}
+
+int
+main(void)
+{
+   Suite *s;
+   SRunner *sr;
+   int number_failed;
+
+   s = init_suite();
+   sr = srunner_create(s);
+
+   srunner_run_all(sr, CK_NORMAL);
+   number_failed = srunner_ntests_failed(sr);
+   srunner_free(sr);
+   return number_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -300,6 +300,24 @@ int virgl_encode_shader_state(struct virgl_context *ctx,
    return 0;
 }
 
+int virgl_encode_shader_tokens(struct virgl_context *ctx,
+                               uint32_t handle,
+                               uint32_t type,
+                               const struct tgsi_token *tokens,
+                               uint32_t num_tokens)
+{
+   const uint32_t len = VIRGL_OBJ_SHADER_HDR_SIZE(0) + num_tokens;
+
+   if (ctx->cbuf->cdw + len + 1 > VIRGL_MAX_CMDBUF_DWORDS)
+      return -1;
+
+   virgl_emit_shader_header(ctx, handle, len, type | VIRGL_OBJ_SHADER_TYPE_BINARY,
+                            VIRGL_OBJ_SHADER_OFFSET_VAL(num_tokens * 4), num_tokens);
+   virgl_emit_shader_streamout(ctx, NULL);
+   virgl_encoder_write_block(ctx->cbuf, (const uint8_t *)tokens, num_tokens * 4);
+   return 0;
+}
+
 
 int virgl_encode_clear(struct virgl_context *ctx,
                       unsigned buffers,
@@ -96,6 +96,12 @@ extern int virgl_encode_shader_state(struct virgl_context *ctx,
                                      const struct pipe_shader_state *shader,
                                      const char *shad_str);
 
+int virgl_encode_shader_tokens(struct virgl_context *ctx,
+                               uint32_t handle,
+                               uint32_t type,
+                               const struct tgsi_token *tokens,
+                               uint32_t num_tokens);
+
 int virgl_encode_stream_output_info(struct virgl_context *ctx,
                                    uint32_t handle,
                                    uint32_t type,
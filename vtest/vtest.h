@@ -27,7 +27,10 @@
 
 #include <errno.h>
 
+#include "c11/threads.h"
+
 struct vtest_context;
+struct vtest_trace_reader;
 
 struct vtest_buffer {
    const char *buffer;
@@ -38,6 +41,7 @@ struct vtest_input {
    union {
       int fd;
       struct vtest_buffer *buffer;
+      struct vtest_trace_reader *trace;
    } data;
    int (*read)(struct vtest_input *input, void *buf, int size);
 };
@@ -55,6 +59,18 @@ void vtest_destroy_context(struct vtest_context *ctx);
 void vtest_poll_context(struct vtest_context *ctx);
 int vtest_get_context_poll_fd(struct vtest_context *ctx);
 
+/* Whether the context is initialized with a capset that never reaches vrend.
+ * The commands of such a context may be dispatched on a thread other than
+ * the one that initialized the renderer, as long as the dispatch of all
+ * commands is serialized.
+ */
+bool vtest_context_avoids_vrend(struct vtest_context *ctx);
+
+/* The lock serializing the dispatch of commands when there are several
+ * dispatching threads.  It is released while writing replies to a client.
+ */
+void vtest_set_dispatch_lock(mtx_t *lock);
+
 void vtest_set_current_context(struct vtest_context *ctx);
 
 int vtest_send_caps(uint32_t length_dw);
@@ -76,6 +92,9 @@ int vtest_transfer_put2_nop(uint32_t length_dw);
 int vtest_block_read(struct vtest_input *input, void *buf, int size);
 int vtest_buf_read(struct vtest_input *input, void *buf, int size);
 
+/* Writes to the shm of a resource of the current context, for replays. */
+int vtest_write_resource_shm(uint32_t res_id, uint32_t offset, const void *data, uint32_t size);
+
 int vtest_resource_busy_wait(uint32_t length_dw);
 int vtest_resource_busy_wait_nop(uint32_t length_dw);
 void vtest_poll_resource_busy_wait(void);
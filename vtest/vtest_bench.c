@@ -0,0 +1,491 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Measures how virgl submission scales with the number of vtest clients.
+ * Each client is a process with its own context that submits batches of
+ * clears to a small render target, and waits for the last one to complete.
+ * The aggregate submit rate is reported.
+ *
+ * Meant to be run against a server started with --no-fork --multi-clients,
+ * so that the clients share a renderer, with and without
+ * --threaded-contexts, e.g. on llvmpipe:
+ *
+ *   LIBGL_ALWAYS_SOFTWARE=1 virgl_test_server --no-fork --multi-clients \
+ *      --use-egl-surfaceless --threaded-contexts
+ *
+ * With -c, the clients instead initialize their contexts with the given
+ * capset, e.g. 4 for venus, and do round trips on a vtest sync.  This
+ * measures the dispatch of the server rather than the renderer, and is meant
+ * to compare --multi-clients with --threaded-clients, which only overlaps
+ * the I/O of the clients, as their calls into virglrenderer are still
+ * serialized.  With -d, the first
+ * client pauses between sending a command and its payload, like a client
+ * sending a large transfer does, which stalls the other clients unless each
+ * is read from its own thread:
+ *
+ *   virgl_test_server --venus --no-virgl --threaded-clients
+ *   vtest_bench -c 4 -d 100
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "pipe/p_defines.h"
+#include "virgl_hw.h"
+#include "virgl_protocol.h"
+#include "vtest_protocol.h"
+
+#define BENCH_WIDTH  256
+#define BENCH_HEIGHT 256
+
+/* clears per submitted batch */
+#define BENCH_CLEARS 64
+
+#define BENCH_SETUP_DWORDS (1 + VIRGL_OBJ_SURFACE_SIZE + 1 + VIRGL_SET_FRAMEBUFFER_STATE_SIZE(1))
+#define BENCH_BATCH_DWORDS (BENCH_CLEARS * (1 + VIRGL_OBJ_CLEAR_SIZE))
+
+struct bench_config {
+   const char *socket_path;
+   uint32_t submits;
+
+   /* the capset of the sync round trip mode, or 0 */
+   uint32_t capset;
+   /* pause of the first client between a command and its payload in the
+    * sync mode
+    */
+   uint32_t delay_us;
+};
+
+struct bench_result {
+   uint64_t submit_count;
+   uint64_t elapsed_ns;
+};
+
+static uint64_t
+bench_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool
+bench_write(int fd, const void *buf, size_t size)
+{
+   const uint8_t *ptr = buf;
+
+   while (size) {
+      const ssize_t ret = write(fd, ptr, size);
+      if (ret < 0 && errno == EINTR)
+         continue;
+      if (ret <= 0)
+         return false;
+      ptr += ret;
+      size -= ret;
+   }
+
+   return true;
+}
+
+static bool
+bench_read(int fd, void *buf, size_t size)
+{
+   uint8_t *ptr = buf;
+
+   while (size) {
+      const ssize_t ret = read(fd, ptr, size);
+      if (ret < 0 && errno == EINTR)
+         continue;
+      if (ret <= 0)
+         return false;
+      ptr += ret;
+      size -= ret;
+   }
+
+   return true;
+}
+
+static bool
+bench_send(int fd, uint32_t cmd, const void *data, uint32_t len)
+{
+   const uint32_t hdr[VTEST_HDR_SIZE] = {
+      [VTEST_CMD_LEN] = len,
+      [VTEST_CMD_ID] = cmd,
+   };
+
+   return bench_write(fd, hdr, sizeof(hdr)) && bench_write(fd, data, len * 4);
+}
+
+static int
+bench_connect(const char *path)
+{
+   struct sockaddr_un addr = { .sun_family = AF_UNIX };
+   snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+   const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (fd < 0)
+      return -1;
+
+   if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+      close(fd);
+      return -1;
+   }
+
+   return fd;
+}
+
+/* Creates the context and a render target.  Protocol version 0 is used, so
+ * the resource handle is chosen by the client and must not collide with the
+ * other clients.
+ */
+static bool
+bench_setup(int fd, uint32_t res_handle)
+{
+   const char name[] = "vtest_bench";
+   const uint32_t name_hdr[VTEST_HDR_SIZE] = {
+      [VTEST_CMD_LEN] = sizeof(name),
+      [VTEST_CMD_ID] = VCMD_CREATE_RENDERER,
+   };
+   if (!bench_write(fd, name_hdr, sizeof(name_hdr)) || !bench_write(fd, name, sizeof(name)))
+      return false;
+
+   const uint32_t res[VCMD_RES_CREATE_SIZE] = {
+      [VCMD_RES_CREATE_RES_HANDLE] = res_handle,
+      [VCMD_RES_CREATE_TARGET] = PIPE_TEXTURE_2D,
+      [VCMD_RES_CREATE_FORMAT] = VIRGL_FORMAT_B8G8R8A8_UNORM,
+      [VCMD_RES_CREATE_BIND] = VIRGL_BIND_RENDER_TARGET,
+      [VCMD_RES_CREATE_WIDTH] = BENCH_WIDTH,
+      [VCMD_RES_CREATE_HEIGHT] = BENCH_HEIGHT,
+      [VCMD_RES_CREATE_DEPTH] = 1,
+      [VCMD_RES_CREATE_ARRAY_SIZE] = 1,
+   };
+
+   return bench_send(fd, VCMD_RESOURCE_CREATE, res, VCMD_RES_CREATE_SIZE);
+}
+
+/* Binds the render target, the framebuffer state persists across batches. */
+static uint32_t
+bench_build_setup(uint32_t *cmd, uint32_t res_handle)
+{
+   const uint32_t surf_handle = 1;
+   uint32_t n = 0;
+
+   cmd[n++] = VIRGL_CMD0(VIRGL_CCMD_CREATE_OBJECT, VIRGL_OBJECT_SURFACE, VIRGL_OBJ_SURFACE_SIZE);
+   cmd[n++] = surf_handle;
+   cmd[n++] = res_handle;
+   cmd[n++] = VIRGL_FORMAT_B8G8R8A8_UNORM;
+   cmd[n++] = 0; /* level */
+   cmd[n++] = 0; /* first and last layer */
+
+   cmd[n++] = VIRGL_CMD0(VIRGL_CCMD_SET_FRAMEBUFFER_STATE, 0, VIRGL_SET_FRAMEBUFFER_STATE_SIZE(1));
+   cmd[n++] = 1; /* nr_cbufs */
+   cmd[n++] = 0; /* zsurf */
+   cmd[n++] = surf_handle;
+
+   return n;
+}
+
+static uint32_t
+bench_build_batch(uint32_t *cmd)
+{
+   uint32_t n = 0;
+
+   for (uint32_t i = 0; i < BENCH_CLEARS; i++) {
+      const float color = (float)i / BENCH_CLEARS;
+
+      cmd[n++] = VIRGL_CMD0(VIRGL_CCMD_CLEAR, 0, VIRGL_OBJ_CLEAR_SIZE);
+      cmd[n++] = PIPE_CLEAR_COLOR0;
+      for (uint32_t c = 0; c < 4; c++)
+         memcpy(&cmd[n++], &color, sizeof(color));
+      memset(&cmd[n], 0, sizeof(uint32_t) * 3); /* depth as double, stencil */
+      n += 3;
+   }
+
+   return n;
+}
+
+static bool
+bench_wait_idle(int fd)
+{
+   const uint32_t args[VCMD_BUSY_WAIT_SIZE] = {
+      [VCMD_BUSY_WAIT_HANDLE] = 0,
+      [VCMD_BUSY_WAIT_FLAGS] = VCMD_BUSY_WAIT_FLAG_WAIT,
+   };
+   uint32_t reply[VTEST_HDR_SIZE + 1];
+
+   return bench_send(fd, VCMD_RESOURCE_BUSY_WAIT, args, VCMD_BUSY_WAIT_SIZE) &&
+          bench_read(fd, reply, sizeof(reply));
+}
+
+/* Sets up a context with the capset and a sync to do round trips on, which
+ * needs protocol version 3.  Returns the sync id, or 0 on failure.
+ */
+static uint32_t
+bench_setup_sync(int fd, uint32_t capset)
+{
+   const char name[] = "vtest_bench";
+   const uint32_t name_hdr[VTEST_HDR_SIZE] = {
+      [VTEST_CMD_LEN] = sizeof(name),
+      [VTEST_CMD_ID] = VCMD_CREATE_RENDERER,
+   };
+   if (!bench_write(fd, name_hdr, sizeof(name_hdr)) || !bench_write(fd, name, sizeof(name)))
+      return 0;
+
+   const uint32_t version[VCMD_PROTOCOL_VERSION_SIZE] = {
+      [VCMD_PROTOCOL_VERSION_VERSION] = 3,
+   };
+   uint32_t reply[VTEST_HDR_SIZE + 1];
+   if (!bench_send(fd, VCMD_PROTOCOL_VERSION, version, VCMD_PROTOCOL_VERSION_SIZE) ||
+       !bench_read(fd, reply, sizeof(reply)) || reply[VTEST_CMD_DATA_START] < 3)
+      return 0;
+
+   const uint32_t init[VCMD_CONTEXT_INIT_SIZE] = {
+      [VCMD_CONTEXT_INIT_CAPSET_ID] = capset,
+   };
+   if (!bench_send(fd, VCMD_CONTEXT_INIT, init, VCMD_CONTEXT_INIT_SIZE))
+      return 0;
+
+   /* this initializes the context */
+   const uint32_t create[VCMD_SYNC_CREATE_SIZE] = { 0 };
+   if (!bench_send(fd, VCMD_SYNC_CREATE, create, VCMD_SYNC_CREATE_SIZE) ||
+       !bench_read(fd, reply, sizeof(reply)))
+      return 0;
+
+   return reply[VTEST_CMD_DATA_START];
+}
+
+static bool
+bench_sync_round_trip(int fd, uint32_t sync_id, uint64_t value, uint32_t delay_us)
+{
+   const uint32_t write_hdr[VTEST_HDR_SIZE] = {
+      [VTEST_CMD_LEN] = VCMD_SYNC_WRITE_SIZE,
+      [VTEST_CMD_ID] = VCMD_SYNC_WRITE,
+   };
+   const uint32_t write_args[VCMD_SYNC_WRITE_SIZE] = {
+      [VCMD_SYNC_WRITE_ID] = sync_id,
+      [VCMD_SYNC_WRITE_VALUE_LO] = (uint32_t)value,
+      [VCMD_SYNC_WRITE_VALUE_HI] = (uint32_t)(value >> 32),
+   };
+   const uint32_t read_args[VCMD_SYNC_READ_SIZE] = {
+      [VCMD_SYNC_READ_ID] = sync_id,
+   };
+   uint32_t reply[VTEST_HDR_SIZE + 2];
+
+   if (!bench_write(fd, write_hdr, sizeof(write_hdr)))
+      return false;
+   if (delay_us)
+      usleep(delay_us);
+
+   return bench_write(fd, write_args, sizeof(write_args)) &&
+          bench_send(fd, VCMD_SYNC_READ, read_args, VCMD_SYNC_READ_SIZE) &&
+          bench_read(fd, reply, sizeof(reply)) &&
+          reply[VTEST_CMD_DATA_START] == (uint32_t)value;
+}
+
+/* Starts timing all clients together. */
+static bool
+bench_wait_start(int ready_fd, int start_fd)
+{
+   char c = 0;
+
+   if (write(ready_fd, &c, 1) != 1)
+      return false;
+   close(ready_fd);
+
+   return read(start_fd, &c, 1) == 1;
+}
+
+/* Runs in each client process, the result is written to result_fd. */
+static int
+bench_client(const struct bench_config *config, uint32_t index, int ready_fd, int start_fd,
+             int result_fd)
+{
+   const uint32_t res_handle = index + 1;
+   uint32_t setup[BENCH_SETUP_DWORDS];
+   uint32_t batch[BENCH_BATCH_DWORDS];
+   uint32_t sync_id = 0;
+
+   const int fd = bench_connect(config->socket_path);
+   if (fd < 0) {
+      fprintf(stderr, "failed to connect to %s: %s\n", config->socket_path, strerror(errno));
+      return 1;
+   }
+
+   const uint32_t setup_len = bench_build_setup(setup, res_handle);
+   const uint32_t batch_len = bench_build_batch(batch);
+
+   if (config->capset) {
+      sync_id = bench_setup_sync(fd, config->capset);
+      if (!sync_id || !bench_sync_round_trip(fd, sync_id, 1, 0))
+         return 1;
+   } else {
+      /* one warm-up batch to exclude shader and context creation */
+      if (!bench_setup(fd, res_handle) ||
+          !bench_send(fd, VCMD_SUBMIT_CMD, setup, setup_len) ||
+          !bench_send(fd, VCMD_SUBMIT_CMD, batch, batch_len) || !bench_wait_idle(fd))
+         return 1;
+   }
+
+   if (!bench_wait_start(ready_fd, start_fd))
+      return 1;
+
+   const uint64_t start = bench_now_ns();
+   if (config->capset) {
+      for (uint32_t i = 0; i < config->submits; i++) {
+         if (!bench_sync_round_trip(fd, sync_id, i + 2, index ? 0 : config->delay_us))
+            return 1;
+      }
+   } else {
+      for (uint32_t i = 0; i < config->submits; i++) {
+         if (!bench_send(fd, VCMD_SUBMIT_CMD, batch, batch_len))
+            return 1;
+      }
+      if (!bench_wait_idle(fd))
+         return 1;
+   }
+
+   const struct bench_result result = {
+      .submit_count = config->submits,
+      .elapsed_ns = bench_now_ns() - start,
+   };
+
+   close(fd);
+
+   return write(result_fd, &result, sizeof(result)) == sizeof(result) ? 0 : 1;
+}
+
+static int
+bench_run(const struct bench_config *config, uint32_t clients)
+{
+   int ready_pipe[2], start_pipe[2], result_pipe[2];
+   if (pipe(ready_pipe) || pipe(start_pipe) || pipe(result_pipe)) {
+      perror("pipe");
+      return 1;
+   }
+
+   for (uint32_t i = 0; i < clients; i++) {
+      const pid_t pid = fork();
+      if (pid < 0) {
+         perror("fork");
+         return 1;
+      }
+      if (!pid)
+         _exit(bench_client(config, i, ready_pipe[1], start_pipe[0], result_pipe[1]));
+   }
+
+   close(ready_pipe[1]);
+   close(start_pipe[0]);
+   close(result_pipe[1]);
+
+   uint32_t ready = 0;
+   char c = 0;
+   while (ready < clients && read(ready_pipe[0], &c, 1) == 1)
+      ready++;
+   for (uint32_t i = 0; i < ready; i++) {
+      if (write(start_pipe[1], &c, 1) != 1)
+         break;
+   }
+
+   uint64_t submit_count = 0;
+   uint64_t elapsed_ns = 0;
+   /* the clients finish at different times with -d */
+   double round_trip_rate = 0.0;
+   uint32_t done = 0;
+   struct bench_result result;
+   while (bench_read(result_pipe[0], &result, sizeof(result))) {
+      submit_count += result.submit_count;
+      round_trip_rate += result.submit_count * 1e9 / result.elapsed_ns;
+      if (elapsed_ns < result.elapsed_ns)
+         elapsed_ns = result.elapsed_ns;
+      done++;
+   }
+
+   close(ready_pipe[0]);
+   close(start_pipe[1]);
+   close(result_pipe[0]);
+
+   int status, failed = 0;
+   while (wait(&status) > 0)
+      failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+
+   if (failed || done != clients) {
+      fprintf(stderr, "%u of %u clients failed\n", clients - done, clients);
+      return 1;
+   }
+
+   if (config->capset) {
+      printf("%2u client(s): %8.1f round trips/s\n", clients, round_trip_rate);
+   } else {
+      printf("%2u client(s): %8.1f submits/s, %8.1f clears/s\n", clients,
+             submit_count * 1e9 / elapsed_ns,
+             submit_count * BENCH_CLEARS * 1e9 / elapsed_ns);
+   }
+
+   return 0;
+}
+
+static void
+usage(const char *name)
+{
+   fprintf(stderr, "usage: %s [-n submits] [-j max_clients] [-c capset [-d delay_us]] "
+                   "[socket_path]\n", name);
+}
+
+int
+main(int argc, char **argv)
+{
+   struct bench_config config = {
+      .socket_path = VTEST_DEFAULT_SOCKET_NAME,
+      .submits = 500,
+   };
+   uint32_t max_clients = 8;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "n:j:c:d:")) != -1) {
+      switch (opt) {
+      case 'n':
+         config.submits = atoi(optarg);
+         break;
+      case 'j':
+         max_clients = atoi(optarg);
+         break;
+      case 'c':
+         config.capset = atoi(optarg);
+         break;
+      case 'd':
+         config.delay_us = atoi(optarg);
+         break;
+      default:
+         usage(argv[0]);
+         return 1;
+      }
+   }
+
+   if (optind < argc - 1 || !config.submits || !max_clients ||
+       (config.delay_us && !config.capset)) {
+      usage(argv[0]);
+      return 1;
+   }
+   if (optind < argc)
+      config.socket_path = argv[optind];
+
+   for (uint32_t clients = 1; clients <= max_clients; clients *= 2) {
+      if (bench_run(&config, clients))
+         return 1;
+   }
+
+   return 0;
+}
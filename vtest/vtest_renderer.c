@@ -47,13 +47,11 @@
 #ifdef HAVE_EVENTFD_H
 #include <sys/eventfd.h>
 #endif
-#if defined (__FreeBSD__)
-#include <sys/stat.h>
-#endif
 
 #include "vtest.h"
 #include "vtest_shm.h"
 #include "vtest_protocol.h"
+#include "vtest_trace.h"
 #include "threadpool.h"
 
 #include "util.h"
@@ -63,7 +61,9 @@
 #include "util/u_memory.h"
 #include "util/u_pointer.h"
 #include "util/u_hash_table.h"
+#include "util/u_thread.h"
 #include "drm.h"
+#include "virtgpu_drm.h"
 
 #ifndef WIN32
 #include "util/libsync.h"
@@ -82,6 +82,9 @@ struct vtest_resource {
    uint32_t res_id;
 
    struct iovec iov;
+
+   /* what the trace knows of the shm in iov */
+   void *trace_shadow;
 };
 
 struct vtest_sync {
@@ -194,9 +197,19 @@ struct vtest_renderer {
    struct list_head free_syncs;
    int next_sync_id;
 
-   struct vtest_context *current_context;
+   /* capturing the client input, see VTEST_SAVE */
+   struct vtest_trace *trace;
+
+   /* released while blocked on a client, see vtest_set_dispatch_lock */
+   mtx_t *dispatch_lock;
 };
 
+/* The context of the command being dispatched.  It is per thread because
+ * the server may dispatch the commands of some clients on their own threads,
+ * see vtest_context_avoids_vrend.
+ */
+static __THREAD_INITIAL_EXEC struct vtest_context *current_context;
+
 /*
  * VCMD_RESOURCE_BUSY_WAIT is used to wait GPU works (VCMD_SUBMIT_CMD) or CPU
  * works (VCMD_TRANSFER_GET2).  A fence is needed only for GPU works.
@@ -271,6 +284,7 @@ static struct vtest_resource *vtest_new_resource(uint32_t client_res_id)
    res->res_id = client_res_id ? client_res_id : res->server_res_id;
    res->iov.iov_base = NULL;
    res->iov.iov_len = 0;
+   res->trace_shadow = NULL;
 
    return res;
 }
@@ -284,6 +298,7 @@ static void vtest_unref_resource(struct vtest_resource *res)
 
    if (res->iov.iov_base)
       munmap(res->iov.iov_base, res->iov.iov_len);
+   free(res->trace_shadow);
 
    list_add(&res->head, &renderer.free_resources);
 }
@@ -373,7 +388,12 @@ sync_destroy_func(void *value)
    vtest_unref_sync(sync);
 }
 
-static int vtest_block_write(int fd, void *buf, int size)
+void vtest_set_dispatch_lock(mtx_t *lock)
+{
+   renderer.dispatch_lock = lock;
+}
+
+static int vtest_fd_write(int fd, void *buf, int size)
 {
    char *ptr = buf;
    int left;
@@ -393,13 +413,27 @@ static int vtest_block_write(int fd, void *buf, int size)
    return size;
 }
 
+/* A client that does not drain its socket must not stall the others. */
+static int vtest_block_write(int fd, void *buf, int size)
+{
+   int ret;
+
+   if (!renderer.dispatch_lock)
+      return vtest_fd_write(fd, buf, size);
+
+   mtx_unlock(renderer.dispatch_lock);
+   ret = vtest_fd_write(fd, buf, size);
+   mtx_lock(renderer.dispatch_lock);
+
+   return ret;
+}
+
 int vtest_block_read(struct vtest_input *input, void *buf, int size)
 {
    int fd = input->data.fd;
    char *ptr = buf;
    int left;
    int ret;
-   static int savefd = -1;
 
    left = size;
    do {
@@ -412,26 +446,8 @@ int vtest_block_read(struct vtest_input *input, void *buf, int size)
       ptr += ret;
    } while (left);
 
-   if (getenv("VTEST_SAVE")) {
-      if (savefd == -1) {
-#if defined (__FreeBSD__)
-        savefd = open(getenv("VTEST_SAVE"),
-                      O_CLOEXEC | O_CREAT | O_WRONLY | O_TRUNC | O_SYNC, S_IRUSR | S_IWUSR);
-
-#else
-        savefd = open(getenv("VTEST_SAVE"),
-                      O_CLOEXEC | O_CREAT | O_WRONLY | O_TRUNC | O_DSYNC, S_IRUSR | S_IWUSR);
-#endif
-         if (savefd == -1) {
-            perror("error opening save file");
-            exit(1);
-         }
-      }
-      if (write(savefd, buf, size) != size) {
-         perror("failed to save");
-         exit(1);
-      }
-   }
+   if (renderer.trace)
+      vtest_trace_write_input(renderer.trace, buf, size);
 
    return size;
 }
@@ -462,7 +478,11 @@ static int vtest_send_fd(int socket_fd, int fd)
 
     *((int *) CMSG_DATA(cmsg)) = fd;
 
+    if (renderer.dispatch_lock)
+       mtx_unlock(renderer.dispatch_lock);
     int size = sendmsg(socket_fd, &msgh, 0);
+    if (renderer.dispatch_lock)
+       mtx_lock(renderer.dispatch_lock);
     if (size < 0) {
       return report_failure("Failed to send fd", -EINVAL);
     }
@@ -592,13 +612,48 @@ drm_sync_wait_run(void *job)
 
    vtest_call_drm_sync_wait(wait);
 
+   /* the pool threads do not hold the dispatch lock */
    uint32_t resp[2] = { wait->first_signaled, wait->ret };
-   vtest_block_write(wait->pipe_fd, resp, sizeof(resp));
+   vtest_fd_write(wait->pipe_fd, resp, sizeof(resp));
 
    vtest_free_drm_sync_wait(wait);
 }
 #endif /* ENABLE_DRM */
 
+/* The trace starts with the caps, because the client makes its choices from
+ * them.  The input of several clients can not be told apart, so the trace
+ * is only captured when there is a single client.
+ */
+static void vtest_init_trace(void)
+{
+   const char *path = getenv("VTEST_SAVE");
+   uint32_t caps_version = 0, caps_size = 0;
+   void *caps = NULL;
+
+   if (!path)
+      return;
+
+   if (renderer.multi_clients) {
+      fprintf(stderr, "VTEST_SAVE is ignored with multiple clients\n");
+      return;
+   }
+
+   if (!(renderer.ctx_flags & VIRGL_RENDERER_NO_VIRGL)) {
+      virgl_renderer_get_cap_set(2, &caps_version, &caps_size);
+      caps = calloc(1, caps_size);
+      if (!caps)
+         caps_size = 0;
+      else
+         virgl_renderer_fill_caps(2, caps_version, caps);
+   }
+
+   renderer.trace = vtest_trace_create(path, caps, caps_size, caps_version);
+   if (!renderer.trace)
+      exit(1);
+
+   free(caps);
+}
+
 int vtest_init_renderer(bool multi_clients,
                         int ctx_flags,
                         const char *render_device)
@@ -622,6 +677,8 @@ int vtest_init_renderer(bool multi_clients,
    renderer.multi_clients = multi_clients;
    renderer.ctx_flags = ctx_flags;
 
+   vtest_init_trace();
+
    return 0;
 }
 
@@ -642,7 +699,7 @@ void vtest_cleanup_renderer(void)
       list_inithead(&renderer.free_contexts);
 
       renderer.next_context_id = 1;
-      renderer.current_context = NULL;
+      current_context = NULL;
    }
 
    if (renderer.next_resource_id > 1) {
@@ -668,6 +725,11 @@ void vtest_cleanup_renderer(void)
       renderer.next_sync_id = 1;
    }
 
+   if (renderer.trace) {
+      vtest_trace_destroy(renderer.trace);
+      renderer.trace = NULL;
+   }
+
    virgl_renderer_cleanup(&renderer);
 }
 
@@ -813,8 +875,8 @@ void vtest_destroy_context(struct vtest_context *ctx)
    UNUSED struct vtest_drm_sync_wait *drm_wait, *drm_wait_tmp;
    uint32_t i;
 
-   if (renderer.current_context == ctx) {
-      renderer.current_context = NULL;
+   if (current_context == ctx) {
+      current_context = NULL;
    }
    list_del(&ctx->head);
 
@@ -855,14 +917,29 @@ int vtest_get_context_poll_fd(struct vtest_context *ctx)
    return virgl_renderer_context_get_poll_fd(ctx->ctx_id);
 }
 
+bool vtest_context_avoids_vrend(struct vtest_context *ctx)
+{
+   if (!ctx->context_initialized)
+      return false;
+
+   switch (ctx->capset_id) {
+   case 0:
+   case VIRTGPU_DRM_CAPSET_VIRGL:
+   case VIRTGPU_DRM_CAPSET_VIRGL2:
+      return false;
+   default:
+      return true;
+   }
+}
+
 void vtest_set_current_context(struct vtest_context *ctx)
 {
-   renderer.current_context = ctx;
+   current_context = ctx;
 }
 
 static struct vtest_context *vtest_get_current_context(void)
 {
-   return renderer.current_context;
+   return current_context;
 }
 
 int vtest_ping_protocol_version(UNUSED uint32_t length_dw)
@@ -1242,6 +1319,15 @@ static int vtest_create_resource_setup_shm(struct vtest_resource *res,
    res->iov.iov_base = ptr;
    res->iov.iov_len = size;
 
+   /* the new shm is zeroed */
+   if (renderer.trace) {
+      res->trace_shadow = calloc(1, size);
+      if (!res->trace_shadow) {
+         close(fd);
+         return -ENOMEM;
+      }
+   }
+
    return fd;
 }
 
@@ -1466,6 +1552,70 @@ int vtest_resource_unref(UNUSED uint32_t length_dw)
    return 0;
 }
 
+/* Saves what the client wrote to the shm of a resource since the last time
+ * into the trace, one run of changed pages at a time.
+ */
+static enum pipe_error vtest_trace_resource_shm(UNUSED void *key, void *value,
+                                                UNUSED void *data)
+{
+   struct vtest_resource *res = value;
+   const size_t page_size = 4096;
+   const char *shm = res->iov.iov_base;
+   char *shadow = res->trace_shadow;
+   size_t start = 0;
+
+   if (!shadow)
+      return PIPE_OK;
+
+   while (start < res->iov.iov_len) {
+      size_t end;
+
+      if (!memcmp(shm + start, shadow + start, MIN2(page_size, res->iov.iov_len - start))) {
+         start += page_size;
+         continue;
+      }
+
+      end = start + page_size;
+      while (end < res->iov.iov_len &&
+             memcmp(shm + end, shadow + end, MIN2(page_size, res->iov.iov_len - end)))
+         end += page_size;
+      end = MIN2(end, res->iov.iov_len);
+
+      memcpy(shadow + start, shm + start, end - start);
+      vtest_trace_write_shm(renderer.trace, res->res_id, start, shadow + start, end - start);
+
+      start = end;
+   }
+
+   return PIPE_OK;
+}
+
+/* Called by the commands that make the host read the shm, right after their
+ * arguments are read, which is when a replay applies the shm records.
+ */
+static void vtest_trace_shm(struct vtest_context *ctx)
+{
+   if (renderer.trace)
+      util_hash_table_foreach(ctx->resource_table, vtest_trace_resource_shm, NULL);
+}
+
+int vtest_write_resource_shm(uint32_t res_id, uint32_t offset, const void *data, uint32_t size)
+{
+   struct vtest_context *ctx = vtest_get_current_context();
+   struct vtest_resource *res;
+
+   res = util_hash_table_get(ctx->resource_table, intptr_to_pointer(res_id));
+   if (!res)
+      return report_failed_call("util_hash_table_get", -ESRCH);
+
+   if (offset > res->iov.iov_len || size > res->iov.iov_len - offset)
+      return report_failed_call("vtest_write_resource_shm", -EINVAL);
+
+   memcpy((char *)res->iov.iov_base + offset, data, size);
+
+   return 0;
+}
+
 int vtest_submit_cmd(uint32_t length_dw)
 {
    struct vtest_context *ctx = vtest_get_current_context();
@@ -1487,6 +1637,8 @@ int vtest_submit_cmd(uint32_t length_dw)
       return -1;
    }
 
+   vtest_trace_shm(ctx);
+
    ret = virgl_renderer_submit_cmd(cbuf, ctx->ctx_id, length_dw);
 
    free(cbuf);
@@ -1769,6 +1921,8 @@ int vtest_transfer_put2(UNUSED uint32_t length_dw)
       return ret;
    }
 
+   vtest_trace_shm(ctx);
+
    return vtest_transfer_put_internal(ctx, &args, 0, true);
 }
 
@@ -2220,17 +2374,6 @@ int vtest_sync_wait(uint32_t length_dw)
    return ret;
 }
 
-// HACK
-#define VIRTGPU_EXECBUF_SYNCOBJ_RESET		0x01
-#define VIRTGPU_EXECBUF_SYNCOBJ_FLAGS ( \
-		VIRTGPU_EXECBUF_SYNCOBJ_RESET | \
-		0)
-struct drm_virtgpu_execbuffer_syncobj {
-	__u32 handle;
-	__u32 flags;
-	__u64 point;
-};
-
 static int vtest_submit_cmd2_batch(struct vtest_context *ctx,
                                    const struct vcmd_submit_cmd2_batch *batch,
                                    const uint32_t *cmds,
@@ -2430,6 +2573,8 @@ int vtest_submit_cmd2(uint32_t length_dw)
       return -1;
    }
 
+   vtest_trace_shm(ctx);
+
    batch_count = submit_cmd2_buf[VCMD_SUBMIT_CMD2_BATCH_COUNT];
    if (length_dw < VCMD_SUBMIT_CMD2_BATCH_RING_IDX(batch_count - 1)) {
       free(submit_cmd2_buf);
@@ -26,6 +26,7 @@
 #include "config.h"
 #endif
 
+#include <errno.h>
 #include <stdio.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -37,7 +38,9 @@
 #include <sys/un.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <string.h>
+#include <time.h>
 
 #include "util.h"
 #include "util/list.h"
@@ -47,10 +50,17 @@
 #include "vtest_protocol.h"
 #include "virglrenderer.h"
 #include "vtest_server.h"
+#include "vtest_trace.h"
 #include "virgl_util.h"
+#include "c11/threads.h"
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 
 enum vtest_client_result {
    VTEST_CLIENT_DISCONNECTED = 1,
@@ -70,10 +80,22 @@ struct vtest_client
 
    struct list_head head;
 
+   /* the reader of read_file, which owns in_fd */
+   struct vtest_trace_reader *trace;
+
    bool in_fd_ready;
    struct vtest_context *context;
    int context_poll_fd;
    bool context_need_poll;
+
+#ifdef HAVE_SYS_EPOLL_H
+   /* whether context_poll_fd is in the epoll set of the main thread */
+   bool context_poll_fd_watched;
+
+   /* served by its own thread, see vtest_server_detach_client */
+   bool threaded;
+   thrd_t thread;
+#endif
 };
 
 struct vtest_server
@@ -88,6 +110,7 @@ struct vtest_server
    bool do_fork;
    bool loop;
    bool multi_clients;
+   bool threaded_clients;
 
    bool use_glx;
    bool use_egl_surfaceless;
@@ -97,12 +120,43 @@ struct vtest_server
    bool no_virgl;
    bool use_compat_profile;
    bool drm;
+   bool threaded_contexts;
+   bool const_ring;
+   bool speculative_shaders;
+   bool resource_pool;
+
+   /* renderer initializations to time instead of serving clients */
+   int benchmark_init;
+
+   /* replays of read_file to time, after the warm-up ones */
+   int replay_iterations;
+   int replay_warmup;
+   int replay_count;
+   bool replay_timing;
+   uint64_t replay_elapsed_ns;
 
    int ctx_flags;
 
    struct list_head new_clients;
    struct list_head active_clients;
    struct list_head inactive_clients;
+
+#ifdef HAVE_SYS_EPOLL_H
+   /* clients served by their own threads */
+   struct list_head thread_clients;
+
+   int epoll_fd;
+   int wake_fd;
+
+   /* Serializes the calls into virglrenderer and the state vtest_renderer.c
+    * shares between the clients, such as the free lists and the syncs, as
+    * well as the client lists above.  It is released whenever a thread
+    * blocks on its client, be it reading a command or writing a reply.  The
+    * threads of the clients never reach vrend, whose context is current on
+    * the main thread only.
+    */
+   mtx_t dispatch_lock;
+#endif
 };
 
 struct vtest_server server = {
@@ -118,7 +172,14 @@ struct vtest_server server = {
    .loop = true,
    .multi_clients = false,
 
+   .replay_warmup = 1,
+
    .ctx_flags = 0,
+
+#ifdef HAVE_SYS_EPOLL_H
+   .epoll_fd = -1,
+   .wake_fd = -1,
+#endif
 };
 
 static void vtest_server_getenv(void);
@@ -128,6 +189,8 @@ static void vtest_server_set_signal_segv(void);
 static void vtest_server_open_read_file(void);
 static void vtest_server_open_socket(void);
 static void vtest_server_run(void);
+static void vtest_server_benchmark_init(void);
+static void vtest_server_report_replay(void);
 static void vtest_server_close_socket(void);
 static int vtest_client_dispatch_commands(struct vtest_client *client);
 
@@ -141,9 +204,17 @@ while (__AFL_LOOP(1000)) {
    vtest_server_getenv();
    vtest_server_parse_args(argc, argv);
 
+   if (server.benchmark_init) {
+      vtest_server_benchmark_init();
+      return 0;
+   }
+
    list_inithead(&server.new_clients);
    list_inithead(&server.active_clients);
    list_inithead(&server.inactive_clients);
+#ifdef HAVE_SYS_EPOLL_H
+   list_inithead(&server.thread_clients);
+#endif
 
    if (server.do_fork) {
       vtest_server_set_signal_child();
@@ -176,6 +247,14 @@ while (__AFL_LOOP(1000)) {
 #define OPT_NO_VIRGL 'g'
 #define OPT_COMPAT_PROFILE 'c'
 #define OPT_DRM 'd'
+#define OPT_THREADED_CONTEXTS 't'
+#define OPT_BENCHMARK_INIT 'b'
+#define OPT_CONST_RING 'k'
+#define OPT_SPECULATIVE_SHADERS 'h'
+#define OPT_THREADED_CLIENTS 'a'
+#define OPT_BENCHMARK 'y'
+#define OPT_WARMUP 'w'
+#define OPT_RESOURCE_POOL 'o'
 
 static void vtest_server_parse_args(int argc, char **argv)
 {
@@ -194,6 +273,14 @@ static void vtest_server_parse_args(int argc, char **argv)
       {"no-virgl",            no_argument, NULL, OPT_NO_VIRGL},
       {"compat",              no_argument, NULL, OPT_COMPAT_PROFILE},
       {"drm",                 no_argument, NULL, OPT_DRM},
+      {"threaded-contexts",   no_argument, NULL, OPT_THREADED_CONTEXTS},
+      {"benchmark-init",      optional_argument, NULL, OPT_BENCHMARK_INIT},
+      {"const-ring",          no_argument, NULL, OPT_CONST_RING},
+      {"speculative-shaders", no_argument, NULL, OPT_SPECULATIVE_SHADERS},
+      {"resource-pool",       no_argument, NULL, OPT_RESOURCE_POOL},
+      {"threaded-clients",    no_argument, NULL, OPT_THREADED_CLIENTS},
+      {"benchmark",           optional_argument, NULL, OPT_BENCHMARK},
+      {"warmup",              required_argument, NULL, OPT_WARMUP},
       {0, 0, 0, 0}
    };
 
@@ -243,6 +330,50 @@ static void vtest_server_parse_args(int argc, char **argv)
       case OPT_SOCKET_PATH:
          server.socket_name = optarg;
          break;
+      case OPT_THREADED_CONTEXTS:
+         /* forked clients would each have a renderer of their own */
+         server.do_fork = false;
+         server.threaded_contexts = true;
+         break;
+      case OPT_CONST_RING:
+         server.const_ring = true;
+         break;
+      case OPT_SPECULATIVE_SHADERS:
+         server.speculative_shaders = true;
+         break;
+      case OPT_RESOURCE_POOL:
+         server.resource_pool = true;
+         break;
+#ifdef HAVE_SYS_EPOLL_H
+      case OPT_THREADED_CLIENTS:
+         printf("threaded-clients enabled: clients must trust each other, "
+                "and only their I/O runs concurrently\n");
+         server.do_fork = false;
+         server.multi_clients = true;
+         server.threaded_clients = true;
+         break;
+#endif
+      case OPT_BENCHMARK_INIT:
+         server.benchmark_init = optarg ? atoi(optarg) : 10;
+         if (server.benchmark_init <= 0) {
+            fprintf(stderr, "Invalid number of initializations: %s\n", optarg);
+            exit(EXIT_FAILURE);
+         }
+         break;
+      case OPT_BENCHMARK:
+         server.replay_iterations = optarg ? atoi(optarg) : 10;
+         if (server.replay_iterations <= 0) {
+            fprintf(stderr, "Invalid number of replays: %s\n", optarg);
+            exit(EXIT_FAILURE);
+         }
+         break;
+      case OPT_WARMUP:
+         server.replay_warmup = atoi(optarg);
+         if (server.replay_warmup < 0) {
+            fprintf(stderr, "Invalid number of warm-up replays: %s\n", optarg);
+            exit(EXIT_FAILURE);
+         }
+         break;
 #ifdef ENABLE_DRM
       case OPT_DRM:
          server.drm = true;
@@ -251,7 +382,13 @@ static void vtest_server_parse_args(int argc, char **argv)
       default:
          printf("Usage: %s [--no-fork] [--no-loop-or-fork] [--multi-clients] "
                 "[--use-glx] [--use-egl-surfaceless] [--use-gles] [--no-virgl]"
-                "[--rendernode <dev>] [--socket-path <path>] "
+                "[--rendernode <dev>] [--socket-path <path>] [--threaded-contexts]"
+                " [--benchmark-init[=<count>]] [--const-ring] [--speculative-shaders]"
+                " [--resource-pool]"
+#ifdef HAVE_SYS_EPOLL_H
+                " [--threaded-clients]"
+#endif
+                " [--benchmark[=<iterations>] [--warmup=<count>]]"
 #ifdef ENABLE_VENUS
                 " [--venus]"
 #endif
@@ -259,6 +396,10 @@ static void vtest_server_parse_args(int argc, char **argv)
                 " [--drm]"
 #endif
                 " [file]\n", argv[0]);
+#ifdef HAVE_SYS_EPOLL_H
+         printf("  --threaded-clients  read and reply to each client on a thread of its own;\n"
+                "                      the calls into virglrenderer stay serialized\n");
+#endif
          exit(EXIT_FAILURE);
          break;
       }
@@ -270,6 +411,16 @@ static void vtest_server_parse_args(int argc, char **argv)
       server.loop = false;
       server.do_fork = false;
       server.multi_clients = false;
+      server.threaded_clients = false;
+   } else if (server.replay_iterations) {
+      fprintf(stderr, "--benchmark needs a file to replay.\n");
+      exit(EXIT_FAILURE);
+   }
+
+   /* the vrend context threads would run under dispatch_lock too */
+   if (server.threaded_clients && server.threaded_contexts) {
+      fprintf(stderr, "Cannot use threaded contexts with threaded clients.\n");
+      exit(EXIT_FAILURE);
    }
 
    if (!server.no_virgl) {
@@ -294,6 +445,15 @@ static void vtest_server_parse_args(int argc, char **argv)
          }
          server.ctx_flags |= VIRGL_RENDERER_COMPAT_PROFILE;
       }
+
+      if (server.threaded_contexts)
+         server.ctx_flags |= VIRGL_RENDERER_THREADED_CONTEXTS;
+      if (server.const_ring)
+         server.ctx_flags |= VIRGL_RENDERER_USE_CONST_RING;
+      if (server.speculative_shaders)
+         server.ctx_flags |= VIRGL_RENDERER_SPECULATIVE_SHADERS;
+      if (server.resource_pool)
+         server.ctx_flags |= VIRGL_RENDERER_USE_RESOURCE_POOL;
    } else {
       server.ctx_flags = VIRGL_RENDERER_NO_VIRGL;
    }
@@ -307,6 +467,56 @@ static void vtest_server_parse_args(int argc, char **argv)
    }
 }
 
+static uint64_t vtest_server_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Times what every client waits for in fork mode before its first command:
+ * the renderer initialization and the caps it queries right after.  The
+ * first initialization fills the probe cache when it is enabled.
+ */
+static void vtest_server_benchmark_init(void)
+{
+   uint64_t first_ns = 0, total_ns = 0, min_ns = UINT64_MAX;
+
+   for (int i = 0; i < server.benchmark_init; i++) {
+      const uint64_t start = vtest_server_now_ns();
+
+      if (vtest_init_renderer(false, server.ctx_flags, server.render_device))
+         exit(EXIT_FAILURE);
+
+      if (!server.no_virgl) {
+         uint32_t max_ver, max_size;
+
+         virgl_renderer_get_cap_set(2, &max_ver, &max_size);
+         void *caps = malloc(max_size);
+         if (caps)
+            virgl_renderer_fill_caps(2, max_ver, caps);
+         free(caps);
+      }
+
+      const uint64_t elapsed = vtest_server_now_ns() - start;
+
+      vtest_cleanup_renderer();
+
+      if (!i)
+         first_ns = elapsed;
+      else
+         total_ns += elapsed;
+      min_ns = MIN2(min_ns, elapsed);
+   }
+
+   printf("renderer init: first %.2f ms", first_ns / 1e6);
+   if (server.benchmark_init > 1)
+      printf(", then mean %.2f ms, min %.2f ms over %d",
+             total_ns / 1e6 / (server.benchmark_init - 1), min_ns / 1e6,
+             server.benchmark_init - 1);
+   printf("\n");
+}
+
 static void vtest_server_getenv(void)
 {
    server.use_glx = getenv("VTEST_USE_GLX") != NULL;
@@ -358,6 +568,31 @@ static void vtest_server_set_signal_segv(void)
    }
 }
 
+static inline bool vtest_client_is_threaded(UNUSED const struct vtest_client *client)
+{
+#ifdef HAVE_SYS_EPOLL_H
+   return client->threaded;
+#else
+   return false;
+#endif
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/* Lets the other threads dispatch while the client is slow to send a
+ * command or its payload.
+ */
+static int vtest_client_read_unlocked(struct vtest_input *input, void *buf, int size)
+{
+   int ret;
+
+   mtx_unlock(&server.dispatch_lock);
+   ret = vtest_block_read(input, buf, size);
+   mtx_lock(&server.dispatch_lock);
+
+   return ret;
+}
+#endif
+
 static int vtest_server_add_client(int in_fd, int out_fd)
 {
    struct vtest_client *client;
@@ -371,6 +606,10 @@ static int vtest_server_add_client(int in_fd, int out_fd)
 
    client->input.data.fd = in_fd;
    client->input.read = vtest_block_read;
+#ifdef HAVE_SYS_EPOLL_H
+   if (server.threaded_clients)
+      client->input.read = vtest_client_read_unlocked;
+#endif
 
    client->context_poll_fd = -1;
 
@@ -379,27 +618,79 @@ static int vtest_server_add_client(int in_fd, int out_fd)
    return 0;
 }
 
+/* Discards the replies to a replayed client, and the fds sent with them. */
+static int vtest_server_drain_output(void *arg)
+{
+   const int fd = (intptr_t)arg;
+   char buf[4096];
+   char cmsg_buf[CMSG_SPACE(sizeof(int))];
+
+   while (true) {
+      struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+      struct msghdr msg = {
+         .msg_iov = &iov,
+         .msg_iovlen = 1,
+         .msg_control = cmsg_buf,
+         .msg_controllen = sizeof(cmsg_buf),
+      };
+      struct cmsghdr *cmsg;
+
+      const ssize_t ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+      if (ret < 0 && errno == EINTR)
+         continue;
+      if (ret <= 0)
+         break;
+
+      for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+         if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            close(*(int *)CMSG_DATA(cmsg));
+      }
+   }
+
+   close(fd);
+
+   return 0;
+}
+
 static void vtest_server_open_read_file(void)
 {
+   struct vtest_client *client;
+   thrd_t drain_thread;
    int in_fd;
-   int out_fd;
+   int out_fds[2];
 
-   in_fd = open(server.read_file, O_RDONLY);
+   in_fd = open(server.read_file, O_RDONLY | O_CLOEXEC);
    if (in_fd == -1) {
       perror(NULL);
       exit(1);
    }
 
-   out_fd = open("/dev/null", O_WRONLY);
-   if (out_fd == -1) {
+   /* the replies go to a socket, because some come with fds */
+   if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, out_fds) ||
+       thrd_create(&drain_thread, vtest_server_drain_output,
+                   (void *)(intptr_t)out_fds[1]) != thrd_success) {
       perror(NULL);
       exit(1);
    }
+   thrd_detach(drain_thread);
 
-   if (vtest_server_add_client(in_fd, out_fd)) {
+   if (vtest_server_add_client(in_fd, out_fds[0])) {
       perror(NULL);
       exit(1);
    }
+
+   client = LIST_ENTRY(struct vtest_client, server.new_clients.prev, head);
+   client->trace = vtest_trace_reader_create(in_fd);
+   if (!client->trace) {
+      fprintf(stderr, "Failed to read %s\n", server.read_file);
+      exit(1);
+   }
+   client->input.data.trace = client->trace;
+   client->input.read = vtest_trace_read;
+
+   server.replay_count++;
+   server.replay_timing = server.replay_iterations &&
+                          server.replay_count > server.replay_warmup;
 }
 
 static void vtest_server_open_socket(void)
@@ -433,6 +724,138 @@ err:
    exit(1);
 }
 
+static void vtest_server_accept_client(void)
+{
+   int new_fd = accept(server.socket, NULL, NULL);
+   if (new_fd < 0) {
+      perror("Failed to accept socket.");
+      exit(1);
+   }
+
+   if (vtest_server_add_client(new_fd, new_fd)) {
+      perror("Failed to add client.");
+      exit(1);
+   }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/* The epoll data of a client fd is the client, with the low bit set for its
+ * context poll fd.  The socket and the wake eventfd have no client.
+ */
+#define VTEST_EPOLL_SOCKET 0
+#define VTEST_EPOLL_WAKE 2
+#define VTEST_EPOLL_CONTEXT_POLL_FD 1
+
+static void vtest_server_watch(int fd, uint64_t data)
+{
+   struct epoll_event ev = {
+      .events = EPOLLIN,
+      .data.u64 = data,
+   };
+
+   if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+      perror("Failed to add fd to epoll");
+      exit(1);
+   }
+}
+
+static void vtest_server_unwatch_client(struct vtest_client *client)
+{
+   epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, client->in_fd, NULL);
+
+   if (client->context_poll_fd_watched) {
+      epoll_ctl(server.epoll_fd, EPOLL_CTL_DEL, client->context_poll_fd, NULL);
+      client->context_poll_fd_watched = false;
+   }
+}
+
+static void vtest_server_wake(void)
+{
+   const uint64_t val = 1;
+
+   if (write(server.wake_fd, &val, sizeof(val)) < 0)
+      perror("Failed to wake the server");
+}
+
+static void vtest_server_init_threads(void)
+{
+   server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+   server.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+   if (server.epoll_fd < 0 || server.wake_fd < 0 ||
+       mtx_init(&server.dispatch_lock, mtx_plain) != thrd_success) {
+      perror("Failed to set up client threads");
+      exit(1);
+   }
+
+   vtest_server_watch(server.socket, VTEST_EPOLL_SOCKET);
+   vtest_server_watch(server.wake_fd, VTEST_EPOLL_WAKE);
+
+   mtx_lock(&server.dispatch_lock);
+   vtest_set_dispatch_lock(&server.dispatch_lock);
+}
+
+static void vtest_server_fini_threads(void)
+{
+   vtest_set_dispatch_lock(NULL);
+   mtx_unlock(&server.dispatch_lock);
+   mtx_destroy(&server.dispatch_lock);
+
+   close(server.wake_fd);
+   close(server.epoll_fd);
+   server.wake_fd = -1;
+   server.epoll_fd = -1;
+}
+
+/* Unlike vtest_server_wait_clients, the set of fds is only updated when a
+ * client comes or goes, and the clients served by their own threads are not
+ * in it.
+ */
+static void vtest_server_wait_clients_epoll(void)
+{
+   struct epoll_event events[32];
+   struct vtest_client *client;
+   int count;
+
+   mtx_unlock(&server.dispatch_lock);
+   do {
+      count = epoll_wait(server.epoll_fd, events, ARRAY_SIZE(events), -1);
+   } while (count < 0 && errno == EINTR);
+   mtx_lock(&server.dispatch_lock);
+
+   if (count < 0) {
+      perror("Failed to wait on epoll!");
+      exit(1);
+   }
+
+   for (int i = 0; i < count; i++) {
+      const uint64_t data = events[i].data.u64;
+
+      if (data == VTEST_EPOLL_SOCKET) {
+         vtest_server_accept_client();
+      } else if (data == VTEST_EPOLL_WAKE) {
+         uint64_t val;
+
+         /* the clients that are done are in inactive_clients already */
+         if (read(server.wake_fd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+            perror("Failed to read the wake eventfd");
+            exit(1);
+         }
+      } else {
+         client = (struct vtest_client *)(uintptr_t)(data & ~(uint64_t)VTEST_EPOLL_CONTEXT_POLL_FD);
+         if (data & VTEST_EPOLL_CONTEXT_POLL_FD)
+            client->context_need_poll = true;
+         else
+            client->in_fd_ready = true;
+      }
+   }
+
+   LIST_FOR_EACH_ENTRY(client, &server.active_clients, head) {
+      if (client->context_poll_fd < 0 && client->context)
+         client->context_need_poll = true;
+   }
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
 static void vtest_server_wait_clients(void)
 {
    struct vtest_client *client;
@@ -440,6 +863,13 @@ static void vtest_server_wait_clients(void)
    int max_fd = -1;
    int ret;
 
+#ifdef HAVE_SYS_EPOLL_H
+   if (server.threaded_clients) {
+      vtest_server_wait_clients_epoll();
+      return;
+   }
+#endif
+
    FD_ZERO(&read_fds);
 
    LIST_FOR_EACH_ENTRY(client, &server.active_clients, head) {
@@ -487,18 +917,8 @@ static void vtest_server_wait_clients(void)
       }
    }
 
-   if (server.socket >= 0 && FD_ISSET(server.socket, &read_fds)) {
-      int new_fd = accept(server.socket, NULL, NULL);
-      if (new_fd < 0) {
-         perror("Failed to accept socket.");
-         exit(1);
-      }
-
-      if (vtest_server_add_client(new_fd, new_fd)) {
-         perror("Failed to add client.");
-         exit(1);
-      }
-   }
+   if (server.socket >= 0 && FD_ISSET(server.socket, &read_fds))
+      vtest_server_accept_client();
 }
 
 static const char *vtest_client_result_string(enum vtest_client_result ret)
@@ -517,6 +937,100 @@ static const char *vtest_client_result_string(enum vtest_client_result ret)
    }
 }
 
+static void vtest_server_retire_client(struct vtest_client *client, int ret)
+{
+   fprintf(ret == VTEST_CLIENT_DISCONNECTED ? stdout : stderr, "client: %s\n",
+           vtest_client_result_string(ret));
+
+   /* the timings of a replay that did not run to the end are meaningless */
+   if (server.replay_iterations && ret != VTEST_CLIENT_DISCONNECTED) {
+      fprintf(stderr, "replay of %s failed\n", server.read_file);
+      exit(EXIT_FAILURE);
+   }
+
+   list_del(&client->head);
+   list_addtail(&client->head, &server.inactive_clients);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static int vtest_client_thread(void *arg)
+{
+   struct vtest_client *client = arg;
+   int ret = 0;
+
+   mtx_lock(&server.dispatch_lock);
+
+   while (!ret) {
+      struct pollfd fds[2] = {
+         { .fd = client->in_fd, .events = POLLIN },
+         { .fd = client->context_poll_fd, .events = POLLIN },
+      };
+      const nfds_t nfds = client->context_poll_fd >= 0 ? 2 : 1;
+      int ready;
+
+      mtx_unlock(&server.dispatch_lock);
+      do {
+         ready = poll(fds, nfds, -1);
+      } while (ready < 0 && errno == EINTR);
+      mtx_lock(&server.dispatch_lock);
+
+      if (ready < 0) {
+         ret = VTEST_CLIENT_ERROR_INPUT_READ;
+         break;
+      }
+
+      /* like in vtest_server_wait_clients, a context without a poll fd is
+       * polled on every wakeup
+       */
+      if (nfds < 2 || fds[1].revents)
+         vtest_poll_context(client->context);
+
+      if (fds[0].revents)
+         ret = vtest_client_dispatch_commands(client);
+   }
+
+   vtest_server_retire_client(client, ret);
+   vtest_server_wake();
+
+   mtx_unlock(&server.dispatch_lock);
+
+   return 0;
+}
+
+/* Moves a client to its own thread once its context is known to never
+ * reach vrend, so that it no longer waits for the other clients between its
+ * commands.  The calls into virglrenderer are still serialized with those of
+ * the others by dispatch_lock, but talking to the client is not.
+ */
+static void vtest_server_detach_client(struct vtest_client *client)
+{
+   vtest_server_unwatch_client(client);
+
+   list_del(&client->head);
+   list_addtail(&client->head, &server.thread_clients);
+
+   client->threaded = true;
+   if (thrd_create(&client->thread, vtest_client_thread, client) != thrd_success) {
+      client->threaded = false;
+      vtest_server_retire_client(client, VTEST_CLIENT_ERROR_CONTEXT_FAILED);
+   }
+}
+
+static void vtest_server_update_client(struct vtest_client *client)
+{
+   if (client->context && vtest_context_avoids_vrend(client->context)) {
+      vtest_server_detach_client(client);
+      return;
+   }
+
+   if (client->context_poll_fd >= 0 && !client->context_poll_fd_watched) {
+      vtest_server_watch(client->context_poll_fd,
+                         (uintptr_t)client | VTEST_EPOLL_CONTEXT_POLL_FD);
+      client->context_poll_fd_watched = true;
+   }
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
 static void vtest_server_dispatch_clients(void)
 {
    struct vtest_client *client, *tmp;
@@ -533,13 +1047,19 @@ static void vtest_server_dispatch_clients(void)
          continue;
       client->in_fd_ready = false;
 
+      const uint64_t start = server.replay_timing ? vtest_server_now_ns() : 0;
       ret = vtest_client_dispatch_commands(client);
+      if (server.replay_timing)
+         server.replay_elapsed_ns += vtest_server_now_ns() - start;
       if (ret) {
-         fprintf(ret == VTEST_CLIENT_DISCONNECTED ? stdout : stderr, "client: %s\n",
-                 vtest_client_result_string(ret));
-         list_del(&client->head);
-         list_addtail(&client->head, &server.inactive_clients);
+         vtest_server_retire_client(client, ret);
+         continue;
       }
+
+#ifdef HAVE_SYS_EPOLL_H
+      if (server.threaded_clients)
+         vtest_server_update_client(client);
+#endif
    }
 }
 
@@ -589,6 +1109,10 @@ static void vtest_server_activate_clients(void)
 
    /* move new clients to the active list */
    LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.new_clients, head) {
+#ifdef HAVE_SYS_EPOLL_H
+      if (server.threaded_clients)
+         vtest_server_watch(client->in_fd, (uintptr_t)client);
+#endif
       list_addtail(&client->head, &server.active_clients);
    }
    list_inithead(&server.new_clients);
@@ -610,10 +1134,23 @@ static void vtest_server_tidy_clients(void)
    struct vtest_client *client, *tmp;
 
    LIST_FOR_EACH_ENTRY_SAFE(client, tmp, &server.inactive_clients, head) {
+#ifdef HAVE_SYS_EPOLL_H
+      /* the thread is done once the client is inactive */
+      if (client->threaded)
+         thrd_join(client->thread, NULL);
+      else if (server.threaded_clients)
+         vtest_server_unwatch_client(client);
+#endif
+
       if (client->context) {
          vtest_destroy_context(client->context);
       }
 
+      if (client->trace) {
+         vtest_trace_reader_destroy(client->trace);
+         client->in_fd = -1;
+      }
+
       if (client->in_fd >= 0) {
          close(client->in_fd);
       }
@@ -628,6 +1165,16 @@ static void vtest_server_tidy_clients(void)
    list_inithead(&server.inactive_clients);
 }
 
+static bool vtest_server_has_clients(void)
+{
+#ifdef HAVE_SYS_EPOLL_H
+   if (!list_is_empty(&server.thread_clients))
+      return true;
+#endif
+
+   return !list_is_empty(&server.active_clients);
+}
+
 static void vtest_server_run(void)
 {
    bool run = true;
@@ -638,8 +1185,13 @@ static void vtest_server_run(void)
       vtest_server_open_socket();
    }
 
+#ifdef HAVE_SYS_EPOLL_H
+   if (server.threaded_clients)
+      vtest_server_init_threads();
+#endif
+
    while (run) {
-      const bool was_empty = list_is_empty(&server.active_clients);
+      const bool was_empty = !vtest_server_has_clients();
       bool is_empty;
 
       vtest_server_wait_clients();
@@ -652,7 +1204,7 @@ static void vtest_server_run(void)
       }
 
       /* init renderer after the first active client is added */
-      is_empty = list_is_empty(&server.active_clients);
+      is_empty = !vtest_server_has_clients();
       if (was_empty && !is_empty) {
          int ret = vtest_init_renderer(server.multi_clients,
                                        server.ctx_flags,
@@ -668,12 +1220,25 @@ static void vtest_server_run(void)
       /* clean up renderer after the last active client is removed */
       if (!was_empty && is_empty) {
          vtest_cleanup_renderer();
-         if (!server.loop) {
+
+         /* replay again, with the renderer in the same state */
+         if (server.read_file && server.replay_iterations &&
+             server.replay_count < server.replay_warmup + server.replay_iterations) {
+            vtest_server_open_read_file();
+         } else if (!server.loop) {
             run = false;
          }
       }
    }
 
+   if (server.replay_iterations)
+      vtest_server_report_replay();
+
+#ifdef HAVE_SYS_EPOLL_H
+   if (server.threaded_clients)
+      vtest_server_fini_threads();
+#endif
+
    vtest_server_close_socket();
 }
 
@@ -732,6 +1297,31 @@ static const struct vtest_command {
    HANDLER(RESOURCE_EXPORT_FD,          resource_export_fd,        true   ),
 };
 
+/* What --benchmark measured over the timed replays. */
+static struct {
+   uint64_t count[ARRAY_SIZE(vtest_commands)];
+   uint64_t ns[ARRAY_SIZE(vtest_commands)];
+   /* transfers back to the client, where a frame would be presented */
+   uint64_t frames;
+} replay_stats;
+
+/* Commands that reach vrend whatever the context is.  A client thread must
+ * not dispatch them, because vrend may only be called from the thread that
+ * initialized it.
+ */
+static bool vtest_command_needs_vrend(uint32_t id)
+{
+   switch (id) {
+   case VCMD_GET_CAPS:
+   case VCMD_GET_CAPS2:
+   case VCMD_GET_CAPSET:
+   case VCMD_RESOURCE_BUSY_WAIT:
+      return true;
+   default:
+      return false;
+   }
+}
+
 static int vtest_client_dispatch_commands(struct vtest_client *client)
 {
    TRACE_FUNC();
@@ -762,7 +1352,10 @@ static int vtest_client_dispatch_commands(struct vtest_client *client)
       return 0;
    }
 
-   vtest_poll_resource_busy_wait();
+   /* the implicit fences are vrend's */
+   if (!vtest_client_is_threaded(client))
+      vtest_poll_resource_busy_wait();
+
    if (header[1] <= 0 || header[1] >= ARRAY_SIZE(vtest_commands)) {
       return VTEST_CLIENT_ERROR_COMMAND_ID;
    }
@@ -772,6 +1365,11 @@ static int vtest_client_dispatch_commands(struct vtest_client *client)
       return VTEST_CLIENT_ERROR_COMMAND_UNEXPECTED;
    }
 
+   if (vtest_client_is_threaded(client) && !server.no_virgl &&
+       vtest_command_needs_vrend(header[1])) {
+      return VTEST_CLIENT_ERROR_COMMAND_UNEXPECTED;
+   }
+
    /* we should consider per-context dispatch table to get rid of if's */
    if (cmd->init_context) {
       ret = vtest_lazy_init_context(client->context);
@@ -783,10 +1381,19 @@ static int vtest_client_dispatch_commands(struct vtest_client *client)
 
    vtest_set_current_context(client->context);
 
+   const uint64_t start = server.replay_timing ? vtest_server_now_ns() : 0;
+
    void *trace_scope = TRACE_SCOPE_BEGIN(cmd->name);
    ret = cmd->dispatch(header[0]);
    TRACE_SCOPE_END(trace_scope);
 
+   if (server.replay_timing) {
+      replay_stats.count[header[1]]++;
+      replay_stats.ns[header[1]] += vtest_server_now_ns() - start;
+      if (header[1] == VCMD_TRANSFER_GET || header[1] == VCMD_TRANSFER_GET2)
+         replay_stats.frames++;
+   }
+
    if (ret < 0) {
       return VTEST_CLIENT_ERROR_COMMAND_DISPATCH;
    }
@@ -794,6 +1401,27 @@ static int vtest_client_dispatch_commands(struct vtest_client *client)
    return 0;
 }
 
+static void vtest_server_report_replay(void)
+{
+   const int iterations = server.replay_iterations;
+   const double elapsed_ms = server.replay_elapsed_ns / 1e6;
+
+   printf("replay: %d iterations after %d warm-up, %.2f ms per iteration",
+          iterations, server.replay_warmup, elapsed_ms / iterations);
+   if (replay_stats.frames && server.replay_elapsed_ns)
+      printf(", %.1f frames/s", replay_stats.frames * 1e9 / server.replay_elapsed_ns);
+   printf("\n");
+
+   printf("%-28s %10s %12s %10s\n", "command", "count", "total ms", "mean us");
+   for (uint32_t i = 0; i < ARRAY_SIZE(vtest_commands); i++) {
+      if (!replay_stats.count[i])
+         continue;
+      printf("%-28s %10" PRIu64 " %12.2f %10.2f\n", vtest_commands[i].name,
+             replay_stats.count[i] / iterations, replay_stats.ns[i] / 1e6 / iterations,
+             replay_stats.ns[i] / 1e3 / replay_stats.count[i]);
+   }
+}
+
 static void vtest_server_close_socket(void)
 {
    if (server.socket != -1) {
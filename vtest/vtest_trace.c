@@ -0,0 +1,391 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "vtest_trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "util/u_math.h"
+#include "virglrenderer.h"
+#include "vtest.h"
+#include "vtest_protocol.h"
+
+struct vtest_trace {
+   int fd;
+};
+
+struct vtest_trace_reader {
+   int fd;
+
+   /* the whole file, so that replays do not time the reads from disk */
+   char *data;
+   size_t size;
+   size_t offset;
+
+   /* a file without vtest_trace_header */
+   bool raw;
+
+   /* left in the current VTEST_TRACE_RECORD_INPUT */
+   uint32_t input_left;
+
+   void *caps;
+   uint32_t caps_size;
+   uint32_t caps_version;
+   bool caps_checked;
+};
+
+/* Unbuffered, so that a trace is complete when the server crashes. */
+static bool
+trace_write(struct vtest_trace *trace, const struct iovec *iov, int iov_count)
+{
+   size_t left = 0;
+   for (int i = 0; i < iov_count; i++)
+      left += iov[i].iov_len;
+
+   struct iovec rest[3];
+   memcpy(rest, iov, sizeof(*iov) * iov_count);
+   struct iovec *cur = rest;
+
+   while (left) {
+      const ssize_t ret = writev(trace->fd, cur, iov_count);
+      if (ret < 0) {
+         if (errno == EINTR)
+            continue;
+         return false;
+      }
+
+      left -= ret;
+      for (size_t done = ret; done;) {
+         const size_t n = MIN2(done, cur->iov_len);
+         cur->iov_base = (char *)cur->iov_base + n;
+         cur->iov_len -= n;
+         done -= n;
+         if (!cur->iov_len && iov_count > 1) {
+            cur++;
+            iov_count--;
+         }
+      }
+   }
+
+   return true;
+}
+
+struct vtest_trace *
+vtest_trace_create(const char *path, const void *caps, uint32_t caps_size, uint32_t caps_version)
+{
+   struct vtest_trace *trace = calloc(1, sizeof(*trace));
+   if (!trace)
+      return NULL;
+
+   trace->fd = open(path, O_CLOEXEC | O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+   if (trace->fd < 0) {
+      perror("error opening save file");
+      free(trace);
+      return NULL;
+   }
+
+   struct vtest_trace_header header = {
+      .version = VTEST_TRACE_VERSION,
+      .protocol_version = VTEST_PROTOCOL_VERSION,
+      .caps_size = caps_size,
+      .caps_version = caps_version,
+   };
+   memcpy(header.magic, VTEST_TRACE_MAGIC, sizeof(header.magic));
+
+   const struct iovec iov[2] = {
+      { .iov_base = &header, .iov_len = sizeof(header) },
+      { .iov_base = (void *)caps, .iov_len = caps_size },
+   };
+   if (!trace_write(trace, iov, caps_size ? 2 : 1)) {
+      perror("failed to save");
+      vtest_trace_destroy(trace);
+      return NULL;
+   }
+
+   return trace;
+}
+
+void
+vtest_trace_destroy(struct vtest_trace *trace)
+{
+   close(trace->fd);
+   free(trace);
+}
+
+void
+vtest_trace_write_input(struct vtest_trace *trace, const void *buf, uint32_t size)
+{
+   const struct vtest_trace_record record = {
+      .type = VTEST_TRACE_RECORD_INPUT,
+      .size = size,
+   };
+   const struct iovec iov[2] = {
+      { .iov_base = (void *)&record, .iov_len = sizeof(record) },
+      { .iov_base = (void *)buf, .iov_len = size },
+   };
+
+   if (!trace_write(trace, iov, 2)) {
+      perror("failed to save");
+      exit(1);
+   }
+}
+
+void
+vtest_trace_write_shm(struct vtest_trace *trace,
+                      uint32_t res_id,
+                      uint32_t offset,
+                      const void *data,
+                      uint32_t size)
+{
+   const struct vtest_trace_shm shm = {
+      .res_id = res_id,
+      .offset = offset,
+   };
+   const struct vtest_trace_record record = {
+      .type = VTEST_TRACE_RECORD_SHM,
+      .size = sizeof(shm) + size,
+   };
+   const struct iovec iov[3] = {
+      { .iov_base = (void *)&record, .iov_len = sizeof(record) },
+      { .iov_base = (void *)&shm, .iov_len = sizeof(shm) },
+      { .iov_base = (void *)data, .iov_len = size },
+   };
+
+   if (!trace_write(trace, iov, 3)) {
+      perror("failed to save");
+      exit(1);
+   }
+}
+
+/* Reads the file to its end, which need not be a regular file. */
+static bool
+trace_preload(struct vtest_trace_reader *reader)
+{
+   struct stat st;
+   size_t capacity = 64 * 1024;
+
+   if (!fstat(reader->fd, &st) && S_ISREG(st.st_mode))
+      capacity = MAX2((size_t)st.st_size, 1);
+
+   while (true) {
+      if (!reader->data || reader->size == capacity) {
+         if (reader->data)
+            capacity *= 2;
+
+         char *data = realloc(reader->data, capacity);
+         if (!data)
+            return false;
+         reader->data = data;
+      }
+
+      const ssize_t ret = read(reader->fd, reader->data + reader->size,
+                               capacity - reader->size);
+      if (ret < 0 && errno == EINTR)
+         continue;
+      if (ret <= 0)
+         return !ret;
+
+      reader->size += ret;
+   }
+}
+
+/* Returns size, or 0 at the end of the trace. */
+static int
+trace_read(struct vtest_trace_reader *reader, void *buf, int size)
+{
+   if ((size_t)size > reader->size - reader->offset)
+      return 0;
+
+   memcpy(buf, reader->data + reader->offset, size);
+   reader->offset += size;
+
+   return size;
+}
+
+struct vtest_trace_reader *
+vtest_trace_reader_create(int fd)
+{
+   struct vtest_trace_reader *reader = calloc(1, sizeof(*reader));
+   if (!reader) {
+      close(fd);
+      return NULL;
+   }
+   reader->fd = fd;
+
+   if (!trace_preload(reader)) {
+      vtest_trace_reader_destroy(reader);
+      return NULL;
+   }
+
+   struct vtest_trace_header header;
+   if (trace_read(reader, &header, sizeof(header)) != sizeof(header) ||
+       memcmp(header.magic, VTEST_TRACE_MAGIC, sizeof(header.magic))) {
+      reader->raw = true;
+      reader->offset = 0;
+      return reader;
+   }
+
+   if (header.version != VTEST_TRACE_VERSION ||
+       header.protocol_version > VTEST_PROTOCOL_VERSION) {
+      fprintf(stderr, "unsupported trace version %u, protocol version %u\n", header.version,
+              header.protocol_version);
+      vtest_trace_reader_destroy(reader);
+      return NULL;
+   }
+
+   if (header.caps_size) {
+      reader->caps = malloc(header.caps_size);
+      if (!reader->caps ||
+          trace_read(reader, reader->caps, header.caps_size) != (int)header.caps_size) {
+         vtest_trace_reader_destroy(reader);
+         return NULL;
+      }
+      reader->caps_size = header.caps_size;
+      reader->caps_version = header.caps_version;
+   }
+
+   return reader;
+}
+
+void
+vtest_trace_reader_destroy(struct vtest_trace_reader *reader)
+{
+   close(reader->fd);
+   free(reader->data);
+   free(reader->caps);
+   free(reader);
+}
+
+/* The client picked its paths from the caps, so a replay with other caps
+ * may take other paths, or fail.  This is checked once the renderer is
+ * initialized, at the first read.
+ */
+static void
+trace_check_caps(struct vtest_trace_reader *reader)
+{
+   uint32_t max_version, max_size;
+
+   reader->caps_checked = true;
+   if (!reader->caps_size)
+      return;
+
+   virgl_renderer_get_cap_set(2, &max_version, &max_size);
+
+   void *caps = calloc(1, max_size);
+   if (!caps)
+      return;
+   virgl_renderer_fill_caps(2, reader->caps_version, caps);
+
+   if (max_size != reader->caps_size || memcmp(caps, reader->caps, max_size))
+      fprintf(stderr, "trace captured with other caps, the replay may diverge\n");
+
+   free(caps);
+}
+
+static int
+trace_apply_shm(struct vtest_trace_reader *reader, uint32_t size)
+{
+   struct vtest_trace_shm shm;
+   int ret;
+
+   if (size < sizeof(shm))
+      return -EINVAL;
+
+   ret = trace_read(reader, &shm, sizeof(shm));
+   if (ret != sizeof(shm))
+      return -EINVAL;
+   size -= sizeof(shm);
+
+   if (size > reader->size - reader->offset)
+      return -EINVAL;
+
+   ret = vtest_write_resource_shm(shm.res_id, shm.offset,
+                                  reader->data + reader->offset, size);
+   reader->offset += size;
+
+   return ret;
+}
+
+/* Moves to the next input record, applying the shm records before it.
+ * Returns 0 at the end of the file.
+ */
+static int
+trace_next_input(struct vtest_trace_reader *reader)
+{
+   while (!reader->input_left) {
+      struct vtest_trace_record record;
+      int ret;
+
+      ret = trace_read(reader, &record, sizeof(record));
+      if (ret != sizeof(record))
+         return ret;
+
+      switch (record.type) {
+      case VTEST_TRACE_RECORD_INPUT:
+         reader->input_left = record.size;
+         break;
+      case VTEST_TRACE_RECORD_SHM:
+         ret = trace_apply_shm(reader, record.size);
+         if (ret < 0)
+            return ret;
+         break;
+      default:
+         fprintf(stderr, "invalid trace record type %u\n", record.type);
+         return -EINVAL;
+      }
+   }
+
+   return 1;
+}
+
+int
+vtest_trace_read(struct vtest_input *input, void *buf, int size)
+{
+   struct vtest_trace_reader *reader = input->data.trace;
+   char *ptr = buf;
+   int left = size;
+   int ret;
+
+   if (reader->raw)
+      return trace_read(reader, buf, size);
+
+   if (!reader->caps_checked)
+      trace_check_caps(reader);
+
+   while (left) {
+      ret = trace_next_input(reader);
+      if (ret <= 0)
+         return ret;
+
+      const int n = MIN2((uint32_t)left, reader->input_left);
+      ret = trace_read(reader, ptr, n);
+      if (ret != n)
+         return 0;
+
+      reader->input_left -= n;
+      left -= n;
+      ptr += n;
+   }
+
+   /* the client wrote to the shm right after sending these bytes */
+   if (!reader->input_left) {
+      ret = trace_next_input(reader);
+      if (ret < 0)
+         return ret;
+   }
+
+   return size;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2026 virglrenderer contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef VTEST_TRACE_H
+#define VTEST_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A trace is what a client sent to the server, captured when VTEST_SAVE is
+ * set and replayed by passing the file to virgl_test_server.
+ *
+ * It starts with a vtest_trace_header followed by the caps the client could
+ * query, and then vtest_trace_records.  Besides the bytes read from the
+ * client, the records hold what the client wrote to the shm of its resources
+ * before the host read it, so that a replay uploads the same data.
+ *
+ * Files without the header are raw input streams, as saved by older servers.
+ */
+
+#define VTEST_TRACE_MAGIC "VTESTTRC"
+#define VTEST_TRACE_VERSION 1
+
+struct vtest_trace_header {
+   char magic[8];
+   uint32_t version;
+   /* VTEST_PROTOCOL_VERSION of the capturing server */
+   uint32_t protocol_version;
+   /* size of the VIRGL2 caps that follow, 0 without vrend */
+   uint32_t caps_size;
+   uint32_t caps_version;
+};
+
+enum vtest_trace_record_type {
+   /* bytes read from the client */
+   VTEST_TRACE_RECORD_INPUT = 1,
+   /* a vtest_trace_shm and the bytes the client wrote to a resource shm */
+   VTEST_TRACE_RECORD_SHM = 2,
+};
+
+struct vtest_trace_record {
+   uint32_t type;
+   uint32_t size;
+};
+
+struct vtest_trace_shm {
+   uint32_t res_id;
+   uint32_t offset;
+};
+
+struct vtest_trace;
+struct vtest_trace_reader;
+
+struct vtest_trace *
+vtest_trace_create(const char *path, const void *caps, uint32_t caps_size, uint32_t caps_version);
+
+void
+vtest_trace_destroy(struct vtest_trace *trace);
+
+void
+vtest_trace_write_input(struct vtest_trace *trace, const void *buf, uint32_t size);
+
+void
+vtest_trace_write_shm(struct vtest_trace *trace,
+                      uint32_t res_id,
+                      uint32_t offset,
+                      const void *data,
+                      uint32_t size);
+
+/* Takes ownership of fd. */
+struct vtest_trace_reader *
+vtest_trace_reader_create(int fd);
+
+void
+vtest_trace_reader_destroy(struct vtest_trace_reader *reader);
+
+struct vtest_input;
+
+/* The read function of a vtest_input over a vtest_trace_reader.  The shm
+ * records following the bytes read are applied before it returns.
+ */
+int
+vtest_trace_read(struct vtest_input *input, void *buf, int size);
+
+#endif /* VTEST_TRACE_H */